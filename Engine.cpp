@@ -15,6 +15,11 @@
 #include "VulkanErrors.hpp"
 #include "FeaturesExtensions.hpp"
 #include "File.hpp"
+#include "Pack.hpp"
+#include "Format.hpp"
+#include "Watcher.hpp"
+#include "AsyncIO.hpp"
+#include "Scene.hpp"
 
 #include <iostream>
 #include <GLFW/glfw3.h>
@@ -51,8 +56,14 @@ void Engine::init() {
   init_pipeline();
   init_command();
   init_sync();
+  init_uploads();
+  init_hot_reload();
 }
 void Engine::kill() {
+  kill_hot_reload();
+  kill_scene();
+  kill_gpu_skinning();
+  kill_uploads();
   kill_sync();
   kill_command();
   kill_pipeline();
@@ -224,7 +235,7 @@ void Engine::choose_device() {
     }
 
     if (graphics && present && discrete) {
-      std::cout << "Chose device " << device_props.deviceName << '\n';
+      print("Chose device {}\n", (const char*)device_props.deviceName);
       vk_physical_device = devices[i];
       return;
     }
@@ -249,6 +260,7 @@ void Engine::init_allocator() {
   DEBUG_OBJ_CREATION(vmaCreateAllocator, check);
 }
 void Engine::kill_allocator() {
+  kill_skinned_bufs();
   free_buffer(vert_buf);
   vmaDestroyAllocator(vma_allocator);
 }
@@ -290,27 +302,6 @@ void Engine::free_buffer(GpuBuffer buf) {
 VertexBuffer::~VertexBuffer() {}
 // *StagingBuffer ///////////////////
 StagingBuffer::~StagingBuffer() {}
-void Engine::alloc_staging_buf(size_t size, void* data) {
-  VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
-  bufCreateInfo.size = size;
-  bufCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-   
-  VmaAllocationCreateInfo allocCreateInfo = {};
-  allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-  allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
-      VMA_ALLOCATION_CREATE_MAPPED_BIT;
-   
-  auto check = vmaCreateBuffer(
-      vma_allocator,
-      &bufCreateInfo,
-      &allocCreateInfo,
-      &staging_buf.buf,
-      &staging_buf.alloc,
-      &staging_buf.alloc_info);
-  DEBUG_OBJ_CREATION(vmaCreateBuffer, check);
-   
-  memcpy(staging_buf.alloc_info.pMappedData, data, size);
-}
 void Engine::alloc_vert_buf(size_t size) {
   VkBufferCreateInfo bufCreateInfo = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
   bufCreateInfo.size = size;
@@ -334,6 +325,199 @@ void Engine::alloc_vert_buf(size_t size) {
   DEBUG_OBJ_CREATION(vmaCreateBuffer, check);
 }
 
+// *Uploads /////////////////////
+static const uint32_t MAX_UPLOAD_REGIONS = 128;
+struct Engine::UploadRead {
+  UploadBatch *batch;
+  size_t length;
+};
+// Everything between two flushes: staging is filled from the front, then copied out in one submit
+struct Engine::UploadBatch {
+  VkBufferCopy regions[MAX_UPLOAD_REGIONS];
+  VkBuffer dsts[MAX_UPLOAD_REGIONS];
+  UploadRead reads[MAX_UPLOAD_REGIONS];
+  uint32_t count = 0;
+  size_t used = 0;
+  uint32_t reads_pending = 0;
+  uint32_t failed = 0;
+};
+void Engine::upload_read_done(const IoCompletion *completion) {
+  UploadRead *read = (UploadRead*)completion->user_data;
+  --read->batch->reads_pending;
+  if (completion->result != (int64_t)read->length) {
+    ++read->batch->failed;
+    print_err("Upload: read failed ({})\n", completion->result);
+  }
+}
+
+void Engine::init_uploads() {
+  alloc_buffer(
+    UPLOAD_STAGING_SIZE, 
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+    0x0, 
+    0x0,
+    VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+    &upload_staging);
+  // Not pinnable if the driver gave us device memory through the BAR, reads just go the normal way
+  AsyncIO::instance()->register_buffer(upload_staging.alloc_info.pMappedData, UPLOAD_STAGING_SIZE);
+
+  VkCommandPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+    .queueFamilyIndex = graphics_queue_index, 
+  };
+  auto check_pool = vkCreateCommandPool(vk_device, &pool_info, nullptr, &upload_pool);
+  DEBUG_OBJ_CREATION(vkCreateCommandPool, check_pool);
+
+  VkCommandBufferAllocateInfo cmd_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+    .commandPool = upload_pool,
+    .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+    .commandBufferCount = 1,
+  };
+  auto check_cmd = vkAllocateCommandBuffers(vk_device, &cmd_info, &upload_cmd);
+  DEBUG_OBJ_CREATION(vkAllocateCommandBuffers, check_cmd);
+
+  VkFenceCreateInfo fence_info = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+  auto check_fence = vkCreateFence(vk_device, &fence_info, nullptr, &upload_fence);
+  DEBUG_OBJ_CREATION(vkCreateFence, check_fence);
+}
+void Engine::kill_uploads() {
+  AsyncIO::instance()->unregister_buffer();
+  vkDestroyFence(vk_device, upload_fence, nullptr);
+  vkDestroyCommandPool(vk_device, upload_pool, nullptr);
+  free_buffer(upload_staging);
+}
+void Engine::flush_uploads(UploadBatch *batch) {
+  if (!batch->count)
+    return;
+
+  AsyncIO *io = AsyncIO::instance();
+  while (batch->reads_pending)
+    io->wait(nullptr, 0, 1);
+  // No-op on coherent memory
+  vmaFlushAllocation(vma_allocator, upload_staging.alloc, 0, batch->used);
+
+  vkResetCommandPool(vk_device, upload_pool, 0x0);
+  VkCommandBufferBeginInfo begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkBeginCommandBuffer(upload_cmd, &begin_info);
+
+  // Runs of regions going to the same buffer are one copy command
+  uint32_t first = 0;
+  for(uint32_t i = 1; i <= batch->count; ++i) {
+    if (i < batch->count && batch->dsts[i] == batch->dsts[first])
+      continue;
+    vkCmdCopyBuffer(upload_cmd, upload_staging.buf, batch->dsts[first], i - first, batch->regions + first);
+    first = i;
+  }
+
+  // Make the copies visible to whatever is submitted after this
+  VkMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+  };
+  vkCmdPipelineBarrier(upload_cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 
+    0x0, 1, &barrier, 0, nullptr, 0, nullptr);
+  vkEndCommandBuffer(upload_cmd);
+
+  VkSubmitInfo submit_info = {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .commandBufferCount = 1,
+    .pCommandBuffers = &upload_cmd,
+  };
+  auto check_submit = vkQueueSubmit(vk_graphics_queue, 1, &submit_info, upload_fence);
+  DEBUG_OBJ_CREATION(vkQueueSubmit, check_submit);
+  // Staging is reused straight after, so wait for this fence rather than the whole queue
+  vkWaitForFences(vk_device, 1, &upload_fence, VK_TRUE, UINT64_MAX);
+  vkResetFences(vk_device, 1, &upload_fence);
+
+  batch->count = 0;
+  batch->used = 0;
+}
+bool Engine::upload(const Upload *uploads, uint32_t count) {
+  UploadBatch batch;
+  uint8_t *staging = (uint8_t*)upload_staging.alloc_info.pMappedData;
+  size_t cap = UPLOAD_STAGING_SIZE;
+  AsyncIO *io = AsyncIO::instance();
+  Pack *pack = Pack::instance();
+  uint32_t failed = 0;
+
+  for(uint32_t i = 0; i < count; ++i) {
+    const Upload *u = &uploads[i];
+    const PackEntry *entry = u->path ? pack->find(u->path) : nullptr;
+
+    if (entry && (entry->flags & PackEntry::COMPRESSED)) {
+      // Decoded on the ThreadPool straight into staging, which needs the whole entry in one piece
+      if (u->offset || u->size != entry->raw_size || u->size > cap) {
+        print_err("Upload: '{}' is compressed, it can only be uploaded whole (up to {} bytes)\n", u->path, cap);
+        ++failed;
+        continue;
+      }
+      if (cap - batch.used < u->size || batch.count == MAX_UPLOAD_REGIONS)
+        flush_uploads(&batch);
+      if (!pack->read(entry, staging + batch.used)) {
+        print_err("Upload: failed to decode '{}'\n", u->path);
+        ++failed;
+        continue;
+      }
+      batch.regions[batch.count] = { batch.used, u->dst_offset, u->size };
+      batch.dsts[batch.count] = u->dst;
+      ++batch.count;
+      batch.used = memory_align(batch.used + u->size, PACK_ALIGN);
+      if (batch.used > cap)
+        batch.used = cap;
+      continue;
+    }
+
+    // Memory and uncompressed pack entries are copied in, anything else is read from the file
+    const uint8_t *src = (const uint8_t*)u->data;
+    if (entry) {
+      // Inside the entry, not just inside the pack file
+      bool inside = u->offset <= entry->size && u->size <= entry->size - u->offset;
+      src = inside ? pack->file.view(entry->offset + u->offset, u->size) : nullptr;
+      if (!src) {
+        print_err("Upload: range is outside of '{}'\n", u->path);
+        ++failed;
+        continue;
+      }
+    }
+
+    size_t done = 0;
+    while (done < u->size) {
+      if (batch.used == cap || batch.count == MAX_UPLOAD_REGIONS)
+        flush_uploads(&batch);
+
+      size_t n = u->size - done < cap - batch.used ? u->size - done : cap - batch.used;
+      uint8_t *dst = staging + batch.used;
+      if (src) {
+        mem_cpy(dst, src + done, n);
+      } else {
+        UploadRead *read = &batch.reads[batch.count];
+        read->batch = &batch;
+        read->length = n;
+        IoRequest req = { u->path, u->offset + done, n, dst, read, upload_read_done };
+        ++batch.reads_pending;
+        io->submit(&req, 1);
+      }
+
+      batch.regions[batch.count] = { batch.used, u->dst_offset + done, n };
+      batch.dsts[batch.count] = u->dst;
+      ++batch.count;
+      batch.used = memory_align(batch.used + n, PACK_ALIGN);
+      if (batch.used > cap)
+        batch.used = cap;
+      done += n;
+    }
+  }
+  flush_uploads(&batch);
+
+  return failed == 0 && batch.failed == 0;
+}
+
 // *UBOs /////////////////////
 void Engine::alloc_ubos(size_t size) {
   ubos.length = MAX_FRAME_COUNT;
@@ -383,6 +567,866 @@ void Engine::update_ubo(uint32_t frame_index) {
   memcpy(ubos[frame_index].alloc_info.pMappedData, &ubo, sizeof(ubo));
 }
 
+// *Skinned vertices /////////////////////
+void Engine::alloc_skinned_bufs(size_t vertex_count) {
+  kill_skinned_bufs();
+  skinned_buf_size = vertex_count * sizeof(SkinnedVertex);
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i)
+    alloc_buffer(
+      skinned_buf_size,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      &skinned_bufs[i]);
+}
+void Engine::kill_skinned_bufs() {
+  if (!skinned_buf_size)
+    return;
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i)
+    free_buffer(skinned_bufs[i]);
+  skinned_buf_size = 0;
+}
+SkinnedVertex* Engine::skinned_vertices(uint32_t frame_index) {
+  return (SkinnedVertex*)skinned_bufs[frame_index].alloc_info.pMappedData;
+}
+
+// *GPU skinning /////////////////////
+bool Engine::init_gpu_skinning(uint32_t vertex_count, uint32_t output_count, uint32_t joint_count, uint32_t instance_count) {
+  GpuSkinning *g = &gpu_skinning;
+  kill_gpu_skinning();
+  // No buffer may be empty
+  if (!vertex_count || !output_count || !instance_count)
+    return false;
+  if (!joint_count)
+    joint_count = 1;
+  g->max_instances = instance_count;
+  alloc_buffer(
+    vertex_count * sizeof(QuantizedVertex),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    0x0,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    0x0,
+    &g->bind_vertices);
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i) {
+    alloc_buffer(
+      joint_count * sizeof(float) * 16,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      &g->palettes[i]);
+    alloc_buffer(
+      instance_count * sizeof(SkinInstance),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      &g->instances[i]);
+    alloc_buffer(
+      output_count * sizeof(SkinnedVertex),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      0x0,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      0x0,
+      &g->outputs[i]);
+  }
+
+  const uint32_t BINDING_COUNT = 4;
+  VkDescriptorSetLayoutBinding bindings[BINDING_COUNT];
+  for(uint32_t i = 0; i < BINDING_COUNT; ++i)
+    bindings[i] = {
+      .binding = i,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+  VkDescriptorSetLayoutCreateInfo layout_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+  layout_info.bindingCount = BINDING_COUNT;
+  layout_info.pBindings = bindings;
+  auto check_set_layout = vkCreateDescriptorSetLayout(vk_device, &layout_info, nullptr, &g->desc_set_layout);
+  DEBUG_OBJ_CREATION(vkCreateDescriptorSetLayout, check_set_layout);
+
+  VkDescriptorPoolSize pool_size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT * MAX_FRAME_COUNT };
+  VkDescriptorPoolCreateInfo pool_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  pool_info.maxSets = MAX_FRAME_COUNT;
+  auto check_pool = vkCreateDescriptorPool(vk_device, &pool_info, nullptr, &g->desc_pool);
+  DEBUG_OBJ_CREATION(vkCreateDescriptorPool, check_pool);
+
+  VkDescriptorSetLayout layouts[MAX_FRAME_COUNT];
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i)
+    layouts[i] = g->desc_set_layout;
+  VkDescriptorSetAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+  alloc_info.descriptorPool = g->desc_pool;
+  alloc_info.descriptorSetCount = MAX_FRAME_COUNT;
+  alloc_info.pSetLayouts = layouts;
+  auto check_sets = vkAllocateDescriptorSets(vk_device, &alloc_info, g->desc_sets);
+  DEBUG_OBJ_CREATION(vkAllocateDescriptorSets, check_sets);
+
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i) {
+    VkDescriptorBufferInfo buf_infos[BINDING_COUNT] = {
+      { g->bind_vertices.buf, 0, VK_WHOLE_SIZE },
+      { g->palettes[i].buf, 0, VK_WHOLE_SIZE },
+      { g->instances[i].buf, 0, VK_WHOLE_SIZE },
+      { g->outputs[i].buf, 0, VK_WHOLE_SIZE },
+    };
+    VkWriteDescriptorSet writes[BINDING_COUNT];
+    for(uint32_t b = 0; b < BINDING_COUNT; ++b) {
+      writes[b] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+      writes[b].dstSet = g->desc_sets[i];
+      writes[b].dstBinding = b;
+      writes[b].descriptorCount = 1;
+      writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[b].pBufferInfo = &buf_infos[b];
+    }
+    vkUpdateDescriptorSets(vk_device, BINDING_COUNT, writes, 0, nullptr);
+  }
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &g->desc_set_layout,
+  };
+  auto check_layout = vkCreatePipelineLayout(vk_device, &pipeline_layout_info, nullptr, &g->layout);
+  DEBUG_OBJ_CREATION(vkCreatePipelineLayout, check_layout);
+
+  VkShaderModule module = create_shader_module(SKIN_SHADER_FILE);
+  g->pipeline = create_skin_pipeline(module);
+  ABORT(g->pipeline != VK_NULL_HANDLE, "Failed to create the skinning pipeline");
+  vkDestroyShaderModule(vk_device, module, nullptr);
+  return true;
+}
+VkPipeline Engine::create_skin_pipeline(VkShaderModule module) {
+  VkComputePipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = module,
+      .pName = "main",
+    },
+    .layout = gpu_skinning.layout,
+  };
+  VkPipeline pipeline;
+  auto check_pipeline = vkCreateComputePipelines(vk_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline);
+  if (check_pipeline != VK_SUCCESS) {
+    print_err("vkCreateComputePipelines returned {}\n", VulkanError::match_error(check_pipeline));
+    return VK_NULL_HANDLE;
+  }
+  return pipeline;
+}
+void Engine::kill_gpu_skinning() {
+  GpuSkinning *g = &gpu_skinning;
+  drop_reloaded(RELOAD_SKIN);
+  if (g->desc_set_layout == VK_NULL_HANDLE)
+    return;
+  vkDestroyPipeline(vk_device, g->pipeline, nullptr);
+  vkDestroyPipelineLayout(vk_device, g->layout, nullptr);
+  vkDestroyDescriptorPool(vk_device, g->desc_pool, nullptr);
+  vkDestroyDescriptorSetLayout(vk_device, g->desc_set_layout, nullptr);
+  free_buffer(g->bind_vertices);
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i) {
+    free_buffer(g->palettes[i]);
+    free_buffer(g->instances[i]);
+    free_buffer(g->outputs[i]);
+  }
+  *g = {};
+}
+bool Engine::upload_skin_vertices(const QuantizedVertex *vertices, uint32_t count, uint32_t first) {
+  Upload up;
+  up.data = vertices;
+  up.size = count * sizeof(QuantizedVertex);
+  up.dst = gpu_skinning.bind_vertices.buf;
+  up.dst_offset = first * sizeof(QuantizedVertex);
+  return upload(&up, 1);
+}
+float* Engine::skin_palettes(uint32_t frame_index) {
+  return (float*)gpu_skinning.palettes[frame_index].alloc_info.pMappedData;
+}
+SkinInstance* Engine::skin_instances(uint32_t frame_index) {
+  return (SkinInstance*)gpu_skinning.instances[frame_index].alloc_info.pMappedData;
+}
+void Engine::dispatch_skinning(uint32_t frame_index, uint32_t instance_count) {
+  GpuSkinning *g = &gpu_skinning;
+  ABORT(instance_count <= g->max_instances, "More skinned instances than init_gpu_skinning made room for");
+  const SkinInstance *instances = skin_instances(frame_index);
+  g->instance_count = instance_count;
+  g->max_vertex_count = 0;
+  for(uint32_t i = 0; i < instance_count; ++i)
+    g->max_vertex_count = instances[i].vertex_count > g->max_vertex_count ? instances[i].vertex_count : g->max_vertex_count;
+}
+// Outside the render pass, which a compute dispatch cannot be in
+void Engine::record_skinning(VkCommandBuffer cmd, uint32_t frame_index) {
+  GpuSkinning *g = &gpu_skinning;
+  uint32_t instance_count = g->instance_count;
+  g->instance_count = 0; // Each frame's buffers are written for that frame only
+  if (!instance_count || !g->max_vertex_count)
+    return;
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, g->pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, g->layout, 0, 1, &g->desc_sets[frame_index], 0, nullptr);
+  // 64 invocations a group, as skin.comp's local_size_x
+  vkCmdDispatch(cmd, (g->max_vertex_count + 63) / 64, instance_count, 1);
+
+  // The host's palette and instance writes are visible to the dispatch through the submit; the
+  // output's previous reader is this frame's last submit, which the frame fence has already waited on
+  VkBufferMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = g->outputs[frame_index].buf,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE,
+  };
+  vkCmdPipelineBarrier(
+      cmd,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+      0x0,
+      0, nullptr,
+      1, &barrier,
+      0, nullptr);
+}
+
+// *Scene /////////////////////
+void Engine::set_scene(const Scene *scene) {
+  SceneDraw *s = &scene_draw;
+  // The frames in flight may still draw the old one
+  vkDeviceWaitIdle(vk_device);
+  kill_scene();
+  if (!scene)
+    return;
+
+  uint32_t primitive_count = 0;
+  for(uint32_t m = 0; m < scene->meshes.count; ++m)
+    primitive_count += (uint32_t)scene->meshes[m].primitives.count;
+  s->first_primitive = (uint32_t*)mem_alloca(sizeof(uint32_t) * (scene->meshes.count + 1), 16);
+  s->vertex_offsets = (uint32_t*)mem_alloca(sizeof(uint32_t) * (primitive_count + 1), 16);
+  s->index_offsets = (uint64_t*)mem_alloca(sizeof(uint64_t) * (primitive_count + 1), 16);
+  Upload *uploads = (Upload*)mem_alloca(sizeof(Upload) * (primitive_count * 2 + 1), 16);
+  if (!s->first_primitive || !s->vertex_offsets || !s->index_offsets || !uploads || !s->graph.init(scene)) {
+    print_err("Scene: failed to lay out its nodes and {} primitives, not drawing it\n", primitive_count);
+    mem_free(uploads);
+    mem_free(s->index_offsets);
+    mem_free(s->vertex_offsets);
+    mem_free(s->first_primitive);
+    *s = {};
+    return;
+  }
+  s->scene = scene;
+
+  size_t vertex_size = 0;
+  size_t index_size = 0;
+  uint32_t p = 0;
+  for(uint32_t m = 0; m < scene->meshes.count; ++m) {
+    s->first_primitive[m] = p;
+    for(uint32_t i = 0; i < scene->meshes[m].primitives.count; ++i, ++p) {
+      const Scene::Primitive *prim = &scene->meshes[m].primitives[i];
+      s->vertex_offsets[p] = (uint32_t)(vertex_size / sizeof(QuantizedVertex));
+      s->index_offsets[p] = index_size;
+      vertex_size += prim->vertices.count * sizeof(QuantizedVertex);
+      index_size = memory_align(index_size + prim->index_data.count, 4);
+    }
+  }
+  s->first_primitive[scene->meshes.count] = p;
+
+  // Nothing was cooked to vertices (e.g. no POSITION anywhere): there is nothing to draw, and no buffer
+  // may be empty
+  if (!vertex_size || !index_size) {
+    mem_free(uploads);
+    kill_scene();
+    return;
+  }
+  alloc_buffer(
+    vertex_size,
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    0x0,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    0x0,
+    &s->vertices);
+  alloc_buffer(
+    index_size,
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    0x0,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+    0x0,
+    &s->indices);
+
+  // Straight from the mapped scene into staging
+  uint32_t upload_count = 0;
+  p = 0;
+  for(uint32_t m = 0; m < scene->meshes.count; ++m) {
+    for(uint32_t i = 0; i < scene->meshes[m].primitives.count; ++i, ++p) {
+      const Scene::Primitive *prim = &scene->meshes[m].primitives[i];
+      if (!prim->vertices.count)
+        continue;
+      Upload *up = &uploads[upload_count++];
+      *up = {};
+      up->data = prim->vertices.data();
+      up->size = prim->vertices.count * sizeof(QuantizedVertex);
+      up->dst = s->vertices.buf;
+      up->dst_offset = s->vertex_offsets[p] * sizeof(QuantizedVertex);
+      up = &uploads[upload_count++];
+      *up = {};
+      up->data = prim->index_data.data();
+      up->size = prim->index_data.count;
+      up->dst = s->indices.buf;
+      up->dst_offset = s->index_offsets[p];
+    }
+  }
+  bool uploaded = upload(uploads, upload_count);
+  mem_free(uploads);
+  if (!uploaded) {
+    print_err("Scene: failed to upload its vertices, not drawing it\n");
+    kill_scene();
+    return;
+  }
+
+  s->graph.update();
+  if (!init_scene_skinning()) {
+    print_err("Scene: failed to set up its skins, not drawing it\n");
+    kill_scene();
+    return;
+  }
+  if (!init_scene_morphs()) {
+    print_err("Scene: failed to set up its morph targets, not drawing it\n");
+    kill_scene();
+    return;
+  }
+  init_scene_culling();
+  init_scene_pipeline();
+}
+// The animation, a Skinning per skin, and where each skinned primitive is posed to in skinned_bufs
+bool Engine::init_scene_skinning() {
+  SceneDraw *s = &scene_draw;
+  const Scene *scene = s->scene;
+  s->animated = scene->animations.count && s->animator.init(scene, 0, &s->graph);
+  s->time = 0.0f;
+
+  const uint32_t TRIANGLES = 4;
+  uint32_t draw_count = 0;
+  for(uint32_t slot = 0; slot < s->graph.count; ++slot) {
+    const Scene::Node *node = &scene->nodes[s->graph.node[slot]];
+    if (node->mesh >= 0 && node->skin >= 0)
+      draw_count += (uint32_t)scene->meshes[node->mesh].primitives.count;
+  }
+  if (!draw_count)
+    return true;
+
+  s->skinnings = (Skinning*)mem_alloca(sizeof(Skinning) * scene->skins.count, 16);
+  if (!s->skinnings)
+    return false;
+  for(uint32_t k = 0; k < scene->skins.count; ++k)
+    if (!s->skinnings[k].init(scene, k, &s->graph))
+      print_err("Scene: skin {} failed to set up, the nodes using it are not drawn\n", k);
+  s->skinned = (SkinnedDraw*)mem_alloca(sizeof(SkinnedDraw) * draw_count, 16);
+  // Each primitive's bind pose is needed once however many nodes draw it, and each skin's palette once
+  uint32_t primitive_count = s->first_primitive[scene->meshes.count];
+  uint32_t *bind_offsets = (uint32_t*)mem_alloca(sizeof(uint32_t) * (primitive_count + 1), 16);
+  uint32_t *palette_offsets = (uint32_t*)mem_alloca(sizeof(uint32_t) * scene->skins.count, 16);
+  if (!s->skinned || !bind_offsets || !palette_offsets) {
+    mem_free(palette_offsets);
+    mem_free(bind_offsets);
+    return false;
+  }
+  uint32_t joint_count = 0;
+  for(uint32_t k = 0; k < scene->skins.count; ++k) {
+    palette_offsets[k] = joint_count;
+    joint_count += s->skinnings[k].joint_count;
+  }
+  memset(bind_offsets, 0xff, sizeof(uint32_t) * primitive_count);
+
+  // A morphed primitive is skinned from its blend on the CPU, so has no bind pose on the GPU
+  uint32_t output_count = 0;
+  uint32_t gpu_output_count = 0;
+  uint32_t gpu_draw_count = 0;
+  uint32_t bind_count = 0;
+  for(uint32_t slot = 0; slot < s->graph.count; ++slot) {
+    const Scene::Node *node = &scene->nodes[s->graph.node[slot]];
+    if (node->mesh < 0 || node->skin < 0 || !s->skinnings[node->skin].palette)
+      continue;
+    const Scene::Mesh *mesh = &scene->meshes[node->mesh];
+    for(uint32_t i = 0; i < mesh->primitives.count; ++i) {
+      const Scene::Primitive *prim = &mesh->primitives[i];
+      if (!prim->vertices.count || prim->mode != TRIANGLES)
+        continue;
+      uint32_t p = s->first_primitive[node->mesh] + i;
+      uint32_t *outputs = &output_count;
+      if (GPU_SKINNING && !prim->targets.count) {
+        if (bind_offsets[p] == UINT32_MAX) {
+          bind_offsets[p] = bind_count;
+          bind_count += (uint32_t)prim->vertices.count;
+        }
+        outputs = &gpu_output_count;
+        ++gpu_draw_count;
+      }
+      s->skinned[s->skinned_count++] = { (uint32_t)node->skin, (uint32_t)node->mesh, i, *outputs, bind_offsets[p],
+          palette_offsets[node->skin], slot, UINT32_MAX };
+      *outputs += (uint32_t)prim->vertices.count;
+    }
+  }
+  mem_free(palette_offsets);
+  mem_free(bind_offsets);
+
+  if (output_count)
+    alloc_skinned_bufs(output_count);
+#if GPU_SKINNING
+  if (!init_gpu_skinning(bind_count, gpu_output_count, joint_count, gpu_draw_count))
+    return true; // Nothing to skin on the GPU
+  // Bind offsets are handed out in draw order, so a draw whose offset is the next one up is its primitive's first
+  uint32_t uploaded = 0;
+  for(uint32_t i = 0; i < s->skinned_count; ++i) {
+    const SkinnedDraw *draw = &s->skinned[i];
+    const Scene::Primitive *prim = &scene->meshes[draw->mesh].primitives[draw->primitive];
+    if (prim->targets.count || draw->bind_offset != uploaded)
+      continue;
+    if (!upload_skin_vertices(prim->vertices.data(), (uint32_t)prim->vertices.count, draw->bind_offset))
+      return false;
+    uploaded += (uint32_t)prim->vertices.count;
+  }
+#endif
+  return true;
+}
+// What a node's morphs blend to: the weights a WEIGHTS channel of 'animator' (if any) drives it to, else its default ones
+static const float* morph_weights(const Scene *scene, const Animator *animator, uint32_t node, uint32_t *count) {
+  const float *weights = animator ? animator->node_weights(node, count) : nullptr;
+  return weights ? weights : Morph::default_weights(scene, node, count);
+}
+/*
+ * A Morph per morphed primitive, blended once: an unskinned node's with where it goes in
+ * morphed_bufs, then each skinned draw's, which init_scene_skinning() has already laid out
+ */
+bool Engine::init_scene_morphs() {
+  SceneDraw *s = &scene_draw;
+  const Scene *scene = s->scene;
+  const uint32_t TRIANGLES = 4;
+  uint32_t draw_count = 0;
+  for(uint32_t slot = 0; slot < s->graph.count; ++slot) {
+    const Scene::Node *node = &scene->nodes[s->graph.node[slot]];
+    if (node->mesh < 0 || node->skin >= 0)
+      continue;
+    const Scene::Mesh *mesh = &scene->meshes[node->mesh];
+    for(uint32_t i = 0; i < mesh->primitives.count; ++i)
+      draw_count += mesh->primitives[i].targets.count && mesh->primitives[i].vertices.count &&
+        mesh->primitives[i].mode == TRIANGLES;
+  }
+  for(uint32_t i = 0; i < s->skinned_count; ++i)
+    draw_count += scene->meshes[s->skinned[i].mesh].primitives[s->skinned[i].primitive].targets.count != 0;
+  if (!draw_count)
+    return true;
+
+  s->morphs = (Morph*)mem_alloca(sizeof(Morph) * draw_count, 16);
+  s->morphed = (MorphedDraw*)mem_alloca(sizeof(MorphedDraw) * draw_count, 16);
+  if (!s->morphs || !s->morphed)
+    return false;
+  uint32_t output_count = 0;
+  for(uint32_t slot = 0; slot < s->graph.count; ++slot) {
+    uint32_t node_index = s->graph.node[slot];
+    const Scene::Node *node = &scene->nodes[node_index];
+    if (node->mesh < 0 || node->skin >= 0)
+      continue;
+    const Scene::Mesh *mesh = &scene->meshes[node->mesh];
+    for(uint32_t i = 0; i < mesh->primitives.count; ++i) {
+      const Scene::Primitive *prim = &mesh->primitives[i];
+      if (!prim->targets.count || !prim->vertices.count || prim->mode != TRIANGLES)
+        continue;
+      Morph *morph = &s->morphs[s->morphed_count];
+      if (!morph->init(scene, node->mesh, i))
+        return false;
+      MorphedDraw *draw = &s->morphed[s->morphed_count++];
+      *draw = { slot, (uint32_t)node->mesh, i, output_count };
+      draw->weights = morph_weights(scene, s->animated ? &s->animator : nullptr, node_index, &draw->weight_count);
+      morph->blend(draw->weights, draw->weight_count);
+      output_count += (uint32_t)prim->vertices.count;
+    }
+  }
+  for(uint32_t i = 0; i < s->skinned_count; ++i) {
+    SkinnedDraw *skinned = &s->skinned[i];
+    if (!scene->meshes[skinned->mesh].primitives[skinned->primitive].targets.count)
+      continue;
+    Morph *morph = &s->morphs[s->morphed_count];
+    if (!morph->init(scene, skinned->mesh, skinned->primitive))
+      return false;
+    skinned->morph = s->morphed_count;
+    MorphedDraw *draw = &s->morphed[s->morphed_count++];
+    *draw = { skinned->slot, skinned->mesh, skinned->primitive, UINT32_MAX };
+    draw->weights = morph_weights(scene, s->animated ? &s->animator : nullptr, s->graph.node[skinned->slot],
+        &draw->weight_count);
+    morph->blend(draw->weights, draw->weight_count);
+  }
+  if (!output_count)
+    return true;
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i) {
+    alloc_buffer(
+      output_count * sizeof(SkinnedVertex),
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      &s->morphed_bufs[i]);
+    s->morphed_stale[i] = true;
+  }
+  return true;
+}
+// Room for every full detail draw with meshlets, should all of them survive; without it they are drawn whole
+void Engine::init_scene_culling() {
+  SceneDraw *s = &scene_draw;
+  const Scene *scene = s->scene;
+  const uint32_t TRIANGLES = 4;
+  size_t size = 0;
+  uint32_t max_meshlets = 0;
+  for(uint32_t slot = 0; slot < s->graph.count; ++slot) {
+    const Scene::Node *node = &scene->nodes[s->graph.node[slot]];
+    if (node->mesh < 0 || node->skin >= 0)
+      continue;
+    const Scene::Mesh *mesh = &scene->meshes[node->mesh];
+    for(uint32_t i = 0; i < mesh->primitives.count; ++i) {
+      const Scene::Primitive *prim = &mesh->primitives[i];
+      if (!prim->vertices.count || prim->mode != TRIANGLES || prim->targets.count || !prim->meshlets.count)
+        continue;
+      size_t index_count = 0;
+      for(uint32_t m = 0; m < prim->meshlets.count; ++m)
+        index_count += prim->meshlets[m].triangle_count * 3;
+      size = memory_align(size + index_count * prim->index_size, 4);
+      max_meshlets = prim->meshlets.count > max_meshlets ? (uint32_t)prim->meshlets.count : max_meshlets;
+    }
+  }
+  if (!size)
+    return;
+  s->survivors = (uint32_t*)mem_alloca(sizeof(uint32_t) * max_meshlets, 16);
+  if (!s->survivors) {
+    print_err("Scene: out of memory for culling {} meshlets, drawing them all\n", max_meshlets);
+    return;
+  }
+  s->culled_size = size;
+  for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i)
+    alloc_buffer(
+      size,
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+      VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT,
+      &s->culled_bufs[i]);
+}
+void Engine::init_scene_pipeline() {
+  SceneDraw *s = &scene_draw;
+  VkPushConstantRange push_range = {
+    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+    .offset = 0,
+    .size = sizeof(QuantizedVertexInput::PushConstants),
+  };
+  VkPipelineLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &vk_desc_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &push_range,
+  };
+  auto check_layout = vkCreatePipelineLayout(vk_device, &layout_info, nullptr, &s->layout);
+  DEBUG_OBJ_CREATION(vkCreatePipelineLayout, check_layout);
+
+  VkShaderModule vertex_module = create_shader_module(SCENE_VERTEX_SHADER_FILE);
+  VkShaderModule fragment_module = create_shader_module(SCENE_FRAGMENT_SHADER_FILE);
+  bool created = create_scene_pipelines(vertex_module, fragment_module, &s->pipeline, &s->skinned_pipeline);
+  ABORT(created, "Failed to create the scene pipelines");
+  vkDestroyShaderModule(vk_device, vertex_module, nullptr);
+  vkDestroyShaderModule(vk_device, fragment_module, nullptr);
+}
+bool Engine::create_scene_pipelines(VkShaderModule vertex_module, VkShaderModule fragment_module, VkPipeline *pipeline,
+    VkPipeline *skinned)
+{
+  SceneDraw *s = &scene_draw;
+  VkVertexInputBindingDescription input_desc;
+  QuantizedVertexInput::get_binding_description(&input_desc);
+  VkVertexInputAttributeDescription attribute_descs[QuantizedVertexInput::ATTRIBUTE_COUNT];
+  QuantizedVertexInput::get_attribute_description(attribute_descs);
+  VkPipelineVertexInputStateCreateInfo vertex_input_state = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+    .vertexBindingDescriptionCount = 1,
+    .pVertexBindingDescriptions = &input_desc,
+    .vertexAttributeDescriptionCount = QuantizedVertexInput::ATTRIBUTE_COUNT,
+    .pVertexAttributeDescriptions = attribute_descs,
+  };
+
+  *pipeline = create_pipeline(vertex_module, fragment_module, s->layout, &vertex_input_state);
+  *skinned = VK_NULL_HANDLE;
+  if (*pipeline == VK_NULL_HANDLE)
+    return false;
+
+  // The same shaders and layout over the posed and morphed vertices, which are floats
+  if (s->skinned_count || s->morphed_count) {
+    VkVertexInputBindingDescription skinned_desc;
+    SkinnedVertexInput::get_binding_description(&skinned_desc);
+    VkVertexInputAttributeDescription skinned_attribute_descs[SkinnedVertexInput::ATTRIBUTE_COUNT];
+    SkinnedVertexInput::get_attribute_description(skinned_attribute_descs);
+    VkPipelineVertexInputStateCreateInfo skinned_input_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = 1,
+      .pVertexBindingDescriptions = &skinned_desc,
+      .vertexAttributeDescriptionCount = SkinnedVertexInput::ATTRIBUTE_COUNT,
+      .pVertexAttributeDescriptions = skinned_attribute_descs,
+    };
+    *skinned = create_pipeline(vertex_module, fragment_module, s->layout, &skinned_input_state);
+    if (*skinned == VK_NULL_HANDLE) {
+      vkDestroyPipeline(vk_device, *pipeline, nullptr);
+      *pipeline = VK_NULL_HANDLE;
+      return false;
+    }
+  }
+  return true;
+}
+void Engine::kill_scene() {
+  SceneDraw *s = &scene_draw;
+  drop_reloaded(RELOAD_SCENE);
+  if (!s->scene)
+    return;
+  if (s->pipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(vk_device, s->pipeline, nullptr);
+    if (s->skinned_pipeline != VK_NULL_HANDLE)
+      vkDestroyPipeline(vk_device, s->skinned_pipeline, nullptr);
+    vkDestroyPipelineLayout(vk_device, s->layout, nullptr);
+  }
+  if (s->vertices.buf != VK_NULL_HANDLE) {
+    free_buffer(s->vertices);
+    free_buffer(s->indices);
+  }
+  kill_skinned_bufs();
+  kill_gpu_skinning();
+  if (s->skinnings)
+    for(uint32_t k = 0; k < s->scene->skins.count; ++k)
+      s->skinnings[k].kill();
+  mem_free(s->skinned);
+  mem_free(s->skinnings);
+  if (s->morphed_bufs[0].buf != VK_NULL_HANDLE)
+    for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i)
+      free_buffer(s->morphed_bufs[i]);
+  for(uint32_t i = 0; i < s->morphed_count; ++i)
+    s->morphs[i].kill();
+  mem_free(s->morphed);
+  mem_free(s->morphs);
+  if (s->culled_size)
+    for(uint32_t i = 0; i < MAX_FRAME_COUNT; ++i)
+      free_buffer(s->culled_bufs[i]);
+  mem_free(s->survivors);
+  if (s->animated)
+    s->animator.kill();
+  s->graph.kill();
+  mem_free(s->index_offsets);
+  mem_free(s->vertex_offsets);
+  mem_free(s->first_primitive);
+  *s = {};
+}
+void Engine::update_scene(uint32_t frame_index) {
+  SceneDraw *s = &scene_draw;
+  if (s->pipeline == VK_NULL_HANDLE)
+    return;
+  if (s->animated) {
+    s->time += camera->delta_time;
+    if (s->animator.duration > 0.0f)
+      s->time = fmodf(s->time, s->animator.duration);
+    s->animator.sample(s->time, &s->graph);
+    s->graph.update();
+  }
+
+  // A blend to the weights of the last one is only a compare; a frame's buffer is rewritten when it is behind
+  bool stale = false;
+  for(uint32_t i = 0; i < s->morphed_count; ++i) {
+    const MorphedDraw *draw = &s->morphed[i];
+    stale |= s->morphs[i].blend(draw->weights, draw->weight_count) && draw->output_offset != UINT32_MAX;
+  }
+  if (stale)
+    for(uint32_t f = 0; f < MAX_FRAME_COUNT; ++f)
+      s->morphed_stale[f] = true;
+  if (s->morphed_stale[frame_index]) {
+    SkinnedVertex *out = (SkinnedVertex*)s->morphed_bufs[frame_index].alloc_info.pMappedData;
+    for(uint32_t i = 0; i < s->morphed_count; ++i)
+      if (s->morphed[i].output_offset != UINT32_MAX)
+        memcpy(out + s->morphed[i].output_offset, s->morphs[i].vertices, sizeof(SkinnedVertex) * s->morphs[i].vertex_count);
+    s->morphed_stale[frame_index] = false;
+  }
+
+  if (!s->skinned_count)
+    return;
+
+  // Morphed primitives are skinned here whichever path the rest take, from their blend
+  for(uint32_t k = 0; k < s->scene->skins.count; ++k)
+    s->skinnings[k].update_palette(&s->graph);
+  SkinnedVertex *out = skinned_vertices(frame_index);
+  for(uint32_t i = 0; i < s->skinned_count; ++i) {
+    const SkinnedDraw *draw = &s->skinned[i];
+    const Scene::Primitive *prim = &s->scene->meshes[draw->mesh].primitives[draw->primitive];
+    if (draw->morph != UINT32_MAX)
+      s->skinnings[draw->skin].skin_parallel(prim->vertices.data(), s->morphs[draw->morph].vertices,
+          (uint32_t)prim->vertices.count, out + draw->output_offset);
+    else if (!GPU_SKINNING)
+      s->skinnings[draw->skin].skin_parallel(prim->vertices.data(), &prim->bounds, (uint32_t)prim->vertices.count,
+          out + draw->output_offset);
+  }
+
+#if GPU_SKINNING
+  if (!gpu_skinning.max_instances)
+    return; // Every skinned primitive is morphed
+  // Palettes in skin order, as init_scene_skinning laid them out; the dispatch is recorded with the frame
+  float *palettes = skin_palettes(frame_index);
+  for(uint32_t k = 0; k < s->scene->skins.count; ++k) {
+    const Skinning *skinning = &s->skinnings[k];
+    if (!skinning->palette)
+      continue; // Failed to set up, so no draw uses it
+    memcpy(palettes, skinning->palette, sizeof(float) * 16 * skinning->joint_count);
+    palettes += 16 * skinning->joint_count;
+  }
+  SkinInstance *instances = skin_instances(frame_index);
+  uint32_t instance_count = 0;
+  for(uint32_t i = 0; i < s->skinned_count; ++i) {
+    const SkinnedDraw *draw = &s->skinned[i];
+    if (draw->morph != UINT32_MAX)
+      continue;
+    const Scene::Primitive *prim = &s->scene->meshes[draw->mesh].primitives[draw->primitive];
+    SkinInstance *instance = &instances[instance_count++];
+    *instance = {};
+    instance->vertex_offset = draw->bind_offset;
+    instance->vertex_count = (uint32_t)prim->vertices.count;
+    instance->output_offset = draw->output_offset;
+    instance->palette_offset = draw->palette_offset;
+    instance->joint_count = s->skinnings[draw->skin].joint_count;
+    memcpy(instance->position_offset, prim->bounds.offset, sizeof(float) * 3);
+    memcpy(instance->position_scale, prim->bounds.scale, sizeof(float) * 3);
+  }
+  dispatch_skinning(frame_index, instance_count);
+#endif
+}
+// Inside the render pass, after the viewport and scissor are set
+// Meshlets::frustum for a mesh drawn with 'world': the clip matrix and the eye taken into the mesh's space
+static void mesh_frustum(const mat4 &clip_from_world, vec3 eye, const float *world, MeshletFrustum *out) {
+  mat4 model;
+  memcpy(&model[0][0], world, sizeof(float) * 16);
+  mat4 clip_from_mesh = clip_from_world * model;
+  vec4 mesh_eye = inverse(model) * vec4(eye, 1.0f);
+  Meshlets::frustum(&clip_from_mesh[0][0], &mesh_eye[0], out);
+}
+void Engine::record_scene(VkCommandBuffer cmd) {
+  SceneDraw *s = &scene_draw;
+  const Scene *scene = s->scene;
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, s->pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, s->layout, 0, 1, &desc_sets[current_frame], 0, nullptr);
+  VkDeviceSize offset = 0;
+  vkCmdBindVertexBuffers(cmd, 0, 1, &s->vertices.buf, &offset);
+
+  // As update_ubo has it, though the flip only swaps the top and bottom planes
+  mat4 clip_from_world = camera->mat_proj();
+  clip_from_world[1][1] *= -1;
+  clip_from_world = clip_from_world * camera->mat_view();
+  uint8_t *culled = s->culled_size ? (uint8_t*)s->culled_bufs[current_frame].alloc_info.pMappedData : nullptr;
+  size_t culled_offset = 0;
+
+  const uint32_t TRIANGLES = 4;
+  for(uint32_t slot = 0; slot < s->graph.count; ++slot) {
+    const Scene::Node *node = &scene->nodes[s->graph.node[slot]];
+    if (node->mesh < 0 || node->skin >= 0)
+      continue;
+    const Scene::Mesh *mesh = &scene->meshes[node->mesh];
+    for(uint32_t i = 0; i < mesh->primitives.count; ++i) {
+      const Scene::Primitive *prim = &mesh->primitives[i];
+      if (!prim->vertices.count || prim->mode != TRIANGLES || prim->targets.count) // Morphed, drawn below
+        continue;
+      uint32_t p = s->first_primitive[node->mesh] + i;
+      const float *world = s->graph.world + slot * 16;
+
+      // The coarsest LOD under a pixel of error where the bounds' centre lands, a world unit there being
+      // the node's largest scale in mesh units
+      float local[3];
+      for(uint32_t a = 0; a < 3; ++a)
+        local[a] = prim->bounds.offset[a] + prim->bounds.scale[a] * 0.5f;
+      vec3 centre;
+      float max_scale = 0.0f;
+      for(uint32_t a = 0; a < 3; ++a) {
+        centre[a] = world[a] * local[0] + world[4 + a] * local[1] + world[8 + a] * local[2] + world[12 + a];
+        const float *axis = world + a * 4;
+        float axis_scale = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+        max_scale = axis_scale > max_scale ? axis_scale : max_scale;
+      }
+      float pixels_per_unit = camera->pixels_per_unit(centre) * sqrtf(max_scale);
+      uint32_t lod_index = Scene::select_lod(prim, pixels_per_unit);
+      const Scene::Lod *lod = &prim->lods[lod_index];
+
+      QuantizedVertexInput::PushConstants push;
+      memcpy(push.model, world, sizeof(push.model));
+      memcpy(push.position_offset, prim->bounds.offset, sizeof(float) * 3);
+      memcpy(push.position_scale, prim->bounds.scale, sizeof(float) * 3);
+      push.position_offset[3] = 0.0f;
+      push.position_scale[3] = 0.0f;
+      vkCmdPushConstants(cmd, s->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+
+      // Meshlets index the same vertices as the LODs do, so only the index buffer differs
+      if (lod_index == 0 && culled && prim->meshlets.count) {
+        MeshletFrustum frustum;
+        mesh_frustum(clip_from_world, camera->pos, world, &frustum);
+        uint32_t survivor_count = Meshlets::cull(prim->meshlets.data(), (uint32_t)prim->meshlets.count, &frustum,
+            s->survivors);
+        uint32_t count = Meshlets::compact(prim->meshlets.data(), s->survivors, survivor_count,
+            prim->meshlet_vertices.data(), prim->meshlet_triangles.data(), prim->index_size, culled + culled_offset);
+        if (count) {
+          vkCmdBindIndexBuffer(cmd, s->culled_bufs[current_frame].buf, culled_offset,
+              QuantizedVertexInput::index_type(prim->index_size));
+          vkCmdDrawIndexed(cmd, count, 1, 0, (int32_t)s->vertex_offsets[p], 0);
+        }
+        culled_offset = memory_align(culled_offset + (size_t)count * prim->index_size, 4);
+        continue;
+      }
+      vkCmdBindIndexBuffer(cmd, s->indices.buf, s->index_offsets[p], QuantizedVertexInput::index_type(prim->index_size));
+      vkCmdDrawIndexed(cmd, lod->count, 1, lod->first, (int32_t)s->vertex_offsets[p], 0);
+    }
+  }
+  if (!s->skinned_count && !s->morphed_count)
+    return;
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, s->skinned_pipeline);
+
+  // Morphed in mesh space: the node's matrix, and positions as they are
+  QuantizedVertexInput::PushConstants push = {};
+  push.position_scale[0] = push.position_scale[1] = push.position_scale[2] = 1.0f;
+  if (s->morphed_bufs[0].buf != VK_NULL_HANDLE)
+    vkCmdBindVertexBuffers(cmd, 0, 1, &s->morphed_bufs[current_frame].buf, &offset);
+  for(uint32_t i = 0; i < s->morphed_count; ++i) {
+    const MorphedDraw *draw = &s->morphed[i];
+    if (draw->output_offset == UINT32_MAX)
+      continue; // Skinned, drawn below
+    const Scene::Primitive *prim = &scene->meshes[draw->mesh].primitives[draw->primitive];
+    uint32_t p = s->first_primitive[draw->mesh] + draw->primitive;
+    memcpy(push.model, s->graph.world + draw->slot * 16, sizeof(push.model));
+    vkCmdPushConstants(cmd, s->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+    vkCmdBindIndexBuffer(cmd, s->indices.buf, s->index_offsets[p], QuantizedVertexInput::index_type(prim->index_size));
+    vkCmdDrawIndexed(cmd, prim->lods[0].count, 1, prim->lods[0].first, (int32_t)draw->output_offset, 0);
+  }
+  if (!s->skinned_count)
+    return;
+
+  // Posed straight to world space: an identity model, and positions as they are
+  memset(push.model, 0, sizeof(push.model));
+  push.model[0] = push.model[5] = push.model[10] = push.model[15] = 1.0f;
+  vkCmdPushConstants(cmd, s->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+  VkBuffer bound = VK_NULL_HANDLE;
+  for(uint32_t i = 0; i < s->skinned_count; ++i) {
+    const SkinnedDraw *draw = &s->skinned[i];
+    // Morphed ones are CPU skinned either way
+    VkBuffer buf = skinned_bufs[current_frame].buf;
+#if GPU_SKINNING
+    if (draw->morph == UINT32_MAX)
+      buf = gpu_skinning.outputs[current_frame].buf;
+#endif
+    if (buf != bound) {
+      vkCmdBindVertexBuffers(cmd, 0, 1, &buf, &offset);
+      bound = buf;
+    }
+    const Scene::Primitive *prim = &scene->meshes[draw->mesh].primitives[draw->primitive];
+    uint32_t p = s->first_primitive[draw->mesh] + draw->primitive;
+    vkCmdBindIndexBuffer(cmd, s->indices.buf, s->index_offsets[p], QuantizedVertexInput::index_type(prim->index_size));
+    vkCmdDrawIndexed(cmd, prim->lods[0].count, 1, prim->lods[0].first, (int32_t)draw->output_offset, 0);
+  }
+}
+
 // *Swapchain /////////////////////////
 void Engine::init_swapchain() {
   get_swapchain_settings();
@@ -701,22 +1745,29 @@ void Engine::kill_desc_set_layout() {
 
 // *Pipeline ///////////////////////
 void Engine::init_pipeline() {
-  VkShaderModule vertex_module = create_shader_module("shaders/triangle3.vert.spv");
-  VkShaderModule fragment_module = create_shader_module("shaders/triangle3.frag.spv");
-  VkPipelineShaderStageCreateInfo stages[] = {
-    {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .stage = VK_SHADER_STAGE_VERTEX_BIT,
-      .module = vertex_module,
-      .pName = "main",
-    }, {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-      .module = fragment_module,
-      .pName = "main",
-    },
+  VkPipelineLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &vk_desc_set_layout,
   };
+  auto check_layout = vkCreatePipelineLayout(vk_device, &layout_info, nullptr, &vk_layout);
+  DEBUG_OBJ_CREATION(vkCreatePipelineLayout, check_layout);
+
+  VkShaderModule vertex_module = create_shader_module(VERTEX_SHADER_FILE);
+  VkShaderModule fragment_module = create_shader_module(FRAGMENT_SHADER_FILE);
 
+  vk_pipeline = create_pipeline(vertex_module, fragment_module);
+  ABORT(vk_pipeline != VK_NULL_HANDLE, "Failed to create graphics pipeline");
+
+  vkDestroyShaderModule(vk_device, vertex_module, nullptr);
+  vkDestroyShaderModule(vk_device, fragment_module, nullptr);
+}
+void Engine::kill_pipeline() {
+  vkDestroyPipeline(vk_device, vk_pipeline, nullptr);
+  vkDestroyPipelineLayout(vk_device, vk_layout, nullptr);
+}
+// Uses only vk_layout and vk_renderpass, so can run on any thread
+VkPipeline Engine::create_pipeline(VkShaderModule vertex_module, VkShaderModule fragment_module) {
   VkVertexInputBindingDescription input_desc;
   Vertex::get_binding_description(&input_desc);
   VkVertexInputAttributeDescription attribute_descs[2];
@@ -729,6 +1780,24 @@ void Engine::init_pipeline() {
     .vertexAttributeDescriptionCount = 2,
     .pVertexAttributeDescriptions = attribute_descs,
   };
+  return create_pipeline(vertex_module, fragment_module, vk_layout, &vertex_input_state);
+}
+VkPipeline Engine::create_pipeline(VkShaderModule vertex_module, VkShaderModule fragment_module, VkPipelineLayout layout,
+    const VkPipelineVertexInputStateCreateInfo *vertex_input)
+{
+  VkPipelineShaderStageCreateInfo stages[] = {
+    {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_VERTEX_BIT,
+      .module = vertex_module,
+      .pName = "main",
+    }, {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+      .module = fragment_module,
+      .pName = "main",
+    },
+  };
 
   VkPipelineInputAssemblyStateCreateInfo vertex_assembly_state = {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
@@ -776,13 +1845,6 @@ void Engine::init_pipeline() {
     .pAttachments = &blend_attachment,
   };
 
-  VkPipelineLayoutCreateInfo layout_info = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-    .setLayoutCount = 1,
-    .pSetLayouts = &vk_desc_set_layout,
-  };
-  auto check_layout = vkCreatePipelineLayout(vk_device, &layout_info, nullptr, &vk_layout);
-
   VkDynamicState dyn_states[] = {
     VK_DYNAMIC_STATE_VIEWPORT,
     VK_DYNAMIC_STATE_SCISSOR,
@@ -798,44 +1860,224 @@ void Engine::init_pipeline() {
     .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
     .stageCount = 2,
     .pStages = stages,
-    .pVertexInputState = &vertex_input_state,
+    .pVertexInputState = vertex_input,
     .pInputAssemblyState = &vertex_assembly_state,
     .pViewportState = &viewport_state,
     .pRasterizationState = &rasterization_state,
     .pMultisampleState = &multisample_state,
     .pColorBlendState = &blend_state,
     .pDynamicState = &dyn_state_info,
-    .layout = vk_layout,
+    .layout = layout,
     .renderPass = vk_renderpass,
     .subpass = 0,
   };
 
-  auto check_pipeline = vkCreateGraphicsPipelines(vk_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &vk_pipeline);
-  DEBUG_OBJ_CREATION(vkCreateGraphicsPipelines, check_pipeline);
-
-  vkDestroyShaderModule(vk_device, vertex_module, nullptr);
-  vkDestroyShaderModule(vk_device, fragment_module, nullptr);
-}
-void Engine::kill_pipeline() {
-  vkDestroyPipeline(vk_device, vk_pipeline, nullptr);
-  vkDestroyPipelineLayout(vk_device, vk_layout, nullptr);
+  VkPipeline pipeline;
+  auto check_pipeline = vkCreateGraphicsPipelines(vk_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline);
+  if (check_pipeline != VK_SUCCESS) {
+    print_err("vkCreateGraphicsPipelines returned {}\n", VulkanError::match_error(check_pipeline));
+    return VK_NULL_HANDLE;
+  }
+  return pipeline;
 }
 VkShaderModule Engine::create_shader_module(const char* file_name) {
+  // Both the pack and a mapped file are at least page/PACK_ALIGN aligned, so the code can be handed 
+  // to vulkan in place (compressed pack entries are decoded to the heap first)
+  MappedFile spirv;
   size_t code_size;
-  const uint32_t *p_code = (const uint32_t*)File::read_spirv(&code_size, file_name);
+  void *heap;
+  const uint8_t *code = Pack::instance()->get(file_name, &code_size, &heap);
+  if (!code) {
+    spirv = File::map(file_name);
+    code = spirv.data;
+    code_size = spirv.size;
+  }
+  ABORT(code, "Failed to map shader file");
+  VkShaderModule module = create_shader_module(code, code_size);
+  ABORT(module != VK_NULL_HANDLE, "Failed to create shader module");
+  if (heap)
+    mem_free(heap);
+
+  return module;
+}
+VkShaderModule Engine::create_shader_module(const uint8_t *code, size_t size) {
+  // A half written file shows up as a bad size or magic; vulkan does not have to validate spirv
+  const uint32_t SPIRV_MAGIC = 0x07230203;
+  if (size < 20 || size % 4 || *(const uint32_t*)code != SPIRV_MAGIC) {
+    print_err("Shader code is not spirv (size {})\n", size);
+    return VK_NULL_HANDLE;
+  }
+
   VkShaderModuleCreateInfo create_info = {
     .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-    .codeSize = code_size, 
-    .pCode = p_code,
+    .codeSize = size, 
+    .pCode = (const uint32_t*)code,
   };
   VkShaderModule module;
   auto check = vkCreateShaderModule(vk_device, &create_info, nullptr, &module);
-  DEBUG_OBJ_CREATION(vkCreateShaderModule, check);
-
-  mem_free(p_code);
+  if (check != VK_SUCCESS) {
+    print_err("vkCreateShaderModule returned {}\n", VulkanError::match_error(check));
+    return VK_NULL_HANDLE;
+  }
   return module;
 }
 
+// *HotReload ////////////////////
+void Engine::init_hot_reload() {
+  retired_pipelines.init(4);
+  Watcher *watcher = Watcher::instance();
+  if (!watcher->is_active())
+    return;
+  watcher->watch(VERTEX_SHADER_FILE, shader_changed, this);
+  watcher->watch(FRAGMENT_SHADER_FILE, shader_changed, this);
+  watcher->watch(SCENE_VERTEX_SHADER_FILE, shader_changed, this);
+  watcher->watch(SCENE_FRAGMENT_SHADER_FILE, shader_changed, this);
+  watcher->watch(SKIN_SHADER_FILE, shader_changed, this);
+}
+void Engine::kill_hot_reload() {
+  drop_reloaded(RELOAD_TRIANGLE | RELOAD_SCENE | RELOAD_SKIN);
+  reload_state = RELOAD_IDLE;
+  collect_retired_pipelines(true);
+  retired_pipelines.kill();
+}
+void Engine::drop_reloaded(uint32_t targets) {
+  // The task touches nothing of a target it was not asked for
+  if (!(reload_building & targets))
+    return;
+  ThreadPool::instance()->wait(&reload_group);
+  VkPipeline *built[] = { &reloaded.triangle, &reloaded.scene, &reloaded.skinned, &reloaded.skin };
+  const uint32_t built_for[] = { RELOAD_TRIANGLE, RELOAD_SCENE, RELOAD_SCENE, RELOAD_SKIN };
+  for(uint32_t i = 0; i < 4; ++i) {
+    if (!(targets & built_for[i]) || *built[i] == VK_NULL_HANDLE)
+      continue;
+    vkDestroyPipeline(vk_device, *built[i], nullptr);
+    *built[i] = VK_NULL_HANDLE;
+  }
+  reload_building &= ~targets;
+}
+VkShaderModule Engine::reload_shader_module(const char *file_name) {
+  MappedFile spirv = File::map(file_name);
+  return spirv.data ? create_shader_module(spirv.data, spirv.size) : VK_NULL_HANDLE;
+}
+void Engine::shader_changed(void *arg, const char *path) {
+  Engine *engine = (Engine*)arg;
+  uint32_t target = RELOAD_TRIANGLE;
+  if (strcmp(path, SCENE_VERTEX_SHADER_FILE) == 0 || strcmp(path, SCENE_FRAGMENT_SHADER_FILE) == 0)
+    target = RELOAD_SCENE;
+  else if (strcmp(path, SKIN_SHADER_FILE) == 0)
+    target = RELOAD_SKIN;
+  print("Hot reload: '{}' changed, rebuilding its pipelines\n", path);
+  engine->reload_requested |= target;
+}
+void Engine::reload_pipeline_task(void *arg) {
+  // Nothing here touches the HeapAllocator
+  Engine *engine = (Engine*)arg;
+  uint32_t targets = engine->reload_building;
+  ReloadedPipelines built = {};
+
+  if (targets & RELOAD_TRIANGLE) {
+    VkShaderModule vertex_module = engine->reload_shader_module(VERTEX_SHADER_FILE);
+    VkShaderModule fragment_module = engine->reload_shader_module(FRAGMENT_SHADER_FILE);
+    if (vertex_module != VK_NULL_HANDLE && fragment_module != VK_NULL_HANDLE)
+      built.triangle = engine->create_pipeline(vertex_module, fragment_module);
+    vkDestroyShaderModule(engine->vk_device, vertex_module, nullptr);
+    vkDestroyShaderModule(engine->vk_device, fragment_module, nullptr);
+  }
+  if (targets & RELOAD_SCENE) {
+    VkShaderModule vertex_module = engine->reload_shader_module(SCENE_VERTEX_SHADER_FILE);
+    VkShaderModule fragment_module = engine->reload_shader_module(SCENE_FRAGMENT_SHADER_FILE);
+    if (vertex_module != VK_NULL_HANDLE && fragment_module != VK_NULL_HANDLE)
+      engine->create_scene_pipelines(vertex_module, fragment_module, &built.scene, &built.skinned);
+    vkDestroyShaderModule(engine->vk_device, vertex_module, nullptr);
+    vkDestroyShaderModule(engine->vk_device, fragment_module, nullptr);
+  }
+  if (targets & RELOAD_SKIN) {
+    VkShaderModule module = engine->reload_shader_module(SKIN_SHADER_FILE);
+    if (module != VK_NULL_HANDLE)
+      built.skin = engine->create_skin_pipeline(module);
+    vkDestroyShaderModule(engine->vk_device, module, nullptr);
+  }
+
+  engine->reloaded = built;
+  engine->reload_state.store(RELOAD_DONE, std::memory_order_release);
+}
+// Called at the top of a frame, before anything is recorded
+void Engine::update_hot_reload() {
+  // Model callbacks may set a new scene, which drops what a build in flight made for the old one
+  Watcher::instance()->dispatch();
+  // Completes any reads started by reload callbacks (e.g. model buffers)
+  AsyncIO::instance()->poll(nullptr, UINT32_MAX);
+
+  if (reload_state.load(std::memory_order_acquire) == RELOAD_DONE) {
+    ThreadPool::instance()->wait(&reload_group);
+    // A target swaps in whole or not at all: the scene's two pipelines come from the same shaders
+    bool failed = false;
+    if (reload_building & RELOAD_TRIANGLE) {
+      failed |= reloaded.triangle == VK_NULL_HANDLE;
+      if (reloaded.triangle != VK_NULL_HANDLE) {
+        retire_pipeline(vk_pipeline);
+        vk_pipeline = reloaded.triangle;
+      }
+    }
+    if (reload_building & RELOAD_SCENE) {
+      failed |= reloaded.scene == VK_NULL_HANDLE;
+      if (reloaded.scene != VK_NULL_HANDLE) {
+        retire_pipeline(scene_draw.pipeline);
+        retire_pipeline(scene_draw.skinned_pipeline);
+        scene_draw.pipeline = reloaded.scene;
+        scene_draw.skinned_pipeline = reloaded.skinned;
+      }
+    }
+    if (reload_building & RELOAD_SKIN) {
+      failed |= reloaded.skin == VK_NULL_HANDLE;
+      if (reloaded.skin != VK_NULL_HANDLE) {
+        retire_pipeline(gpu_skinning.pipeline);
+        gpu_skinning.pipeline = reloaded.skin;
+      }
+    }
+    if (failed)
+      print_err("Hot reload: a pipeline rebuild failed, keeping the old one\n");
+    else if (reload_building)
+      print("Hot reload: pipelines swapped\n");
+    reloaded = {};
+    reload_building = 0;
+    reload_state = RELOAD_IDLE;
+  }
+
+  // One rebuild at a time: changes that land mid build start another once it is swapped in. Only what
+  // exists is rebuilt; a scene or skinning made later reads the shaders itself.
+  if (reload_requested && reload_state.load(std::memory_order_acquire) == RELOAD_IDLE) {
+    uint32_t targets = reload_requested;
+    if (scene_draw.pipeline == VK_NULL_HANDLE)
+      targets &= ~RELOAD_SCENE;
+    if (gpu_skinning.desc_set_layout == VK_NULL_HANDLE)
+      targets &= ~RELOAD_SKIN;
+    reload_requested = 0;
+    if (targets) {
+      reload_building = targets;
+      reload_state = RELOAD_RUNNING;
+      ThreadPool::instance()->submit(reload_pipeline_task, this, &reload_group);
+    }
+  }
+}
+// Destroyed once the frames in flight are done with it
+void Engine::retire_pipeline(VkPipeline pipeline) {
+  if (pipeline != VK_NULL_HANDLE)
+    retired_pipelines.push(RetiredPipeline{ pipeline, frame_count });
+}
+// Must be called once the fence for the current frame has been waited on
+void Engine::collect_retired_pipelines(bool all) {
+  size_t kept = 0;
+  for(size_t i = 0; i < retired_pipelines.length; ++i) {
+    RetiredPipeline retired = retired_pipelines[i];
+    if (all || frame_count >= retired.frame + MAX_FRAME_COUNT)
+      vkDestroyPipeline(vk_device, retired.pipeline, nullptr);
+    else
+      retired_pipelines[kept++] = retired;
+  }
+  retired_pipelines.length = kept;
+}
+
 
 // *Command ////////////////////
 void Engine::init_command() {
@@ -887,6 +2129,8 @@ void Engine::record_command_buffer(VkCommandBuffer cmd, uint32_t image_index) {
   auto check_begin_buffer = vkBeginCommandBuffer(cmd, &cmd_begin_info);
   DEBUG_OBJ_CREATION(vkBeginCommandBuffer, check_begin_buffer);
 
+  record_skinning(cmd, current_frame);
+
   VkClearValue clear_color = {{{ 0.0f, 0.0f, 0.0f }}};
   VkRenderPassBeginInfo renderpass_info = {
     .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
@@ -901,61 +2145,40 @@ void Engine::record_command_buffer(VkCommandBuffer cmd, uint32_t image_index) {
   };
 
   vkCmdBeginRenderPass(cmd, &renderpass_info, VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline);
-
-  VkDeviceSize offset = 0;
-  vkCmdBindVertexBuffers(cmd, 0, 1, &vert_buf.buf, &offset);
-  vkCmdBindIndexBuffer(cmd, vert_buf.buf, sizeof(Vertex) * 4, VK_INDEX_TYPE_UINT32);
 
   VkViewport viewport = get_viewport();
   VkRect2D scissor = get_scissor();
   vkCmdSetViewport(cmd, 0, 1, &viewport);
   vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-  vkCmdBindDescriptorSets(
-      cmd,
-      VK_PIPELINE_BIND_POINT_GRAPHICS,
-      vk_layout,
-      0,
-      1,
-      &desc_sets[current_frame],
-      0,
-      nullptr);
-
-  //vkCmdDraw(cmd, 3, 1, 0, 0);
-  vkCmdDrawIndexed(cmd, index_count, 1, 0, 0, 0);
+  // The test quad stands in when there is no scene
+  if (scene_draw.pipeline != VK_NULL_HANDLE) {
+    record_scene(cmd);
+  } else {
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, vk_pipeline);
+
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cmd, 0, 1, &vert_buf.buf, &offset);
+    vkCmdBindIndexBuffer(cmd, vert_buf.buf, sizeof(Vertex) * 4, VK_INDEX_TYPE_UINT32);
+
+    vkCmdBindDescriptorSets(
+        cmd,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        vk_layout,
+        0,
+        1,
+        &desc_sets[current_frame],
+        0,
+        nullptr);
+
+    //vkCmdDraw(cmd, 3, 1, 0, 0);
+    vkCmdDrawIndexed(cmd, index_count, 1, 0, 0, 0);
+  }
 
   vkCmdEndRenderPass(cmd);
   auto check_end_buffer = vkEndCommandBuffer(cmd);
   DEBUG_OBJ_CREATION(vkEndCommandBuffer, check_end_buffer);
 }
-void Engine::record_and_submit_cpy(size_t size, size_t index_offset) {
-  uint32_t pool_index = 0;
-  uint32_t index = allocate_commandbuffers(pool_index, 1); 
-
-  VkCommandBuffer cmd = vk_commandbuffers[index];
-  VkCommandBufferBeginInfo begin_info{};
-  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-  vkBeginCommandBuffer(cmd, &begin_info);
-    
-    VkBufferCopy copy_region{};
-    copy_region.size = sizeof(Vertex) * vertex_count + sizeof(Index) * index_count;
-    vkCmdCopyBuffer(cmd, staging_buf.buf, vert_buf.buf, 1, &copy_region);
-
-  vkEndCommandBuffer(cmd);
-
-  VkSubmitInfo submit_info{};
-  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &cmd;
-
-  vkQueueSubmit(vk_graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-  vkQueueWaitIdle(vk_graphics_queue);
-  vkResetCommandPool(vk_device, vk_commandpools[pool_index], 0x0);
-  vkFreeCommandBuffers(vk_device, vk_commandpools[pool_index], 1, &cmd);
-}
 
 // *Sync /////////////////
 void Engine::init_sync() {
@@ -1022,10 +2245,12 @@ void Engine::render_loop() {
 
   size_t size = sizeof(IndexVertex);
   IndexVertex index_vertex;
-  alloc_staging_buf(size, &index_vertex); 
   alloc_vert_buf(size);
-  record_and_submit_cpy(size, sizeof(Vertex) * 4);
-  vmaDestroyBuffer(vma_allocator, staging_buf.buf, staging_buf.alloc);
+  Upload quad;
+  quad.data = &index_vertex;
+  quad.size = size;
+  quad.dst = vert_buf.buf;
+  ABORT(upload(&quad, 1), "Failed to upload vertex data");
 
   camera->update();
 
@@ -1033,7 +2258,6 @@ void Engine::render_loop() {
     camera->set_time();
     // TODO:: These calls are blocking and slow, move to a different thread...
     window->poll();
-    std::cout << camera->delta_time << '\n';
 
     if (window->height != height || window->width != width) {
       /* 
@@ -1052,6 +2276,7 @@ void Engine::render_loop() {
       resize_framebuffers();
     }
 
+    update_hot_reload();
     draw_frame(&current_frame);
   }
 
@@ -1065,6 +2290,7 @@ void Engine::draw_frame(uint32_t *frame_index) {
   VkCommandBuffer cmd = vk_commandbuffers[*frame_index];
 
   vkWaitForFences(vk_device, 1, &render_done_fence, VK_TRUE, UINT64_MAX);
+  collect_retired_pipelines(false);
 
   uint32_t image_index;
   auto check_acquire = vkAcquireNextImageKHR(vk_device, vk_swapchain, UINT64_MAX, image_available, VK_NULL_HANDLE, &image_index);
@@ -1083,6 +2309,7 @@ void Engine::draw_frame(uint32_t *frame_index) {
 
   vkResetFences(vk_device, 1, &render_done_fence);
   vkResetCommandPool(vk_device, vk_commandpools[*frame_index], 0x0);
+  update_scene(*frame_index);
   record_command_buffer(cmd, image_index);
 
   update_ubo(*frame_index);
@@ -1101,6 +2328,7 @@ void Engine::draw_frame(uint32_t *frame_index) {
   auto check_graphics_submit = 
     vkQueueSubmit(vk_graphics_queue, 1, &graphics_submit_info, render_done_fence);
   DEBUG_OBJ_CREATION(vkQueueSubmit, check_graphics_submit);
+  ++frame_count;
 
   VkPresentInfoKHR present_info = {
     .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -1158,7 +2386,7 @@ VKAPI_ATTR VkBool32 VKAPI_CALL Engine::debug_callback(
   void* pUserData) {
 
   if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
-    std::cerr << "validation layer: " << pCallbackData->pMessage << std::endl;
+    print_err("validation layer: {}\n", pCallbackData->pMessage);
   }
 
   return VK_FALSE;
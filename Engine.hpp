@@ -9,6 +9,12 @@
 #include "Vec.hpp"
 #include "Camera.hpp"
 #include "Clock.hpp"
+#include "Threads.hpp"
+#include "Quantize.hpp"
+#include "Skinning.hpp"
+#include "SceneGraph.hpp"
+#include "Animator.hpp"
+#include "Morph.hpp"
 
 #define VMA_STATIC_VULKAN_FUNCTIONS 0
 #define VMA_DYNAMIC_VULKAN_FUNCTIONS 1
@@ -16,9 +22,21 @@
 
 namespace Sol {
 
+struct IoCompletion;
+struct Scene;
+
 #define V_LAYERS true
+// Skinned primitives are posed by shaders/skin.comp, else on the CPU by Skinning
+#define GPU_SKINNING true
 
 #define MAX_FRAME_COUNT 2
+#define UPLOAD_STAGING_SIZE (64 * 1024 * 1024)
+
+#define VERTEX_SHADER_FILE "shaders/triangle3.vert.spv"
+#define FRAGMENT_SHADER_FILE "shaders/triangle3.frag.spv"
+#define SKIN_SHADER_FILE "shaders/skin.comp.spv"
+#define SCENE_VERTEX_SHADER_FILE "shaders/quantized.vert.spv"
+#define SCENE_FRAGMENT_SHADER_FILE "shaders/quantized.frag.spv"
 
 struct SwapchainSettings {
   VkSurfaceTransformFlagBitsKHR transform;
@@ -59,6 +77,74 @@ struct Vertex {
   }
 };
 
+// Vertex input for a cooked mesh's Scene::Primitive::vertices; the formats do the dequantizing, see
+// shaders/quantized.vert for the position and the octahedral vectors
+struct QuantizedVertexInput {
+  static const uint32_t ATTRIBUTE_COUNT = 6;
+
+  // Pushed per primitive: its node's world matrix and its Scene::Primitive::bounds, as vec4s for std430
+  struct PushConstants {
+    float model[16];
+    float position_offset[4];
+    float position_scale[4];
+  };
+
+  static void get_binding_description(VkVertexInputBindingDescription *desc) {
+    *desc = {};
+    desc->binding = 0;
+    desc->stride = sizeof(QuantizedVertex);
+    desc->inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  }
+  static void get_attribute_description(VkVertexInputAttributeDescription *desc) {
+    const struct { VkFormat format; uint32_t offset; } attributes[ATTRIBUTE_COUNT] = {
+      { VK_FORMAT_R16G16B16A16_UNORM, offsetof(QuantizedVertex, position) },
+      { VK_FORMAT_R16G16_SNORM, offsetof(QuantizedVertex, normal) },
+      { VK_FORMAT_R16G16_SNORM, offsetof(QuantizedVertex, tangent) },
+      { VK_FORMAT_R16G16_SFLOAT, offsetof(QuantizedVertex, uv) },
+      { VK_FORMAT_R8G8B8A8_UINT, offsetof(QuantizedVertex, joints) },
+      { VK_FORMAT_R8G8B8A8_UNORM, offsetof(QuantizedVertex, weights) },
+    };
+    for(uint32_t i = 0; i < ATTRIBUTE_COUNT; ++i) {
+      desc[i] = {};
+      desc[i].binding = 0;
+      desc[i].location = i;
+      desc[i].format = attributes[i].format;
+      desc[i].offset = attributes[i].offset;
+    }
+  }
+  static VkIndexType index_type(uint32_t index_size) {
+    return index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  }
+};
+
+// Vertex input for Skinning's output, drawn with shaders/quantized.vert pushed an identity model, an
+// offset of 0 and a scale of 1
+struct SkinnedVertexInput {
+  static const uint32_t ATTRIBUTE_COUNT = 4;
+
+  static void get_binding_description(VkVertexInputBindingDescription *desc) {
+    *desc = {};
+    desc->binding = 0;
+    desc->stride = sizeof(SkinnedVertex);
+    desc->inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  }
+  static void get_attribute_description(VkVertexInputAttributeDescription *desc) {
+    const struct { VkFormat format; uint32_t offset; } attributes[ATTRIBUTE_COUNT] = {
+      { VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(SkinnedVertex, position) },
+      { VK_FORMAT_R16G16_SNORM, offsetof(SkinnedVertex, normal) },
+      { VK_FORMAT_R16G16_SNORM, offsetof(SkinnedVertex, tangent) },
+      { VK_FORMAT_R16G16_SFLOAT, offsetof(SkinnedVertex, uv) },
+    };
+    for(uint32_t i = 0; i < ATTRIBUTE_COUNT; ++i) {
+      desc[i] = {};
+      desc[i].binding = 0;
+      desc[i].location = i;
+      desc[i].format = attributes[i].format;
+      desc[i].offset = attributes[i].offset;
+    }
+  }
+};
+
 const uint32_t vertex_count = 4;
 const Vertex vertices[] = {
   {{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}},
@@ -113,6 +199,9 @@ static Engine* instance();
 void init();
 void run();
 void kill();
+// The cooked scene to draw, after init(): before run() or from a hot reload callback, which waits for
+// the frames in flight first. It must stay mapped until it is replaced or the Engine is killed.
+void set_scene(const Scene *scene);
 
 uint32_t current_frame;
 
@@ -155,14 +244,85 @@ private:
     VmaAllocationCreateFlags vma_flags,
     GpuBuffer *buf);
   void free_buffer(GpuBuffer buf);
-  StagingBuffer staging_buf;
-  void alloc_staging_buf(size_t size, void* data);
   VertexBuffer vert_buf;
   void alloc_vert_buf(size_t size);
   Vec<GpuBuffer> ubos;
   void alloc_ubos(size_t size);
   void kill_ubos();
   void update_ubo(uint32_t frame_index);
+  /*
+   * CPU skinned vertices, rewritten every frame: one host visible, persistently mapped vertex buffer
+   * a frame in flight, so Skinning::skin_parallel writes a frame's while the GPU still reads the last one's.
+   */
+  GpuBuffer skinned_bufs[MAX_FRAME_COUNT] = {};
+  size_t skinned_buf_size = 0;
+  void alloc_skinned_bufs(size_t vertex_count);
+  void kill_skinned_bufs();
+  SkinnedVertex* skinned_vertices(uint32_t frame_index);
+
+// GPU skinning
+  /*
+   * Every skinned instance in one compute dispatch, recorded ahead of the render pass in the frame's
+   * own command buffer, with a barrier between the writes and the vertex input rather than a wait on
+   * the queue. Bind pose vertices are uploaded once; the palettes and instances are host written a
+   * frame, and like the output buffers there is one of each a frame in flight, so the frame fence is
+   * all that guards them. The output is drawn through SkinnedVertexInput, as the CPU path's is.
+   * With nothing to skin (no vertices, outputs or instances) init_gpu_skinning() makes nothing and
+   * returns false; a skin without joints still gets room for one.
+   */
+  struct GpuSkinning {
+    VkDescriptorSetLayout desc_set_layout = VK_NULL_HANDLE;
+    VkDescriptorPool desc_pool;
+    VkDescriptorSet desc_sets[MAX_FRAME_COUNT];
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+    GpuBuffer bind_vertices;               // QuantizedVertex, device local
+    GpuBuffer palettes[MAX_FRAME_COUNT];   // 16 floats a joint, mapped
+    GpuBuffer instances[MAX_FRAME_COUNT];  // SkinInstance, mapped
+    GpuBuffer outputs[MAX_FRAME_COUNT];    // SkinnedVertex, device local
+    uint32_t max_instances;
+    uint32_t instance_count = 0;   // Set by dispatch_skinning() for the next recorded frame only
+    uint32_t max_vertex_count = 0; // Of this frame's instances: the dispatch's width
+  };
+  GpuSkinning gpu_skinning;
+  bool init_gpu_skinning(uint32_t vertex_count, uint32_t output_count, uint32_t joint_count, uint32_t instance_count);
+  // Over gpu_skinning's layout, so can run on any thread while it lives
+  VkPipeline create_skin_pipeline(VkShaderModule module);
+  void kill_gpu_skinning();
+  bool upload_skin_vertices(const QuantizedVertex *vertices, uint32_t count, uint32_t first);
+  // The frame's mapped palette and instance buffers, to fill before dispatch_skinning()
+  float* skin_palettes(uint32_t frame_index);
+  SkinInstance* skin_instances(uint32_t frame_index);
+  // The frame's first 'instance_count' instances are skinned when it is recorded
+  void dispatch_skinning(uint32_t frame_index, uint32_t instance_count);
+  void record_skinning(VkCommandBuffer cmd, uint32_t frame_index);
+
+// Uploads
+  /*
+   * One persistently mapped staging buffer: file ranges are read straight into it (AsyncIO, into a 
+   * buffer registered with io_uring where possible) and pack entries are decoded straight into it, so 
+   * upload data never passes through the heap. Uploads bigger than the staging buffer go in pieces.
+   */
+  struct Upload {
+    const char *path = nullptr; // Pack entry or file to read from, or...
+    const void *data = nullptr; // ...memory to copy from
+    size_t offset = 0; // Into the file/entry
+    size_t size = 0;
+    VkBuffer dst = VK_NULL_HANDLE;
+    VkDeviceSize dst_offset = 0;
+  };
+  StagingBuffer upload_staging;
+  VkCommandPool upload_pool;
+  VkCommandBuffer upload_cmd;
+  VkFence upload_fence;
+  struct UploadRead;
+  struct UploadBatch;
+  void init_uploads();
+  void kill_uploads();
+  // Blocks until the copies are done; false if any read failed (the rest are still uploaded)
+  bool upload(const Upload *uploads, uint32_t count);
+  void flush_uploads(UploadBatch *batch);
+  static void upload_read_done(const IoCompletion *completion);
 
 // Swapchain
   VkSwapchainKHR vk_swapchain;
@@ -200,7 +360,136 @@ private:
   VkPipelineLayout vk_layout;
   void init_pipeline();
   void kill_pipeline();
+  VkPipeline create_pipeline(VkShaderModule vertex_module, VkShaderModule fragment_module);
+  VkPipeline create_pipeline(VkShaderModule vertex_module, VkShaderModule fragment_module, VkPipelineLayout layout,
+      const VkPipelineVertexInputStateCreateInfo *vertex_input);
   VkShaderModule create_shader_module(const char* file_name);
+  VkShaderModule create_shader_module(const uint8_t *code, size_t size);
+
+// Scene
+  /*
+   * The cooked scene, drawn through QuantizedVertexInput: every primitive's vertices in one device
+   * local buffer and every index_data in another, uploaded once by set_scene(), then one draw a
+   * primitive of each node with a mesh, at the LOD Scene::select_lod picks for where it is, pushed the
+   * node's world matrix and the primitive's bounds. At full detail a primitive with meshlets draws only
+   * those Meshlets::cull keeps for the camera, compacted into the frame's culled_bufs as it is recorded.
+   * The pipeline's topology is fixed, so only triangle lists are drawn.
+   *
+   * The scene's first animation, if it has one, loops on the graph. The primitives of nodes with a
+   * skin are posed by update_scene() each frame, by GpuSkinning with GPU_SKINNING, else with
+   * Skinning::skin_parallel into the frame's skinned_bufs, and drawn from there through
+   * SkinnedVertexInput at full detail, as a posed mesh leaves the bounds its LODs were picked by.
+   * Morphed primitives get a Morph each, blended to the weights the animation's WEIGHTS channels
+   * drive the node to, else its default weights. Those of unskinned nodes are drawn the same way from
+   * morphed_bufs with the node's matrix; those of skinned nodes are skinned from the blend, on the CPU
+   * into skinned_bufs whatever GPU_SKINNING says, as GpuSkinning's bind pose is uploaded once.
+   */
+  struct SkinnedDraw {
+    uint32_t skin;
+    uint32_t mesh;
+    uint32_t primitive;      // In the mesh
+    uint32_t output_offset;  // Into skinned_bufs, or GpuSkinning::outputs if GPU skinned, in vertices
+    uint32_t bind_offset;    // Into GpuSkinning::bind_vertices, shared by the draws of one primitive
+    uint32_t palette_offset; // Into GpuSkinning::palettes, in joints
+    uint32_t slot;           // The node's SceneGraph slot
+    uint32_t morph;          // Into morphs, UINT32_MAX if the primitive has no targets
+  };
+  struct MorphedDraw {
+    uint32_t slot;           // The node's SceneGraph slot
+    uint32_t mesh;
+    uint32_t primitive;      // In the mesh
+    uint32_t output_offset;  // Into morphed_bufs, in vertices; UINT32_MAX for a skinned node's, which is skinned instead
+    const float *weights;    // The animator's for the node, else its default ones
+    uint32_t weight_count;
+  };
+  struct SceneDraw {
+    const Scene *scene = nullptr;
+    SceneGraph graph;
+    GpuBuffer vertices;
+    GpuBuffer indices;
+    uint32_t *first_primitive; // Per mesh, into the two below
+    uint32_t *vertex_offsets;  // Per primitive, in vertices
+    uint64_t *index_offsets;   // Per primitive, in bytes, 4 byte aligned for either index size
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+    Animator animator;
+    bool animated;
+    float time;                // Into the animation
+    Skinning *skinnings;       // Per scene skin
+    SkinnedDraw *skinned;
+    uint32_t skinned_count;
+    Morph *morphs;             // Per MorphedDraw
+    MorphedDraw *morphed;
+    uint32_t morphed_count;
+    GpuBuffer morphed_bufs[MAX_FRAME_COUNT];  // Host visible and mapped, as skinned_bufs; none if only skinned nodes morph
+    bool morphed_stale[MAX_FRAME_COUNT];      // The frame's buffer is behind the last blend
+    VkPipeline skinned_pipeline; // Over SkinnedVertexInput, for the skinned and the morphed
+    GpuBuffer culled_bufs[MAX_FRAME_COUNT];   // Host visible and mapped, the surviving meshlets' indices
+    size_t culled_size;        // Bytes of each, room for every meshlet draw at once; 0 without any
+    uint32_t *survivors;       // Meshlets::cull's, room for the most meshlets of any primitive
+  };
+  SceneDraw scene_draw;
+  bool init_scene_skinning();
+  bool init_scene_morphs();
+  void init_scene_culling();
+  void init_scene_pipeline();
+  // Over scene_draw's layout, so can run on any thread while it lives; 'skinned' only if there are
+  // skinned or morphed draws. False (and nothing made) if either fails.
+  bool create_scene_pipelines(VkShaderModule vertex_module, VkShaderModule fragment_module, VkPipeline *pipeline,
+      VkPipeline *skinned);
+  void kill_scene();
+  // After the frame's fence: animates the graph and poses the skinned and morphed primitives into the frame's buffers
+  void update_scene(uint32_t frame_index);
+  void record_scene(VkCommandBuffer cmd);
+
+// Hot reload
+  /*
+   * Shader changes are picked up by the Watcher: the triangle's, the scene's (its pipeline and the
+   * skinned one share them) and skin.comp's. The new pipelines are built on the ThreadPool and
+   * swapped in at the top of a frame; the old ones may still be in use by frames in flight, so they
+   * are only destroyed MAX_FRAME_COUNT frames later. The scene and skinning layouts stay as they are:
+   * a shader that changes its interface needs a restart. kill_scene() and kill_gpu_skinning() wait
+   * for a build in flight and drop what it made for them.
+   */
+  enum ReloadState : uint32_t {
+    RELOAD_IDLE,
+    RELOAD_RUNNING,
+    RELOAD_DONE,
+  };
+  enum ReloadTarget : uint32_t {
+    RELOAD_TRIANGLE = 0x1, // vk_pipeline
+    RELOAD_SCENE    = 0x2, // scene_draw's pipeline and skinned_pipeline
+    RELOAD_SKIN     = 0x4, // gpu_skinning's pipeline
+  };
+  struct RetiredPipeline {
+    VkPipeline pipeline;
+    uint64_t frame; // frame_count when it was replaced
+  };
+  // Written by the task before RELOAD_DONE, VK_NULL_HANDLE where a target was not built or failed
+  struct ReloadedPipelines {
+    VkPipeline triangle;
+    VkPipeline scene;
+    VkPipeline skinned;
+    VkPipeline skin;
+  };
+  uint64_t frame_count = 0; // Frames submitted
+  Vec<RetiredPipeline> retired_pipelines;
+  TaskGroup reload_group;
+  std::atomic<uint32_t> reload_state{RELOAD_IDLE};
+  ReloadedPipelines reloaded = {};
+  uint32_t reload_requested = 0; // ReloadTarget bits
+  uint32_t reload_building = 0;  // What the task in flight builds, read by it
+  void init_hot_reload();
+  void kill_hot_reload();
+  void update_hot_reload();
+  void collect_retired_pipelines(bool all);
+  void retire_pipeline(VkPipeline pipeline);
+  // Waits for a build in flight and destroys what it made for 'targets'
+  void drop_reloaded(uint32_t targets);
+  // The loose file, not the pack's: it is the one that was just edited. VK_NULL_HANDLE if unreadable.
+  VkShaderModule reload_shader_module(const char *file_name);
+  static void shader_changed(void *arg, const char *path);
+  static void reload_pipeline_task(void *arg);
 
 // Framebuffer
   Vec<VkFramebuffer> vk_framebuffers;
@@ -215,7 +504,6 @@ private:
   void kill_command();
   uint32_t allocate_commandbuffers(uint32_t command_pool_index, uint32_t buffer_count);
   void record_command_buffer(VkCommandBuffer cmd, uint32_t image_index);
-  void record_and_submit_cpy(size_t size, size_t index_offset);
 
 // Sync
   Vec<VkSemaphore> vk_semaphores;
@@ -1,5 +1,4 @@
 // clang-format off
-#include <iostream>
 #include <cstring>
 
 #include "tlsf.h"
@@ -19,10 +18,11 @@ size_t mem_align(size_t size, size_t alignment) {
 // MemoryService //////////////////////
 static MemoryService GlobalMemoryService;
 MemoryService *MemoryService::instance() { return &GlobalMemoryService; }
+thread_local Allocator *MemoryService::thread_scratch = nullptr;
 void MemoryService::init(MemoryConfig* config) {
-  std::cout << "Initializing memory service, allocating " << config->heap_size << " bytes to HeapAllocator...\n";
+  print("Initializing memory service, allocating {} bytes to HeapAllocator...\n", config->heap_size);
   system_allocator.init(config->heap_size);
-  std::cout << "Allocating " << config->linear_size << " bytes to LinearAllocator...\n";
+  print("Allocating {} bytes to LinearAllocator...\n", config->linear_size);
   scratch_allocator.init(config->linear_size);
 }
 void MemoryService::shutdown() { 
@@ -37,7 +37,7 @@ void HeapAllocator::init(size_t size) {
   memory = malloc(size);
   limit = size;
   handle = tlsf_create_with_pool(memory, size);
-  std::cout << "HeapAllocator, size " << size << " created...\n";
+  print("HeapAllocator, size {} created...\n", size);
 } // init
 
 void HeapAllocator::shutdown() {
@@ -45,11 +45,11 @@ void HeapAllocator::shutdown() {
   pool_t pool = tlsf_get_pool(handle);
   tlsf_walk_pool(pool, nullptr, (void*)&stats);
   if (stats.allocated_bytes)
-    std::cerr << "FAILED TO SHUTDOWN HEAPALLOCATOR! DETECTED ALLOCATED MEMORY!\n"
-      << "  Allocated: " << stats.allocated_bytes << '\n'
-      << "  Total: " << stats.total_bytes << '\n';
+    print_err("FAILED TO SHUTDOWN HEAPALLOCATOR! DETECTED ALLOCATED MEMORY!\n"
+      "  Allocated: {}\n"
+      "  Total: {}\n", stats.allocated_bytes, stats.total_bytes);
   else 
-    std::cout << "HeapAllocator successfully shutdown! All memory free!\n";
+    print("HeapAllocator successfully shutdown! All memory free!\n");
 
   assert(stats.allocated_bytes == 0 && "MEMORY IS STILL ALLOCATED\n");
   tlsf_destroy(handle);
@@ -100,7 +100,9 @@ void LinearAllocator::init(size_t size) {
   cap = size;
 }
 void *LinearAllocator::allocate(size_t size, size_t alignment) {
-  size_t pad = mem_align(size, alignment) - size;
+  // Align the address, not the size: pad from the current top up to the next 'alignment' boundary
+  size_t top = (size_t)(mem + alloced);
+  size_t pad = mem_align(top, alignment) - top;
 #ifdef MEM_STATS
   stats.alloc(size + pad);
 #endif
@@ -122,9 +124,9 @@ void LinearAllocator::free() {
 #endif
 }
 void LinearAllocator::kill() { 
-  std::cout << "Linear allocator freed\n";
+  print("Linear allocator freed\n");
 #ifdef MEM_STATS
-  std::cout << "        Remaining Allocation size in LinearAllocator: " << stats.alloced << '\n';
+  print("        Remaining Allocation size in LinearAllocator: {}\n", stats.alloced);
   stats.alloced = 0;
 #endif
   cap = 0; 
@@ -132,4 +134,37 @@ void LinearAllocator::kill() {
   ::free((void*)mem);
 }
 
+// TaskArena ////////////////////
+void TaskArena::bind() {
+  prev = MemoryService::thread_scratch;
+  MemoryService::thread_scratch = this;
+}
+void TaskArena::unbind() {
+  MemoryService::thread_scratch = prev;
+}
+
+void *TaskArena::reallocate(size_t, void*) { return nullptr; }
+void TaskArena::deallocate(void*) { }
+
+void *TaskArena::allocate(size_t size, size_t alignment) {
+  size_t top = (size_t)(mem + alloced);
+  size_t pad = mem_align(top, alignment) - top;
+  if (!mem || alloced + pad + size > cap) {
+    size_t block = size + alignment > next_block ? size + alignment : next_block;
+    MemoryService *service = MemoryService::instance();
+    {
+      std::lock_guard<std::mutex> lock(service->scratch_lock);
+      mem = (uint8_t*)service->scratch_allocator.allocate(block, 16);
+    }
+    cap = block;
+    alloced = 0;
+    next_block = next_block * 2 < MAX_BLOCK ? next_block * 2 : MAX_BLOCK;
+    top = (size_t)mem;
+    pad = mem_align(top, alignment) - top;
+  }
+  void *ptr = (void*)(mem + alloced + pad);
+  alloced += pad + size;
+  return ptr;
+}
+
 } // namespace Sol
@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <cstdint>
 #include <cstring>
+#include <mutex>
 #include <vector>
 
 #include "tlsf.h"
@@ -89,6 +90,32 @@ struct LinearAllocator : public Allocator {
 #endif
 };
 
+/*
+ * A task's bump allocator, over blocks it takes from the shared scratch arena (under
+ * MemoryService::scratch_lock), so tasks running at once only contend once a block. What it hands out
+ * lives in the scratch arena and goes when that is cut; the unused end of each block is wasted. Only
+ * for while the thread that owns the scratch arena waits on the tasks, as it does not take the lock.
+ */
+struct TaskArena : public Allocator {
+  static const size_t MIN_BLOCK = 4096; // Blocks double from here, so waste stays under what is used
+  static const size_t MAX_BLOCK = 256 * 1024;
+
+  uint8_t *mem = nullptr;
+  size_t cap = 0;
+  size_t alloced = 0;
+  size_t next_block = MIN_BLOCK;
+  Allocator *prev = nullptr;
+
+  // Make this the calling thread's MemoryService::scratch(), until unbind()
+  void bind();
+  void unbind();
+
+  /* General API */
+  void *allocate(size_t size, size_t alignment) override;
+  void *reallocate(size_t size, void* ptr) override;
+  void deallocate(void* ptr) override;
+};
+
 struct MemoryConfig {
   size_t heap_size = 32 * 1024 * 1024;
   size_t linear_size = 1024 * 1024;
@@ -97,8 +124,12 @@ struct MemoryConfig {
 struct MemoryService {
   HeapAllocator system_allocator;
   LinearAllocator scratch_allocator;
+  std::mutex scratch_lock; // Taken by TaskArenas, not by plain scratch allocations
+  static thread_local Allocator *thread_scratch;
   // return a pointer to an instance of a static MemoryService
   static MemoryService* instance();
+  // The arena Array, StringBuffer and lin_alloca use on this thread: a bound TaskArena, else 'scratch_allocator'
+  static Allocator* scratch() { return thread_scratch ? thread_scratch : &instance()->scratch_allocator; }
   void init(MemoryConfig* config);
   // free all memory associated with the service
   void shutdown();
@@ -106,7 +137,7 @@ struct MemoryService {
 
 inline void mem_cpy(void* to, void* from, size_t size);
 
-#define lin_alloca(size, alignment) ((Sol::MemoryService::instance()->scratch_allocator).allocate(size, alignment))
+#define lin_alloca(size, alignment) (Sol::MemoryService::scratch()->allocate(size, alignment))
 #define mem_cpy(to, from, size) (memcpy(to, from, size))
 
 #define mem_alloc2(size, alignment, alloc) ((alloc)->allocate(size, alignment))
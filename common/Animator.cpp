@@ -0,0 +1,672 @@
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+#include "Animator.hpp"
+#include "Allocator.hpp"
+#include "Clip.hpp"
+#include "Decode.hpp"
+#include "Format.hpp"
+#include "Scene.hpp"
+#include "SceneGraph.hpp"
+
+namespace Sol {
+
+namespace {
+  static const uint32_t MAX_WALK = 4; // Keys stepped from the cursor before a binary search
+
+  static uint32_t run_index(uint32_t path, uint32_t interpolation) {
+    return path * 3 + interpolation;
+  }
+  static uint32_t path_components(uint32_t path) {
+    return path == Scene::Animation::ROTATION ? 4 : 3;
+  }
+
+  // The key at or before 'time' (clamped so there is always a next one) and how far along to the next
+  static void locate(Animator::Timeline *timeline, float time, uint32_t *key, float *t, float *span) {
+    const float *times = timeline->times;
+    uint32_t n = timeline->key_count;
+    uint32_t c = timeline->cursor;
+    if (time < times[c])
+      c = 0; // Went back, e.g. the clip looped
+
+    uint32_t walk = 0;
+    while (c + 1 < n && times[c + 1] <= time && walk < MAX_WALK) {
+      ++c;
+      ++walk;
+    }
+    if (walk == MAX_WALK) {
+      uint32_t lo = c;
+      uint32_t hi = n;
+      while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (times[mid] <= time)
+          lo = mid;
+        else
+          hi = mid;
+      }
+      c = lo;
+    }
+    timeline->cursor = c;
+
+    if (c + 1 >= n)
+      c = n - 2;
+    float d = times[c + 1] - times[c];
+    float u = d > 0.0f ? (time - times[c]) / d : 0.0f;
+    *key = c;
+    *t = u < 0.0f ? 0.0f : (u > 1.0f ? 1.0f : u);
+    *span = d;
+  }
+
+  /*
+   * Tracks in run order and by slot within a run (counting sorts, the second stable): a kernel then
+   * reads its tracks' keys at a steady stride the prefetcher follows, and writes the graph front to back.
+   */
+  static void order_tracks(const AnimationTrack *src, uint32_t count, uint32_t *runs, uint32_t *order) {
+    uint32_t run_sizes[Animator::RUN_COUNT] = {};
+    uint32_t slot_count = 0;
+    for(uint32_t i = 0; i < count; ++i) {
+      ++run_sizes[run_index(src[i].path, src[i].interpolation)];
+      slot_count = src[i].slot + 1 > slot_count ? src[i].slot + 1 : slot_count;
+    }
+    uint32_t *by_slot = (uint32_t*)mem_alloca(sizeof(uint32_t) * ((size_t)slot_count + 1), 16);
+    uint32_t *slot_order = (uint32_t*)mem_alloca(sizeof(uint32_t) * (count ? count : 1), 16);
+    memset(by_slot, 0, sizeof(uint32_t) * ((size_t)slot_count + 1));
+    for(uint32_t i = 0; i < count; ++i)
+      ++by_slot[src[i].slot + 1];
+    for(uint32_t i = 0; i < slot_count; ++i)
+      by_slot[i + 1] += by_slot[i];
+    for(uint32_t i = 0; i < count; ++i)
+      slot_order[by_slot[src[i].slot]++] = i;
+    runs[0] = 0;
+    for(uint32_t r = 0; r < Animator::RUN_COUNT; ++r)
+      runs[r + 1] = runs[r] + run_sizes[r];
+    uint32_t fill[Animator::RUN_COUNT];
+    memcpy(fill, runs, sizeof(fill));
+    for(uint32_t i = 0; i < count; ++i) {
+      const AnimationTrack *track = &src[slot_order[i]];
+      order[fill[run_index(track->path, track->interpolation)]++] = slot_order[i];
+    }
+    mem_free(slot_order);
+    mem_free(by_slot);
+  }
+
+  // A clip track's window: its two times, padded to 4 floats, then after every track's times its two values
+  static float* window_times(const Animator *a, uint32_t i) {
+    return a->keys + i * 4;
+  }
+  static float* window_values(const Animator *a, uint32_t i) {
+    return a->keys + a->timeline_count * 4 + i * 8;
+  }
+  static void push_key(Animator *a, uint32_t track, const ClipKey *key) {
+    float *times = window_times(a, track);
+    float *values = window_values(a, track);
+    times[0] = times[1];
+    times[1] = Clips::time(key, a->clip_duration);
+    memcpy(values, values + 4, sizeof(float) * 4);
+    Clips::value(&a->clip_tracks[track], key, values + 4);
+  }
+  // Every window back to its track's first two keys, which are where the layout has them whatever their 'track' says
+  static void rewind(Animator *a) {
+    for(uint32_t i = 0; i < a->timeline_count * 2; ++i)
+      push_key(a, i / 2, &a->clip_keys[i]);
+    for(uint32_t i = 0; i < a->timeline_count; ++i)
+      a->timelines[i].cursor = 0;
+    a->stream = a->timeline_count * 2;
+  }
+  // Read keys off the stream while the next one is due: its track has reached the key before it
+  static void advance(Animator *a, float time) {
+    if (time < a->stream_time)
+      rewind(a);
+    a->stream_time = time;
+    while (a->stream < a->clip_key_count) {
+      const ClipKey *key = &a->clip_keys[a->stream];
+      // Scene::validate() leaves the keys unchecked, so a key for no track is dropped here
+      if (key->track >= a->timeline_count) {
+        ++a->stream;
+        continue;
+      }
+      if (window_times(a, key->track)[1] > time)
+        break;
+      push_key(a, key->track, key);
+      ++a->stream;
+    }
+  }
+
+  static void store(SceneGraph *graph, float *out, uint32_t slot, __m128 v) {
+    _mm_store_ps(out + slot * 4, v);
+    graph->mark_dirty(slot);
+  }
+
+  static void sample_step(const Animator *a, uint32_t begin, uint32_t end, float *out, SceneGraph *graph) {
+    for(uint32_t i = begin; i < end; ++i) {
+      const Animator::Track *track = &a->tracks[i];
+      uint32_t k = a->key[track->timeline] + (a->t[track->timeline] >= 1.0f);
+      store(graph, out, track->slot, _mm_load_ps(track->values + k * 4));
+    }
+  }
+
+  static void sample_linear(const Animator *a, uint32_t begin, uint32_t end, float *out, SceneGraph *graph) {
+    for(uint32_t i = begin; i < end; ++i) {
+      const Animator::Track *track = &a->tracks[i];
+      const float *v = track->values + a->key[track->timeline] * 4;
+      __m128 v0 = _mm_load_ps(v);
+      __m128 v1 = _mm_load_ps(v + 4);
+      store(graph, out, track->slot, _mm_add_ps(v0, _mm_mul_ps(_mm_sub_ps(v1, v0), _mm_set1_ps(a->t[track->timeline]))));
+    }
+  }
+
+  // 1 / sqrt to full float precision: the estimate and one Newton step
+  static __m128 rsqrt(__m128 x) {
+    __m128 r = _mm_rsqrt_ps(x);
+    __m128 rrx = _mm_mul_ps(_mm_mul_ps(r, r), x);
+    return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), rrx));
+  }
+
+  /*
+   * Four tracks at a time: their keys are transposed so each register holds one component of four
+   * quaternions. The second key is negated where the two are more than half a turn apart, so the
+   * blend takes the short way round. A batch short of four repeats its first track and stores only
+   * the real ones.
+   */
+  static void sample_rotations(const Animator *a, uint32_t begin, uint32_t end, SceneGraph *graph) {
+    for(uint32_t i = begin; i < end; i += 4) {
+      uint32_t lanes = end - i < 4 ? end - i : 4;
+      const Animator::Track *track[4];
+      float ts[4];
+      for(uint32_t l = 0; l < 4; ++l) {
+        track[l] = &a->tracks[i + (l < lanes ? l : 0)];
+        ts[l] = a->t[track[l]->timeline];
+      }
+
+      __m128 q0[4], q1[4];
+      for(uint32_t l = 0; l < 4; ++l) {
+        const float *v = track[l]->values + a->key[track[l]->timeline] * 4;
+        q0[l] = _mm_load_ps(v);
+        q1[l] = _mm_load_ps(v + 4);
+      }
+      _MM_TRANSPOSE4_PS(q0[0], q0[1], q0[2], q0[3]);
+      _MM_TRANSPOSE4_PS(q1[0], q1[1], q1[2], q1[3]);
+
+      __m128 dot = _mm_mul_ps(q0[0], q1[0]);
+      for(uint32_t c = 1; c < 4; ++c)
+        dot = _mm_add_ps(dot, _mm_mul_ps(q0[c], q1[c]));
+      __m128 flip = _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), _mm_set1_ps(-0.0f));
+      for(uint32_t c = 0; c < 4; ++c)
+        q1[c] = _mm_xor_ps(q1[c], flip);
+
+      __m128 w0, w1;
+      __m128 t = _mm_loadu_ps(ts);
+      if (!a->slerp) {
+        w0 = _mm_sub_ps(_mm_set1_ps(1.0f), t);
+        w1 = t;
+      } else {
+        // Nearly parallel keys fall back to the nlerp weights, where sin(theta) would divide by ~0
+        float cosines[4], ws0[4], ws1[4];
+        _mm_storeu_ps(cosines, _mm_xor_ps(dot, flip));
+        for(uint32_t l = 0; l < 4; ++l) {
+          float cosine = cosines[l] > 1.0f ? 1.0f : cosines[l];
+          float theta = acosf(cosine);
+          float sine = sinf(theta);
+          if (sine > 1e-4f) {
+            ws0[l] = sinf((1.0f - ts[l]) * theta) / sine;
+            ws1[l] = sinf(ts[l] * theta) / sine;
+          } else {
+            ws0[l] = 1.0f - ts[l];
+            ws1[l] = ts[l];
+          }
+        }
+        w0 = _mm_loadu_ps(ws0);
+        w1 = _mm_loadu_ps(ws1);
+      }
+
+      __m128 q[4];
+      for(uint32_t c = 0; c < 4; ++c)
+        q[c] = _mm_add_ps(_mm_mul_ps(q0[c], w0), _mm_mul_ps(q1[c], w1));
+      __m128 length2 = _mm_mul_ps(q[0], q[0]);
+      for(uint32_t c = 1; c < 4; ++c)
+        length2 = _mm_add_ps(length2, _mm_mul_ps(q[c], q[c]));
+      __m128 scale = rsqrt(length2);
+      for(uint32_t c = 0; c < 4; ++c)
+        q[c] = _mm_mul_ps(q[c], scale);
+      _MM_TRANSPOSE4_PS(q[0], q[1], q[2], q[3]);
+
+      for(uint32_t l = 0; l < lanes; ++l)
+        store(graph, graph->rotation, track[l]->slot, q[l]);
+    }
+  }
+
+  // glTF's cubic Hermite spline: the tangents are per second, so they are scaled by the keys' span
+  static void sample_cubic(const Animator *a, uint32_t begin, uint32_t end, float *out, bool normalize, SceneGraph *graph) {
+    for(uint32_t i = begin; i < end; ++i) {
+      const Animator::Track *track = &a->tracks[i];
+      const float *v = track->values + a->key[track->timeline] * 12; // in tangent, value, out tangent
+      float t = a->t[track->timeline];
+      float t2 = t * t;
+      float t3 = t2 * t;
+      float d = a->span[track->timeline];
+      __m128 p = _mm_mul_ps(_mm_load_ps(v + 4), _mm_set1_ps(2.0f * t3 - 3.0f * t2 + 1.0f));
+      p = _mm_add_ps(p, _mm_mul_ps(_mm_load_ps(v + 8), _mm_set1_ps((t3 - 2.0f * t2 + t) * d)));
+      p = _mm_add_ps(p, _mm_mul_ps(_mm_load_ps(v + 16), _mm_set1_ps(-2.0f * t3 + 3.0f * t2)));
+      p = _mm_add_ps(p, _mm_mul_ps(_mm_load_ps(v + 12), _mm_set1_ps((t3 - t2) * d)));
+      if (normalize) {
+        __m128 sq = _mm_mul_ps(p, p);
+        sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+        sq = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 0, 3, 2)));
+        p = _mm_mul_ps(p, rsqrt(sq));
+      }
+      store(graph, out, track->slot, p);
+    }
+  }
+
+  // As glTF has it, a mesh's primitives all have the same number of targets; its default weights say so too
+  static uint32_t morph_target_count(const Scene *scene, uint32_t node) {
+    int32_t mesh = scene->nodes[node].mesh;
+    if (mesh < 0)
+      return 0;
+    const Scene::Mesh *m = &scene->meshes[mesh];
+    return m->primitives.count ? (uint32_t)m->primitives[0].targets.count : (uint32_t)m->weights.count;
+  }
+
+  /*
+   * The animation's WEIGHTS channels, decoded as they are, a timeline each: they are few and their
+   * keys wide, so the kernels are scalar loops over a key's weights.
+   */
+  static void init_weights(Animator *a, const Scene *scene, uint32_t animation) {
+    a->weight_tracks = nullptr;
+    a->weight_track_count = 0;
+    a->weight_keys = nullptr;
+    a->weights = nullptr;
+    const Scene::Animation *anim = &scene->animations[animation];
+    uint32_t channel_count = (uint32_t)anim->channels.count;
+    uint32_t *channels = (uint32_t*)mem_alloca(sizeof(uint32_t) * (channel_count ? channel_count : 1), 16);
+    if (!channels) {
+      print_err("Animator: out of memory for the weight channels of animation {}\n", animation);
+      return;
+    }
+    uint32_t count = 0;
+    size_t key_floats = 0;
+    uint32_t weight_count = 0;
+    for(uint32_t i = 0; i < channel_count; ++i) {
+      const Scene::Animation::Channel *channel = &anim->channels[i];
+      if (channel->path != Scene::Animation::WEIGHTS)
+        continue;
+      const Scene::Animation::Sampler *sampler = &anim->samplers[channel->sampler];
+      const Scene::Accessor *input = &scene->accessors[sampler->input];
+      const Scene::Accessor *output = &scene->accessors[sampler->output];
+      uint32_t per_key = sampler->interpolation == Scene::Animation::CUBICSPLINE ? 3 : 1;
+      uint32_t targets = morph_target_count(scene, channel->node);
+      if (!targets || input->type != Scene::SCALAR || output->type != Scene::SCALAR || input->count == 0 ||
+          output->count != (uint64_t)input->count * per_key * targets)
+      {
+        print_err("Animator: weight channel {} of animation {} has accessors {} and {} for {} targets\n", i, animation,
+            sampler->input, sampler->output, targets);
+        continue;
+      }
+      uint32_t keys_used = input->count < 2 ? 2 : (uint32_t)input->count;
+      key_floats += memory_align(keys_used, 4) + (size_t)keys_used * per_key * targets;
+      weight_count += targets;
+      channels[count++] = i;
+    }
+    if (!count) {
+      mem_free(channels);
+      return;
+    }
+
+    a->weight_tracks = (Animator::WeightTrack*)mem_alloca(sizeof(Animator::WeightTrack) * count, 16);
+    a->weight_keys = (float*)mem_alloca(sizeof(float) * key_floats, 16);
+    a->weights = (float*)mem_alloca(sizeof(float) * weight_count, 16);
+    bool ok = a->weight_tracks && a->weight_keys && a->weights;
+    float *next = a->weight_keys;
+    uint32_t offset = 0;
+    for(uint32_t c = 0; ok && c < count; ++c) {
+      const Scene::Animation::Channel *channel = &anim->channels[channels[c]];
+      const Scene::Animation::Sampler *sampler = &anim->samplers[channel->sampler];
+      const Scene::Accessor *input = &scene->accessors[sampler->input];
+      const Scene::Accessor *output = &scene->accessors[sampler->output];
+      float *times = (float*)mem_alloca(sizeof(float) * input->count, 16);
+      float *values = (float*)mem_alloca(sizeof(float) * output->count, 16);
+      ok = times && values;
+      if (ok) {
+        AccessorView view = scene->accessor_view(sampler->input);
+        Decode::floats(&view, times);
+        view = scene->accessor_view(sampler->output);
+        Decode::floats(&view, values);
+
+        Animator::WeightTrack *track = &a->weight_tracks[c];
+        uint32_t key_count = (uint32_t)input->count;
+        uint32_t keys_used = key_count < 2 ? 2 : key_count;
+        uint32_t per_key = sampler->interpolation == Scene::Animation::CUBICSPLINE ? 3 : 1;
+        uint32_t targets = morph_target_count(scene, channel->node);
+        for(uint32_t k = 0; k < keys_used; ++k)
+          next[k] = times[k < key_count ? k : 0];
+        track->timeline = { next, keys_used, 0 };
+        a->duration = next[keys_used - 1] > a->duration ? next[keys_used - 1] : a->duration;
+        next += memory_align(keys_used, 4);
+        uint32_t value_count = key_count * per_key * targets;
+        for(uint32_t e = 0; e < keys_used * per_key * targets; ++e)
+          next[e] = values[e % value_count];
+        track->values = next;
+        track->interpolation = sampler->interpolation;
+        track->node = channel->node;
+        track->count = targets;
+        track->offset = offset;
+        // The first key's value until the first sample()
+        memcpy(a->weights + offset, next + (per_key == 3 ? targets : 0), sizeof(float) * targets);
+        next += keys_used * per_key * targets;
+        offset += targets;
+      }
+      mem_free(values);
+      mem_free(times);
+    }
+    mem_free(channels);
+    if (!ok) {
+      print_err("Animator: out of memory for the weight tracks of animation {}, they are not played\n", animation);
+      mem_free(a->weights);
+      mem_free(a->weight_keys);
+      mem_free(a->weight_tracks);
+      a->weight_tracks = nullptr;
+      a->weight_keys = nullptr;
+      a->weights = nullptr;
+      return;
+    }
+    a->weight_track_count = count;
+  }
+
+  // sample_step, sample_linear and sample_cubic over one track's weights
+  static void sample_weights(Animator::WeightTrack *track, float time, float *out) {
+    uint32_t k;
+    float t, d;
+    locate(&track->timeline, time, &k, &t, &d);
+    uint32_t n = track->count;
+    if (track->interpolation == Scene::Animation::STEP) {
+      memcpy(out, track->values + (k + (t >= 1.0f)) * n, sizeof(float) * n);
+    } else if (track->interpolation == Scene::Animation::LINEAR) {
+      const float *v0 = track->values + k * n;
+      const float *v1 = v0 + n;
+      for(uint32_t i = 0; i < n; ++i)
+        out[i] = v0[i] + (v1[i] - v0[i]) * t;
+    } else {
+      const float *v = track->values + k * 3 * n; // in tangents, values, out tangents, then the next key's
+      float t2 = t * t;
+      float t3 = t2 * t;
+      float h00 = 2.0f * t3 - 3.0f * t2 + 1.0f;
+      float h10 = (t3 - 2.0f * t2 + t) * d;
+      float h01 = -2.0f * t3 + 3.0f * t2;
+      float h11 = (t3 - t2) * d;
+      for(uint32_t i = 0; i < n; ++i)
+        out[i] = v[n + i] * h00 + v[2 * n + i] * h10 + v[4 * n + i] * h01 + v[3 * n + i] * h11;
+    }
+  }
+}
+
+// Keys are decoded once an accessor, as a node's channels usually share their input
+bool Animator::init(const Scene *scene, uint32_t animation, const SceneGraph *graph, bool compressed) {
+  if (animation >= scene->animations.count) {
+    print_err("Animator: no animation {}, the scene has {}\n", animation, (uint64_t)scene->animations.count);
+    return false;
+  }
+  const Scene::Animation *anim = &scene->animations[animation];
+  if (compressed) {
+    if (!init(anim->clip_tracks.data(), (uint32_t)anim->clip_tracks.count, anim->clip_keys.data(),
+        (uint32_t)anim->clip_keys.count, anim->duration, graph))
+      return false;
+    init_weights(this, scene, animation);
+    return true;
+  }
+  uint32_t accessor_count = (uint32_t)scene->accessors.count;
+  float **decoded = (float**)mem_alloca(sizeof(float*) * (accessor_count ? accessor_count : 1), 8);
+  memset(decoded, 0, sizeof(float*) * accessor_count);
+  uint32_t channel_count = (uint32_t)anim->channels.count;
+  AnimationTrack *list = (AnimationTrack*)mem_alloca(sizeof(AnimationTrack) * (channel_count ? channel_count : 1), 8);
+
+  uint32_t count = 0;
+  for(uint32_t i = 0; i < channel_count; ++i) {
+    const Scene::Animation::Channel *channel = &anim->channels[i];
+    const Scene::Animation::Sampler *sampler = &anim->samplers[channel->sampler];
+    if (channel->path == Scene::Animation::WEIGHTS)
+      continue;
+    if (channel->node >= graph->node_count || graph->slot[channel->node] == UINT32_MAX)
+      continue;
+
+    const Scene::Accessor *input = &scene->accessors[sampler->input];
+    const Scene::Accessor *output = &scene->accessors[sampler->output];
+    uint32_t per_key = sampler->interpolation == Scene::Animation::CUBICSPLINE ? 3 : 1;
+    Scene::Type type = channel->path == Scene::Animation::ROTATION ? Scene::VEC4 : Scene::VEC3;
+    if (input->type != Scene::SCALAR || output->type != type || input->count == 0 ||
+        output->count != input->count * per_key)
+    {
+      print_err("Animator: channel {} of animation {} has mismatched accessors {} and {}\n", i, animation,
+          sampler->input, sampler->output);
+      continue;
+    }
+    uint32_t accessors[2] = { sampler->input, sampler->output };
+    for(uint32_t a = 0; a < 2; ++a) {
+      if (decoded[accessors[a]])
+        continue;
+      const Scene::Accessor *acc = &scene->accessors[accessors[a]];
+      decoded[accessors[a]] = (float*)mem_alloca(sizeof(float) * acc->count * acc->components, 16);
+      AccessorView view = scene->accessor_view(accessors[a]);
+      Decode::floats(&view, decoded[accessors[a]]);
+    }
+    list[count++] = { graph->slot[channel->node], channel->path, sampler->interpolation, input->count,
+        decoded[sampler->input], decoded[sampler->output] };
+  }
+
+  bool ok = init(list, count);
+  for(uint32_t i = 0; i < accessor_count; ++i)
+    if (decoded[i])
+      mem_free(decoded[i]);
+  mem_free(list);
+  mem_free(decoded);
+  if (ok)
+    init_weights(this, scene, animation);
+  return ok;
+}
+
+/*
+ * Tracks with the same 'times' pointer and key count share a timeline, found with a small open
+ * addressed table on the pointer, so a node's channels (or a whole clip baked at one rate) are
+ * located once a frame rather than once a channel.
+ */
+bool Animator::init(const AnimationTrack *tracks_, uint32_t track_count_) {
+  for(uint32_t i = 0; i < track_count_; ++i) {
+    const AnimationTrack *src = &tracks_[i];
+    if (src->path > Scene::Animation::SCALE || src->interpolation > Scene::Animation::CUBICSPLINE || !src->key_count) {
+      print_err("Animator: track {} has path {}, interpolation {} and {} keys\n", i, src->path,
+          src->interpolation, src->key_count);
+      return false;
+    }
+  }
+
+  uint32_t alloc_count = track_count_ ? track_count_ : 1;
+  uint32_t table_size = 16;
+  while (table_size < alloc_count * 2)
+    table_size *= 2;
+  uint32_t *table = (uint32_t*)mem_alloca(sizeof(uint32_t) * table_size, 16); // Timeline + 1, 0 if empty
+  uint32_t *track_timeline = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+  uint32_t *first_track = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16); // Of each timeline
+  memset(table, 0, sizeof(uint32_t) * table_size);
+  timeline_count = 0;
+  size_t key_floats = 0;
+  for(uint32_t i = 0; i < track_count_; ++i) {
+    const AnimationTrack *src = &tracks_[i];
+    uint32_t h = (uint32_t)(((uint64_t)(uintptr_t)src->times * 0x9e3779b97f4a7c15ull) >> 32) & (table_size - 1);
+    for(;; h = (h + 1) & (table_size - 1)) {
+      uint32_t tl = table[h];
+      if (!tl) {
+        table[h] = ++timeline_count;
+        first_track[timeline_count - 1] = i;
+        key_floats += memory_align(src->key_count < 2 ? 2 : src->key_count, 4);
+        break;
+      }
+      const AnimationTrack *other = &tracks_[first_track[tl - 1]];
+      if (other->times == src->times && other->key_count == src->key_count)
+        break;
+    }
+    track_timeline[i] = table[h] - 1;
+    uint32_t per_key = src->interpolation == Scene::Animation::CUBICSPLINE ? 3 : 1;
+    key_floats += (size_t)(src->key_count < 2 ? 2 : src->key_count) * per_key * 4;
+  }
+
+  clip_tracks = nullptr;
+  clip_keys = nullptr;
+  clip_key_count = 0;
+  clip_duration = 0.0f;
+  weight_tracks = nullptr;
+  weight_track_count = 0;
+  weight_keys = nullptr;
+  weights = nullptr;
+  track_count = track_count_;
+  tracks = (Track*)mem_alloca(sizeof(Track) * alloc_count, 16);
+  timelines = (Timeline*)mem_alloca(sizeof(Timeline) * (timeline_count ? timeline_count : 1), 16);
+  key = (uint32_t*)mem_alloca(sizeof(uint32_t) * (timeline_count ? timeline_count : 1), 16);
+  t = (float*)mem_alloca(sizeof(float) * (timeline_count ? timeline_count : 1), 16);
+  span = (float*)mem_alloca(sizeof(float) * (timeline_count ? timeline_count : 1), 16);
+  keys = (float*)mem_alloca(sizeof(float) * (key_floats ? key_floats : 4), 16);
+  duration = 0.0f;
+  slerp = false;
+
+  float *next = keys;
+  for(uint32_t tl = 0; tl < timeline_count; ++tl) {
+    const AnimationTrack *src = &tracks_[first_track[tl]];
+    uint32_t keys_used = src->key_count < 2 ? 2 : src->key_count;
+    for(uint32_t k = 0; k < keys_used; ++k)
+      next[k] = src->times[k < src->key_count ? k : 0];
+    timelines[tl] = { next, keys_used, 0 };
+    duration = next[keys_used - 1] > duration ? next[keys_used - 1] : duration;
+    next += memory_align(keys_used, 4);
+  }
+
+  // Values in the order the kernels visit them
+  uint32_t *order = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+  order_tracks(tracks_, track_count, runs, order);
+  for(uint32_t i = 0; i < track_count; ++i) {
+    const AnimationTrack *src = &tracks_[order[i]];
+    Track *track = &tracks[i];
+    uint32_t keys_used = src->key_count < 2 ? 2 : src->key_count;
+    uint32_t per_key = src->interpolation == Scene::Animation::CUBICSPLINE ? 3 : 1;
+    uint32_t components = path_components(src->path);
+    track->values = next;
+    track->timeline = track_timeline[order[i]];
+    track->slot = src->slot;
+    for(uint32_t e = 0; e < keys_used * per_key; ++e) {
+      const float *v = src->values + (e % (src->key_count * per_key)) * components;
+      next[0] = v[0];
+      next[1] = v[1];
+      next[2] = v[2];
+      next[3] = components == 4 ? v[3] : 0.0f;
+      next += 4;
+    }
+  }
+  mem_free(order);
+  mem_free(first_track);
+  mem_free(track_timeline);
+  mem_free(table);
+  return true;
+}
+
+/*
+ * A timeline a clip track, whose two keys are the window the stream fills; tracks whose node the
+ * graph does not reach still stream, so the windows keep up, but are not sampled.
+ */
+bool Animator::init(const ClipTrack *clip_tracks_, uint32_t clip_track_count, const ClipKey *clip_keys_,
+    uint32_t clip_key_count_, float duration_, const SceneGraph *graph)
+{
+  if (clip_key_count_ < (uint64_t)clip_track_count * 2) {
+    print_err("Animator: {} clip keys cannot start {} tracks\n", clip_key_count_, clip_track_count);
+    return false;
+  }
+  AnimationTrack *list = (AnimationTrack*)mem_alloca(sizeof(AnimationTrack) * (clip_track_count ? clip_track_count : 1), 8);
+  uint32_t *source = (uint32_t*)mem_alloca(sizeof(uint32_t) * (clip_track_count ? clip_track_count : 1), 16);
+  uint32_t count = 0;
+  for(uint32_t i = 0; i < clip_track_count; ++i) {
+    const ClipTrack *src = &clip_tracks_[i];
+    if (src->node >= graph->node_count || graph->slot[src->node] == UINT32_MAX)
+      continue;
+    list[count] = { graph->slot[src->node], src->path, src->interpolation, 2, nullptr, nullptr };
+    source[count++] = i;
+  }
+  uint32_t *order = (uint32_t*)mem_alloca(sizeof(uint32_t) * (count ? count : 1), 16);
+  order_tracks(list, count, runs, order);
+
+  clip_tracks = clip_tracks_;
+  clip_keys = clip_keys_;
+  clip_key_count = clip_key_count_;
+  track_count = count;
+  timeline_count = clip_track_count;
+  uint32_t alloc_count = clip_track_count ? clip_track_count : 1;
+  tracks = (Track*)mem_alloca(sizeof(Track) * alloc_count, 16);
+  timelines = (Timeline*)mem_alloca(sizeof(Timeline) * alloc_count, 16);
+  key = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+  t = (float*)mem_alloca(sizeof(float) * alloc_count, 16);
+  span = (float*)mem_alloca(sizeof(float) * alloc_count, 16);
+  keys = (float*)mem_alloca(sizeof(float) * 12 * alloc_count, 16);
+  memset(keys, 0, sizeof(float) * 12 * alloc_count);
+  duration = duration_;
+  clip_duration = duration_;
+  slerp = false;
+  weight_tracks = nullptr;
+  weight_track_count = 0;
+  weight_keys = nullptr;
+  weights = nullptr;
+  for(uint32_t i = 0; i < clip_track_count; ++i)
+    timelines[i] = { window_times(this, i), 2, 0 };
+  for(uint32_t i = 0; i < count; ++i) {
+    uint32_t clip_track = source[order[i]];
+    tracks[i] = { window_values(this, clip_track), clip_track, list[order[i]].slot };
+  }
+  rewind(this);
+  stream_time = 0.0f;
+
+  mem_free(order);
+  mem_free(source);
+  mem_free(list);
+  return true;
+}
+
+void Animator::kill() {
+  mem_free(weights);
+  mem_free(weight_keys);
+  mem_free(weight_tracks);
+  mem_free(keys);
+  mem_free(span);
+  mem_free(t);
+  mem_free(key);
+  mem_free(timelines);
+  mem_free(tracks);
+}
+
+void Animator::sample(float time, SceneGraph *graph) {
+  if (clip_tracks)
+    advance(this, time);
+  for(uint32_t i = 0; i < timeline_count; ++i)
+    locate(&timelines[i], time, &key[i], &t[i], &span[i]);
+
+  float *outputs[3] = { graph->translation, graph->rotation, graph->scale };
+  for(uint32_t path = 0; path < 3; ++path) {
+    uint32_t r = run_index(path, 0);
+    if (path == Scene::Animation::ROTATION)
+      sample_rotations(this, runs[r], runs[r + 1], graph);
+    else
+      sample_linear(this, runs[r], runs[r + 1], outputs[path], graph);
+    r = run_index(path, Scene::Animation::STEP);
+    sample_step(this, runs[r], runs[r + 1], outputs[path], graph);
+    r = run_index(path, Scene::Animation::CUBICSPLINE);
+    sample_cubic(this, runs[r], runs[r + 1], outputs[path], path == Scene::Animation::ROTATION, graph);
+  }
+  for(uint32_t i = 0; i < weight_track_count; ++i)
+    sample_weights(&weight_tracks[i], time, weights + weight_tracks[i].offset);
+}
+
+const float* Animator::node_weights(uint32_t node, uint32_t *count) const {
+  for(uint32_t i = 0; i < weight_track_count; ++i)
+    if (weight_tracks[i].node == node) {
+      *count = weight_tracks[i].count;
+      return weights + weight_tracks[i].offset;
+    }
+  *count = 0;
+  return nullptr;
+}
+
+} // namespace Sol
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Sol {
+
+struct Scene;
+struct SceneGraph;
+struct ClipTrack;
+struct ClipKey;
+
+// One channel, for Animator::init: its keys and the SceneGraph slot and transform part it drives
+struct AnimationTrack {
+  uint32_t slot;
+  uint32_t path;          // Scene::Animation::Path, but not WEIGHTS (see Animator::WeightTrack)
+  uint32_t interpolation; // Scene::Animation::Interpolation
+  uint32_t key_count;     // At least 1
+  const float *times;     // Increasing, in seconds
+  const float *values;    // Packed vec3s (translation, scale) or xyzw quaternions; three a key for
+                          // CUBICSPLINE, as in glTF: in tangent, value, out tangent
+};
+
+/*
+ * Samples one animation's channels into a SceneGraph's local transforms. Keys are decoded once, at
+ * init, to floats with 4 a value (so each is one aligned SSE load), and channels are sorted into one
+ * run per path and interpolation, so sample() runs each kernel over a run with no per channel branching.
+ *
+ * Tracks that share their times share a timeline, which keeps the key it last sampled: playing
+ * forward only ever steps a key or two, and a jump (or a loop back to the start) falls back to a
+ * binary search. Rotations are interpolated four tracks at a time, transposed to xxxx/yyyy/zzzz/wwww:
+ * nlerp by default, slerp if 'slerp' is set.
+ *
+ * A compressed clip (Clip.hpp) is decoded as it plays instead: each track is its own two key timeline,
+ * a window that sample() refills from the key stream, so only the keys that came due since the last
+ * frame are dequantized. Going back in time replays the stream from the start.
+ *
+ * Morph target weights are not in clips, so they come from the animation's WEIGHTS channels whichever
+ * way the transforms play: a track a node, a key its morph target count of floats, sampled into
+ * 'weights' for node_weights() to hand to Morph::blend.
+ */
+struct Animator {
+  // Times shared by tracks
+  struct Timeline {
+    const float *times;
+    uint32_t key_count; // At least 2: a single key is doubled
+    uint32_t cursor;    // The key at or before the last sampled time
+  };
+  struct Track {
+    const float *values; // 4 floats a value, 16 byte aligned
+    uint32_t timeline;
+    uint32_t slot;
+  };
+  struct WeightTrack {
+    Timeline timeline;
+    const float *values;    // 'count' floats a key, three times that for CUBICSPLINE
+    uint32_t interpolation;
+    uint32_t node;          // In the scene, as Morph::default_weights takes it
+    uint32_t count;         // The node's morph targets
+    uint32_t offset;        // Into 'weights'
+  };
+  static const uint32_t RUN_COUNT = 9; // Path (translation, rotation, scale) * interpolation
+
+  Track *tracks;
+  uint32_t track_count;
+  uint32_t runs[RUN_COUNT + 1]; // Run r is tracks [runs[r], runs[r + 1])
+  Timeline *timelines;
+  uint32_t timeline_count;
+  float *keys;   // Every timeline's times and track's values
+  uint32_t *key; // Per timeline, where sample() found 'time'...
+  float *t;      // ...how far it is to the next key, 0 to 1...
+  float *span;   // ...and the seconds between the two keys (for the cubic tangents)
+  float duration;
+  bool slerp;
+  // The clip being streamed, not owned; nullptr for uncompressed tracks
+  const ClipTrack *clip_tracks;
+  const ClipKey *clip_keys;
+  uint32_t clip_key_count;
+  uint32_t stream;   // The next key to read
+  float stream_time; // Of the last sample(), to notice a jump back
+  float clip_duration; // What the clip's key times are quantized over; 'duration' may run past it for the weights
+  WeightTrack *weight_tracks;
+  uint32_t weight_track_count;
+  float *weight_keys;  // Every weight track's times and values
+  float *weights;      // Every weight track's, as sample() left them
+
+  /*
+   * The tracks of 'scene->animations[animation]' that target a node of 'graph': its compressed clip,
+   * or with 'compressed' false its channels as they are. Channels whose accessors do not match the glTF
+   * rules (a scalar input, an output of vec3s or vec4s with a value, or three for CUBICSPLINE, a key)
+   * are left out, printing why. WEIGHTS channels need a scalar output of the node's morph target
+   * count a key (three times that for CUBICSPLINE); out of memory for them, the transforms still play.
+   */
+  bool init(const Scene *scene, uint32_t animation, const SceneGraph *graph, bool compressed = true);
+  // Neither of these has weight tracks
+  bool init(const AnimationTrack *tracks_, uint32_t track_count_);
+  // A clip from Clips::compress, which must outlive the Animator
+  bool init(const ClipTrack *clip_tracks_, uint32_t clip_track_count, const ClipKey *clip_keys_,
+      uint32_t clip_key_count_, float duration_, const SceneGraph *graph);
+  void kill();
+
+  // Times before the first key hold the first value, times after the last the last: wrap 'time' by 'duration' to loop
+  void sample(float time, SceneGraph *graph);
+  // The weights a track drives 'node' to, as of the last sample(); nullptr and 0 if none does
+  const float* node_weights(uint32_t node, uint32_t *count) const;
+};
+
+} // namespace Sol
@@ -9,7 +9,7 @@ struct Array {
   T* mem = nullptr;
   size_t cap = 0;
   size_t len = 0;
-  Allocator *alloc = &MemoryService::instance()->scratch_allocator;
+  Allocator *alloc = MemoryService::scratch();
   
 void init(size_t size, size_t alignment) {
   cap = size;
@@ -0,0 +1,415 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#include "AsyncIO.hpp"
+#include "Threads.hpp"
+#include "VulkanErrors.hpp"
+
+#if defined(IORING_OFF_SQ_RING) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define SOL_HAS_URING 1
+#else
+#define SOL_HAS_URING 0
+#endif
+
+namespace Sol {
+
+static AsyncIO GlobalAsyncIO;
+AsyncIO* AsyncIO::instance() { return &GlobalAsyncIO; }
+
+namespace {
+  // Linux will not transfer more than this in one read
+  static const size_t MAX_READ = 0x7ffff000;
+
+  static int open_for_read(const IoRequest *req) {
+    int fd = open(req->path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0)
+      posix_fadvise(fd, (off_t)req->offset, (off_t)req->length, POSIX_FADV_WILLNEED);
+    return fd;
+  }
+}
+
+// *Init /////////////////////////
+void AsyncIO::init(uint32_t queue_depth, bool force_threads) {
+  depth = 1;
+  while (depth < queue_depth)
+    depth <<= 1;
+
+  slots = (Slot*)mem_alloca(sizeof(Slot) * depth, 8);
+  free_slots = (uint32_t*)mem_alloca(sizeof(uint32_t) * depth, 4);
+  done_ring = (uint32_t*)mem_alloca(sizeof(uint32_t) * depth, 4);
+  for(uint32_t i = 0; i < depth; ++i) {
+    slots[i] = Slot();
+    free_slots[i] = depth - 1 - i;
+  }
+  free_count = depth;
+  done_head = 0;
+  done_tail = 0;
+  backlog.init(depth);
+  backlog_head = 0;
+
+  use_uring = !force_threads && init_uring();
+  print("AsyncIO initialized, depth {}, backend: {}\n", depth, use_uring ? "io_uring" : "thread pool");
+}
+void AsyncIO::kill() {
+  while (pending())
+    wait(nullptr, 0, 1);
+
+  unregister_buffer();
+  if (use_uring)
+    kill_uring();
+  backlog.kill();
+  mem_free(done_ring);
+  mem_free(free_slots);
+  mem_free(slots);
+}
+
+bool AsyncIO::init_uring() {
+#if SOL_HAS_URING
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = (int)syscall(__NR_io_uring_setup, depth, &params);
+  if (fd < 0)
+    return false; // Old kernel, or disabled by seccomp (containers...)
+
+  // IORING_OP_READ arrived with the same kernel (5.6) as this feature bit
+  if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+    close(fd);
+    return false;
+  }
+
+  uring.fd = fd;
+  uring.sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  uring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    if (uring.cq_size > uring.sq_size)
+      uring.sq_size = uring.cq_size;
+    uring.cq_size = uring.sq_size;
+  }
+
+  uring.sq_ptr = mmap(nullptr, uring.sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (uring.sq_ptr == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  if (single_mmap) {
+    uring.cq_ptr = uring.sq_ptr;
+  } else {
+    uring.cq_ptr = mmap(nullptr, uring.cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (uring.cq_ptr == MAP_FAILED) {
+      munmap(uring.sq_ptr, uring.sq_size);
+      close(fd);
+      return false;
+    }
+  }
+  uring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  uring.sqes = mmap(nullptr, uring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (uring.sqes == MAP_FAILED) {
+    if (!single_mmap)
+      munmap(uring.cq_ptr, uring.cq_size);
+    munmap(uring.sq_ptr, uring.sq_size);
+    close(fd);
+    return false;
+  }
+
+  uint8_t *sq = (uint8_t*)uring.sq_ptr;
+  uring.sq_head = (uint32_t*)(sq + params.sq_off.head);
+  uring.sq_tail = (uint32_t*)(sq + params.sq_off.tail);
+  uring.sq_mask = (uint32_t*)(sq + params.sq_off.ring_mask);
+  uring.sq_array = (uint32_t*)(sq + params.sq_off.array);
+  uint8_t *cq = (uint8_t*)uring.cq_ptr;
+  uring.cq_head = (uint32_t*)(cq + params.cq_off.head);
+  uring.cq_tail = (uint32_t*)(cq + params.cq_off.tail);
+  uring.cq_mask = (uint32_t*)(cq + params.cq_off.ring_mask);
+  uring.cqes = (void*)(cq + params.cq_off.cqes);
+  uring.to_submit = 0;
+  return true;
+#else
+  return false;
+#endif
+}
+void AsyncIO::kill_uring() {
+#if SOL_HAS_URING
+  munmap(uring.sqes, uring.sqes_size);
+  if (uring.cq_ptr != uring.sq_ptr)
+    munmap(uring.cq_ptr, uring.cq_size);
+  munmap(uring.sq_ptr, uring.sq_size);
+  close(uring.fd);
+  uring.fd = -1;
+#endif
+}
+
+bool AsyncIO::register_buffer(void *base, size_t size) {
+#if SOL_HAS_URING && defined(__NR_io_uring_register)
+  unregister_buffer();
+  if (!use_uring || size > 1024 * 1024 * 1024) // Kernel limit per registered buffer
+    return false;
+
+  struct iovec iov = { base, size };
+  long res = syscall(__NR_io_uring_register, uring.fd, IORING_REGISTER_BUFFERS, &iov, 1);
+  if (res < 0)
+    return false;
+  fixed_base = (uint8_t*)base;
+  fixed_size = size;
+  return true;
+#else
+  return false;
+#endif
+}
+void AsyncIO::unregister_buffer() {
+#if SOL_HAS_URING && defined(__NR_io_uring_register)
+  if (!fixed_base)
+    return;
+  while (pending())
+    wait(nullptr, 0, 1);
+  syscall(__NR_io_uring_register, uring.fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+  fixed_base = nullptr;
+  fixed_size = 0;
+#endif
+}
+
+// *Submit ///////////////////////
+void AsyncIO::submit(const IoRequest *reqs, uint32_t count) {
+  for(uint32_t i = 0; i < count; ++i) {
+    if (free_count && backlog_head == backlog.length)
+      start(&reqs[i]);
+    else
+      backlog.push(reqs[i]);
+  }
+  if (use_uring)
+    flush_uring(0);
+}
+void AsyncIO::start(const IoRequest *req) {
+  uint32_t index = free_slots[--free_count];
+  Slot *slot = &slots[index];
+  slot->req = *req;
+  slot->done = 0;
+  slot->result = 0;
+  slot->fd = -1;
+
+  if (use_uring) {
+    start_uring(index);
+  } else {
+    ThreadPool::instance()->submit(read_task, slot, nullptr);
+  }
+}
+void AsyncIO::fill_from_backlog() {
+  while (free_count && backlog_head < backlog.length) {
+    start(&backlog[backlog_head]);
+    ++backlog_head;
+  }
+  if (backlog_head == backlog.length) {
+    backlog.length = 0;
+    backlog_head = 0;
+  }
+}
+void AsyncIO::finish(uint32_t index) {
+  Slot *slot = &slots[index];
+  if (slot->fd >= 0) {
+    close(slot->fd);
+    slot->fd = -1;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done_ring[done_tail & (depth - 1)] = index;
+    ++done_tail;
+  }
+  cond.notify_one();
+}
+
+// *Thread pool backend //////////
+void AsyncIO::read_task(void *arg) {
+  AsyncIO *io = AsyncIO::instance();
+  Slot *slot = (Slot*)arg;
+  const IoRequest *req = &slot->req;
+
+  int fd = open_for_read(req);
+  if (fd < 0) {
+    slot->result = -errno;
+  } else {
+    uint8_t *dst = (uint8_t*)req->dst;
+    while (slot->done < req->length) {
+      size_t count = req->length - slot->done;
+      ssize_t res = pread(fd, dst + slot->done, count < MAX_READ ? count : MAX_READ, (off_t)(req->offset + slot->done));
+      if (res < 0 && errno == EINTR)
+        continue;
+      if (res < 0) {
+        slot->result = -errno;
+        break;
+      }
+      if (res == 0)
+        break; // EOF
+      slot->done += (size_t)res;
+    }
+    if (slot->result == 0)
+      slot->result = (int64_t)slot->done;
+    close(fd);
+  }
+  io->finish((uint32_t)(slot - io->slots));
+}
+
+// *io_uring backend /////////////
+void AsyncIO::start_uring(uint32_t index) {
+  Slot *slot = &slots[index];
+  slot->fd = open_for_read(&slot->req);
+  if (slot->fd < 0) {
+    slot->result = -errno;
+    finish(index);
+    return;
+  }
+  if (slot->req.length == 0) {
+    finish(index);
+    return;
+  }
+  push_uring_read(index);
+}
+void AsyncIO::push_uring_read(uint32_t index) {
+#if SOL_HAS_URING
+  Slot *slot = &slots[index];
+  size_t count = slot->req.length - slot->done;
+
+  // Only this thread produces sqes, the kernel only moves the head
+  uint32_t tail = *uring.sq_tail;
+  uint32_t sq_index = tail & *uring.sq_mask;
+  io_uring_sqe *sqe = &((io_uring_sqe*)uring.sqes)[sq_index];
+  memset(sqe, 0, sizeof(*sqe));
+  uint8_t *dst = (uint8_t*)slot->req.dst + slot->done;
+  uint32_t len = (uint32_t)(count < MAX_READ ? count : MAX_READ);
+  bool fixed = fixed_base && dst >= fixed_base && dst + len <= fixed_base + fixed_size;
+  sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe->buf_index = 0;
+  sqe->fd = slot->fd;
+  sqe->addr = (uint64_t)(uintptr_t)dst;
+  sqe->len = len;
+  sqe->off = slot->req.offset + slot->done;
+  sqe->user_data = index;
+  uring.sq_array[sq_index] = sq_index;
+  __atomic_store_n(uring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++uring.to_submit;
+#endif
+}
+void AsyncIO::flush_uring(uint32_t min_complete) {
+#if SOL_HAS_URING
+  if (uring.to_submit || min_complete) {
+    uint32_t flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    for(;;) {
+      long res = syscall(__NR_io_uring_enter, uring.fd, uring.to_submit, min_complete, flags, nullptr, 0);
+      if (res < 0 && errno == EINTR)
+        continue;
+      ABORT(res >= 0, "AsyncIO: io_uring_enter failed");
+      uring.to_submit -= (uint32_t)res;
+      break;
+    }
+  }
+  reap_uring();
+#endif
+}
+void AsyncIO::reap_uring() {
+#if SOL_HAS_URING
+  uint32_t head = *uring.cq_head;
+  uint32_t tail = __atomic_load_n(uring.cq_tail, __ATOMIC_ACQUIRE);
+  io_uring_cqe *cqes = (io_uring_cqe*)uring.cqes;
+
+  while (head != tail) {
+    io_uring_cqe *cqe = &cqes[head & *uring.cq_mask];
+    uint32_t index = (uint32_t)cqe->user_data;
+    int32_t res = cqe->res;
+    ++head;
+
+    Slot *slot = &slots[index];
+    if (res == -EAGAIN || res == -EINTR) {
+      push_uring_read(index);
+    } else if (res < 0) {
+      slot->result = res;
+      finish(index);
+    } else {
+      slot->done += (size_t)res;
+      if (res > 0 && slot->done < slot->req.length) {
+        push_uring_read(index); // Short read, go again for the rest
+      } else {
+        slot->result = (int64_t)slot->done;
+        finish(index);
+      }
+    }
+  }
+  __atomic_store_n(uring.cq_head, head, __ATOMIC_RELEASE);
+#endif
+}
+
+// *Completion ///////////////////
+size_t AsyncIO::pending() {
+  return (depth - free_count) + (backlog.length - backlog_head);
+}
+
+uint32_t AsyncIO::poll(IoCompletion *out, uint32_t max) {
+  uint32_t written = 0;
+  handle_completions(out, max, &written);
+  return written;
+}
+
+// Returns how many were handled, callbacks included, which a callback submitting more cannot skew as pending() would
+uint32_t AsyncIO::handle_completions(IoCompletion *out, uint32_t max, uint32_t *written_out) {
+  if (use_uring)
+    flush_uring(0);
+
+  uint32_t written = 0;
+  uint32_t handled = 0;
+  while (handled < max) {
+    uint32_t index;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (done_head == done_tail)
+        break;
+      index = done_ring[done_head & (depth - 1)];
+      ++done_head;
+    }
+
+    Slot *slot = &slots[index];
+    IoCompletion completion = { slot->req.user_data, slot->result };
+    IoCallback callback = slot->req.callback;
+    free_slots[free_count++] = index;
+    ++handled;
+
+    if (callback)
+      callback(&completion);
+    else if (out)
+      out[written++] = completion;
+  }
+
+  fill_from_backlog();
+  if (use_uring)
+    flush_uring(0);
+  *written_out = written;
+  return handled;
+}
+
+uint32_t AsyncIO::wait(IoCompletion *out, uint32_t max, uint32_t min) {
+  uint32_t written = 0;
+  uint32_t handled = 0;
+  for(;;) {
+    uint32_t polled = 0;
+    handled += handle_completions(out ? out + written : nullptr, out ? max - written : UINT32_MAX, &polled);
+    written += polled;
+
+    if (handled >= min || pending() == 0 || (out && written == max))
+      return written;
+
+    if (use_uring) {
+      flush_uring(1);
+    } else {
+      std::unique_lock<std::mutex> lock(mutex);
+      cond.wait(lock, [this]{ return done_head != done_tail; });
+    }
+  }
+}
+
+} // namespace Sol
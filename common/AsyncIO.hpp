@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+
+#include "Allocator.hpp"
+#include "Vec.hpp"
+
+namespace Sol {
+
+struct IoCompletion {
+  void *user_data;
+  int64_t result; // Bytes read, or -errno
+};
+typedef void (*IoCallback)(const IoCompletion *completion);
+
+/*
+ * 'path' and 'dst' must stay valid until the read completes. If 'callback' is set it is called from
+ * AsyncIO::poll()/wait() (on the polling thread) instead of the completion being returned.
+ */
+struct IoRequest {
+  const char *path;
+  size_t offset;
+  size_t length;
+  void *dst;
+  void *user_data = nullptr;
+  IoCallback callback = nullptr;
+};
+
+/*
+ * Batched asynchronous file reads. Uses io_uring when the kernel allows it (raw syscalls, no liburing),
+ * else falls back to pread() on the ThreadPool. Every file gets a POSIX_FADV_WILLNEED for its range
+ * so the kernel starts read ahead as soon as the request is seen.
+ *
+ * Requests beyond the queue depth wait in a backlog and are started as completions are popped, so
+ * submit() never blocks. submit/poll/wait must be called from one thread.
+ */
+struct AsyncIO {
+  static AsyncIO* instance();
+
+  struct Slot {
+    IoRequest req;
+    int fd = -1;
+    size_t done = 0; // bytes read so far
+    int64_t result = 0;
+  };
+
+  uint32_t depth = 0; // Power of 2
+  Slot *slots = nullptr;
+  uint32_t *free_slots = nullptr;
+  uint32_t free_count = 0;
+  // Ring of finished slot indices: a slot is only ever in one place, so this can never overflow
+  uint32_t *done_ring = nullptr;
+  uint32_t done_head = 0;
+  uint32_t done_tail = 0;
+  Vec<IoRequest> backlog;
+  size_t backlog_head = 0;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+
+  bool use_uring = false;
+  struct Uring {
+    int fd = -1;
+    void *sq_ptr = nullptr;
+    void *cq_ptr = nullptr;
+    size_t sq_size = 0;
+    size_t cq_size = 0;
+    void *sqes = nullptr;
+    size_t sqes_size = 0;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    void *cqes;
+    uint32_t to_submit = 0;
+  } uring;
+  // Registered with register_buffer(): reads into it use IORING_OP_READ_FIXED
+  uint8_t *fixed_base = nullptr;
+  size_t fixed_size = 0;
+
+  // 'queue_depth' is rounded up to a power of 2. 'force_threads' skips io_uring entirely.
+  void init(uint32_t queue_depth, bool force_threads);
+  void kill();
+
+  void submit(const IoRequest *reqs, uint32_t count);
+  // Non blocking: handle up to 'max' finished reads, returning how many were written to 'out'
+  uint32_t poll(IoCompletion *out, uint32_t max);
+  // As poll, but blocks until at least 'min' reads have been handled (fewer if nothing is pending)
+  uint32_t wait(IoCompletion *out, uint32_t max, uint32_t min);
+  // Reads submitted but not yet handled by poll/wait
+  size_t pending();
+
+  /*
+   * io_uring only: pin [base, base + size) (e.g. persistently mapped staging memory) with the kernel 
+   * once, so reads landing in it skip the per read page pinning. false if unsupported (thread pool 
+   * backend, RLIMIT_MEMLOCK, device memory the kernel cannot pin); reads work the same either way.
+   * One buffer at a time; unregister_buffer() waits for pending reads first.
+   */
+  bool register_buffer(void *base, size_t size);
+  void unregister_buffer();
+
+private:
+  bool init_uring();
+  void kill_uring();
+  void start(const IoRequest *req);
+  void start_uring(uint32_t slot);
+  void push_uring_read(uint32_t slot);
+  void flush_uring(uint32_t min_complete);
+  void reap_uring();
+  void finish(uint32_t slot);
+  void fill_from_backlog();
+  uint32_t handle_completions(IoCompletion *out, uint32_t max, uint32_t *written);
+  static void read_task(void *arg);
+};
+
+} // namespace Sol
@@ -48,6 +48,13 @@ struct Camera {
   mat4 mat_view() {
     return lookAt(pos, pos + front, up);
   }
+  // How many pixels tall one world unit at 'point' is on screen, for picking a LOD (Scene::select_lod)
+  float pixels_per_unit(vec3 point) {
+    float distance = length(point - pos);
+    distance = distance < near_plane ? near_plane : distance;
+    return height / (2.0f * tan(radians(fov) * 0.5f) * distance);
+  }
+  // Depth 0 to 1, as Vulkan clips it: GLM_FORCE_DEPTH_ZERO_TO_ONE is defined for the whole build (CMakeLists.txt)
   mat4 mat_proj() {
     float c_width = width <= 0 ? 1 : width;
     float c_height = height <= 0 ? 1 : height;
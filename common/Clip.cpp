@@ -0,0 +1,377 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Clip.hpp"
+#include "Allocator.hpp"
+#include "Animator.hpp"
+#include "Format.hpp"
+#include "Scene.hpp"
+
+namespace Sol {
+
+namespace {
+  static const float BAKE_RATE = 60.0f;
+  static const float SQRT2 = 1.41421356f;
+
+  static uint32_t path_components(uint32_t path) {
+    return path == Scene::Animation::ROTATION ? 4 : 3;
+  }
+  static uint16_t unorm16(float f) {
+    f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+    return (uint16_t)(f * 65535.0f + 0.5f);
+  }
+
+  // The keys a track has once a cubic spline is baked and a single key doubled
+  static uint32_t source_count(const AnimationTrack *track) {
+    if (track->interpolation != Scene::Animation::CUBICSPLINE || track->key_count < 2)
+      return track->key_count < 2 ? 2 : track->key_count;
+    uint32_t count = 1;
+    for(uint32_t k = 0; k + 1 < track->key_count; ++k) {
+      float steps = ceilf((track->times[k + 1] - track->times[k]) * BAKE_RATE);
+      count += steps < 1.0f ? 1 : (uint32_t)steps;
+    }
+    return count;
+  }
+
+  // The track's keys as linear (or step) keys of 4 floats, rotations normalized
+  static void source_keys(const AnimationTrack *track, float *times, float *values) {
+    uint32_t components = path_components(track->path);
+    uint32_t n = track->key_count;
+    if (track->interpolation != Scene::Animation::CUBICSPLINE) {
+      for(uint32_t k = 0; k < (n < 2 ? 2 : n); ++k) {
+        uint32_t src = k < n ? k : 0;
+        times[k] = track->times[src];
+        for(uint32_t c = 0; c < 4; ++c)
+          values[k * 4 + c] = c < components ? track->values[src * components + c] : 0.0f;
+      }
+    } else {
+      // glTF's Hermite form, as Animator's sample_cubic: a key is in tangent, value, out tangent
+      const float *v = track->values;
+      uint32_t out = 0;
+      for(uint32_t k = 0; k + 1 < n; ++k) {
+        float t0 = track->times[k];
+        float d = track->times[k + 1] - t0;
+        float fsteps = ceilf(d * BAKE_RATE);
+        uint32_t steps = fsteps < 1.0f ? 1 : (uint32_t)fsteps;
+        const float *p0 = v + (k * 3 + 1) * components;
+        const float *m0 = v + (k * 3 + 2) * components;
+        const float *m1 = v + (k * 3 + 3) * components;
+        const float *p1 = v + (k * 3 + 4) * components;
+        for(uint32_t s = 0; s < steps; ++s, ++out) {
+          float t = (float)s / (float)steps;
+          float t2 = t * t;
+          float t3 = t2 * t;
+          times[out] = t0 + d * t;
+          for(uint32_t c = 0; c < 4; ++c)
+            values[out * 4 + c] = c >= components ? 0.0f : (2.0f * t3 - 3.0f * t2 + 1.0f) * p0[c] +
+                (t3 - 2.0f * t2 + t) * d * m0[c] + (-2.0f * t3 + 3.0f * t2) * p1[c] + (t3 - t2) * d * m1[c];
+        }
+      }
+      uint32_t last = n - 1;
+      times[out] = track->times[last];
+      for(uint32_t c = 0; c < 4; ++c)
+        values[out * 4 + c] = c < components ? v[(last * 3 + 1) * components + c] : 0.0f;
+      if (n == 1) {
+        times[1] = times[0];
+        memcpy(values + 4, values, sizeof(float) * 4);
+      }
+    }
+    if (track->path != Scene::Animation::ROTATION)
+      return;
+    uint32_t count = source_count(track);
+    for(uint32_t k = 0; k < count; ++k) {
+      float *q = values + k * 4;
+      float length = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+      float inv = length > 0.0f ? 1.0f / length : 0.0f;
+      for(uint32_t c = 0; c < 4; ++c)
+        q[c] = length > 0.0f ? q[c] * inv : (c == 3 ? 1.0f : 0.0f);
+    }
+  }
+
+  static void encode_rotation(const float *q, uint16_t *out) {
+    uint32_t largest = 0;
+    for(uint32_t c = 1; c < 4; ++c)
+      if (fabsf(q[c]) > fabsf(q[largest]))
+        largest = c;
+    float sign = q[largest] < 0.0f ? -1.0f : 1.0f;
+    uint32_t o = 0;
+    for(uint32_t c = 0; c < 4; ++c) {
+      if (c == largest)
+        continue;
+      float f = (q[c] * sign * SQRT2) * 0.5f + 0.5f;
+      f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+      out[o++] = (uint16_t)(f * 32767.0f + 0.5f);
+    }
+    out[0] |= (uint16_t)((largest & 1) << 15);
+    out[1] |= (uint16_t)((largest >> 1) << 15);
+  }
+
+  // How far apart two values are, as Tolerance measures them: the angle between rotations, else the largest axis
+  static float distance(uint32_t path, const float *a, const float *b) {
+    if (path == Scene::Animation::ROTATION) {
+      // 4 atan2(|a - b|, |a + b|) rather than 2 acos(a . b), which is all rounding error near 0
+      double dot = (double)a[0] * b[0] + (double)a[1] * b[1] + (double)a[2] * b[2] + (double)a[3] * b[3];
+      double sign = dot < 0.0 ? -1.0 : 1.0;
+      double difference = 0.0, sum = 0.0;
+      for(uint32_t c = 0; c < 4; ++c) {
+        difference += ((double)a[c] - sign * b[c]) * ((double)a[c] - sign * b[c]);
+        sum += ((double)a[c] + sign * b[c]) * ((double)a[c] + sign * b[c]);
+      }
+      return (float)(4.0 * atan2(sqrt(difference), sqrt(sum)));
+    }
+    float d = 0.0f;
+    for(uint32_t c = 0; c < 3; ++c)
+      d = fabsf(a[c] - b[c]) > d ? fabsf(a[c] - b[c]) : d;
+    return d;
+  }
+
+  // What the Animator samples between two keys: a lerp, or an nlerp the short way round for rotations
+  static void interpolate(uint32_t path, const float *a, const float *b, float t, float *out) {
+    if (path != Scene::Animation::ROTATION) {
+      for(uint32_t c = 0; c < 4; ++c)
+        out[c] = a[c] + (b[c] - a[c]) * t;
+      return;
+    }
+    float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+    float w1 = dot < 0.0f ? -t : t;
+    float length2 = 0.0f;
+    for(uint32_t c = 0; c < 4; ++c) {
+      out[c] = a[c] * (1.0f - t) + b[c] * w1;
+      length2 += out[c] * out[c];
+    }
+    float inv = 1.0f / sqrtf(length2);
+    for(uint32_t c = 0; c < 4; ++c)
+      out[c] *= inv;
+  }
+
+  // The decoded track (keys 'kept' of 'times'/'values') at 'time', as the Animator samples it
+  static void evaluate(uint32_t path, uint32_t interpolation, const float *times, const float *values,
+      const uint32_t *kept, uint32_t kept_count, uint32_t *cursor, float time, float *out)
+  {
+    uint32_t c = *cursor;
+    while (c + 2 < kept_count && times[kept[c + 1]] <= time)
+      ++c;
+    *cursor = c;
+    float t0 = times[kept[c]];
+    float d = times[kept[c + 1]] - t0;
+    float u = d > 0.0f ? (time - t0) / d : 0.0f;
+    u = u < 0.0f ? 0.0f : (u > 1.0f ? 1.0f : u);
+    const float *a = values + kept[c] * 4;
+    const float *b = values + kept[c + 1] * 4;
+    if (interpolation == Scene::Animation::STEP)
+      memcpy(out, u >= 1.0f ? b : a, sizeof(float) * 4);
+    else
+      interpolate(path, a, b, u, out);
+  }
+
+  /*
+   * Greedy, front to back: a segment grows while every source key inside it is within 'tolerance' of
+   * the line between its (decoded) ends, at the key's decoded time, and the key it could not reach past is kept.
+   */
+  static uint32_t reduce(uint32_t path, uint32_t interpolation, uint32_t count, const float *values,
+      const float *decoded_times, const float *decoded, float tolerance, uint32_t *kept)
+  {
+    uint32_t kept_count = 0;
+    kept[kept_count++] = 0;
+    if (interpolation == Scene::Animation::STEP) {
+      for(uint32_t k = 1; k + 1 < count; ++k)
+        if (distance(path, decoded + k * 4, decoded + kept[kept_count - 1] * 4) > tolerance)
+          kept[kept_count++] = k;
+      kept[kept_count++] = count - 1;
+      return kept_count;
+    }
+
+    uint32_t a = 0;
+    uint32_t b = 1;
+    while (b + 1 < count) {
+      uint32_t end = b + 1;
+      float t0 = decoded_times[a];
+      float d = decoded_times[end] - t0;
+      bool fits = true;
+      for(uint32_t k = a + 1; k <= end && fits; ++k) {
+        float v[4];
+        float u = d > 0.0f ? (decoded_times[k] - t0) / d : 0.0f;
+        u = u < 0.0f ? 0.0f : (u > 1.0f ? 1.0f : u);
+        if (k < end) {
+          interpolate(path, decoded + a * 4, decoded + end * 4, u, v);
+          fits = distance(path, v, values + k * 4) <= tolerance;
+        }
+        // nlerp bends away from the line between keys, so rotations are checked halfway to each key too
+        if (fits && path == Scene::Animation::ROTATION) {
+          float source[4];
+          float u_half = d > 0.0f ? ((decoded_times[k - 1] + decoded_times[k]) * 0.5f - t0) / d : 0.0f;
+          interpolate(path, values + (k - 1) * 4, values + k * 4, 0.5f, source);
+          interpolate(path, decoded + a * 4, decoded + end * 4, u_half < 0.0f ? 0.0f : u_half, v);
+          fits = distance(path, v, source) <= tolerance;
+        }
+      }
+      if (fits) {
+        b = end;
+      } else {
+        kept[kept_count++] = b;
+        a = b;
+        b = a + 1;
+      }
+    }
+    kept[kept_count++] = count - 1;
+    return kept_count;
+  }
+}
+
+uint32_t Clips::max_keys(const AnimationTrack *tracks, uint32_t track_count) {
+  uint32_t count = 0;
+  for(uint32_t i = 0; i < track_count; ++i)
+    count += source_count(&tracks[i]);
+  return count;
+}
+
+uint32_t Clips::compress(const AnimationTrack *tracks, uint32_t track_count, const Tolerance *tolerance,
+    ClipTrack *out_tracks, ClipKey *keys, float *duration, float *max_error)
+{
+  if (track_count > MAX_TRACKS) {
+    print_err("Clips: {} tracks, past the {} a clip can have\n", track_count, (uint32_t)MAX_TRACKS);
+    return 0;
+  }
+  float clip_duration = 0.0f;
+  uint32_t max_count = 2;
+  for(uint32_t i = 0; i < track_count; ++i) {
+    const AnimationTrack *track = &tracks[i];
+    float last = track->times[track->key_count - 1];
+    clip_duration = last > clip_duration ? last : clip_duration;
+    uint32_t count = source_count(track);
+    max_count = count > max_count ? count : max_count;
+  }
+  float errors[3] = {};
+  float tolerances[3] = { tolerance->translation, tolerance->rotation, tolerance->scale };
+
+  float *times = (float*)mem_alloca(sizeof(float) * max_count, 16);
+  float *values = (float*)mem_alloca(sizeof(float) * 4 * max_count, 16);
+  float *decoded_times = (float*)mem_alloca(sizeof(float) * max_count, 16);
+  float *decoded = (float*)mem_alloca(sizeof(float) * 4 * max_count, 16);
+  ClipKey *quantized = (ClipKey*)mem_alloca(sizeof(ClipKey) * max_count, 16);
+  uint32_t *kept = (uint32_t*)mem_alloca(sizeof(uint32_t) * max_count, 16);
+  uint32_t *every = (uint32_t*)mem_alloca(sizeof(uint32_t) * max_count, 16);
+  for(uint32_t k = 0; k < max_count; ++k)
+    every[k] = k;
+  uint32_t key_capacity = max_keys(tracks, track_count);
+  ClipKey *reduced = (ClipKey*)mem_alloca(sizeof(ClipKey) * (key_capacity ? key_capacity : 1), 16);
+  uint32_t reduced_count = 0;
+
+  for(uint32_t i = 0; i < track_count; ++i) {
+    const AnimationTrack *track = &tracks[i];
+    ClipTrack *out = &out_tracks[i];
+    uint32_t count = source_count(track);
+    source_keys(track, times, values);
+    out->node = track->slot;
+    out->path = track->path;
+    out->interpolation = track->interpolation == Scene::Animation::STEP ? Scene::Animation::STEP : Scene::Animation::LINEAR;
+
+    float min[3] = { values[0], values[1], values[2] };
+    float max[3] = { values[0], values[1], values[2] };
+    for(uint32_t k = 1; k < count; ++k) {
+      for(uint32_t c = 0; c < 3; ++c) {
+        min[c] = values[k * 4 + c] < min[c] ? values[k * 4 + c] : min[c];
+        max[c] = values[k * 4 + c] > max[c] ? values[k * 4 + c] : max[c];
+      }
+    }
+    for(uint32_t c = 0; c < 3; ++c) {
+      out->offset[c] = track->path == Scene::Animation::ROTATION ? 0.0f : min[c];
+      out->scale[c] = track->path == Scene::Animation::ROTATION ? 0.0f : (max[c] - min[c]) / 65535.0f;
+    }
+
+    for(uint32_t k = 0; k < count; ++k) {
+      ClipKey *key = &quantized[k];
+      key->track = (uint16_t)i;
+      key->time = clip_duration > 0.0f ? unorm16(times[k] / clip_duration) : 0;
+      if (track->path == Scene::Animation::ROTATION) {
+        encode_rotation(values + k * 4, key->value);
+      } else {
+        for(uint32_t c = 0; c < 3; ++c)
+          key->value[c] = out->scale[c] > 0.0f ? unorm16((values[k * 4 + c] - min[c]) / (max[c] - min[c])) : 0;
+      }
+      decoded_times[k] = time(key, clip_duration);
+      value(out, key, decoded + k * 4);
+    }
+
+    uint32_t kept_count = reduce(track->path, out->interpolation, count, values, decoded_times, decoded,
+        tolerances[track->path], kept);
+    out->key_count = kept_count;
+    for(uint32_t k = 0; k < kept_count; ++k)
+      reduced[reduced_count + k] = quantized[kept[k]];
+    reduced_count += kept_count;
+
+    /*
+     * Against the uncompressed track sampled the same way, which at a jump (two keys at one time) is
+     * the second. A key's time moves by up to half a step of the quantization, which is not counted.
+     */
+    uint32_t cursor = 0;
+    uint32_t source_cursor = 0;
+    for(uint32_t k = 0; k < count; ++k) {
+      float v[4], source[4];
+      evaluate(track->path, out->interpolation, decoded_times, decoded, kept, kept_count, &cursor, decoded_times[k], v);
+      evaluate(track->path, out->interpolation, times, values, every, count, &source_cursor, times[k], source);
+      float e = distance(track->path, v, source);
+      errors[track->path] = e > errors[track->path] ? e : errors[track->path];
+    }
+  }
+
+  /*
+   * The stream: every track's first two keys, then the rest by when they are first needed, which is
+   * the time of the key before them. Sorting on need, track, then position keeps each track's keys in
+   * order, even where two share a time.
+   */
+  uint64_t *order = (uint64_t*)mem_alloca(sizeof(uint64_t) * (reduced_count ? reduced_count : 1), 16);
+  uint32_t order_count = 0;
+  uint32_t first = 0;
+  for(uint32_t i = 0; i < track_count; ++i) {
+    keys[i * 2] = reduced[first];
+    keys[i * 2 + 1] = reduced[first + 1];
+    for(uint32_t k = 2; k < out_tracks[i].key_count; ++k)
+      order[order_count++] = (uint64_t)reduced[first + k - 1].time << 48 | (uint64_t)i << 32 | (first + k);
+    first += out_tracks[i].key_count;
+  }
+  std::sort(order, order + order_count);
+  for(uint32_t k = 0; k < order_count; ++k)
+    keys[track_count * 2 + k] = reduced[(uint32_t)order[k]];
+
+  mem_free(order);
+  mem_free(reduced);
+  mem_free(every);
+  mem_free(kept);
+  mem_free(quantized);
+  mem_free(decoded);
+  mem_free(decoded_times);
+  mem_free(values);
+  mem_free(times);
+  *duration = clip_duration;
+  if (max_error)
+    memcpy(max_error, errors, sizeof(errors));
+  return reduced_count;
+}
+
+float Clips::time(const ClipKey *key, float duration) {
+  return (float)key->time * (duration / 65535.0f);
+}
+
+void Clips::value(const ClipTrack *track, const ClipKey *key, float *out) {
+  if (track->path != Scene::Animation::ROTATION) {
+    for(uint32_t c = 0; c < 3; ++c)
+      out[c] = track->offset[c] + (float)key->value[c] * track->scale[c];
+    out[3] = 0.0f;
+    return;
+  }
+  uint32_t largest = (key->value[0] >> 15) | (key->value[1] >> 15) << 1;
+  float sum = 0.0f;
+  uint32_t o = 0;
+  for(uint32_t c = 0; c < 4; ++c) {
+    if (c == largest)
+      continue;
+    float f = ((float)(key->value[o++] & 0x7fff) * (2.0f / 32767.0f) - 1.0f) * (1.0f / SQRT2);
+    out[c] = f;
+    sum += f * f;
+  }
+  out[largest] = sqrtf(sum < 1.0f ? 1.0f - sum : 0.0f);
+}
+
+} // namespace Sol
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Sol {
+
+struct AnimationTrack;
+
+// A compressed track: which node and transform part it drives and how to dequantize its keys
+struct ClipTrack {
+  uint32_t node;          // Scene node index
+  uint32_t path;          // Scene::Animation::Path: TRANSLATION, ROTATION or SCALE
+  uint32_t interpolation; // LINEAR or STEP: cubic splines are baked to linear keys
+  uint32_t key_count;     // At least 2: a single key is doubled
+  float offset[3];        // Translation and scale: value = offset + unorm16 * scale, per axis
+  float scale[3];
+};
+
+/*
+ * One key, 10 bytes. Rotations are smallest three: the largest component is dropped (the quaternion
+ * negated first if it is negative) and rebuilt from the unit length, the other three are 15 bit fractions
+ * of -1/sqrt(2)..1/sqrt(2), and the dropped one's index is in the top bits of value[0] (low bit) and value[1].
+ */
+struct ClipKey {
+  uint16_t track;
+  uint16_t time; // UNORM16 of the clip's duration
+  uint16_t value[3];
+};
+
+/*
+ * Cook time animation compression. Each track's keys are quantized, then the keys that interpolating
+ * their (quantized) neighbours reproduces within the path's tolerance are dropped, so the error is
+ * measured on what the runtime decodes (times are 1/65535ths of the clip, which the error leaves out). A step track drops the keys that do not change its value, and a
+ * cubic spline is first baked to linear keys at 60 a second.
+ *
+ * The keys are one stream, ordered by when the sampler first needs them: every track's first two keys
+ * (track order), then each later key by the time of its track's previous key. Playing forward, a decoder
+ * keeps a two key window per track and reads keys off the stream only while the next one is due, so a
+ * frame touches just the keys that became current since the last. See Animator::init.
+ */
+struct Clips {
+  static const uint32_t MAX_TRACKS = 65536;
+
+  struct Tolerance {
+    float translation = 0.0005f; // In scene units
+    float rotation = 0.0005f;    // Radians
+    float scale = 0.0005f;
+  };
+
+  // Upper bound on the keys compress() writes for these tracks
+  static uint32_t max_keys(const AnimationTrack *tracks, uint32_t track_count);
+  /*
+   * 'tracks' as for Animator::init, but 'slot' is kept as ClipTrack::node. 'keys' needs room for
+   * max_keys(). Returns the key count, 0 (printing why) if there are more than MAX_TRACKS tracks;
+   * 'duration' is the last key's time and 'max_error' the largest per path, in the tolerance's units.
+   */
+  static uint32_t compress(const AnimationTrack *tracks, uint32_t track_count, const Tolerance *tolerance,
+      ClipTrack *out_tracks, ClipKey *keys, float *duration, float *max_error = nullptr);
+
+  static float time(const ClipKey *key, float duration);
+  // Four floats, xyzw or xyz and 0
+  static void value(const ClipTrack *track, const ClipKey *key, float *out);
+};
+
+} // namespace Sol
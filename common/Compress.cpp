@@ -0,0 +1,183 @@
+#include <cstring>
+
+#include "Compress.hpp"
+
+namespace Sol {
+
+namespace {
+  static const size_t MIN_MATCH = 4;
+  // The format requires the last 5 bytes to be literals, and the last match to start 12 bytes before
+  // the end (so the decoder can always over read a little)
+  static const size_t LAST_LITERALS = 5;
+  static const size_t MF_LIMIT = 12;
+  static const uint32_t HASH_LOG = 12;
+  static const size_t MAX_OFFSET = 65535;
+
+  inline uint32_t read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+  }
+  inline uint32_t hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+  }
+  // Write 'len' in the 255, 255, ..., rem extension encoding
+  inline uint8_t* write_len(uint8_t *op, size_t len) {
+    while (len >= 255) {
+      *op++ = 255;
+      len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+  }
+  inline bool read_len(const uint8_t **ip, const uint8_t *end, size_t *len) {
+    uint8_t b;
+    do {
+      if (*ip >= end)
+        return false;
+      b = *(*ip)++;
+      *len += b;
+    } while (b == 255);
+    return true;
+  }
+
+  // Worst case bytes needed for one sequence with 'lits' literals (match part included)
+  inline size_t sequence_cost(size_t lits) {
+    return 1 + lits + lits / 255 + 1 + 2 + 8;
+  }
+}
+
+size_t Compress::bound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+size_t Compress::compress_block(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_cap) {
+  // Positions are stored + 1 so that 0 means empty
+  uint32_t table[1 << HASH_LOG];
+  memset(table, 0, sizeof(table));
+
+  const uint8_t *dst_end = dst + dst_cap;
+  uint8_t *op = dst;
+  size_t anchor = 0;
+  size_t ip = 0;
+
+  if (size > MF_LIMIT) {
+    size_t limit = size - MF_LIMIT;
+    size_t match_limit = size - LAST_LITERALS;
+    uint32_t misses = 0;
+
+    while (ip < limit) {
+      uint32_t seq = read32(src + ip);
+      uint32_t h = hash4(seq);
+      size_t ref = table[h];
+      table[h] = (uint32_t)ip + 1;
+
+      if (!ref || ip - (ref - 1) > MAX_OFFSET || read32(src + ref - 1) != seq) {
+        // Skip ahead faster the longer nothing matches (incompressible data)
+        ip += 1 + (misses++ >> 6);
+        continue;
+      }
+      ref -= 1;
+      misses = 0;
+
+      // Extend backwards into the pending literals, then forwards
+      while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+        --ip;
+        --ref;
+      }
+      size_t len = MIN_MATCH;
+      while (ip + len < match_limit && src[ip + len] == src[ref + len])
+        ++len;
+
+      size_t lits = ip - anchor;
+      if ((size_t)(dst_end - op) < sequence_cost(lits) + len / 255)
+        return 0;
+
+      uint8_t *token = op++;
+      *token = (uint8_t)((lits >= 15 ? 15 : lits) << 4);
+      if (lits >= 15)
+        op = write_len(op, lits - 15);
+      memcpy(op, src + anchor, lits);
+      op += lits;
+
+      uint16_t offset = (uint16_t)(ip - ref);
+      *op++ = (uint8_t)(offset & 0xff);
+      *op++ = (uint8_t)(offset >> 8);
+
+      size_t match = len - MIN_MATCH;
+      *token |= (uint8_t)(match >= 15 ? 15 : match);
+      if (match >= 15)
+        op = write_len(op, match - 15);
+
+      ip += len;
+      anchor = ip;
+      if (ip < limit)
+        table[hash4(read32(src + ip - 2))] = (uint32_t)(ip - 2) + 1;
+    }
+  }
+
+  // Trailing literals
+  size_t lits = size - anchor;
+  if ((size_t)(dst_end - op) < 1 + lits + lits / 255 + 1)
+    return 0;
+  uint8_t *token = op++;
+  *token = (uint8_t)((lits >= 15 ? 15 : lits) << 4);
+  if (lits >= 15)
+    op = write_len(op, lits - 15);
+  memcpy(op, src + anchor, lits);
+  op += lits;
+
+  return op - dst;
+}
+
+size_t Compress::decompress_block(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_cap) {
+  const uint8_t *ip = src;
+  const uint8_t *end = src + size;
+  uint8_t *op = dst;
+  uint8_t *op_end = dst + dst_cap;
+
+  while (ip < end) {
+    uint8_t token = *ip++;
+
+    size_t lits = token >> 4;
+    if (lits == 15 && !read_len(&ip, end, &lits))
+      return 0;
+    if ((size_t)(end - ip) < lits || (size_t)(op_end - op) < lits)
+      return 0;
+    memcpy(op, ip, lits);
+    ip += lits;
+    op += lits;
+
+    if (ip == end)
+      break; // The last sequence is literals only
+
+    if (end - ip < 2)
+      return 0;
+    size_t offset = ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - dst))
+      return 0;
+
+    size_t len = token & 15;
+    if (len == 15 && !read_len(&ip, end, &len))
+      return 0;
+    len += MIN_MATCH;
+    if ((size_t)(op_end - op) < len)
+      return 0;
+
+    const uint8_t *match = op - offset;
+    if (offset >= len) {
+      memcpy(op, match, len);
+      op += len;
+    } else {
+      // Overlapping copy repeats the last 'offset' bytes (run length encoding falls out of this)
+      for(size_t i = 0; i < len; ++i)
+        op[i] = match[i];
+      op += len;
+    }
+  }
+
+  return op - dst;
+}
+
+} // namespace Sol
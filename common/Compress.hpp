@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Sol {
+
+/*
+ * LZ4 style byte oriented LZ77 (the sequence layout is the LZ4 block format): greedy hash chain free
+ * matching for compression, and a decoder that is little more than memcpy. Blocks are independent,
+ * so a stream split into blocks can be decoded on as many threads as there are blocks.
+ */
+struct Compress {
+  static const size_t BLOCK_SIZE = 64 * 1024;
+
+  // Worst case output size for 'size' input bytes
+  static size_t bound(size_t size);
+  // Returns the compressed size, or 0 if it does not fit in 'dst_cap' (store the block raw instead)
+  static size_t compress_block(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_cap);
+  // Returns the decompressed size, or 0 if 'src' is malformed or would overflow 'dst_cap'
+  static size_t decompress_block(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_cap);
+};
+
+} // namespace Sol
@@ -0,0 +1,622 @@
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Cooker.hpp"
+#include "File.hpp"
+#include "Format.hpp"
+#include "Scene.hpp"
+#include "Threads.hpp"
+#include "glTF.hpp"
+#include "wyhash.h"
+
+namespace Sol {
+
+static Cooker GlobalCooker;
+Cooker* Cooker::instance() { return &GlobalCooker; }
+
+using glTF::Json;
+
+namespace {
+  /*
+   * One model's hash check and cook, run on the ThreadPool. The main thread sets up the inputs and
+   * the 'deps' buffer; the task only writes its results and the cooked file, and allocates nothing
+   * from the HeapAllocator (nlohmann and the piece list use the C++ heap).
+   */
+  struct CookJob {
+    const char *models_dir;
+    const char *name;
+    const char *cooked;
+    char glb[PATH_MAX];   // The intermediate .glb, which the main thread turns into 'cooked'
+    const char *old_deps; // nullptr if the model is not in the manifest
+    uint64_t old_hash;
+    float weld_epsilon;
+
+    uint64_t hash;
+    char *deps; // MAX_DEPS_SIZE bytes
+    bool was_cooked;
+    bool failed;
+  };
+
+  // A file that goes into the cooked BIN chunk (or a view of a .glb source's own BIN chunk, or a decoded 'data:' uri)
+  struct Piece {
+    MappedFile file;
+    std::vector<uint8_t> decoded;
+    const uint8_t *data;
+    size_t size;
+    uint64_t offset; // In the BIN chunk
+  };
+
+  struct Cook {
+    CookJob *job;
+    std::vector<Piece> pieces;
+    uint64_t bin_size = 0;
+    size_t deps_len = 0;
+
+    // Pieces start 16 byte aligned, which keeps every accessor's component alignment
+    uint64_t add(Piece piece) {
+      piece.offset = memory_align(bin_size, 16);
+      bin_size = piece.offset + piece.size;
+      uint64_t offset = piece.offset;
+      pieces.push_back(std::move(piece));
+      return offset;
+    }
+  };
+
+  static bool join_path(char *out, const char *dir, const char *name, size_t len) {
+    int n = snprintf(out, PATH_MAX, "%s/%.*s", dir, (int)len, name);
+    return n > 0 && n < PATH_MAX;
+  }
+  // Missing is false, empty is true with no data
+  static bool map_file(const char *path, MappedFile *file) {
+    if (access(path, R_OK) != 0)
+      return false;
+    *file = File::map(path);
+    return true;
+  }
+  static uint64_t hash_file(const MappedFile *file, uint64_t seed) {
+    return wyhash(file->data, file->size, seed, _wyp);
+  }
+
+  // Fold each file in a tab separated dependency list into 'hash', false if one is missing
+  static bool hash_deps(const char *dir, const char *deps, uint64_t *hash) {
+    for(const char *d = deps; *d;) {
+      const char *end = strchr(d, '\t');
+      if (!end)
+        end = d + strlen(d);
+      char path[PATH_MAX];
+      MappedFile file;
+      if (!join_path(path, dir, d, (size_t)(end - d)) || !map_file(path, &file))
+        return false;
+      *hash = hash_file(&file, *hash);
+      d = *end ? end + 1 : end;
+    }
+    return true;
+  }
+
+  // Map a file the model references and record it as a dependency
+  static bool add_dep(Cook *cook, const std::string &uri, Piece *piece) {
+    CookJob *job = cook->job;
+    char path[PATH_MAX];
+    if (!join_path(path, job->models_dir, uri.c_str(), uri.size()) || !map_file(path, &piece->file)) {
+      print_err("Cooker: '{}' references missing file '{}'\n", job->name, uri.c_str());
+      return false;
+    }
+    if (cook->deps_len + uri.size() + 2 > Cooker::MAX_DEPS_SIZE) {
+      print_err("Cooker: '{}' has too many dependencies\n", job->name);
+      return false;
+    }
+    if (cook->deps_len)
+      job->deps[cook->deps_len++] = '\t';
+    mem_cpy(job->deps + cook->deps_len, uri.c_str(), uri.size());
+    cook->deps_len += uri.size();
+    job->deps[cook->deps_len] = '\0';
+
+    job->hash = hash_file(&piece->file, job->hash);
+    piece->data = piece->file.data;
+    piece->size = piece->file.size;
+    return true;
+  }
+  static bool has_uri(const Json &obj) {
+    auto uri = obj.find("uri");
+    return uri != obj.end() && uri->is_string();
+  }
+  static bool is_data_uri(const std::string &uri) {
+    return uri.compare(0, 5, "data:") == 0;
+  }
+  static int base64_value(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+' || c == '-') return 62;
+    if (c == '/' || c == '_') return 63;
+    return -1;
+  }
+  // 'data:[<mime>];base64,<payload>'
+  static bool decode_data_uri(const std::string &uri, std::vector<uint8_t> *out) {
+    size_t comma = uri.find(',');
+    if (comma == std::string::npos || comma < 7 || uri.compare(comma - 7, 7, ";base64") != 0)
+      return false;
+    out->reserve((uri.size() - comma) / 4 * 3);
+    uint32_t bits = 0;
+    uint32_t bit_count = 0;
+    for(size_t i = comma + 1; i < uri.size() && uri[i] != '='; ++i) {
+      int v = base64_value(uri[i]);
+      if (v < 0)
+        return false;
+      bits = (bits << 6) | (uint32_t)v;
+      bit_count += 6;
+      if (bit_count >= 8) {
+        bit_count -= 8;
+        out->push_back((uint8_t)(bits >> bit_count));
+      }
+    }
+    return true;
+  }
+  // A 'data:' uri is decoded, anything else is a file in the models dir
+  static bool load_uri(Cook *cook, const std::string &uri, Piece *piece) {
+    if (!is_data_uri(uri))
+      return add_dep(cook, uri, piece);
+    if (!decode_data_uri(uri, &piece->decoded)) {
+      print_err("Cooker: '{}' has a malformed data uri\n", cook->job->name);
+      return false;
+    }
+    piece->data = piece->decoded.data();
+    piece->size = piece->decoded.size();
+    return true;
+  }
+  static const char* image_mime_type(const Piece *piece, const std::string &uri) {
+    if (piece->size >= 8 && memcmp(piece->data, glTF::PNG_BYTE_PATTERN, 8) == 0)
+      return "image/png";
+    if (piece->size >= 3 && memcmp(piece->data, glTF::JPG_BYTE_PATTERN, 3) == 0)
+      return "image/jpeg";
+    size_t dot = uri.rfind('.');
+    if (dot != std::string::npos && (uri.compare(dot, 4, ".jpg") == 0 || uri.compare(dot, 5, ".jpeg") == 0))
+      return "image/jpeg";
+    return "image/png";
+  }
+
+  static bool write_at(int fd, const void *data, size_t size, uint64_t offset) {
+    const uint8_t *p = (const uint8_t*)data;
+    while (size) {
+      ssize_t n = pwrite(fd, p, size, (off_t)offset);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      p += n;
+      size -= (size_t)n;
+      offset += (uint64_t)n;
+    }
+    return true;
+  }
+
+  // Written to a temporary and renamed over the old cook, so a reader never sees half a file
+  static bool write_glb(Cook *cook, const std::string &json) {
+    CookJob *job = cook->job;
+    char tmp[PATH_MAX];
+    int n = snprintf(tmp, sizeof(tmp), "%s.tmp", job->glb);
+    if (n <= 0 || n >= (int)sizeof(tmp))
+      return false;
+
+    uint32_t json_len = (uint32_t)memory_align(json.size(), 4);
+    uint32_t bin_len = (uint32_t)memory_align(cook->bin_size, 4);
+    bool has_bin = !cook->pieces.empty();
+    uint64_t total = 12 + 8 + json_len + (has_bin ? 8 + bin_len : 0);
+    if (total > UINT32_MAX) {
+      print_err("Cooker: '{}' is too big for a glb\n", job->name);
+      return false;
+    }
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      print_err("Cooker: failed to open '{}' for writing\n", tmp);
+      return false;
+    }
+    uint32_t header[5] = { glTF::GLB_MAGIC, 2, (uint32_t)total, json_len, glTF::GLB_CHUNK_JSON };
+    const char spaces[4] = { ' ', ' ', ' ', ' ' };
+    bool ok = write_at(fd, header, sizeof(header), 0) &&
+      write_at(fd, json.data(), json.size(), 20) &&
+      write_at(fd, spaces, json_len - json.size(), 20 + json.size());
+
+    uint64_t bin_start = 20 + json_len + 8;
+    if (ok && has_bin) {
+      uint32_t chunk[2] = { bin_len, glTF::GLB_CHUNK_BIN };
+      ok = write_at(fd, chunk, sizeof(chunk), bin_start - 8);
+      // Straight from each mapping; the gaps between pieces are holes, i.e. zeros
+      for(size_t i = 0; ok && i < cook->pieces.size(); ++i)
+        ok = write_at(fd, cook->pieces[i].data, cook->pieces[i].size, bin_start + cook->pieces[i].offset);
+    }
+    ok = ok && ftruncate(fd, (off_t)total) == 0;
+    close(fd);
+
+    if (ok && rename(tmp, job->glb) != 0)
+      ok = false;
+    if (!ok) {
+      print_err("Cooker: failed to write '{}'\n", job->glb);
+      unlink(tmp);
+    }
+    return ok;
+  }
+
+  /*
+   * Every buffer (external file, 'data:' uri or a .glb source's BIN chunk) and every image with a uri
+   * is moved into one new buffer 0, with the buffer views offset to match; images get a buffer view
+   * and mime type in place of their uri.
+   */
+  static bool cook_model(CookJob *job, const uint8_t *src, size_t src_size) {
+    Cook cook;
+    cook.job = job;
+    job->deps[0] = '\0';
+
+    const uint8_t *json_data = src;
+    size_t json_size = src_size;
+    glTF::GlbChunks chunks = {};
+    bool glb = glTF::is_glb(src, src_size);
+    if (glb) {
+      if (!glTF::glb_chunks(src, src_size, &chunks))
+        return false;
+      json_data = chunks.json;
+      json_size = chunks.json_size;
+    }
+    Json json = Json::parse(json_data, json_data + json_size, nullptr, false);
+    if (json.is_discarded() || !json.is_object()) {
+      print_err("Cooker: '{}' is not valid json\n", job->name);
+      return false;
+    }
+
+    Json no_array = Json::array();
+    auto buffers_it = json.find("buffers");
+    Json &buffers = buffers_it != json.end() && buffers_it->is_array() ? *buffers_it : no_array;
+    auto images_it = json.find("images");
+
+    // Where each old buffer starts in buffer 0
+    std::vector<uint64_t> buffer_offset(buffers.size(), 0);
+    for(size_t i = 0; i < buffers.size(); ++i) {
+      Json &buf = buffers[i];
+      uint64_t byte_length = buf.value("byteLength", (uint64_t)0);
+      Piece piece;
+      if (has_uri(buf)) {
+        if (!load_uri(&cook, buf["uri"].get_ref<const std::string&>(), &piece))
+          return false;
+      } else if (i == 0 && glb && chunks.bin) {
+        piece.data = chunks.bin;
+        piece.size = chunks.bin_size;
+      } else {
+        print_err("Cooker: buffer {} of '{}' has no data\n", (uint64_t)i, job->name);
+        return false;
+      }
+      if (piece.size < byte_length) {
+        print_err("Cooker: buffer {} of '{}' is smaller than its byteLength\n", (uint64_t)i, job->name);
+        return false;
+      }
+      piece.size = byte_length;
+      buffer_offset[i] = cook.add(std::move(piece));
+    }
+
+    auto views_it = json.find("bufferViews");
+    if (views_it != json.end() && views_it->is_array()) {
+      for(auto &view : *views_it) {
+        uint32_t buffer = view.value("buffer", 0u);
+        if (buffer >= buffers.size()) {
+          print_err("Cooker: buffer view of '{}' has a bad buffer index\n", job->name);
+          return false;
+        }
+        view["buffer"] = 0;
+        if (buffer_offset[buffer])
+          view["byteOffset"] = view.value("byteOffset", (uint64_t)0) + buffer_offset[buffer];
+      }
+    }
+
+    if (images_it != json.end() && images_it->is_array()) {
+      for(auto &img : *images_it) {
+        if (!has_uri(img))
+          continue;
+        const std::string uri = img["uri"].get<std::string>();
+        Piece piece;
+        if (!load_uri(&cook, uri, &piece))
+          return false;
+        const char *mime_type = image_mime_type(&piece, uri);
+        uint64_t size = piece.size;
+        uint64_t offset = cook.add(std::move(piece));
+
+        Json &views = json["bufferViews"];
+        if (!views.is_array())
+          views = Json::array();
+        Json view = { { "buffer", 0 }, { "byteOffset", offset }, { "byteLength", size } };
+        img.erase("uri");
+        img["bufferView"] = views.size();
+        img["mimeType"] = mime_type;
+        views.push_back(view);
+      }
+    }
+
+    if (!cook.pieces.empty())
+      json["buffers"] = Json::array({ { { "byteLength", cook.bin_size } } });
+
+    if (!write_glb(&cook, json.dump()))
+      return false;
+    job->was_cooked = true;
+    return true;
+  }
+
+  static void cook_task(void *arg, size_t begin, size_t end) {
+    CookJob *jobs = (CookJob*)arg;
+    for(size_t i = begin; i < end; ++i) {
+      CookJob *job = &jobs[i];
+      char path[PATH_MAX];
+      MappedFile src;
+      if (!join_path(path, job->models_dir, job->name, strlen(job->name)) || !map_file(path, &src) || !src.data) {
+        print_err("Cooker: failed to read '{}'\n", job->name);
+        job->failed = true;
+        continue;
+      }
+
+      // Up to date if the source and every file it used hash the same, and the cook is still there
+      // Seeded with the format version and the settings, so a change to either re-cooks everything
+      uint32_t epsilon_bits;
+      memcpy(&epsilon_bits, &job->weld_epsilon, sizeof(epsilon_bits));
+      job->hash = hash_file(&src, (uint64_t)epsilon_bits << 32 | SCENE_VERSION);
+      if (job->old_deps) {
+        uint64_t hash = job->hash;
+        if (hash_deps(job->models_dir, job->old_deps, &hash) && hash == job->old_hash &&
+            access(job->cooked, R_OK) == 0)
+        {
+          job->hash = hash;
+          continue;
+        }
+      }
+      job->failed = !cook_model(job, src.data, src.size);
+    }
+  }
+
+  /*
+   * The glTF structs live on the scratch arena and the HeapAllocator, so the .glb is turned into the
+   * scene here on the main thread, once the pool is done. The new scene is validated before it
+   * replaces the old one, and the .glb is gone either way.
+   */
+  static bool bake_scene(CookJob *job) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", job->cooked);
+    LinearAllocator *scratch = &MemoryService::instance()->scratch_allocator;
+    size_t mark = scratch->alloced;
+
+    bool ok;
+    {
+      MappedFile glb = File::map(job->glb);
+      glTF::glTF gltf;
+      ok = glb.data && gltf.parse_glb(glb.data, glb.size) && Scene::write(&gltf, tmp, job->weld_epsilon);
+    }
+    scratch->cut(scratch->alloced - mark);
+    unlink(job->glb);
+
+    SceneFile check;
+    ok = ok && check.open(tmp);
+    check.close();
+    if (ok && rename(tmp, job->cooked) != 0)
+      ok = false;
+    if (!ok) {
+      print_err("Cooker: failed to write the scene for '{}'\n", job->name);
+      unlink(tmp);
+    }
+    return ok;
+  }
+
+  static bool is_model_file(const char *name) {
+    const char *dot = strrchr(name, '.');
+    return dot && (strcmp(dot, ".gltf") == 0 || strcmp(dot, ".glb") == 0 || strcmp(dot, ".json") == 0);
+  }
+  static Cooker::Model* find_model(Vec<Cooker::Model> *models, const char *name) {
+    for(size_t i = 0; i < models->length; ++i)
+      if (strcmp((*models)[i].name.c_str(), name) == 0)
+        return &(*models)[i];
+    return nullptr;
+  }
+  static void kill_model(Cooker::Model *model) {
+    model->name.kill();
+    model->cooked.kill();
+    model->deps.kill();
+  }
+}
+
+void Cooker::init(const char *models_dir_, const char *cache_dir_) {
+  Allocator *heap = &MemoryService::instance()->system_allocator;
+  models_dir = StringBuffer::get(0, models_dir_, heap);
+  cache_dir = StringBuffer::get(0, cache_dir_, heap);
+  models.init(16);
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/manifest", cache_dir_);
+  if (access(path, R_OK) != 0)
+    return;
+  MappedFile manifest = File::map(path);
+  const char *p = (const char*)manifest.data;
+  const char *end = p + manifest.size;
+  while (p < end) {
+    const char *line_end = (const char*)memchr(p, '\n', (size_t)(end - p));
+    if (!line_end)
+      break; // Cut short: re-cooking what is missing is the safe fallback
+
+    // hash \t name \t cooked [\t deps...]
+    const char *fields[3];
+    size_t lens[3];
+    const char *f = p;
+    uint32_t field = 0;
+    for(; field < 3 && f <= line_end; ++field) {
+      const char *tab = (const char*)memchr(f, '\t', (size_t)(line_end - f));
+      const char *field_end = tab ? tab : line_end;
+      fields[field] = f;
+      lens[field] = (size_t)(field_end - f);
+      f = field_end + 1;
+    }
+    if (field == 3 && lens[0] == 16 && lens[1] && lens[2]) {
+      Model model;
+      model.hash = strtoull(fields[0], nullptr, 16);
+      model.name = StringBuffer::get(lens[1], fields[1], heap);
+      model.cooked = StringBuffer::get(lens[2], fields[2], heap);
+      if (f < line_end)
+        model.deps = StringBuffer::get((size_t)(line_end - f), f, heap);
+      else
+        model.deps = StringBuffer::get(0, "", heap);
+      models.push(model);
+    }
+    p = line_end + 1;
+  }
+}
+void Cooker::kill() {
+  for(size_t i = 0; i < models.length; ++i)
+    kill_model(&models[i]);
+  models.kill();
+  models_dir.kill();
+  cache_dir.kill();
+}
+
+uint32_t Cooker::update() {
+  DIR *dir = opendir(models_dir.c_str());
+  if (!dir) {
+    print_err("Cooker: no models dir '{}'\n", models_dir);
+    return 0;
+  }
+  if (mkdir(cache_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    print_err("Cooker: cannot create cache dir '{}' ({})\n", cache_dir, errno);
+    closedir(dir);
+    return 0;
+  }
+
+  Allocator *heap = &MemoryService::instance()->system_allocator;
+  Vec<Model> scanned;
+  scanned.init(16);
+  for(struct dirent *entry = readdir(dir); entry; entry = readdir(dir)) {
+    if (entry->d_name[0] == '.' || !is_model_file(entry->d_name))
+      continue;
+    Model model;
+    model.name = StringBuffer::get(0, entry->d_name, heap);
+    model.cooked = StringBuffer::get(0, cache_dir.c_str(), heap);
+    model.cooked.push("/");
+    model.cooked.push(entry->d_name);
+    model.cooked.push(".scene");
+    model.deps = StringBuffer::get(0, "", heap);
+    model.hash = 0;
+    scanned.push(model);
+  }
+  closedir(dir);
+
+  size_t count = scanned.length;
+  CookJob *jobs = (CookJob*)mem_alloca(sizeof(CookJob) * (count ? count : 1), 8);
+  char *deps = (char*)mem_alloca((size_t)MAX_DEPS_SIZE * (count ? count : 1), 8);
+  for(size_t i = 0; i < count; ++i) {
+    Model *old = find_model(&models, scanned[i].name.c_str());
+    CookJob *job = &jobs[i];
+    job->models_dir = models_dir.c_str();
+    job->name = scanned[i].name.c_str();
+    job->cooked = scanned[i].cooked.c_str();
+    snprintf(job->glb, sizeof(job->glb), "%s/%s.glb", cache_dir.c_str(), job->name);
+    job->old_deps = old ? old->deps.c_str() : nullptr;
+    job->old_hash = old ? old->hash : 0;
+    job->weld_epsilon = weld_epsilon;
+    job->hash = 0;
+    job->deps = deps + (size_t)MAX_DEPS_SIZE * i;
+    job->was_cooked = false;
+    job->failed = false;
+  }
+  ThreadPool::instance()->parallel_for(count, 1, cook_task, jobs);
+  for(size_t i = 0; i < count; ++i) {
+    if (jobs[i].was_cooked && !bake_scene(&jobs[i])) {
+      jobs[i].was_cooked = false;
+      jobs[i].failed = true;
+    }
+  }
+
+  // A model that failed to cook keeps its last good cook, if it had one
+  uint32_t cooked = 0;
+  uint32_t failed = 0;
+  Vec<Model> next;
+  next.init(count);
+  for(size_t i = 0; i < count; ++i) {
+    Model *model = &scanned[i];
+    Model *old = find_model(&models, model->name.c_str());
+    if (jobs[i].failed) {
+      ++failed;
+      if (old) {
+        next.push(*old);
+        old->name = StringBuffer(); // Moved to 'next'
+      }
+      kill_model(model);
+      continue;
+    }
+    model->hash = jobs[i].hash;
+    if (jobs[i].was_cooked) {
+      ++cooked;
+      if (old && strcmp(old->cooked.c_str(), model->cooked.c_str()) != 0)
+        unlink(old->cooked.c_str());
+      model->deps.kill();
+      model->deps = StringBuffer::get(0, jobs[i].deps, heap);
+    } else {
+      model->deps.kill();
+      model->deps = StringBuffer::get(0, old->deps.c_str(), heap);
+    }
+    next.push(*model);
+  }
+  // Whatever is left of the old manifest is for models that are gone
+  for(size_t i = 0; i < models.length; ++i) {
+    if (!models[i].name.len)
+      continue;
+    if (!find_model(&next, models[i].name.c_str()))
+      unlink(models[i].cooked.c_str());
+    kill_model(&models[i]);
+  }
+  models.kill();
+  scanned.kill();
+  models = next;
+  mem_free(jobs);
+  mem_free(deps);
+
+  char path[PATH_MAX];
+  char tmp[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/manifest", cache_dir.c_str());
+  snprintf(tmp, sizeof(tmp), "%s/manifest.tmp", cache_dir.c_str());
+  FILE *f = fopen(tmp, "wb");
+  bool ok = f;
+  for(size_t i = 0; ok && i < models.length; ++i) {
+    Model *m = &models[i];
+    ok = fprintf(f, "%016llx\t%s\t%s%s%s\n", (unsigned long long)m->hash, m->name.c_str(), m->cooked.c_str(),
+        m->deps.len ? "\t" : "", m->deps.c_str()) > 0;
+  }
+  if (f)
+    ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp, path) != 0)
+    print_err("Cooker: failed to write the manifest '{}'\n", path);
+
+  print("Cooker: {} of {} models cooked, {} failed\n", cooked, (uint32_t)count, failed);
+  return cooked;
+}
+
+const char* Cooker::find(const char *name) {
+  Model *model = find_model(&models, name);
+  return model ? model->cooked.c_str() : nullptr;
+}
+bool Cooker::watch(const char *name, WatchFunc func, void *arg) {
+  Watcher *watcher = Watcher::instance();
+  Model *model = find_model(&models, name);
+  char path[PATH_MAX];
+  if (!watcher->is_active() || !model || !join_path(path, models_dir.c_str(), name, strlen(name)) ||
+      !watcher->watch(path, func, arg))
+    return false;
+  bool ok = true;
+  for(const char *d = model->deps.c_str(); *d;) {
+    const char *end = strchr(d, '\t');
+    if (!end)
+      end = d + strlen(d);
+    ok = join_path(path, models_dir.c_str(), d, (size_t)(end - d)) && watcher->watch(path, func, arg) && ok;
+    d = *end ? end + 1 : end;
+  }
+  return ok;
+}
+
+} // namespace Sol
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Allocator.hpp"
+#include "String.hpp"
+#include "Vec.hpp"
+#include "Watcher.hpp"
+
+namespace Sol {
+
+/*
+ * Model cache. Each glTF model in the models dir is cooked into one self contained .scene in the cache
+ * dir: every buffer and image is merged into one buffer, by way of an intermediate .glb, and the result
+ * is written in the Scene layout, so the runtime maps one file and parses nothing (see Scene.hpp).
+ *
+ * A manifest in the cache dir keeps, per model, the wyhash of its source and then of each file it
+ * depends on, the cooked path and the dependency list. update() re-hashes every model (over mmap,
+ * across the ThreadPool) and only re-cooks those that are new or whose hash changed. The manifest is a
+ * text file, one model a line: 'hash name cooked deps...', tab separated.
+ */
+struct Cooker {
+  static Cooker* instance();
+
+  static const uint32_t MAX_DEPS_SIZE = 16 * 1024; // Of a model's tab separated dependency list
+
+  struct Model {
+    StringBuffer name;   // File name inside the models dir
+    StringBuffer cooked; // Path of the cooked .scene
+    StringBuffer deps;   // Tab separated, relative to the models dir
+    uint64_t hash;
+  };
+
+  StringBuffer models_dir;
+  StringBuffer cache_dir;
+  Vec<Model> models;
+  float weld_epsilon = 0.0f; // See Scene::write; part of every model's hash, so changing it re-cooks
+
+  // Reads the manifest, if there is one
+  void init(const char *models_dir_, const char *cache_dir_);
+  void kill();
+
+  // Re-cook what changed and rewrite the manifest, returns how many models were cooked
+  uint32_t update();
+  // Cooked path of a model by its name in the models dir, nullptr if it never cooked
+  const char* find(const char *name);
+  // Hot reload: 'func' is called with 'arg' when the model's source or any file it depends on changes.
+  // A re-cook can add dependencies, so call it again after update(); what is already watched is kept.
+  bool watch(const char *name, WatchFunc func, void *arg);
+};
+
+} // namespace Sol
@@ -0,0 +1,382 @@
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
+
+#include "Decode.hpp"
+#include "Allocator.hpp"
+#include "Scene.hpp"
+
+namespace Sol {
+
+namespace {
+  static const uint32_t SPARSE_BATCH = 64;
+  static const uint32_t TYPE_ROWS[] = { 1, 2, 3, 4, 2, 3, 4 };
+  static const uint32_t TYPE_COLUMNS[] = { 1, 1, 1, 1, 2, 3, 4 };
+
+  // Per component: (float)c * scale, then max(-1) for signed normalized (else max(-inf), i.e. nothing)
+  struct Convert {
+    uint32_t component_type;
+    uint32_t component_size;
+    uint32_t rows;
+    uint32_t columns;
+    uint32_t column_size; // Bytes, with padding
+    uint32_t element_size;
+    float scale;
+    float min;
+  };
+  static Convert get_convert(const AccessorView *view) {
+    Convert c;
+    c.component_type = view->component_type;
+    c.component_size = Decode::component_size(view->component_type);
+    c.rows = TYPE_ROWS[view->type];
+    c.columns = TYPE_COLUMNS[view->type];
+    c.column_size = c.columns > 1 ? (uint32_t)memory_align(c.rows * c.component_size, 4) : c.rows * c.component_size;
+    c.element_size = c.column_size * c.columns;
+    c.scale = 1.0f;
+    c.min = -INFINITY;
+    if (view->normalized) {
+      switch(view->component_type) {
+        case Scene::INT8:
+          c.scale = 1.0f / 127.0f;
+          c.min = -1.0f;
+          break;
+        case Scene::UINT8:
+          c.scale = 1.0f / 255.0f;
+          break;
+        case Scene::INT16:
+          c.scale = 1.0f / 32767.0f;
+          c.min = -1.0f;
+          break;
+        case Scene::UINT16:
+          c.scale = 1.0f / 65535.0f;
+          break;
+        default:
+          break;
+      }
+    }
+    return c;
+  }
+
+  // Scalar path: the reference the SSE kernels match bit for bit
+  static float read_float(const Convert *c, const uint8_t *p) {
+    float f;
+    switch(c->component_type) {
+      case Scene::INT8:
+        f = (float)(int8_t)*p;
+        break;
+      case Scene::UINT8:
+        f = (float)*p;
+        break;
+      case Scene::INT16: {
+        int16_t v;
+        memcpy(&v, p, 2);
+        f = (float)v;
+        break;
+      }
+      case Scene::UINT16: {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        f = (float)v;
+        break;
+      }
+      case Scene::UINT32: {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return (float)v;
+      }
+      case Scene::FLOAT:
+        memcpy(&f, p, 4);
+        return f;
+      default:
+        return 0.0f;
+    }
+    f *= c->scale;
+    return f < c->min ? c->min : f;
+  }
+  static uint32_t read_uint(uint32_t component_type, const uint8_t *p) {
+    switch(component_type) {
+      case Scene::INT8:
+      case Scene::UINT8:
+        return *p;
+      case Scene::INT16:
+      case Scene::UINT16: {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        return v;
+      }
+      case Scene::UINT32:
+      case Scene::FLOAT: {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+      }
+      default:
+        return 0;
+    }
+  }
+  static void read_element(const Convert *c, const uint8_t *p, float *out) {
+    for(uint32_t col = 0; col < c->columns; ++col)
+      for(uint32_t row = 0; row < c->rows; ++row)
+        *out++ = read_float(c, p + col * c->column_size + row * c->component_size);
+  }
+
+  // SSE2 //////////////////////////
+  static inline void store_ints(float *out, __m128i v, __m128 scale, __m128 min) {
+    _mm_storeu_ps(out, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), scale), min));
+  }
+  static inline __m128i widen_u8(__m128i v) {
+    __m128i zero = _mm_setzero_si128();
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero);
+  }
+  static inline __m128i widen_i8(__m128i v) {
+    __m128i v16 = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(v16, v16), 16);
+  }
+
+  // 'n' tightly packed components
+  static void floats_run(const Convert *c, const uint8_t *src, size_t n, float *out) {
+    const __m128 scale = _mm_set1_ps(c->scale);
+    const __m128 min = _mm_set1_ps(c->min);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    switch(c->component_type) {
+      case Scene::UINT8:
+        for(; i + 16 <= n; i += 16) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+          __m128i lo = _mm_unpacklo_epi8(v, zero);
+          __m128i hi = _mm_unpackhi_epi8(v, zero);
+          store_ints(out + i, _mm_unpacklo_epi16(lo, zero), scale, min);
+          store_ints(out + i + 4, _mm_unpackhi_epi16(lo, zero), scale, min);
+          store_ints(out + i + 8, _mm_unpacklo_epi16(hi, zero), scale, min);
+          store_ints(out + i + 12, _mm_unpackhi_epi16(hi, zero), scale, min);
+        }
+        break;
+      case Scene::INT8:
+        for(; i + 16 <= n; i += 16) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+          __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+          __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+          store_ints(out + i, _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16), scale, min);
+          store_ints(out + i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16), scale, min);
+          store_ints(out + i + 8, _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16), scale, min);
+          store_ints(out + i + 12, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16), scale, min);
+        }
+        break;
+      case Scene::UINT16:
+        for(; i + 8 <= n; i += 8) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+          store_ints(out + i, _mm_unpacklo_epi16(v, zero), scale, min);
+          store_ints(out + i + 4, _mm_unpackhi_epi16(v, zero), scale, min);
+        }
+        break;
+      case Scene::INT16:
+        for(; i + 8 <= n; i += 8) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+          store_ints(out + i, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16), scale, min);
+          store_ints(out + i + 4, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16), scale, min);
+        }
+        break;
+      case Scene::FLOAT:
+        memcpy(out, src, n * sizeof(float));
+        i = n;
+        break;
+      default:
+        break;
+    }
+    for(; i < n; ++i)
+      out[i] = read_float(c, src + i * c->component_size);
+  }
+
+  /*
+   * One element per step: a 4 lane load from the element converts all of its (up to 4) components, and
+   * a 4 float store writes them, the extra lanes landing in the following elements' slots before those
+   * are written. The elements at the end, where the store would run past 'out' or the load past the
+   * data, go through the scalar path.
+   */
+  static void floats_strided(const Convert *c, const AccessorView *view, float *out) {
+    uint32_t components = c->rows * c->columns;
+    uint32_t count = view->count;
+    const uint8_t *src = view->data;
+    const uint8_t *end = src + (size_t)(count - 1) * view->stride + c->element_size;
+    const __m128 scale = _mm_set1_ps(c->scale);
+    const __m128 min = _mm_set1_ps(c->min);
+    size_t total = (size_t)count * components;
+
+    uint32_t i = 0;
+    if (components <= 4 && c->element_size == components * c->component_size) {
+      switch(c->component_type) {
+        case Scene::UINT8:
+        case Scene::INT8: {
+          bool is_signed = c->component_type == Scene::INT8;
+          for(; (size_t)i * components + 4 <= total && src + (size_t)i * view->stride + 4 <= end; ++i) {
+            int32_t bytes;
+            memcpy(&bytes, src + (size_t)i * view->stride, 4);
+            __m128i v = _mm_cvtsi32_si128(bytes);
+            store_ints(out + (size_t)i * components, is_signed ? widen_i8(v) : widen_u8(v), scale, min);
+          }
+          break;
+        }
+        case Scene::UINT16:
+        case Scene::INT16: {
+          bool is_signed = c->component_type == Scene::INT16;
+          for(; (size_t)i * components + 4 <= total && src + (size_t)i * view->stride + 8 <= end; ++i) {
+            __m128i v = _mm_loadl_epi64((const __m128i*)(src + (size_t)i * view->stride));
+            v = is_signed ? _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16) : _mm_unpacklo_epi16(v, _mm_setzero_si128());
+            store_ints(out + (size_t)i * components, v, scale, min);
+          }
+          break;
+        }
+        case Scene::FLOAT:
+          for(; (size_t)i * components + 4 <= total && src + (size_t)i * view->stride + 16 <= end; ++i)
+            _mm_storeu_ps(out + (size_t)i * components, _mm_loadu_ps((const float*)(src + (size_t)i * view->stride)));
+          break;
+        default:
+          break;
+      }
+    }
+    for(; i < count; ++i)
+      read_element(c, src + (size_t)i * view->stride, out + (size_t)i * components);
+  }
+
+  static void floats_dense(const AccessorView *view, float *out) {
+    Convert c = get_convert(view);
+    uint32_t components = c.rows * c.columns;
+    if (!view->count)
+      return;
+    if (!view->data)
+      memset(out, 0, sizeof(float) * components * view->count);
+    else if (view->stride == c.element_size && c.element_size == components * c.component_size)
+      floats_run(&c, view->data, (size_t)components * view->count, out);
+    else
+      floats_strided(&c, view, out);
+  }
+
+  static void uints_dense(const AccessorView *view, uint32_t *out) {
+    uint32_t size = Decode::component_size(view->component_type);
+    uint32_t components = Decode::components(view->type);
+    uint32_t element_size = Decode::element_size(view->component_type, view->type);
+    if (!view->count)
+      return;
+    if (!view->data) {
+      memset(out, 0, sizeof(uint32_t) * components * view->count);
+      return;
+    }
+    if (view->stride != element_size || element_size != components * size) {
+      Convert c = get_convert(view);
+      for(uint32_t i = 0; i < view->count; ++i)
+        for(uint32_t col = 0; col < c.columns; ++col)
+          for(uint32_t row = 0; row < c.rows; ++row)
+            *out++ = read_uint(c.component_type, view->data + (size_t)i * view->stride + col * c.column_size + row * size);
+      return;
+    }
+
+    size_t n = (size_t)components * view->count;
+    const uint8_t *src = view->data;
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    switch(view->component_type) {
+      case Scene::UINT8:
+      case Scene::INT8:
+        for(; i + 16 <= n; i += 16) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+          __m128i lo = _mm_unpacklo_epi8(v, zero);
+          __m128i hi = _mm_unpackhi_epi8(v, zero);
+          _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(lo, zero));
+          _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(lo, zero));
+          _mm_storeu_si128((__m128i*)(out + i + 8), _mm_unpacklo_epi16(hi, zero));
+          _mm_storeu_si128((__m128i*)(out + i + 12), _mm_unpackhi_epi16(hi, zero));
+        }
+        break;
+      case Scene::UINT16:
+      case Scene::INT16:
+        for(; i + 8 <= n; i += 8) {
+          __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+          _mm_storeu_si128((__m128i*)(out + i), _mm_unpacklo_epi16(v, zero));
+          _mm_storeu_si128((__m128i*)(out + i + 4), _mm_unpackhi_epi16(v, zero));
+        }
+        break;
+      case Scene::UINT32:
+      case Scene::FLOAT:
+        memcpy(out, src, n * sizeof(uint32_t));
+        i = n;
+        break;
+      default:
+        break;
+    }
+    for(; i < n; ++i)
+      out[i] = read_uint(view->component_type, src + i * size);
+  }
+
+  // The sparse values are a tightly packed accessor of their own: decode a batch, then scatter it
+  template<typename T, void (*dense)(const AccessorView*, T*)>
+  static void apply_sparse(const AccessorView *view, T *out) {
+    uint32_t components = Decode::components(view->type);
+    uint32_t element_size = Decode::element_size(view->component_type, view->type);
+    uint32_t index_size = Decode::component_size(view->sparse_index_type);
+    uint32_t indices[SPARSE_BATCH];
+    T values[SPARSE_BATCH * 16];
+
+    for(uint32_t first = 0; first < view->sparse_count; first += SPARSE_BATCH) {
+      uint32_t n = view->sparse_count - first < SPARSE_BATCH ? view->sparse_count - first : SPARSE_BATCH;
+      AccessorView index_view = {};
+      index_view.data = view->sparse_indices + (size_t)first * index_size;
+      index_view.stride = index_size;
+      index_view.component_type = view->sparse_index_type;
+      index_view.type = Scene::SCALAR;
+      index_view.count = n;
+      uints_dense(&index_view, indices);
+
+      AccessorView value_view = *view;
+      value_view.data = view->sparse_values + (size_t)first * element_size;
+      value_view.stride = element_size;
+      value_view.count = n;
+      value_view.sparse_count = 0;
+      dense(&value_view, values);
+
+      for(uint32_t i = 0; i < n; ++i)
+        if (indices[i] < view->count)
+          memcpy(out + (size_t)indices[i] * components, values + i * components, sizeof(T) * components);
+    }
+  }
+}
+
+uint32_t Decode::component_size(uint32_t component_type) {
+  switch(component_type) {
+    case Scene::INT8:
+    case Scene::UINT8:
+      return 1;
+    case Scene::INT16:
+    case Scene::UINT16:
+      return 2;
+    case Scene::UINT32:
+    case Scene::FLOAT:
+      return 4;
+    default:
+      return 0;
+  }
+}
+uint32_t Decode::components(uint32_t type) {
+  return type <= Scene::MAT4 ? TYPE_ROWS[type] * TYPE_COLUMNS[type] : 0;
+}
+uint32_t Decode::element_size(uint32_t component_type, uint32_t type) {
+  uint32_t size = component_size(component_type);
+  if (!size || type > Scene::MAT4)
+    return 0;
+  uint32_t column_size = TYPE_ROWS[type] * size;
+  if (TYPE_COLUMNS[type] > 1)
+    column_size = (uint32_t)memory_align(column_size, 4);
+  return column_size * TYPE_COLUMNS[type];
+}
+
+void Decode::floats(const AccessorView *view, float *out) {
+  floats_dense(view, out);
+  if (view->sparse_count)
+    apply_sparse<float, floats_dense>(view, out);
+}
+void Decode::uints(const AccessorView *view, uint32_t *out) {
+  uints_dense(view, out);
+  if (view->sparse_count)
+    apply_sparse<uint32_t, uints_dense>(view, out);
+}
+
+} // namespace Sol
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Sol {
+
+// Where an accessor's elements are and how they are stored, see Scene::accessor_view and glTF::accessor_view
+struct AccessorView {
+  const uint8_t *data;     // First element, nullptr if the accessor has no buffer view (all zeros)
+  uint32_t stride;         // Bytes from one element to the next, never 0
+  uint32_t component_type; // GL enum, as Scene::ComponentType
+  uint32_t type;           // SCALAR..MAT4, as Scene::Type
+  uint32_t count;
+  bool normalized;
+
+  // Tightly packed, in the accessor's own element layout
+  uint32_t sparse_count;   // 0 if not sparse
+  uint32_t sparse_index_type;
+  const uint8_t *sparse_indices;
+  const uint8_t *sparse_values;
+};
+
+/*
+ * Accessor decoding, to packed floats (count * components of them) or to uint32s for indices and
+ * joints. Normalized integers follow the glTF rules: unsigned c / max, signed max(c / max, -1).
+ * Matrix columns of 1 and 2 byte components are 4 byte aligned, as the spec lays them out.
+ *
+ * Tightly packed data is converted as one flat run of components, 16 bytes per SSE2 step; strided
+ * (interleaved) data one element per step, with a scalar tail where a 16 byte load would run past
+ * the data. Sparse values are decoded in batches through the same kernels and then scattered.
+ * Sparse indices past 'count' are skipped. Nothing allocates, so any thread can decode.
+ */
+struct Decode {
+  static uint32_t component_size(uint32_t component_type); // 0 if not a valid component type
+  static uint32_t components(uint32_t type);
+  // Including matrix column padding, 0 if either argument is invalid
+  static uint32_t element_size(uint32_t component_type, uint32_t type);
+
+  static void floats(const AccessorView *view, float *out);
+  static void uints(const AccessorView *view, uint32_t *out);
+};
+
+} // namespace Sol
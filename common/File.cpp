@@ -1,17 +1,89 @@
+#include <cerrno>
 #include <cstdio>
-#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "File.hpp"
 #include "Allocator.hpp"
+#include "Format.hpp"
 
 namespace Sol {
 
+// MappedFile ///////////////////
+MappedFile::MappedFile(MappedFile &&other) {
+  data = other.data;
+  size = other.size;
+  other.data = nullptr;
+  other.size = 0;
+}
+MappedFile& MappedFile::operator=(MappedFile &&other) {
+  if (this != &other) {
+    unmap();
+    data = other.data;
+    size = other.size;
+    other.data = nullptr;
+    other.size = 0;
+  }
+  return *this;
+}
+MappedFile::~MappedFile() {
+  unmap();
+}
+void MappedFile::unmap() {
+  if (data)
+    munmap((void*)data, size);
+  data = nullptr;
+  size = 0;
+}
+const uint8_t* MappedFile::view(size_t offset, size_t count) const {
+  if (offset > size || count > size - offset)
+    return nullptr;
+  return data + offset;
+}
+
+// File /////////////////////////
+MappedFile File::map(const char* file_name, uint32_t advise) {
+  MappedFile file;
+  int fd = open(file_name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    print_err("FAILED TO MAP FILE {}!\n", file_name);
+    return file;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return file;
+  }
+
+  void *ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping holds its own reference to the file
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    print_err("FAILED TO MAP FILE {}!\n", file_name);
+    return file;
+  }
+
+  if (advise & ADVISE_SEQUENTIAL)
+    madvise(ptr, (size_t)st.st_size, MADV_SEQUENTIAL);
+  if (advise & ADVISE_RANDOM)
+    madvise(ptr, (size_t)st.st_size, MADV_RANDOM);
+  if (advise & ADVISE_WILLNEED)
+    madvise(ptr, (size_t)st.st_size, MADV_WILLNEED);
+
+  file.data = (const uint8_t*)ptr;
+  file.size = (size_t)st.st_size;
+  return file;
+}
+
 void* File::read_spirv(size_t *byte_count, const char* file_name) {
   Allocator *alloc = &Sol::MemoryService::instance()->system_allocator;
   FILE *file = fopen(file_name, "r");
 
   if (!file) {
-    std::cerr << "FAILED TO READ FILE " << file_name << "!\n";
+    print_err("FAILED TO READ FILE {}!\n", file_name);
     fclose(file);
     return nullptr;
   }
@@ -32,7 +104,7 @@ void* File::read_bin(size_t *byte_count, const char* file_name) {
   FILE *file = fopen(file_name, "r");
 
   if (!file) {
-    std::cerr << "FAILED TO READ FILE " << file_name << "!\n";
+    print_err("FAILED TO READ FILE {}!\n", file_name);
     fclose(file);
     return nullptr;
   }
@@ -48,4 +120,26 @@ void* File::read_bin(size_t *byte_count, const char* file_name) {
   return buffer;
 }
 
+bool File::write(const char* file_name, const void *data, size_t size) {
+  int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    print_err("FAILED TO OPEN FILE {} FOR WRITING!\n", file_name);
+    return false;
+  }
+  const uint8_t *p = (const uint8_t*)data;
+  while (size) {
+    ssize_t n = ::write(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    p += n;
+    size -= (size_t)n;
+  }
+  close(fd);
+  if (size)
+    print_err("FAILED TO WRITE FILE {}!\n", file_name);
+  return size == 0;
+}
+
 }
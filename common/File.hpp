@@ -6,9 +6,41 @@
 
 namespace Sol {
 
+/*
+ * Read only mmap of a whole file: the contents are used in place, so there is no read into a heap buffer 
+ * and nothing to free. Unmapped when it goes out of scope, so it is move only. 'data' is null if the 
+ * file could not be mapped (or is empty).
+ */
+struct MappedFile {
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile &&other);
+  MappedFile& operator=(MappedFile &&other);
+  ~MappedFile();
+
+  void unmap();
+  // Pointer to 'offset', or nullptr if [offset, offset + count) is not inside the file
+  const uint8_t* view(size_t offset, size_t count) const;
+};
+
 struct File {
+  // madvise() hints for File::map
+  enum Advise {
+    ADVISE_NONE = 0x0,
+    ADVISE_SEQUENTIAL = 0x1,
+    ADVISE_RANDOM = 0x2,
+    ADVISE_WILLNEED = 0x4,
+  };
+
+  static MappedFile map(const char* file_name, uint32_t advise = ADVISE_SEQUENTIAL | ADVISE_WILLNEED);
   static void* read_bin(size_t *byte_count, const char* file_name);
   static void* read_spirv(size_t *byte_count, const char* file_name);
+  // Create or truncate 'file_name' and write all of 'data' to it
+  static bool write(const char* file_name, const void *data, size_t size);
 };
 
 }
@@ -0,0 +1,221 @@
+#include <charconv>
+#include <unistd.h>
+
+#include "Format.hpp"
+#include "VulkanErrors.hpp"
+
+namespace Sol {
+
+namespace {
+  static const char DIGIT_PAIRS[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+  static const char HEX_DIGITS[17] = "0123456789abcdef";
+
+  static size_t fmt_hex(char *buf, uint64_t v) {
+    char tmp[16];
+    size_t count = 0;
+    do {
+      tmp[15 - count] = HEX_DIGITS[v & 0xf];
+      v >>= 4;
+      ++count;
+    } while (v);
+    mem_cpy(buf, tmp + 16 - count, count);
+    return count;
+  }
+
+  static void write_all(int fd, const char *s, size_t len) {
+    while (len) {
+      ssize_t res = ::write(fd, s, len);
+      if (res <= 0)
+        return;
+      s += res;
+      len -= (size_t)res;
+    }
+  }
+}
+
+// FmtBuffer ////////////////////
+void FmtBuffer::put(const char *s, size_t n) {
+  if (str) {
+    size_t rem = str->cap - str->len;
+    if (rem < n)
+      str->grow(n - rem > str->cap ? n - rem : str->cap); // at least double, to amortize spills
+    char *dst = str->data();
+    mem_cpy(dst + str->len, s, n);
+    str->len += n;
+    dst[str->len] = '\0';
+    return;
+  }
+
+  size_t rem = cap - len;
+  if (n > rem)
+    n = rem;
+  mem_cpy(buf + len, s, n);
+  len += n;
+}
+void FmtBuffer::put(char c) {
+  put(&c, 1);
+}
+
+// Number Conversion ////////////
+size_t fmt_u64(char *buf, uint64_t v) {
+  // Fill from the back two digits at a time, then shift down into place
+  char tmp[20];
+  char *end = tmp + 20;
+  char *p = end;
+  while (v >= 100) {
+    uint64_t pair = (v % 100) * 2;
+    v /= 100;
+    p -= 2;
+    p[0] = DIGIT_PAIRS[pair];
+    p[1] = DIGIT_PAIRS[pair + 1];
+  }
+  if (v >= 10) {
+    p -= 2;
+    p[0] = DIGIT_PAIRS[v * 2];
+    p[1] = DIGIT_PAIRS[v * 2 + 1];
+  } else {
+    *--p = (char)('0' + v);
+  }
+  size_t count = end - p;
+  mem_cpy(buf, p, count);
+  return count;
+}
+size_t fmt_i64(char *buf, int64_t v) {
+  if (v >= 0)
+    return fmt_u64(buf, (uint64_t)v);
+  buf[0] = '-';
+  // Negate in unsigned space so INT64_MIN does not overflow
+  return 1 + fmt_u64(buf + 1, ~(uint64_t)v + 1);
+}
+
+/*
+ * std::to_chars is the shortest round trip (Ryu) conversion in libstdc++ and is guaranteed not to
+ * allocate, so there is no reason to hand roll it.
+ */
+size_t fmt_double(char *buf, double v, int precision) {
+  std::to_chars_result res;
+  if (precision < 0)
+    res = std::to_chars(buf, buf + 64, v);
+  else
+    res = std::to_chars(buf, buf + 64, v, std::chars_format::fixed, precision);
+  return res.ec == std::errc() ? res.ptr - buf : 0;
+}
+size_t fmt_float(char *buf, float v, int precision) {
+  std::to_chars_result res;
+  if (precision < 0)
+    res = std::to_chars(buf, buf + 64, v);
+  else
+    res = std::to_chars(buf, buf + 64, v, std::chars_format::fixed, precision);
+  return res.ec == std::errc() ? res.ptr - buf : 0;
+}
+
+// Formatting ///////////////////
+void format_args(FmtBuffer *out, const char *fmt, const FmtArg *args, size_t arg_count) {
+  size_t arg_index = 0;
+  const char *run = fmt;
+  const char *p = fmt;
+  char tmp[64];
+
+  while (*p) {
+    if (*p != '{' && *p != '}') {
+      ++p;
+      continue;
+    }
+
+    out->put(run, p - run);
+    if (p[0] == p[1]) { // '{{' or '}}'
+      out->put(p[0]);
+      p += 2;
+      run = p;
+      continue;
+    }
+    if (*p == '}') { // stray close brace, just print it
+      out->put('}');
+      ++p;
+      run = p;
+      continue;
+    }
+
+    // Parse the (tiny) spec: '{}', '{:.N}' or '{:x}'
+    ++p;
+    int precision = -1;
+    bool hex = false;
+    if (*p == ':') {
+      ++p;
+      if (*p == '.') {
+        ++p;
+        precision = 0;
+        while (*p >= '0' && *p <= '9') {
+          precision = precision * 10 + (*p - '0');
+          ++p;
+        }
+      } else if (*p == 'x') {
+        hex = true;
+        ++p;
+      }
+    }
+    ABORT(*p == '}', "format: malformed format spec");
+    ++p;
+    run = p;
+
+    if (arg_index >= arg_count) {
+      out->put("{?}", 3);
+      continue;
+    }
+
+    const FmtArg &arg = args[arg_index++];
+    size_t len = 0;
+    switch (arg.type) {
+      case FmtArg::INT:
+        len = hex ? fmt_hex(tmp, (uint64_t)arg.i) : fmt_i64(tmp, arg.i);
+        break;
+      case FmtArg::UINT:
+        len = hex ? fmt_hex(tmp, arg.u) : fmt_u64(tmp, arg.u);
+        break;
+      case FmtArg::FLOAT:
+        len = fmt_float(tmp, arg.f, precision);
+        break;
+      case FmtArg::DOUBLE:
+        len = fmt_double(tmp, arg.d, precision);
+        break;
+      case FmtArg::CHAR:
+        tmp[0] = arg.c;
+        len = 1;
+        break;
+      case FmtArg::BOOL:
+        out->put(arg.b ? "true" : "false", arg.b ? 4 : 5);
+        break;
+      case FmtArg::STR:
+        out->put(arg.s, arg.len ? arg.len : strlen(arg.s));
+        break;
+      case FmtArg::PTR:
+        tmp[0] = '0';
+        tmp[1] = 'x';
+        len = 2 + fmt_hex(tmp + 2, (uint64_t)(uintptr_t)arg.p);
+        break;
+    }
+    if (len)
+      out->put(tmp, len);
+  }
+  out->put(run, p - run);
+}
+
+void write_out(const char *s, size_t len) {
+  write_all(STDOUT_FILENO, s, len);
+}
+void write_err(const char *s, size_t len) {
+  write_all(STDERR_FILENO, s, len);
+}
+
+} // namespace Sol
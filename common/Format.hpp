@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "String.hpp"
+
+namespace Sol {
+
+/*
+ * Type safe formatting which never touches the heap: output goes either into a caller owned (stack)
+ * buffer, or is pushed onto a StringBuffer (which only spills to its own allocator).
+ *
+ *    format(buf, sizeof(buf), "frame {} took {:.3}ms", frame, ms);
+ *
+ * '{}' is replaced by the next argument, '{:.N}' prints a float with N decimals, '{:x}' prints an
+ * integer as hex; '{{' and '}}' are literal braces. Floats with no precision are printed as the
+ * shortest string that round trips.
+ */
+
+struct FmtArg {
+  enum Type {
+    INT,
+    UINT,
+    FLOAT,
+    DOUBLE,
+    CHAR,
+    BOOL,
+    STR,
+    PTR,
+  };
+  Type type;
+  size_t len = 0;
+  union {
+    int64_t i;
+    uint64_t u;
+    float f;
+    double d;
+    char c;
+    bool b;
+    const char *s;
+    const void *p;
+  };
+
+  FmtArg(int v)                : type(INT)    { i = v; }
+  FmtArg(long v)               : type(INT)    { i = v; }
+  FmtArg(long long v)          : type(INT)    { i = v; }
+  FmtArg(short v)              : type(INT)    { i = v; }
+  FmtArg(signed char v)        : type(INT)    { i = v; }
+  FmtArg(unsigned v)           : type(UINT)   { u = v; }
+  FmtArg(unsigned long v)      : type(UINT)   { u = v; }
+  FmtArg(unsigned long long v) : type(UINT)   { u = v; }
+  FmtArg(unsigned short v)     : type(UINT)   { u = v; }
+  FmtArg(unsigned char v)      : type(UINT)   { u = v; }
+  FmtArg(float v)              : type(FLOAT)  { f = v; }
+  FmtArg(double v)             : type(DOUBLE) { d = v; }
+  FmtArg(char v)               : type(CHAR)   { c = v; }
+  FmtArg(bool v)               : type(BOOL)   { b = v; }
+  FmtArg(const char *v)        : type(STR)    { s = v ? v : "(null)"; }
+  FmtArg(const StringBuffer &v): type(STR)    { s = v.is_inline() ? v.small : v.heap; len = v.len; }
+  FmtArg(const void *v)        : type(PTR)    { p = v; }
+};
+
+// Output sink: a fixed buffer, or a StringBuffer when 'str' is set.
+struct FmtBuffer {
+  char *buf = nullptr;
+  size_t cap = 0; // excluding the null byte
+  size_t len = 0;
+  StringBuffer *str = nullptr;
+
+  void put(const char *s, size_t n);
+  void put(char c);
+};
+
+void format_args(FmtBuffer *out, const char *fmt, const FmtArg *args, size_t arg_count);
+// Write straight to stdout/stderr with write(2): no stdio buffering or locking
+void write_out(const char *s, size_t len);
+void write_err(const char *s, size_t len);
+
+// Convert 'v' into 'buf' (no null byte), returning the char count. 'buf' must hold at least 20 chars.
+size_t fmt_u64(char *buf, uint64_t v);
+size_t fmt_i64(char *buf, int64_t v);
+// Shortest round trip representation if 'precision' < 0, else fixed with 'precision' decimals.
+// 'buf' must hold at least 64 chars.
+size_t fmt_double(char *buf, double v, int precision);
+size_t fmt_float(char *buf, float v, int precision);
+
+// Returns the formatted length (excluding the null byte), truncated to 'size' - 1.
+template<typename... Args>
+size_t format(char *buf, size_t size, const char *fmt, const Args&... args) {
+  FmtBuffer out;
+  out.buf = buf;
+  out.cap = size - 1;
+  const FmtArg list[sizeof...(Args) + 1] = { FmtArg(args)..., FmtArg(0) };
+  format_args(&out, fmt, list, sizeof...(Args));
+  buf[out.len] = '\0';
+  return out.len;
+}
+// Append to 'str'
+template<typename... Args>
+void format(StringBuffer *str, const char *fmt, const Args&... args) {
+  FmtBuffer out;
+  out.str = str;
+  const FmtArg list[sizeof...(Args) + 1] = { FmtArg(args)..., FmtArg(0) };
+  format_args(&out, fmt, list, sizeof...(Args));
+}
+
+#define FMT_PRINT_BUFFER_SIZE 1024
+
+template<typename... Args>
+void print(const char *fmt, const Args&... args) {
+  char buf[FMT_PRINT_BUFFER_SIZE];
+  size_t len = format(buf, FMT_PRINT_BUFFER_SIZE, fmt, args...);
+  write_out(buf, len);
+}
+template<typename... Args>
+void print_err(const char *fmt, const Args&... args) {
+  char buf[FMT_PRINT_BUFFER_SIZE];
+  size_t len = format(buf, FMT_PRINT_BUFFER_SIZE, fmt, args...);
+  write_err(buf, len);
+}
+
+} // namespace Sol
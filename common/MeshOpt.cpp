@@ -0,0 +1,771 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MeshOpt.hpp"
+#include "Allocator.hpp"
+#include "wyhash.h"
+
+namespace Sol {
+
+namespace {
+  /*
+   * FIFO cache as per vertex timestamps: the clock only ticks on a miss, so a vertex is still cached
+   * while fewer than 'size' misses have happened since it went in. reset() empties it in O(1).
+   */
+  struct FifoCache {
+    uint32_t *time_in;
+    uint32_t time;
+    uint32_t size;
+
+    bool init(uint32_t vertex_count, uint32_t cache_size) {
+      time_in = (uint32_t*)mem_alloca(sizeof(uint32_t) * (vertex_count ? vertex_count : 1), 16);
+      if (!time_in)
+        return false;
+      memset(time_in, 0, sizeof(uint32_t) * vertex_count);
+      size = cache_size;
+      time = cache_size + 1;
+      return true;
+    }
+    void kill() {
+      mem_free(time_in);
+    }
+    void reset() {
+      time += size + 1;
+    }
+    bool miss(uint32_t v) {
+      if (time - time_in[v] <= size)
+        return false;
+      time_in[v] = time++;
+      return true;
+    }
+    uint32_t triangle_misses(const uint32_t *tri) {
+      return miss(tri[0]) + miss(tri[1]) + miss(tri[2]);
+    }
+  };
+
+  // Welding grid cell: 'epsilon' wide, clamped so a neighbour cell never overflows
+  static int32_t weld_cell(float f, float epsilon) {
+    float cell = floorf(f / epsilon);
+    return (int32_t)fminf(fmaxf(cell, -1073741824.0f), 1073741824.0f);
+  }
+
+  // Sum of squared distances to weighted planes, as a symmetric 4x4, with the planes' total weight
+  struct Quadric {
+    double a2, b2, c2, d2, ab, ac, ad, bc, bd, cd;
+    double weight;
+
+    void add_plane(const double *n, double d, double w) {
+      a2 += w * n[0] * n[0];
+      b2 += w * n[1] * n[1];
+      c2 += w * n[2] * n[2];
+      d2 += w * d * d;
+      ab += w * n[0] * n[1];
+      ac += w * n[0] * n[2];
+      ad += w * n[0] * d;
+      bc += w * n[1] * n[2];
+      bd += w * n[1] * d;
+      cd += w * n[2] * d;
+      weight += w;
+    }
+    void add(const Quadric *q) {
+      a2 += q->a2; b2 += q->b2; c2 += q->c2; d2 += q->d2;
+      ab += q->ab; ac += q->ac; ad += q->ad;
+      bc += q->bc; bd += q->bd; cd += q->cd;
+      weight += q->weight;
+    }
+    double error(const float *p) const {
+      double x = p[0], y = p[1], z = p[2];
+      return a2 * x * x + b2 * y * y + c2 * z * z + d2 +
+          2.0 * (ab * x * y + ac * x * z + bc * y * z + ad * x + bd * y + cd * z);
+    }
+  };
+
+  enum VertexKind : uint8_t {
+    VERTEX_MANIFOLD,
+    VERTEX_BORDER, // On an edge with one triangle
+    VERTEX_LOCKED, // On a seam or a non manifold edge
+  };
+
+  struct Collapse {
+    uint32_t v; // Moves onto 't'
+    uint32_t t;
+    double cost;     // What collapses go by
+    double distance; // Its quadric part alone, the squared distance the error reports
+  };
+
+  static void cross(const double *a, const double *b, double *out) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+  }
+  static void triangle_normal(const float *p0, const float *p1, const float *p2, double *n) {
+    double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+    double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+    cross(e1, e2, n);
+  }
+  static double length(const double *v) {
+    return sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  }
+
+  struct Cluster {
+    uint32_t first; // Triangle
+    uint32_t count;
+    float sort_key;
+  };
+
+  /*
+   * Positions hash by grid cell: bit for bit with no epsilon, else by 'epsilon' cells, where a vertex is
+   * looked up in its own cell and the 26 around it, as a match within 'epsilon' may be across a cell
+   * border. The other streams go into the hash whole, so only vertices equal in those collide.
+   * UINT32_MAX if out of heap.
+   */
+  static uint32_t weld_remap(const float *positions, const MeshOpt::WeldStream *streams, uint32_t stream_count,
+      uint32_t vertex_count, float epsilon, uint32_t *remap)
+  {
+    if (!vertex_count)
+      return 0;
+    uint64_t *attr_hash = (uint64_t*)mem_alloca(sizeof(uint64_t) * vertex_count, 16);
+    int32_t *cells = (int32_t*)mem_alloca(sizeof(int32_t) * 3 * vertex_count, 16);
+    // Open addressing, one slot per unique vertex at most, so never more than half full
+    uint32_t capacity = 16;
+    while (capacity < vertex_count * 2)
+      capacity *= 2;
+    uint32_t *table = (uint32_t*)mem_alloca(sizeof(uint32_t) * capacity, 16);
+    if (!attr_hash || !cells || !table) {
+      mem_free(table);
+      mem_free(cells);
+      mem_free(attr_hash);
+      return UINT32_MAX;
+    }
+    for(uint32_t v = 0; v < vertex_count; ++v) {
+      uint64_t hash = 0;
+      for(uint32_t s = 0; s < stream_count; ++s)
+        hash = wyhash((const uint8_t*)streams[s].data + (size_t)v * streams[s].size, streams[s].size, hash, _wyp);
+      attr_hash[v] = hash;
+      if (epsilon > 0.0f)
+        for(uint32_t a = 0; a < 3; ++a)
+          cells[v * 3 + a] = weld_cell(positions[v * 3 + a], epsilon);
+      else
+        memcpy(cells + v * 3, positions + v * 3, sizeof(float) * 3);
+    }
+
+    memset(table, 0xff, sizeof(uint32_t) * capacity);
+
+    int32_t reach = epsilon > 0.0f ? 1 : 0;
+    uint32_t unique = 0;
+    for(uint32_t v = 0; v < vertex_count; ++v) {
+      uint32_t match = UINT32_MAX;
+      for(int32_t dz = -reach; dz <= reach && match == UINT32_MAX; ++dz)
+      for(int32_t dy = -reach; dy <= reach && match == UINT32_MAX; ++dy)
+      for(int32_t dx = -reach; dx <= reach && match == UINT32_MAX; ++dx) {
+        int32_t cell[3] = { cells[v * 3] + dx, cells[v * 3 + 1] + dy, cells[v * 3 + 2] + dz };
+        uint64_t hash = wyhash(cell, sizeof(cell), attr_hash[v], _wyp);
+        for(uint32_t slot = (uint32_t)hash & (capacity - 1); table[slot] != UINT32_MAX; slot = (slot + 1) & (capacity - 1)) {
+          uint32_t u = table[slot];
+          if (attr_hash[u] != attr_hash[v] || memcmp(cells + u * 3, cell, sizeof(cell)) != 0)
+            continue;
+          bool same = true;
+          for(uint32_t a = 0; a < 3 && same; ++a)
+            same = fabsf(positions[u * 3 + a] - positions[v * 3 + a]) <= epsilon || epsilon <= 0.0f;
+          for(uint32_t s = 0; s < stream_count && same; ++s)
+            same = memcmp((const uint8_t*)streams[s].data + (size_t)u * streams[s].size,
+                          (const uint8_t*)streams[s].data + (size_t)v * streams[s].size, streams[s].size) == 0;
+          if (same) {
+            match = u;
+            break;
+          }
+        }
+      }
+      if (match != UINT32_MAX) {
+        remap[v] = remap[match];
+        continue;
+      }
+      uint64_t hash = wyhash(cells + v * 3, sizeof(int32_t) * 3, attr_hash[v], _wyp);
+      uint32_t slot = (uint32_t)hash & (capacity - 1);
+      while (table[slot] != UINT32_MAX)
+        slot = (slot + 1) & (capacity - 1);
+      table[slot] = v;
+      remap[v] = unique++;
+    }
+    mem_free(table);
+    mem_free(cells);
+    mem_free(attr_hash);
+    return unique;
+  }
+}
+
+uint32_t MeshOpt::weld(const float *positions, const WeldStream *streams, uint32_t stream_count, uint32_t vertex_count,
+    float epsilon, uint32_t *remap)
+{
+  uint32_t unique = weld_remap(positions, streams, stream_count, vertex_count, epsilon, remap);
+  if (unique != UINT32_MAX)
+    return unique;
+  for(uint32_t v = 0; v < vertex_count; ++v)
+    remap[v] = v;
+  return vertex_count;
+}
+
+void MeshOpt::compact_vertices(void *data, uint32_t size, const uint32_t *remap, uint32_t vertex_count) {
+  uint8_t *bytes = (uint8_t*)data;
+  uint32_t next = 0;
+  for(uint32_t v = 0; v < vertex_count; ++v) {
+    if (remap[v] != next)
+      continue;
+    if (next != v)
+      memcpy(bytes + (size_t)next * size, bytes + (size_t)v * size, size);
+    ++next;
+  }
+}
+
+/*
+ * Passes over the mesh: each picks every movable vertex's cheapest collapse, then applies them cheapest
+ * first, skipping those next to one already applied this pass (their costs are stale) and those that
+ * would flip a triangle, until the target is reached. Positions are scaled into a unit box first, so the
+ * attribute weights mean the same for any mesh.
+ */
+uint32_t MeshOpt::simplify(uint32_t *out, const uint32_t *indices, uint32_t index_count, const float *positions,
+    uint32_t vertex_count, const SimplifyAttribute *attributes, uint32_t attribute_count, uint32_t target_index_count,
+    float target_error, float *error)
+{
+  *error = 0.0f;
+  uint32_t count = 0;
+  for(uint32_t i = 0; i + 2 < index_count; i += 3) {
+    uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+    if (a == b || b == c || a == c)
+      continue;
+    out[count++] = a;
+    out[count++] = b;
+    out[count++] = c;
+  }
+  if (count <= target_index_count || !vertex_count)
+    return count;
+
+  float min[3] = { INFINITY, INFINITY, INFINITY };
+  float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+  for(uint32_t i = 0; i < count; ++i)
+    for(uint32_t a = 0; a < 3; ++a) {
+      min[a] = fminf(min[a], positions[out[i] * 3 + a]);
+      max[a] = fmaxf(max[a], positions[out[i] * 3 + a]);
+    }
+  float extent = fmaxf(fmaxf(max[0] - min[0], max[1] - min[1]), max[2] - min[2]);
+  float scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+  float *pos = (float*)mem_alloca(sizeof(float) * 3 * vertex_count, 16);
+  uint8_t *kind = (uint8_t*)mem_alloca(vertex_count, 16);
+  uint64_t *edges = (uint64_t*)mem_alloca(sizeof(uint64_t) * count, 16);
+  Quadric *quadrics = (Quadric*)mem_alloca(sizeof(Quadric) * vertex_count, 16);
+  if (!pos || !kind || !edges || !quadrics) {
+    mem_free(quadrics);
+    mem_free(edges);
+    mem_free(kind);
+    mem_free(pos);
+    return count;
+  }
+  for(uint32_t v = 0; v < vertex_count; ++v)
+    for(uint32_t a = 0; a < 3; ++a)
+      pos[v * 3 + a] = (positions[v * 3 + a] - min[a]) * scale;
+
+  // Vertex kinds, from the directed edges: a missing reverse is a border, a repeat is non manifold
+  memset(kind, VERTEX_MANIFOLD, vertex_count);
+  for(uint32_t i = 0; i < count; ++i) {
+    uint32_t next = i % 3 == 2 ? i - 2 : i + 1;
+    edges[i] = (uint64_t)out[i] << 32 | out[next];
+  }
+  std::sort(edges, edges + count);
+  for(uint32_t i = 0; i < count; ++i) {
+    uint32_t a = (uint32_t)(edges[i] >> 32), b = (uint32_t)edges[i];
+    if ((i + 1 < count && edges[i + 1] == edges[i]) || (i && edges[i - 1] == edges[i])) {
+      kind[a] = VERTEX_LOCKED;
+      kind[b] = VERTEX_LOCKED;
+    } else if (!std::binary_search(edges, edges + count, (uint64_t)b << 32 | a)) {
+      kind[a] = kind[a] == VERTEX_LOCKED ? VERTEX_LOCKED : VERTEX_BORDER;
+      kind[b] = kind[b] == VERTEX_LOCKED ? VERTEX_LOCKED : VERTEX_BORDER;
+    }
+  }
+  uint32_t *seams = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  uint32_t *users = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  uint8_t *used = (uint8_t*)mem_alloca(vertex_count, 16);
+  if (!seams || !users || !used || weld_remap(positions, nullptr, 0, vertex_count, 0.0f, seams) == UINT32_MAX) {
+    mem_free(used);
+    mem_free(users);
+    mem_free(seams);
+    mem_free(quadrics);
+    mem_free(edges);
+    mem_free(kind);
+    mem_free(pos);
+    return count;
+  }
+  memset(users, 0, sizeof(uint32_t) * vertex_count);
+  memset(used, 0, vertex_count);
+  for(uint32_t i = 0; i < count; ++i)
+    used[out[i]] = 1;
+  for(uint32_t v = 0; v < vertex_count; ++v)
+    users[seams[v]] += used[v];
+  for(uint32_t v = 0; v < vertex_count; ++v)
+    if (users[seams[v]] > 1)
+      kind[v] = VERTEX_LOCKED;
+  mem_free(used);
+  mem_free(users);
+  mem_free(seams);
+
+  // Each triangle's plane, area weighted, and for a border edge the plane through it square to the
+  // triangle, so the border keeps its shape too
+  const double BORDER_WEIGHT = 10.0;
+  memset(quadrics, 0, sizeof(Quadric) * vertex_count);
+  for(uint32_t i = 0; i < count; i += 3) {
+    double n[3];
+    triangle_normal(pos + out[i] * 3, pos + out[i + 1] * 3, pos + out[i + 2] * 3, n);
+    double len = length(n);
+    if (len == 0.0)
+      continue;
+    for(uint32_t a = 0; a < 3; ++a)
+      n[a] /= len;
+    const float *p0 = pos + out[i] * 3;
+    double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+    for(uint32_t c = 0; c < 3; ++c)
+      quadrics[out[i + c]].add_plane(n, d, len * 0.5);
+
+    for(uint32_t c = 0; c < 3; ++c) {
+      uint32_t a = out[i + c], b = out[i + (c + 1) % 3];
+      if (std::binary_search(edges, edges + count, (uint64_t)b << 32 | a))
+        continue;
+      double e[3] = { (double)pos[b * 3] - pos[a * 3], (double)pos[b * 3 + 1] - pos[a * 3 + 1],
+                      (double)pos[b * 3 + 2] - pos[a * 3 + 2] };
+      double en[3];
+      cross(e, n, en);
+      double en_len = length(en);
+      if (en_len == 0.0)
+        continue;
+      for(uint32_t k = 0; k < 3; ++k)
+        en[k] /= en_len;
+      double ed = -(en[0] * pos[a * 3] + en[1] * pos[a * 3 + 1] + en[2] * pos[a * 3 + 2]);
+      double w = (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]) * BORDER_WEIGHT;
+      quadrics[a].add_plane(en, ed, w);
+      quadrics[b].add_plane(en, ed, w);
+    }
+  }
+  mem_free(edges);
+
+  uint32_t *live = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  uint32_t *offsets = (uint32_t*)mem_alloca(sizeof(uint32_t) * (vertex_count + 1), 16);
+  uint32_t *adjacency = (uint32_t*)mem_alloca(sizeof(uint32_t) * count, 16);
+  uint32_t *collapse = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  uint8_t *touched = (uint8_t*)mem_alloca(vertex_count, 16);
+  Collapse *candidates = (Collapse*)mem_alloca(sizeof(Collapse) * vertex_count, 16);
+  if (!live || !offsets || !adjacency || !collapse || !touched || !candidates) {
+    mem_free(candidates);
+    mem_free(touched);
+    mem_free(collapse);
+    mem_free(adjacency);
+    mem_free(offsets);
+    mem_free(live);
+    mem_free(quadrics);
+    mem_free(kind);
+    mem_free(pos);
+    return count;
+  }
+  for(uint32_t v = 0; v < vertex_count; ++v)
+    collapse[v] = v;
+
+  double limit = (double)target_error * scale;
+  limit *= limit;
+  double max_distance = 0.0;
+  while (count > target_index_count) {
+    memset(live, 0, sizeof(uint32_t) * vertex_count);
+    for(uint32_t i = 0; i < count; ++i)
+      ++live[out[i]];
+    offsets[0] = 0;
+    for(uint32_t v = 0; v < vertex_count; ++v)
+      offsets[v + 1] = offsets[v] + live[v];
+    memcpy(live, offsets, sizeof(uint32_t) * vertex_count);
+    for(uint32_t i = 0; i < count; ++i)
+      adjacency[live[out[i]]++] = i / 3;
+
+    uint32_t candidate_count = 0;
+    for(uint32_t v = 0; v < vertex_count; ++v) {
+      if (kind[v] == VERTEX_LOCKED || offsets[v] == offsets[v + 1])
+        continue;
+      Collapse best = { v, v, INFINITY, 0.0 };
+      for(uint32_t a = offsets[v]; a < offsets[v + 1]; ++a) {
+        for(uint32_t c = 0; c < 3; ++c) {
+          uint32_t t = out[adjacency[a] * 3 + c];
+          if (t == v)
+            continue;
+          if (kind[v] == VERTEX_BORDER) {
+            uint32_t shared = 0;
+            for(uint32_t b = offsets[v]; b < offsets[v + 1]; ++b) {
+              const uint32_t *tri = out + adjacency[b] * 3;
+              shared += tri[0] == t || tri[1] == t || tri[2] == t;
+            }
+            if (shared != 1)
+              continue;
+          }
+          Quadric q = quadrics[v];
+          q.add(&quadrics[t]);
+          double distance = q.weight > 0.0 ? fmax(q.error(pos + t * 3), 0.0) / q.weight : 0.0;
+          double cost = distance;
+          for(uint32_t k = 0; k < attribute_count; ++k) {
+            const SimplifyAttribute *attr = &attributes[k];
+            for(uint32_t i = 0; i < attr->components; ++i) {
+              double diff = attr->data[v * attr->components + i] - attr->data[t * attr->components + i];
+              cost += attr->weight * diff * diff;
+            }
+          }
+          if (cost < best.cost)
+            best = { v, t, cost, distance };
+        }
+      }
+      if (best.t != v)
+        candidates[candidate_count++] = best;
+    }
+    std::sort(candidates, candidates + candidate_count,
+        [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+    memset(touched, 0, vertex_count);
+    uint32_t removed = 0;
+    uint32_t applied = 0;
+    for(uint32_t i = 0; i < candidate_count && count - removed > target_index_count; ++i) {
+      Collapse *cand = &candidates[i];
+      if (cand->distance > limit)
+        continue;
+      if (touched[cand->v] || touched[cand->t])
+        continue;
+
+      // No triangle that keeps its area may turn more than ~75 degrees
+      bool flips = false;
+      for(uint32_t a = offsets[cand->v]; a < offsets[cand->v + 1] && !flips; ++a) {
+        const uint32_t *tri = out + adjacency[a] * 3;
+        if (tri[0] == cand->t || tri[1] == cand->t || tri[2] == cand->t)
+          continue;
+        const float *p[3];
+        for(uint32_t c = 0; c < 3; ++c)
+          p[c] = pos + (tri[c] == cand->v ? cand->t : tri[c]) * 3;
+        double before[3], after[3];
+        triangle_normal(pos + tri[0] * 3, pos + tri[1] * 3, pos + tri[2] * 3, before);
+        triangle_normal(p[0], p[1], p[2], after);
+        double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        flips = dot <= 0.25 * length(before) * length(after);
+      }
+      if (flips)
+        continue;
+
+      collapse[cand->v] = cand->t;
+      quadrics[cand->t].add(&quadrics[cand->v]);
+      max_distance = fmax(max_distance, cand->distance);
+      for(uint32_t a = offsets[cand->v]; a < offsets[cand->v + 1]; ++a) {
+        const uint32_t *tri = out + adjacency[a] * 3;
+        touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+        removed += tri[0] == cand->t || tri[1] == cand->t || tri[2] == cand->t ? 3 : 0;
+      }
+      ++applied;
+    }
+    if (!applied)
+      break;
+
+    uint32_t next = 0;
+    for(uint32_t i = 0; i < count; i += 3) {
+      uint32_t a = collapse[out[i]], b = collapse[out[i + 1]], c = collapse[out[i + 2]];
+      if (a == b || b == c || a == c)
+        continue;
+      out[next++] = a;
+      out[next++] = b;
+      out[next++] = c;
+    }
+    count = next;
+  }
+
+  mem_free(candidates);
+  mem_free(touched);
+  mem_free(collapse);
+  mem_free(adjacency);
+  mem_free(offsets);
+  mem_free(live);
+  mem_free(quadrics);
+  mem_free(kind);
+  mem_free(pos);
+  *error = (float)(sqrt(max_distance) / scale);
+  return count;
+}
+
+VertexCacheStats MeshOpt::analyze_vertex_cache(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count,
+    uint32_t cache_size)
+{
+  VertexCacheStats stats = {};
+  if (index_count < 3)
+    return stats;
+  FifoCache cache;
+  if (!cache.init(vertex_count, cache_size))
+    return stats;
+  uint8_t *used = (uint8_t*)mem_alloca(vertex_count ? vertex_count : 1, 16);
+  if (!used) {
+    cache.kill();
+    return stats;
+  }
+  memset(used, 0, vertex_count);
+
+  uint32_t misses = 0;
+  uint32_t unique = 0;
+  for(uint32_t i = 0; i < index_count; ++i) {
+    misses += cache.miss(indices[i]);
+    unique += !used[indices[i]];
+    used[indices[i]] = 1;
+  }
+  stats.acmr = (float)misses / (float)(index_count / 3);
+  stats.atvr = (float)misses / (float)unique;
+  mem_free(used);
+  cache.kill();
+  return stats;
+}
+
+/*
+ * Tipsify: emit every live triangle around a 'fan' vertex, then move the fan to the vertex among those
+ * just emitted that is oldest in the cache while it would still be cached after its remaining
+ * triangles are emitted. With no such vertex, back up the stack of recently emitted vertices for one
+ * with triangles left (the dead end case), and failing that take the next vertex in index order.
+ */
+void MeshOpt::optimize_vertex_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+  uint32_t tri_count = index_count / 3;
+  if (!tri_count)
+    return;
+  for(uint32_t i = 0; i < tri_count * 3; ++i)
+    if (indices[i] >= vertex_count)
+      return;
+
+  // Vertex to triangle adjacency, one list, by offsets
+  uint32_t *live = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  uint32_t *offsets = (uint32_t*)mem_alloca(sizeof(uint32_t) * (vertex_count + 1), 16);
+  uint32_t *adjacency = (uint32_t*)mem_alloca(sizeof(uint32_t) * tri_count * 3, 16);
+  uint32_t *fill = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  uint8_t *emitted = (uint8_t*)mem_alloca(tri_count, 16);
+  uint32_t *dead_ends = (uint32_t*)mem_alloca(sizeof(uint32_t) * tri_count * 3, 16);
+  uint32_t *candidates = (uint32_t*)mem_alloca(sizeof(uint32_t) * tri_count * 3, 16);
+  uint32_t *out = (uint32_t*)mem_alloca(sizeof(uint32_t) * tri_count * 3, 16);
+  FifoCache cache;
+  bool ok = cache.init(vertex_count, cache_size);
+  if (!ok || !live || !offsets || !adjacency || !fill || !emitted || !dead_ends || !candidates || !out) {
+    cache.kill();
+    mem_free(out);
+    mem_free(candidates);
+    mem_free(dead_ends);
+    mem_free(emitted);
+    mem_free(fill);
+    mem_free(adjacency);
+    mem_free(offsets);
+    mem_free(live);
+    return;
+  }
+  memset(live, 0, sizeof(uint32_t) * vertex_count);
+  for(uint32_t i = 0; i < tri_count * 3; ++i)
+    ++live[indices[i]];
+  offsets[0] = 0;
+  for(uint32_t v = 0; v < vertex_count; ++v)
+    offsets[v + 1] = offsets[v] + live[v];
+  memcpy(fill, offsets, sizeof(uint32_t) * vertex_count);
+  for(uint32_t t = 0; t < tri_count; ++t)
+    for(uint32_t c = 0; c < 3; ++c)
+      adjacency[fill[indices[t * 3 + c]]++] = t;
+  mem_free(fill);
+  memset(emitted, 0, tri_count);
+
+  uint32_t dead_end_count = 0;
+  uint32_t out_count = 0;
+  uint32_t cursor = 0;
+  uint32_t fan = 0;
+  while (cursor < vertex_count && !live[cursor])
+    ++cursor;
+  fan = cursor;
+
+  while (fan < vertex_count) {
+    uint32_t candidate_count = 0;
+    for(uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+      uint32_t t = adjacency[a];
+      if (emitted[t])
+        continue;
+      emitted[t] = 1;
+      for(uint32_t c = 0; c < 3; ++c) {
+        uint32_t v = indices[t * 3 + c];
+        out[out_count++] = v;
+        dead_ends[dead_end_count++] = v;
+        candidates[candidate_count++] = v;
+        --live[v];
+        cache.miss(v);
+      }
+    }
+
+    uint32_t next = UINT32_MAX;
+    uint32_t best = 0;
+    for(uint32_t i = 0; i < candidate_count; ++i) {
+      uint32_t v = candidates[i];
+      if (!live[v])
+        continue;
+      uint32_t age = cache.time - cache.time_in[v];
+      uint32_t priority = age + 2 * live[v] <= cache_size ? age : 0;
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+    while (next == UINT32_MAX && dead_end_count) {
+      uint32_t v = dead_ends[--dead_end_count];
+      if (live[v])
+        next = v;
+    }
+    while (next == UINT32_MAX && cursor < vertex_count) {
+      if (live[cursor])
+        next = cursor;
+      ++cursor;
+    }
+    fan = next;
+  }
+
+  memcpy(indices, out, sizeof(uint32_t) * out_count);
+  cache.kill();
+  mem_free(out);
+  mem_free(candidates);
+  mem_free(dead_ends);
+  mem_free(emitted);
+  mem_free(adjacency);
+  mem_free(offsets);
+  mem_free(live);
+}
+
+/*
+ * Sander, Nehab and Barczak 2007: a cluster whose area weighted normal points away from the mesh's
+ * centroid is on the outside, so is likely to occlude others; those are drawn first, most outward first.
+ */
+void MeshOpt::optimize_overdraw(uint32_t *indices, uint32_t index_count, const float *positions, uint32_t vertex_count,
+    float threshold, uint32_t cache_size)
+{
+  uint32_t tri_count = index_count / 3;
+  if (tri_count < 2)
+    return;
+  for(uint32_t i = 0; i < tri_count * 3; ++i)
+    if (indices[i] >= vertex_count)
+      return;
+
+  FifoCache cache;
+  bool ok = cache.init(vertex_count, cache_size);
+  Cluster *clusters = (Cluster*)mem_alloca(sizeof(Cluster) * tri_count, 16);
+  uint32_t cluster_count = 0;
+
+  // Hard boundaries: the cache order had nothing cached to go on
+  uint32_t *hard = (uint32_t*)mem_alloca(sizeof(uint32_t) * (tri_count + 1), 16);
+  if (!ok || !clusters || !hard) {
+    mem_free(hard);
+    mem_free(clusters);
+    cache.kill();
+    return;
+  }
+  uint32_t hard_count = 0;
+  for(uint32_t t = 0; t < tri_count; ++t)
+    if (cache.triangle_misses(indices + t * 3) == 3 || t == 0)
+      hard[hard_count++] = t;
+  hard[hard_count] = tri_count;
+
+  // Soft boundaries inside each, where the cluster so far is about as cache friendly as the whole
+  for(uint32_t h = 0; h < hard_count; ++h) {
+    uint32_t start = hard[h];
+    uint32_t end = hard[h + 1];
+    cache.reset();
+    uint32_t misses = 0;
+    for(uint32_t t = start; t < end; ++t)
+      misses += cache.triangle_misses(indices + t * 3);
+    float limit = threshold * (float)misses / (float)(end - start);
+
+    cache.reset();
+    misses = 0;
+    uint32_t first = start;
+    for(uint32_t t = start; t < end; ++t) {
+      misses += cache.triangle_misses(indices + t * 3);
+      if (t + 1 < end && (float)misses <= limit * (float)(t + 1 - first)) {
+        clusters[cluster_count++] = { first, t + 1 - first, 0.0f };
+        first = t + 1;
+        misses = 0;
+        cache.reset();
+      }
+    }
+    clusters[cluster_count++] = { first, end - first, 0.0f };
+  }
+  mem_free(hard);
+  cache.kill();
+  if (cluster_count < 2) {
+    mem_free(clusters);
+    return;
+  }
+
+  // Per cluster area weighted centroid and normal ('normals' holds the centroid then the normal)
+  float *normals = (float*)mem_alloca(sizeof(float) * 6 * cluster_count, 16);
+  uint32_t *out = (uint32_t*)mem_alloca(sizeof(uint32_t) * tri_count * 3, 16);
+  if (!normals || !out) {
+    mem_free(out);
+    mem_free(normals);
+    mem_free(clusters);
+    return;
+  }
+  float mesh_centroid[3] = {};
+  float mesh_area = 0.0f;
+  for(uint32_t c = 0; c < cluster_count; ++c) {
+    float *centroid = normals + c * 6;
+    float *normal = centroid + 3;
+    float area = 0.0f;
+    memset(centroid, 0, sizeof(float) * 6);
+    for(uint32_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t) {
+      const float *p0 = positions + indices[t * 3] * 3;
+      const float *p1 = positions + indices[t * 3 + 1] * 3;
+      const float *p2 = positions + indices[t * 3 + 2] * 3;
+      float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+      float a = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      for(uint32_t i = 0; i < 3; ++i) {
+        normal[i] += n[i];
+        centroid[i] += (p0[i] + p1[i] + p2[i]) * (a / 3.0f);
+      }
+      area += a;
+    }
+    for(uint32_t i = 0; i < 3; ++i)
+      mesh_centroid[i] += centroid[i];
+    mesh_area += area;
+    if (area > 0.0f)
+      for(uint32_t i = 0; i < 3; ++i)
+        centroid[i] /= area;
+  }
+  if (mesh_area > 0.0f)
+    for(uint32_t i = 0; i < 3; ++i)
+      mesh_centroid[i] /= mesh_area;
+  for(uint32_t c = 0; c < cluster_count; ++c) {
+    const float *centroid = normals + c * 6;
+    const float *normal = centroid + 3;
+    float len = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+    float key = 0.0f;
+    for(uint32_t i = 0; i < 3; ++i)
+      key += (centroid[i] - mesh_centroid[i]) * normal[i];
+    clusters[c].sort_key = len > 0.0f ? key / len : 0.0f;
+  }
+  mem_free(normals);
+
+  std::stable_sort(clusters, clusters + cluster_count,
+      [](const Cluster &a, const Cluster &b) { return a.sort_key > b.sort_key; });
+  uint32_t out_count = 0;
+  for(uint32_t c = 0; c < cluster_count; ++c) {
+    memcpy(out + out_count, indices + clusters[c].first * 3, sizeof(uint32_t) * 3 * clusters[c].count);
+    out_count += clusters[c].count * 3;
+  }
+  memcpy(indices, out, sizeof(uint32_t) * out_count);
+  mem_free(out);
+  mem_free(clusters);
+}
+
+uint32_t MeshOpt::optimize_vertex_fetch(uint32_t *indices, uint32_t index_count, uint32_t vertex_count, uint32_t *remap) {
+  memset(remap, 0xff, sizeof(uint32_t) * vertex_count);
+  uint32_t next = 0;
+  for(uint32_t i = 0; i < index_count; ++i) {
+    uint32_t v = indices[i];
+    if (remap[v] == UINT32_MAX)
+      remap[v] = next++;
+    indices[i] = remap[v];
+  }
+  return next;
+}
+
+} // namespace Sol
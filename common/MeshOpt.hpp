@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Sol {
+
+// Post transform vertex cache behaviour of an index buffer, for a FIFO cache
+struct VertexCacheStats {
+  float acmr; // Misses per triangle: 3 is no reuse, ~0.5 the ideal for a regular grid
+  float atvr; // Misses per referenced vertex: 1 is ideal
+};
+
+/*
+ * Cook time mesh optimization, in the order it should run:
+ *    weld                  - duplicate vertices merged, which gives a non-indexed primitive its indices
+ *    simplify              - LODs, per LOD from here on
+ *    optimize_vertex_cache - Tipsify (Sander et al. 2007) triangle order for a FIFO cache of 'cache_size'
+ *    optimize_overdraw     - clusters of that order sorted front facing outward first, for early z
+ *    optimize_vertex_fetch - vertices renumbered in first use order, so fetches walk memory forwards
+ * Temporary memory is from the HeapAllocator; a pass that runs out of it leaves its input as it is
+ * (weld returns an identity remap, analyze_vertex_cache zeroed stats).
+ */
+struct MeshOpt {
+  static const uint32_t CACHE_SIZE = 16;
+
+  // One per vertex attribute besides the position: 'size' bytes a vertex, tightly packed
+  struct WeldStream {
+    const void *data;
+    uint32_t size;
+  };
+  /*
+   * Vertices whose streams are byte for byte the same, and whose positions (vec3s) are the same or,
+   * with an 'epsilon', at most that far apart per axis, get the same 'remap' entry. Entries count up
+   * from 0 in first use order, so each duplicate maps onto an earlier vertex; returns how many are unique.
+   */
+  static uint32_t weld(const float *positions, const WeldStream *streams, uint32_t stream_count, uint32_t vertex_count,
+      float epsilon, uint32_t *remap);
+  // In place: the first vertex with each 'remap' entry moves to that slot, for a remap from weld()
+  static void compact_vertices(void *data, uint32_t size, const uint32_t *remap, uint32_t vertex_count);
+
+  // A float vertex attribute the simplifier keeps close: 'weight' scales its squared difference
+  struct SimplifyAttribute {
+    const float *data;
+    uint32_t components;
+    float weight;
+  };
+  /*
+   * Quadric error metric (Garland and Heckbert 1997) simplification of a triangle list to at most
+   * 'target_index_count' indices, or as close as it gets without an error past 'target_error'. Edges
+   * collapse onto one of their vertices, so the result indexes the same vertices and every LOD of a mesh
+   * can share one vertex buffer. The cost of a collapse is its quadric error plus the attributes' weighted
+   * squared difference. Border vertices only move along the border; vertices on attribute seams (the same
+   * position as another vertex) or non manifold edges never move.
+   * Writes the indices to 'out' (room for 'index_count'), returns how many, and sets 'error' to the
+   * largest collapse error it allowed, as a distance from the source surface in the positions' units.
+   * Out of heap, 'out' is just 'indices' without their degenerate triangles.
+   */
+  static uint32_t simplify(uint32_t *out, const uint32_t *indices, uint32_t index_count, const float *positions,
+      uint32_t vertex_count, const SimplifyAttribute *attributes, uint32_t attribute_count, uint32_t target_index_count,
+      float target_error, float *error);
+
+  static VertexCacheStats analyze_vertex_cache(const uint32_t *indices, uint32_t index_count, uint32_t vertex_count,
+      uint32_t cache_size = CACHE_SIZE);
+
+  static void optimize_vertex_cache(uint32_t *indices, uint32_t index_count, uint32_t vertex_count,
+      uint32_t cache_size = CACHE_SIZE);
+  /*
+   * Clusters start wherever the cache order jumps (all 3 vertices miss), and are split further where the
+   * cluster so far already has an ACMR within 'threshold' of the whole one's, so a higher threshold
+   * gives more, smaller clusters: less overdraw, more cache misses. 'positions' are vec3s.
+   */
+  static void optimize_overdraw(uint32_t *indices, uint32_t index_count, const float *positions, uint32_t vertex_count,
+      float threshold = 1.05f, uint32_t cache_size = CACHE_SIZE);
+  // 'remap' gets each old vertex's new index, ~0u if nothing uses it; returns the used vertex count
+  static uint32_t optimize_vertex_fetch(uint32_t *indices, uint32_t index_count, uint32_t vertex_count, uint32_t *remap);
+};
+
+} // namespace Sol
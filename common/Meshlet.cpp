@@ -0,0 +1,197 @@
+#include <cmath>
+#include <cstring>
+
+#include "Meshlet.hpp"
+
+namespace Sol {
+
+namespace {
+  static void normalize(float *v) {
+    float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (len > 0.0f)
+      for(uint32_t i = 0; i < 3; ++i)
+        v[i] /= len;
+  }
+
+  /*
+   * Sphere around the vertices' box. The cone is the average of the unit triangle normals; when
+   * some normal is near square to it or beyond, the meshlet is never back facing as a whole.
+   */
+  static void meshlet_bounds(Meshlet *m, const uint32_t *vertices, const uint8_t *triangles, const float *positions) {
+    float min[3] = { INFINITY, INFINITY, INFINITY };
+    float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for(uint32_t i = 0; i < m->vertex_count; ++i)
+      for(uint32_t a = 0; a < 3; ++a) {
+        min[a] = fminf(min[a], positions[vertices[m->vertex_offset + i] * 3 + a]);
+        max[a] = fmaxf(max[a], positions[vertices[m->vertex_offset + i] * 3 + a]);
+      }
+    for(uint32_t a = 0; a < 3; ++a)
+      m->center[a] = (min[a] + max[a]) * 0.5f;
+    float radius2 = 0.0f;
+    for(uint32_t i = 0; i < m->vertex_count; ++i) {
+      const float *p = positions + vertices[m->vertex_offset + i] * 3;
+      float d[3] = { p[0] - m->center[0], p[1] - m->center[1], p[2] - m->center[2] };
+      radius2 = fmaxf(radius2, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    m->radius = sqrtf(radius2);
+
+    float normals[Meshlets::MAX_TRIANGLES][3];
+    uint32_t normal_count = 0;
+    float axis[3] = {};
+    for(uint32_t t = 0; t < m->triangle_count; ++t) {
+      const uint8_t *tri = triangles + m->triangle_offset + t * 3;
+      const float *p0 = positions + vertices[m->vertex_offset + tri[0]] * 3;
+      const float *p1 = positions + vertices[m->vertex_offset + tri[1]] * 3;
+      const float *p2 = positions + vertices[m->vertex_offset + tri[2]] * 3;
+      float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+      float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+      float *n = normals[normal_count];
+      n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+      n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+      n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+      if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+        continue;
+      normalize(n);
+      for(uint32_t a = 0; a < 3; ++a)
+        axis[a] += n[a];
+      ++normal_count;
+    }
+    normalize(axis);
+    float min_dot = normal_count ? 1.0f : -1.0f;
+    for(uint32_t i = 0; i < normal_count; ++i)
+      min_dot = fminf(min_dot, axis[0] * normals[i][0] + axis[1] * normals[i][1] + axis[2] * normals[i][2]);
+    memcpy(m->cone_axis, axis, sizeof(axis));
+    m->cone_cutoff = min_dot <= 0.1f ? 1.0f : sqrtf(1.0f - min_dot * min_dot);
+  }
+}
+
+// Every meshlet but the last ends on a full triangle list, or with more than MAX_VERTICES - 3 vertices
+uint32_t Meshlets::max_count(uint32_t index_count) {
+  return index_count / 3 / ((MAX_VERTICES - 2) / 3) + 1;
+}
+
+uint32_t Meshlets::build(Meshlet *meshlets, uint32_t *vertices, uint8_t *triangles, const uint32_t *indices,
+    uint32_t index_count, const float *positions, uint32_t *vertex_count, uint32_t *triangle_bytes)
+{
+  uint32_t meshlet_count = 0;
+  uint32_t vertex_total = 0;
+  uint32_t triangle_total = 0;
+  Meshlet *m = nullptr;
+  for(uint32_t i = 0; i + 2 < index_count; i += 3) {
+    // Local index of each corner, MAX_VERTICES if it is new to the meshlet
+    uint8_t local[3] = { MAX_VERTICES, MAX_VERTICES, MAX_VERTICES };
+    uint32_t added = 0;
+    if (m) {
+      for(uint32_t c = 0; c < 3; ++c) {
+        for(uint32_t v = 0; v < m->vertex_count; ++v)
+          if (vertices[m->vertex_offset + v] == indices[i + c])
+            local[c] = (uint8_t)v;
+        bool repeat = (c > 0 && indices[i + c] == indices[i]) || (c > 1 && indices[i + c] == indices[i + 1]);
+        added += local[c] == MAX_VERTICES && !repeat;
+      }
+    }
+    if (!m || m->vertex_count + added > MAX_VERTICES || m->triangle_count == MAX_TRIANGLES) {
+      if (m)
+        meshlet_bounds(m, vertices, triangles, positions);
+      m = &meshlets[meshlet_count++];
+      memset(m, 0, sizeof(*m));
+      m->vertex_offset = vertex_total;
+      m->triangle_offset = triangle_total;
+      local[0] = local[1] = local[2] = MAX_VERTICES;
+    }
+    for(uint32_t c = 0; c < 3; ++c) {
+      if (local[c] == MAX_VERTICES) {
+        for(uint32_t v = 0; v < m->vertex_count && local[c] == MAX_VERTICES; ++v)
+          if (vertices[m->vertex_offset + v] == indices[i + c])
+            local[c] = (uint8_t)v;
+      }
+      if (local[c] == MAX_VERTICES) {
+        local[c] = (uint8_t)m->vertex_count++;
+        vertices[vertex_total++] = indices[i + c];
+      }
+      triangles[triangle_total++] = local[c];
+    }
+    ++m->triangle_count;
+  }
+  if (m)
+    meshlet_bounds(m, vertices, triangles, positions);
+  *vertex_count = vertex_total;
+  *triangle_bytes = triangle_total;
+  return meshlet_count;
+}
+
+// Gribb and Hartmann, for Vulkan's clip volume: -w <= x, y <= w and 0 <= z <= w. The near plane is z >= 0,
+// which is only the camera's near plane for a 0 to 1 depth projection (see Camera::mat_proj); with GL's
+// -1 to 1 it would be rows[3] + rows[2]
+void Meshlets::frustum(const float *clip_from_mesh, const float *camera, MeshletFrustum *out) {
+  float rows[4][4];
+  for(uint32_t r = 0; r < 4; ++r)
+    for(uint32_t c = 0; c < 4; ++c)
+      rows[r][c] = clip_from_mesh[c * 4 + r];
+  for(uint32_t c = 0; c < 4; ++c) {
+    out->planes[0][c] = rows[3][c] + rows[0][c];
+    out->planes[1][c] = rows[3][c] - rows[0][c];
+    out->planes[2][c] = rows[3][c] + rows[1][c];
+    out->planes[3][c] = rows[3][c] - rows[1][c];
+    out->planes[4][c] = rows[2][c];
+    out->planes[5][c] = rows[3][c] - rows[2][c];
+  }
+  for(uint32_t p = 0; p < 6; ++p) {
+    float *plane = out->planes[p];
+    float len = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+    if (len > 0.0f)
+      for(uint32_t c = 0; c < 4; ++c)
+        plane[c] /= len;
+  }
+  memcpy(out->camera, camera, sizeof(out->camera));
+}
+
+// The cone test is for the whole sphere, so it holds wherever in the meshlet the apex would be
+bool Meshlets::visible(const Meshlet *m, const MeshletFrustum *frustum) {
+  for(uint32_t p = 0; p < 6; ++p) {
+    const float *plane = frustum->planes[p];
+    if (plane[0] * m->center[0] + plane[1] * m->center[1] + plane[2] * m->center[2] + plane[3] < -m->radius)
+      return false;
+  }
+  float d[3] = { m->center[0] - frustum->camera[0], m->center[1] - frustum->camera[1], m->center[2] - frustum->camera[2] };
+  float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+  float along = d[0] * m->cone_axis[0] + d[1] * m->cone_axis[1] + d[2] * m->cone_axis[2];
+  return along < m->cone_cutoff * distance + m->radius;
+}
+
+uint32_t Meshlets::cull(const Meshlet *meshlets, uint32_t count, const MeshletFrustum *frustum, uint32_t *survivors) {
+  uint32_t survivor_count = 0;
+  for(uint32_t i = 0; i < count; ++i)
+    if (visible(&meshlets[i], frustum))
+      survivors[survivor_count++] = i;
+  return survivor_count;
+}
+
+// A triangle with a local index past its meshlet's vertices (a corrupt scene) is left out
+uint32_t Meshlets::compact(const Meshlet *meshlets, const uint32_t *survivors, uint32_t survivor_count,
+    const uint32_t *vertices, const uint8_t *triangles, uint32_t index_size, void *out)
+{
+  uint16_t *out16 = (uint16_t*)out;
+  uint32_t *out32 = (uint32_t*)out;
+  uint32_t count = 0;
+  for(uint32_t s = 0; s < survivor_count; ++s) {
+    const Meshlet *m = &meshlets[survivors[s]];
+    const uint32_t *local_vertices = vertices + m->vertex_offset;
+    const uint8_t *tri = triangles + m->triangle_offset;
+    for(uint32_t t = 0; t < m->triangle_count; ++t, tri += 3) {
+      if (tri[0] >= m->vertex_count || tri[1] >= m->vertex_count || tri[2] >= m->vertex_count)
+        continue;
+      if (index_size == 2) {
+        for(uint32_t c = 0; c < 3; ++c)
+          out16[count + c] = (uint16_t)local_vertices[tri[c]];
+      } else {
+        for(uint32_t c = 0; c < 3; ++c)
+          out32[count + c] = local_vertices[tri[c]];
+      }
+      count += 3;
+    }
+  }
+  return count;
+}
+
+} // namespace Sol
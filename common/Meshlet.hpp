@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Sol {
+
+/*
+ * A cluster of a triangle list, small enough to cull on its own: up to MAX_VERTICES vertices, listed in
+ * the primitive's meshlet_vertices, and up to MAX_TRIANGLES triangles, as 3 bytes each indexing that
+ * list, in meshlet_triangles. 48 bytes.
+ */
+struct Meshlet {
+  float center[3]; // Bounding sphere, in the mesh's space
+  float radius;
+  float cone_axis[3]; // Every triangle's normal is within the cone around 'cone_axis'...
+  float cone_cutoff;  // ...whose half angle's sine this is; 1 if the normals spread too far to cull on
+  uint32_t vertex_offset;   // Into meshlet_vertices
+  uint32_t triangle_offset; // Into meshlet_triangles, in bytes
+  uint32_t vertex_count;
+  uint32_t triangle_count;
+};
+
+// Culling planes and eye, in the space of the mesh being culled
+struct MeshletFrustum {
+  float planes[6][4]; // Inside is dot(plane.xyz, p) + plane.w >= 0, with unit normals
+  float camera[3];
+};
+
+struct Meshlets {
+  static const uint32_t MAX_VERTICES = 64;
+  static const uint32_t MAX_TRIANGLES = 124;
+
+  // Upper bound on how many meshlets build() makes of 'index_count' indices
+  static uint32_t max_count(uint32_t index_count);
+  /*
+   * Greedy, in index order, so the triangles should already be in vertex cache order (MeshOpt): a
+   * meshlet ends when the next triangle would take it past either limit. 'vertices' needs room for
+   * 'index_count' entries and 'triangles' for 'index_count' bytes; the counts used are returned in
+   * 'vertex_count' and 'triangle_bytes'. 'positions' are vec3s. Returns the meshlet count.
+   */
+  static uint32_t build(Meshlet *meshlets, uint32_t *vertices, uint8_t *triangles, const uint32_t *indices,
+      uint32_t index_count, const float *positions, uint32_t *vertex_count, uint32_t *triangle_bytes);
+
+  // From a column major clip from mesh matrix (projection * view * model) and the eye in mesh space; the
+  // projection's depth must be 0 to 1, as Vulkan's (and Camera::mat_proj's) is
+  static void frustum(const float *clip_from_mesh, const float *camera, MeshletFrustum *out);
+  // False if the meshlet is outside the frustum or faces away from the camera
+  static bool visible(const Meshlet *meshlet, const MeshletFrustum *frustum);
+  // Writes the indices of the visible meshlets to 'survivors', returns how many
+  static uint32_t cull(const Meshlet *meshlets, uint32_t count, const MeshletFrustum *frustum, uint32_t *survivors);
+  /*
+   * Drawing only the survivors without mesh shaders: their triangles as one index
+   * buffer of 'index_size' (2 or 4) byte indices into the primitive's vertices, for one
+   * vkCmdDrawIndexed. 'out' needs room for 3 * MAX_TRIANGLES indices a survivor; returns the index count.
+   */
+  static uint32_t compact(const Meshlet *meshlets, const uint32_t *survivors, uint32_t survivor_count,
+      const uint32_t *vertices, const uint8_t *triangles, uint32_t index_size, void *out);
+};
+
+} // namespace Sol
@@ -0,0 +1,175 @@
+#include <cstring>
+#include <emmintrin.h>
+
+#include "Morph.hpp"
+#include "Allocator.hpp"
+#include "Scene.hpp"
+
+namespace Sol {
+
+namespace {
+  static void dequantize(const QuantizedVertex *in, const QuantizedBounds *bounds, SkinnedVertex *out) {
+    for(uint32_t a = 0; a < 3; ++a)
+      out->position[a] = bounds->offset[a] + (float)in->position[a] * (1.0f / 65535.0f) * bounds->scale[a];
+    out->position[3] = in->position[3] ? 1.0f : 0.0f;
+    out->normal[0] = in->normal[0];
+    out->normal[1] = in->normal[1];
+    out->tangent[0] = in->tangent[0];
+    out->tangent[1] = in->tangent[1];
+    out->uv[0] = in->uv[0];
+    out->uv[1] = in->uv[1];
+    out->pad = 0;
+  }
+}
+
+bool Morph::init(const Scene *scene, uint32_t mesh, uint32_t primitive) {
+  const Scene::Primitive *prim = &scene->meshes[mesh].primitives[primitive];
+  *this = {};
+  if (!prim->targets.count || !prim->vertices.count)
+    return false;
+  uint32_t count = (uint32_t)prim->targets.count;
+  const MorphDelta **target_deltas = (const MorphDelta**)mem_alloca(sizeof(MorphDelta*) * count, 16);
+  uint32_t *counts = (uint32_t*)mem_alloca(sizeof(uint32_t) * count, 16);
+  bool ok = target_deltas && counts;
+  for(uint32_t t = 0; ok && t < count; ++t) {
+    target_deltas[t] = prim->targets[t].deltas.data();
+    counts[t] = (uint32_t)prim->targets[t].deltas.count;
+  }
+  ok = ok && init(target_deltas, counts, count, prim->vertices.data(), &prim->bounds, (uint32_t)prim->vertices.count);
+  mem_free(counts);
+  mem_free(target_deltas);
+  return ok;
+}
+
+bool Morph::init(const MorphDelta *const *target_deltas, const uint32_t *counts, uint32_t count,
+    const QuantizedVertex *in, const QuantizedBounds *bounds, uint32_t in_count)
+{
+  *this = {};
+  target_count = count;
+  vertex_count = in_count;
+  deltas = (const MorphDelta**)mem_alloca(sizeof(MorphDelta*) * target_count, 16);
+  delta_counts = (uint32_t*)mem_alloca(sizeof(uint32_t) * target_count, 16);
+  weights = (float*)mem_alloca(sizeof(float) * target_count, 16);
+  vertices = (SkinnedVertex*)mem_alloca(sizeof(SkinnedVertex) * vertex_count, 16);
+  base = (float*)mem_alloca(sizeof(float) * 12 * vertex_count, 16);
+  sums = (float*)mem_alloca(sizeof(float) * 12 * vertex_count, 16);
+  marks = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  dirty = (uint32_t*)mem_alloca(sizeof(uint32_t) * vertex_count, 16);
+  if (!deltas || !delta_counts || !weights || !vertices || !base || !sums || !marks || !dirty) {
+    kill();
+    *this = {};
+    return false;
+  }
+  for(uint32_t t = 0; t < target_count; ++t) {
+    deltas[t] = target_deltas[t];
+    delta_counts[t] = counts[t];
+    weights[t] = 0.0f;
+  }
+  memset(marks, 0, sizeof(uint32_t) * vertex_count);
+
+  for(uint32_t v = 0; v < vertex_count; ++v) {
+    dequantize(&in[v], bounds, &vertices[v]);
+    float *b = base + v * 12;
+    memcpy(b, vertices[v].position, sizeof(float) * 4);
+    Quantize::from_octahedral(vertices[v].normal, b + 4);
+    Quantize::from_octahedral(vertices[v].tangent, b + 8);
+    b[7] = b[11] = 0.0f;
+  }
+  return true;
+}
+
+void Morph::kill() {
+  mem_free(dirty);
+  mem_free(marks);
+  mem_free(sums);
+  mem_free(base);
+  mem_free(vertices);
+  mem_free(weights);
+  mem_free(delta_counts);
+  mem_free(deltas);
+}
+
+/*
+ * The deltas are summed into 'sums' first, one SSE multiply add a row, so a vertex that several
+ * targets move is renormalized and encoded once. A delta's position row carries its vertex index in
+ * the w lane, which the mask keeps out of the sum. A target going to 0 still lists its vertices, so
+ * they are put back. Scene::validate() checks only the delta tables, so a delta past the vertices is
+ * skipped here.
+ */
+bool Morph::blend(const float *new_weights, uint32_t count) {
+  bool same = blended;
+  for(uint32_t t = 0; t < target_count && same; ++t)
+    same = (t < count ? new_weights[t] : 0.0f) == weights[t];
+  if (same)
+    return false;
+  blended = true;
+
+  ++mark;
+  uint32_t dirty_count = 0;
+  for(uint32_t t = 0; t < target_count; ++t) {
+    float w = t < count ? new_weights[t] : 0.0f;
+    if (w != 0.0f || weights[t] != 0.0f) {
+      const MorphDelta *d = deltas[t];
+      for(uint32_t i = 0; i < delta_counts[t]; ++i) {
+        uint32_t v = d[i].vertex;
+        if (v >= vertex_count || marks[v] == mark)
+          continue;
+        marks[v] = mark;
+        dirty[dirty_count++] = v;
+        float *s = sums + v * 12;
+        _mm_store_ps(s, _mm_setzero_ps());
+        _mm_store_ps(s + 4, _mm_setzero_ps());
+        _mm_store_ps(s + 8, _mm_setzero_ps());
+      }
+    }
+    weights[t] = w;
+  }
+
+  const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  for(uint32_t t = 0; t < target_count; ++t) {
+    if (weights[t] == 0.0f)
+      continue;
+    __m128 w = _mm_set1_ps(weights[t]);
+    const MorphDelta *d = deltas[t];
+    for(uint32_t i = 0; i < delta_counts[t]; ++i) {
+      if (d[i].vertex >= vertex_count)
+        continue;
+      float *s = sums + d[i].vertex * 12;
+      __m128 position = _mm_and_ps(_mm_loadu_ps(d[i].position), xyz);
+      _mm_store_ps(s, _mm_add_ps(_mm_load_ps(s), _mm_mul_ps(position, w)));
+      _mm_store_ps(s + 4, _mm_add_ps(_mm_load_ps(s + 4), _mm_mul_ps(_mm_loadu_ps(d[i].normal), w)));
+      _mm_store_ps(s + 8, _mm_add_ps(_mm_load_ps(s + 8), _mm_mul_ps(_mm_loadu_ps(d[i].tangent), w)));
+    }
+  }
+
+  // Octahedral encoding divides by the L1 norm, so the summed directions need no normalizing first
+  for(uint32_t i = 0; i < dirty_count; ++i) {
+    uint32_t v = dirty[i];
+    const float *b = base + v * 12;
+    const float *s = sums + v * 12;
+    float out[4];
+    _mm_storeu_ps(out, _mm_add_ps(_mm_load_ps(b), _mm_load_ps(s)));
+    memcpy(vertices[v].position, out, sizeof(float) * 3);
+    _mm_storeu_ps(out, _mm_add_ps(_mm_load_ps(b + 4), _mm_load_ps(s + 4)));
+    Quantize::octahedral(out, vertices[v].normal);
+    _mm_storeu_ps(out, _mm_add_ps(_mm_load_ps(b + 8), _mm_load_ps(s + 8)));
+    Quantize::octahedral(out, vertices[v].tangent);
+  }
+  return true;
+}
+
+const float* Morph::default_weights(const Scene *scene, uint32_t node, uint32_t *count) {
+  const Scene::Node *n = &scene->nodes[node];
+  if (n->weights.count) {
+    *count = (uint32_t)n->weights.count;
+    return n->weights.data();
+  }
+  if (n->mesh >= 0 && scene->meshes[n->mesh].weights.count) {
+    *count = (uint32_t)scene->meshes[n->mesh].weights.count;
+    return scene->meshes[n->mesh].weights.data();
+  }
+  *count = 0;
+  return nullptr;
+}
+
+} // namespace Sol
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Skinning.hpp"
+
+namespace Sol {
+
+struct Scene;
+
+/*
+ * One vertex a morph target moves, 48 bytes, each part a 16 byte row. Scene::Target::deltas holds
+ * only the vertices whose deltas are not all zero, ascending, as the cooker found them in the target's
+ * (often sparse) accessors, so the runtime never walks the vertices a target leaves alone.
+ */
+struct MorphDelta {
+  float position[3];
+  uint32_t vertex;   // Into Scene::Primitive::vertices
+  float normal[4];   // xyz, w 0; 0 if the primitive has no normals
+  float tangent[4];  // xyz, w 0; 0 if the primitive has no tangents
+};
+
+/*
+ * Morph target blending on the CPU, one primitive at a time: the cooked vertices plus each target's
+ * deltas times its weight, to float positions and renormalized octahedral normals and tangents.
+ * Only the vertices of targets weighted now or at the last blend are rewritten, so targets that stay
+ * at 0 cost nothing, and a blend with the same weights as the last one is skipped altogether, leaving
+ * 'vertices' as they were: a face at rest costs a compare a frame.
+ */
+struct Morph {
+  uint32_t target_count;
+  uint32_t vertex_count;
+  const MorphDelta **deltas;  // Each target's, with 'delta_counts'
+  uint32_t *delta_counts;
+  float *base;                // Rest position, normal and tangent, 12 floats a vertex
+  float *sums;                // This blend's deltas, 12 floats a vertex, only the dirty ones used
+  uint32_t *marks;            // The blend that last listed each vertex as dirty
+  uint32_t *dirty;            // The vertices of the targets weighted this blend or the last
+  uint32_t mark;
+  float *weights;             // Of the last blend
+  bool blended;
+  SkinnedVertex *vertices;    // The result, 'vertex_count' of them, drawn through SkinnedVertexInput
+
+  // The rest pose is in 'vertices' after init; false if the primitive has no targets or no vertices, or out of memory
+  bool init(const Scene *scene, uint32_t mesh, uint32_t primitive);
+  // 'deltas' as Scene::Target::deltas has them, read in place by blend(), so they must outlive the Morph
+  bool init(const MorphDelta *const *deltas, const uint32_t *delta_counts, uint32_t target_count,
+      const QuantizedVertex *vertices, const QuantizedBounds *bounds, uint32_t vertex_count);
+  void kill();
+
+  // Missing weights are 0, extra ones ignored. False if they are the last blend's, so nothing changed
+  bool blend(const float *weights, uint32_t count);
+
+  // A node's weights override its mesh's, as glTF has it; nullptr and 0 if neither has any
+  static const float* default_weights(const Scene *scene, uint32_t node, uint32_t *count);
+};
+
+} // namespace Sol
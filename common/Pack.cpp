@@ -0,0 +1,367 @@
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "Pack.hpp"
+#include "Compress.hpp"
+#include "Threads.hpp"
+#include "Format.hpp"
+#include "VulkanErrors.hpp"
+#include "wyhash.h"
+
+namespace Sol {
+
+static Pack GlobalPack;
+Pack* Pack::instance() { return &GlobalPack; }
+
+namespace {
+  static bool write_at(int fd, const void *data, size_t size, uint64_t offset) {
+    const uint8_t *ptr = (const uint8_t*)data;
+    while (size) {
+      ssize_t res = pwrite(fd, ptr, size, (off_t)offset);
+      if (res <= 0)
+        return false;
+      ptr += res;
+      size -= (size_t)res;
+      offset += (uint64_t)res;
+    }
+    return true;
+  }
+
+  struct BlockJob {
+    const uint8_t *src;
+    uint8_t *dst;
+    size_t raw_size;
+    const uint32_t *sizes;
+    const uint64_t *offsets; // Of each compressed block, from the first block
+    size_t block_size;
+    std::atomic<bool> failed;
+  };
+  static void decompress_blocks(void *arg, size_t begin, size_t end) {
+    BlockJob *job = (BlockJob*)arg;
+    for(size_t i = begin; i < end; ++i) {
+      size_t raw_offset = i * job->block_size;
+      size_t raw_count = job->raw_size - raw_offset < job->block_size ? job->raw_size - raw_offset : job->block_size;
+      const uint8_t *block = job->src + job->offsets[i];
+      uint32_t stored = job->sizes[i] & ~PackBlocks::RAW_BLOCK;
+
+      if (job->sizes[i] & PackBlocks::RAW_BLOCK) {
+        if (stored != raw_count)
+          job->failed = true;
+        else
+          mem_cpy(job->dst + raw_offset, block, raw_count);
+      } else if (Compress::decompress_block(block, stored, job->dst + raw_offset, raw_count) != raw_count) {
+        job->failed = true;
+      }
+    }
+  }
+  static void compress_blocks(void *arg, size_t begin, size_t end) {
+    // Here 'dst' holds one Compress::bound(block_size) slot per block, 'sizes' is written
+    BlockJob *job = (BlockJob*)arg;
+    size_t slot_size = Compress::bound(job->block_size);
+    uint32_t *sizes = (uint32_t*)job->sizes;
+    for(size_t i = begin; i < end; ++i) {
+      size_t raw_offset = i * job->block_size;
+      size_t raw_count = job->raw_size - raw_offset < job->block_size ? job->raw_size - raw_offset : job->block_size;
+      uint8_t *slot = job->dst + i * slot_size;
+
+      size_t size = Compress::compress_block(job->src + raw_offset, raw_count, slot, raw_count);
+      if (size == 0 || size >= raw_count) {
+        mem_cpy(slot, job->src + raw_offset, raw_count);
+        sizes[i] = (uint32_t)raw_count | PackBlocks::RAW_BLOCK;
+      } else {
+        sizes[i] = (uint32_t)size;
+      }
+    }
+  }
+}
+
+// Pack /////////////////////////
+uint64_t Pack::hash_name(const char *name) {
+  uint64_t hash = wyhash(name, strlen(name), 0, _wyp);
+  return hash ? hash : 1; // 0 is the empty slot
+}
+
+bool Pack::open(const char *path) {
+  close();
+  file = File::map(path, File::ADVISE_RANDOM);
+  if (!file.data)
+    return false;
+
+  const PackHeader *head = (const PackHeader*)file.view(0, sizeof(PackHeader));
+  bool ok = head && head->magic == PACK_MAGIC && head->version == PACK_VERSION && head->file_size == file.size;
+  ok = ok && head->table_size && (head->table_size & (head->table_size - 1)) == 0;
+  ok = ok && file.view(head->table_offset, head->table_size * sizeof(PackEntry));
+  ok = ok && file.view(head->names_offset, head->names_size);
+  // The names block ends in a terminator, so a name that starts inside it ends inside it too. Each
+  // used slot's name and stored bytes must be in the file: find() and data() trust them from here on
+  const char *name_block = ok ? (const char*)(file.data + head->names_offset) : nullptr;
+  ok = ok && (!head->names_size || name_block[head->names_size - 1] == '\0');
+  const PackEntry *slots = ok ? (const PackEntry*)(file.data + head->table_offset) : nullptr;
+  for(uint32_t i = 0; ok && i < head->table_size; ++i)
+    ok = !slots[i].name_hash || (slots[i].name_offset < head->names_size && file.view(slots[i].offset, slots[i].size));
+  if (!ok) {
+    print_err("Pack: '{}' is not a valid pack file\n", path);
+    file.unmap();
+    return false;
+  }
+
+  header = head;
+  table = (const PackEntry*)(file.data + head->table_offset);
+  names = (const char*)(file.data + head->names_offset);
+  return true;
+}
+void Pack::close() {
+  file.unmap();
+  header = nullptr;
+  table = nullptr;
+  names = nullptr;
+}
+
+const PackEntry* Pack::find(const char *name) const {
+  if (!header)
+    return nullptr;
+
+  uint64_t hash = hash_name(name);
+  uint32_t mask = header->table_size - 1;
+  for(uint32_t i = 0; i < header->table_size; ++i) {
+    const PackEntry *entry = &table[(hash + i) & mask];
+    if (entry->name_hash == 0)
+      return nullptr;
+    if (entry->name_hash == hash && strcmp(names + entry->name_offset, name) == 0)
+      return entry;
+  }
+  return nullptr;
+}
+const uint8_t* Pack::data(const PackEntry *entry) const {
+  return file.view(entry->offset, entry->size);
+}
+bool Pack::read(const PackEntry *entry, void *dst) const {
+  const uint8_t *src = data(entry);
+  if (!src)
+    return false;
+  if (!(entry->flags & PackEntry::COMPRESSED)) {
+    mem_cpy(dst, src, entry->size);
+    return true;
+  }
+
+  if (entry->size < sizeof(PackBlocks))
+    return false;
+  const PackBlocks *blocks = (const PackBlocks*)src;
+  size_t table_size = sizeof(PackBlocks) + sizeof(uint32_t) * (size_t)blocks->block_count;
+  uint64_t block_count = (entry->raw_size + blocks->block_size - 1) / (blocks->block_size ? blocks->block_size : 1);
+  if (entry->size < table_size || blocks->block_size == 0 || blocks->block_count != block_count)
+    return false;
+
+  // Block offsets are a prefix sum of the sizes; small enough to do serially before going wide
+  const uint32_t *sizes = (const uint32_t*)(blocks + 1);
+  uint64_t stack_offsets[256];
+  uint64_t *offsets = blocks->block_count <= 256 ? stack_offsets : 
+    (uint64_t*)mem_alloca(sizeof(uint64_t) * blocks->block_count, 8);
+  uint64_t offset = table_size;
+  for(uint32_t i = 0; i < blocks->block_count; ++i) {
+    offsets[i] = offset;
+    offset += sizes[i] & ~PackBlocks::RAW_BLOCK;
+  }
+
+  bool ok = offset <= entry->size;
+  if (ok) {
+    BlockJob job;
+    job.src = src;
+    job.dst = (uint8_t*)dst;
+    job.raw_size = entry->raw_size;
+    job.sizes = sizes;
+    job.offsets = offsets;
+    job.block_size = blocks->block_size;
+    job.failed = false;
+    ThreadPool::instance()->parallel_for(blocks->block_count, 1, decompress_blocks, &job);
+    ok = !job.failed;
+  }
+
+  if (offsets != stack_offsets)
+    mem_free(offsets);
+  return ok;
+}
+const uint8_t* Pack::get(const char *name, size_t *size, void **heap) const {
+  *heap = nullptr;
+  const PackEntry *entry = find(name);
+  if (!entry)
+    return nullptr;
+
+  *size = entry->raw_size;
+  if (!(entry->flags & PackEntry::COMPRESSED))
+    return data(entry);
+
+  uint8_t *buf = (uint8_t*)mem_alloca(entry->raw_size ? entry->raw_size : 1, 16);
+  if (!read(entry, buf)) {
+    print_err("Pack: corrupt entry '{}'\n", name);
+    mem_free(buf);
+    return nullptr;
+  }
+  *heap = buf;
+  return buf;
+}
+
+// PackWriter ///////////////////
+namespace {
+  // Returns the size of the PackBlocks stream written to a HeapAllocator buffer in 'out'
+  static size_t write_compressed(const uint8_t *src, size_t size, uint8_t **out) {
+    size_t block_size = Compress::BLOCK_SIZE;
+    uint32_t block_count = (uint32_t)((size + block_size - 1) / block_size);
+    size_t slot_size = Compress::bound(block_size);
+
+    uint32_t *sizes = (uint32_t*)mem_alloca(sizeof(uint32_t) * block_count, 4);
+    uint8_t *slots = (uint8_t*)mem_alloca(slot_size * block_count, 16);
+
+    BlockJob job;
+    job.src = src;
+    job.dst = slots;
+    job.raw_size = size;
+    job.sizes = sizes;
+    job.offsets = nullptr;
+    job.block_size = block_size;
+    job.failed = false;
+    ThreadPool::instance()->parallel_for(block_count, 1, compress_blocks, &job);
+
+    size_t total = sizeof(PackBlocks) + sizeof(uint32_t) * block_count;
+    for(uint32_t i = 0; i < block_count; ++i)
+      total += sizes[i] & ~PackBlocks::RAW_BLOCK;
+
+    uint8_t *buf = (uint8_t*)mem_alloca(total, 16);
+    PackBlocks *blocks = (PackBlocks*)buf;
+    blocks->block_count = block_count;
+    blocks->block_size = (uint32_t)block_size;
+    mem_cpy(buf + sizeof(PackBlocks), sizes, sizeof(uint32_t) * block_count);
+
+    uint8_t *op = buf + sizeof(PackBlocks) + sizeof(uint32_t) * block_count;
+    for(uint32_t i = 0; i < block_count; ++i) {
+      size_t stored = sizes[i] & ~PackBlocks::RAW_BLOCK;
+      mem_cpy(op, slots + i * slot_size, stored);
+      op += stored;
+    }
+
+    mem_free(slots);
+    mem_free(sizes);
+    *out = buf;
+    return total;
+  }
+}
+
+void PackWriter::init() {
+  inputs.init(16);
+}
+void PackWriter::kill() {
+  inputs.kill();
+}
+void PackWriter::add(const char *name, const char *path, uint32_t flags) {
+  Input input;
+  input.name = StringBuffer::get(0, name);
+  input.path = StringBuffer::get(0, path);
+  input.flags = flags;
+  inputs.push(input);
+}
+
+bool PackWriter::write(const char *out_path) {
+  uint32_t count = (uint32_t)inputs.length;
+  uint32_t table_size = 16;
+  while (table_size < count * 2)
+    table_size <<= 1;
+
+  // Layout: header, table, names, then aligned payloads. The header and table are written last, once
+  // the payload offsets are known
+  PackHeader header = {};
+  header.magic = PACK_MAGIC;
+  header.version = PACK_VERSION;
+  header.entry_count = count;
+  header.table_size = table_size;
+  header.table_offset = memory_align(sizeof(PackHeader), 16);
+  header.names_offset = header.table_offset + sizeof(PackEntry) * table_size;
+  header.names_size = 0;
+  for(uint32_t i = 0; i < count; ++i)
+    header.names_size += inputs[i].name.len + 1;
+
+  PackEntry *table = (PackEntry*)mem_alloca(sizeof(PackEntry) * table_size, 8);
+  memset(table, 0, sizeof(PackEntry) * table_size);
+  char *names = (char*)mem_alloca(header.names_size, 1);
+
+  int fd = ::open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0;
+  if (!ok)
+    print_err("PackWriter: failed to open '{}' for writing\n", out_path);
+
+  uint64_t offset = memory_align(header.names_offset + header.names_size, PACK_ALIGN);
+  uint32_t name_offset = 0;
+  for(uint32_t i = 0; ok && i < count; ++i) {
+    Input *input = &inputs[i];
+    PackEntry entry = {};
+    entry.name_hash = Pack::hash_name(input->name.c_str());
+    entry.offset = offset;
+    entry.name_offset = name_offset;
+    mem_cpy(names + name_offset, input->name.c_str(), input->name.len + 1);
+    name_offset += (uint32_t)input->name.len + 1;
+
+    MappedFile src = File::map(input->path.c_str());
+    if (!src.data && access(input->path.c_str(), R_OK) != 0) {
+      print_err("PackWriter: missing input '{}'\n", input->path);
+      ok = false;
+      break;
+    }
+    entry.raw_size = src.size;
+    entry.content_hash = wyhash(src.data, src.size, 0, _wyp);
+
+    const uint8_t *payload = src.data;
+    size_t payload_size = src.size;
+    uint8_t *packed = nullptr;
+    if ((input->flags & PackEntry::COMPRESSED) && src.size) {
+      payload_size = write_compressed(src.data, src.size, &packed);
+      if (payload_size < src.size) {
+        payload = packed;
+        entry.flags |= PackEntry::COMPRESSED;
+      } else {
+        payload_size = src.size;
+      }
+    }
+    entry.size = payload_size;
+
+    if (payload_size && !write_at(fd, payload, payload_size, offset)) {
+      print_err("PackWriter: failed to copy '{}'\n", input->path);
+      ok = false;
+    }
+    if (packed)
+      mem_free(packed);
+    if (!ok)
+      break;
+
+    uint32_t mask = table_size - 1;
+    uint32_t slot = (uint32_t)(entry.name_hash & mask);
+    while (table[slot].name_hash) {
+      if (table[slot].name_hash == entry.name_hash && strcmp(names + table[slot].name_offset, input->name.c_str()) == 0) {
+        print_err("PackWriter: duplicate entry '{}'\n", input->name);
+        ok = false;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+    table[slot] = entry;
+    offset = memory_align(offset + entry.size, PACK_ALIGN);
+  }
+
+  if (ok) {
+    header.file_size = offset;
+    ok = write_at(fd, &header, sizeof(header), 0) &&
+      write_at(fd, table, sizeof(PackEntry) * table_size, header.table_offset) &&
+      write_at(fd, names, header.names_size, header.names_offset) &&
+      ftruncate(fd, (off_t)offset) == 0;
+  }
+  if (fd >= 0)
+    ::close(fd);
+
+  mem_free(names);
+  mem_free(table);
+  return ok;
+}
+
+} // namespace Sol
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Allocator.hpp"
+#include "File.hpp"
+#include "Vec.hpp"
+
+namespace Sol {
+
+/*
+ * Single file asset archive:
+ *
+ *   [PackHeader][PackEntry table][names][payloads...]
+ *
+ * The table is an open addressed hash table (power of 2 slots, linear probing) keyed by the wyhash of
+ * the entry name, so a lookup is a hash and (almost always) one probe. Names are kept only to check
+ * for hash collisions. Payloads start on PACK_ALIGN boundaries, which covers vulkan's buffer copy
+ * offset and non coherent atom alignments, so a payload can be copied straight into staging memory.
+ *
+ * At runtime the whole pack is one mmap: open, fstat, mmap, close.
+ *
+ * COMPRESSED entries are a PackBlocks header, a table of block sizes, then independently compressed
+ * Compress::BLOCK_SIZE blocks; Pack::read() decodes the blocks in parallel straight into the caller's
+ * memory (e.g. a mapped staging buffer).
+ */
+
+static const uint32_t PACK_MAGIC = 0x4b415053; // 'SPAK'
+static const uint32_t PACK_VERSION = 2;
+static const uint64_t PACK_ALIGN = 256;
+
+struct PackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t table_size; // slots, power of 2
+  uint64_t table_offset;
+  uint64_t names_offset;
+  uint64_t names_size;
+  uint64_t file_size;
+};
+
+struct PackEntry {
+  enum Flags {
+    NONE = 0x0,
+    COMPRESSED = 0x1,
+  };
+  uint64_t name_hash; // 0 marks an empty slot
+  uint64_t offset; // From the start of the file
+  uint64_t size; // Stored size
+  uint64_t raw_size; // Size once decompressed (== size if not COMPRESSED)
+  uint64_t content_hash; // Of the raw data
+  uint32_t name_offset; // Into the names block
+  uint32_t flags;
+};
+
+struct PackBlocks {
+  static const uint32_t RAW_BLOCK = 0x80000000; // Set in a block size if it was stored uncompressed
+  uint32_t block_count;
+  uint32_t block_size;
+  // uint32_t sizes[block_count];
+  // blocks...
+};
+
+struct Pack {
+  static Pack* instance();
+
+  MappedFile file;
+  const PackHeader *header = nullptr;
+  const PackEntry *table = nullptr;
+  const char *names = nullptr;
+
+  static uint64_t hash_name(const char *name);
+
+  // false if the file is missing or not a valid pack
+  bool open(const char *path);
+  void close();
+  bool is_open() const { return header != nullptr; }
+
+  const PackEntry* find(const char *name) const;
+  // Stored bytes of 'entry', in place
+  const uint8_t* data(const PackEntry *entry) const;
+  // Write the raw contents of 'entry' (raw_size bytes) to 'dst', decompressing on the ThreadPool
+  bool read(const PackEntry *entry, void *dst) const;
+  /*
+   * Raw contents of 'name', or nullptr if the pack is not open or has no such entry. Uncompressed
+   * entries point into the mapping; compressed ones are decoded into a HeapAllocator buffer that is
+   * returned in 'heap' for the caller to mem_free (else 'heap' is set to nullptr).
+   */
+  const uint8_t* get(const char *name, size_t *size, void **heap) const;
+};
+
+struct PackWriter {
+  struct Input {
+    StringBuffer name;
+    StringBuffer path;
+    uint32_t flags;
+  };
+  Vec<Input> inputs;
+
+  void init();
+  void kill();
+  // 'name' is the lookup key at runtime, 'path' is where to read the data from now. 'flags' are
+  // PackEntry::Flags: a COMPRESSED entry is stored raw anyway if compression does not shrink it
+  void add(const char *name, const char *path, uint32_t flags);
+  bool write(const char *out_path);
+};
+
+} // namespace Sol
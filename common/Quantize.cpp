@@ -0,0 +1,173 @@
+#include <cmath>
+#include <cstring>
+
+#include "Quantize.hpp"
+
+namespace Sol {
+
+namespace {
+  static int16_t snorm16(float f) {
+    f = f < -1.0f ? -1.0f : f > 1.0f ? 1.0f : f;
+    return (int16_t)lrintf(f * 32767.0f);
+  }
+  static float sign_not_zero(float f) {
+    return f >= 0.0f ? 1.0f : -1.0f;
+  }
+}
+
+// Round to nearest even, with denormals, infinities and NaN kept
+uint16_t Quantize::half(float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, 4);
+  uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+  uint32_t abs = bits & 0x7fffffff;
+
+  if (abs >= 0x7f800000) // Inf or NaN
+    return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+  if (abs >= 0x477ff000) // Rounds past the largest half
+    return sign | 0x7c00;
+  if (abs < 0x38800000) { // Denormal half, or zero
+    float denormal;
+    memcpy(&denormal, &abs, 4);
+    return sign | (uint16_t)lrintf(denormal * 16777216.0f); // * 2^24
+  }
+  uint32_t mantissa_odd = (abs >> 13) & 1;
+  abs += 0xc8000fff + mantissa_odd; // Rebias the exponent (127 -> 15) and round
+  return sign | (uint16_t)(abs >> 13);
+}
+float Quantize::from_half(uint16_t h) {
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exponent = (h >> 10) & 0x1f;
+  uint32_t mantissa = h & 0x3ff;
+  float f;
+  if (exponent == 0) {
+    f = (float)mantissa / 16777216.0f;
+    uint32_t bits;
+    memcpy(&bits, &f, 4);
+    bits |= sign;
+    memcpy(&f, &bits, 4);
+    return f;
+  }
+  uint32_t bits = sign | (exponent == 31 ? 0x7f800000 | (mantissa << 13) : ((exponent + 112) << 23) | (mantissa << 13));
+  memcpy(&f, &bits, 4);
+  return f;
+}
+
+// Unit vector to the octahedron, whose lower half is folded over the upper
+void Quantize::octahedral(const float *n, int16_t *out) {
+  float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+  if (l1 == 0.0f) {
+    out[0] = 0;
+    out[1] = 0;
+    return;
+  }
+  float x = n[0] / l1;
+  float y = n[1] / l1;
+  if (n[2] < 0.0f) {
+    float fx = (1.0f - fabsf(y)) * sign_not_zero(x);
+    float fy = (1.0f - fabsf(x)) * sign_not_zero(y);
+    x = fx;
+    y = fy;
+  }
+  out[0] = snorm16(x);
+  out[1] = snorm16(y);
+}
+void Quantize::from_octahedral(const int16_t *in, float *n) {
+  float x = fmaxf(in[0] / 32767.0f, -1.0f);
+  float y = fmaxf(in[1] / 32767.0f, -1.0f);
+  float z = 1.0f - fabsf(x) - fabsf(y);
+  float t = fmaxf(-z, 0.0f);
+  x += x >= 0.0f ? -t : t;
+  y += y >= 0.0f ? -t : t;
+  float len = sqrtf(x * x + y * y + z * z);
+  n[0] = x / len;
+  n[1] = y / len;
+  n[2] = z / len;
+}
+
+bool Quantize::vertices(const Input *input, QuantizedVertex *out, QuantizedBounds *bounds) {
+  float min[3] = { INFINITY, INFINITY, INFINITY };
+  float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+  if (input->min && input->max) {
+    memcpy(min, input->min, sizeof(min));
+    memcpy(max, input->max, sizeof(max));
+  } else {
+    for(uint32_t i = 0; i < input->count * 3; ++i) {
+      min[i % 3] = fminf(min[i % 3], input->positions[i]);
+      max[i % 3] = fmaxf(max[i % 3], input->positions[i]);
+    }
+  }
+  // 0 extent is a flat axis, which the shader maps back with a 0 scale
+  float inv_extent[3];
+  for(uint32_t a = 0; a < 3; ++a) {
+    if (!input->count)
+      min[a] = max[a] = 0.0f;
+    bounds->offset[a] = min[a];
+    bounds->scale[a] = max[a] - min[a];
+    inv_extent[a] = bounds->scale[a] > 0.0f ? 65535.0f / bounds->scale[a] : 0.0f;
+  }
+
+  if (input->joints)
+    for(uint32_t i = 0; i < input->count * 4; ++i)
+      if (input->joints[i] > 255)
+        return false;
+
+  for(uint32_t i = 0; i < input->count; ++i) {
+    QuantizedVertex *v = &out[i];
+    memset(v, 0, sizeof(*v));
+
+    for(uint32_t a = 0; a < 3; ++a) {
+      float q = (input->positions[i * 3 + a] - min[a]) * inv_extent[a];
+      v->position[a] = (uint16_t)lrintf(q < 0.0f ? 0.0f : q > 65535.0f ? 65535.0f : q);
+    }
+    v->position[3] = 65535;
+    if (input->normals)
+      octahedral(input->normals + i * 3, v->normal);
+    if (input->tangents) {
+      octahedral(input->tangents + i * 4, v->tangent);
+      v->position[3] = input->tangents[i * 4 + 3] < 0.0f ? 0 : 65535;
+    }
+    if (input->uvs) {
+      v->uv[0] = half(input->uvs[i * 2]);
+      v->uv[1] = half(input->uvs[i * 2 + 1]);
+    }
+    if (input->joints)
+      for(uint32_t j = 0; j < 4; ++j)
+        v->joints[j] = (uint8_t)input->joints[i * 4 + j];
+
+    // Renormalized, then the rounding error goes to the largest weight so the sum stays exact
+    if (input->weights) {
+      const float *w = input->weights + i * 4;
+      float sum = w[0] + w[1] + w[2] + w[3];
+      if (sum <= 0.0f) {
+        v->weights[0] = 255;
+        continue;
+      }
+      int32_t total = 0;
+      uint32_t largest = 0;
+      for(uint32_t j = 0; j < 4; ++j) {
+        v->weights[j] = (uint8_t)lrintf(fmaxf(w[j], 0.0f) / sum * 255.0f);
+        total += v->weights[j];
+        if (w[j] > w[largest])
+          largest = j;
+      }
+      v->weights[largest] = (uint8_t)(v->weights[largest] + (255 - total));
+    }
+  }
+  return true;
+}
+
+uint32_t Quantize::index_size(uint32_t vertex_count) {
+  return vertex_count > 65536 ? 4 : 2;
+}
+void Quantize::indices(const uint32_t *in, uint32_t count, uint32_t vertex_count, void *out) {
+  if (index_size(vertex_count) == 4) {
+    memcpy(out, in, sizeof(uint32_t) * count);
+    return;
+  }
+  uint16_t *out16 = (uint16_t*)out;
+  for(uint32_t i = 0; i < count; ++i)
+    out16[i] = (uint16_t)in[i];
+}
+
+} // namespace Sol
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Sol {
+
+/*
+ * The cooked vertex: 28 bytes, against 72 for the same attributes as floats. Every field is in a
+ * format the vertex input dequantizes by itself (see QuantizedVertexInput in Engine.hpp), apart from
+ * the position, which the shader maps from its UNORM16 bounds (shaders/quantized.vert).
+ */
+struct QuantizedVertex {
+  uint16_t position[4]; // UNORM16 across the primitive's bounds; [3] is the tangent's handedness, 0 for -1
+  int16_t normal[2];    // Octahedral, SNORM16
+  int16_t tangent[2];   // Octahedral, SNORM16
+  uint16_t uv[2];       // Half floats, TEXCOORD_0
+  uint8_t joints[4];    // JOINTS_0, so only the first 256 joints of a skin
+  uint8_t weights[4];   // UNORM8, summing to exactly 255
+};
+
+// position = offset + unorm * scale, per axis
+struct QuantizedBounds {
+  float offset[3];
+  float scale[3];
+};
+
+struct Quantize {
+  // Decoded attributes (Decode::floats/uints), nullptr for the ones the primitive does not have
+  struct Input {
+    uint32_t count;
+    const float *positions; // vec3
+    const float *normals;   // vec3
+    const float *tangents;  // vec4
+    const float *uvs;       // vec2
+    const uint32_t *joints; // uvec4
+    const float *weights;   // vec4
+    const float *min;       // Position bounds, computed from the positions if nullptr
+    const float *max;
+  };
+
+  static uint16_t half(float f);
+  static float from_half(uint16_t h);
+  static void octahedral(const float *n, int16_t *out);
+  static void from_octahedral(const int16_t *in, float *n);
+
+  // False if a joint index does not fit in 8 bits
+  static bool vertices(const Input *input, QuantizedVertex *out, QuantizedBounds *bounds);
+  // 2 if every index of a primitive with 'vertex_count' vertices fits in 16 bits, else 4
+  static uint32_t index_size(uint32_t vertex_count);
+  // To index_size(vertex_count) bytes each
+  static void indices(const uint32_t *in, uint32_t count, uint32_t vertex_count, void *out);
+};
+
+} // namespace Sol
@@ -0,0 +1,1171 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "Scene.hpp"
+#include "Animator.hpp"
+#include "glTF.hpp"
+#include "Pack.hpp"
+#include "Format.hpp"
+#include "MeshOpt.hpp"
+#include "wyhash.h"
+
+namespace Sol {
+
+namespace {
+  // Validation ////////////////////
+  struct Bounds {
+    const uint8_t *base;
+    size_t size;
+  };
+
+  template<typename T>
+  static bool in_bounds(const Bounds *b, const RelArray<T> *arr) {
+    if (!arr->count)
+      return true;
+    int64_t start = (int64_t)((const uint8_t*)arr - b->base) + arr->offset;
+    if (start < 0 || (uint64_t)start > b->size || start % alignof(T) != 0)
+      return false;
+    return arr->count <= (b->size - (uint64_t)start) / sizeof(T);
+  }
+  static bool check_string(const Bounds *b, const RelArray<char> *str) {
+    return str->count && in_bounds(b, str) && (*str)[str->count - 1] == '\0';
+  }
+  // -1 is allowed, for "none"
+  static bool check_index(int32_t i, uint64_t count) {
+    return i == -1 || (i >= 0 && (uint64_t)i < count);
+  }
+  static bool check_indices(const Bounds *b, const RelArray<uint32_t> *arr, uint64_t count) {
+    if (!in_bounds(b, arr))
+      return false;
+    for(uint64_t i = 0; i < arr->count; ++i)
+      if ((*arr)[i] >= count)
+        return false;
+    return true;
+  }
+  static bool check_attributes(const Bounds *b, const RelArray<Scene::Attribute> *attrs, uint64_t accessor_count) {
+    if (!in_bounds(b, attrs))
+      return false;
+    for(uint64_t i = 0; i < attrs->count; ++i) {
+      const Scene::Attribute *attr = &(*attrs)[i];
+      if (attr->semantic > Scene::CUSTOM || attr->accessor >= accessor_count || !check_string(b, &attr->name))
+        return false;
+    }
+    return true;
+  }
+  // 'count' elements of 'elem_size' bytes, 'stride' apart, from 'offset' into the view
+  static bool check_view_range(const Scene *scene, uint32_t view, uint64_t offset, uint64_t count,
+      uint64_t elem_size, uint64_t stride)
+  {
+    if (view >= scene->buffer_views.count)
+      return false;
+    if (!count)
+      return true;
+    uint64_t end = offset + (count - 1) * stride + elem_size;
+    return end >= offset && end <= scene->buffer_views[view].byte_length;
+  }
+  // LOD 0 is the whole primitive, and the LODs are each inside the index data, which they fill
+  static bool check_lods(const Scene::Primitive *prim) {
+    if (!prim->vertices.count)
+      return !prim->lods.count && !prim->index_data.count;
+    if (!prim->lods.count || prim->lods.count > SCENE_MAX_LODS || prim->lods[0].first != 0 ||
+        prim->lods[0].count != prim->index_count)
+      return false;
+    uint64_t index_count = prim->index_data.count / prim->index_size;
+    uint64_t total = 0;
+    for(uint64_t i = 0; i < prim->lods.count; ++i) {
+      if ((uint64_t)prim->lods[i].first + prim->lods[i].count > index_count)
+        return false;
+      total += prim->lods[i].count;
+    }
+    return total * prim->index_size == prim->index_data.count;
+  }
+  // Only the table, deltas only on cooked vertices: Morph::blend() skips a delta past the vertices
+  static bool check_morphs(const Bounds *b, const Scene::Primitive *prim, const Scene::Target *target) {
+    return in_bounds(b, &target->deltas) && (!target->deltas.count || prim->vertices.count);
+  }
+  // Only the table: Meshlets::compact() skips a triangle whose local indices are out of range
+  static bool check_meshlets(const Bounds *b, const Scene::Primitive *prim) {
+    if (!in_bounds(b, &prim->meshlets) || !in_bounds(b, &prim->meshlet_vertices) ||
+        !in_bounds(b, &prim->meshlet_triangles) || prim->meshlet_triangles.count % 4 != 0)
+      return false;
+    for(uint64_t i = 0; i < prim->meshlets.count; ++i) {
+      const Meshlet *m = &prim->meshlets[i];
+      if (m->vertex_count > Meshlets::MAX_VERTICES || m->triangle_count > Meshlets::MAX_TRIANGLES ||
+          (uint64_t)m->vertex_offset + m->vertex_count > prim->meshlet_vertices.count ||
+          (uint64_t)m->triangle_offset + m->triangle_count * 3 > prim->meshlet_triangles.count)
+        return false;
+    }
+    return true;
+  }
+  /*
+   * Only the tracks, so a clip costs the same to validate however many keys it has: the keys' total is
+   * their count, which puts the first two of each track in the stream. Animator does not trust a key's
+   * track index; it takes the first two by position and skips a later key whose track is out of range.
+   */
+  static bool check_clip(const Bounds *b, const Scene::Animation *anim, uint64_t node_count) {
+    if (!in_bounds(b, &anim->clip_tracks) || !in_bounds(b, &anim->clip_keys) ||
+        anim->clip_tracks.count > Clips::MAX_TRACKS || !(anim->duration >= 0.0f))
+      return false;
+    uint64_t key_count = 0;
+    for(uint64_t i = 0; i < anim->clip_tracks.count; ++i) {
+      const ClipTrack *track = &anim->clip_tracks[i];
+      if (track->node >= node_count || track->path > Scene::Animation::SCALE ||
+          track->interpolation > Scene::Animation::STEP || track->key_count < 2)
+        return false;
+      key_count += track->key_count;
+    }
+    return key_count == anim->clip_keys.count;
+  }
+
+  static bool check_accessor(const Scene *scene, const Scene::Accessor *a) {
+    uint32_t size = Decode::component_size(a->component_type);
+    if (!size || a->type > Scene::MAT4 || a->components != Decode::components(a->type) || a->min_max_count > 16 ||
+        a->normalized > 1 || (a->normalized && size == 4))
+      return false;
+    uint64_t elem_size = Decode::element_size(a->component_type, a->type);
+    if (a->buffer_view >= 0) {
+      if ((uint32_t)a->buffer_view >= scene->buffer_views.count)
+        return false;
+      uint32_t stride = scene->buffer_views[a->buffer_view].byte_stride;
+      if (!check_view_range(scene, a->buffer_view, a->byte_offset, a->count, elem_size, stride ? stride : elem_size))
+        return false;
+    } else if (a->buffer_view != -1) {
+      return false;
+    }
+
+    const Scene::Accessor::Sparse *sparse = &a->sparse;
+    if (!sparse->count)
+      return true;
+    uint32_t index_size = Decode::component_size(sparse->indices_component_type);
+    bool unsigned_index = sparse->indices_component_type == Scene::UINT8 ||
+      sparse->indices_component_type == Scene::UINT16 || sparse->indices_component_type == Scene::UINT32;
+    return unsigned_index && sparse->count <= a->count &&
+      check_view_range(scene, sparse->indices_view, sparse->indices_offset, sparse->count, index_size, index_size) &&
+      check_view_range(scene, sparse->values_view, sparse->values_offset, sparse->count, elem_size, elem_size);
+  }
+  static bool check_mat_texture(const Scene::MatTexture *tex, uint64_t texture_count) {
+    return check_index(tex->index, texture_count);
+  }
+
+  static bool validate_scene(const Bounds *b, const Scene *s) {
+    if (!in_bounds(b, &s->scenes) || !in_bounds(b, &s->nodes) || !in_bounds(b, &s->meshes) ||
+        !in_bounds(b, &s->accessors) || !in_bounds(b, &s->buffer_views) || !in_bounds(b, &s->buffers) ||
+        !in_bounds(b, &s->materials) || !in_bounds(b, &s->textures) || !in_bounds(b, &s->images) ||
+        !in_bounds(b, &s->samplers) || !in_bounds(b, &s->cameras) || !in_bounds(b, &s->skins) ||
+        !in_bounds(b, &s->animations))
+      return false;
+
+    // Each level only refers to levels checked before it
+    for(uint64_t i = 0; i < s->buffers.count; ++i)
+      if (!in_bounds(b, &s->buffers[i].data))
+        return false;
+    for(uint64_t i = 0; i < s->buffer_views.count; ++i) {
+      const Scene::BufferView *view = &s->buffer_views[i];
+      if (view->buffer >= s->buffers.count)
+        return false;
+      uint64_t end = view->byte_offset + view->byte_length;
+      if (end < view->byte_offset || end > s->buffers[view->buffer].data.count)
+        return false;
+    }
+    for(uint64_t i = 0; i < s->accessors.count; ++i)
+      if (!check_accessor(s, &s->accessors[i]))
+        return false;
+
+    for(uint64_t i = 0; i < s->meshes.count; ++i) {
+      const Scene::Mesh *mesh = &s->meshes[i];
+      if (!in_bounds(b, &mesh->primitives) || !in_bounds(b, &mesh->weights) || !in_bounds(b, &mesh->target_names))
+        return false;
+      for(uint64_t j = 0; j < mesh->target_names.count; ++j)
+        if (!check_string(b, &mesh->target_names[j]))
+          return false;
+      for(uint64_t j = 0; j < mesh->primitives.count; ++j) {
+        const Scene::Primitive *prim = &mesh->primitives[j];
+        if (!check_attributes(b, &prim->attributes, s->accessors.count) || !in_bounds(b, &prim->targets) ||
+            !check_index(prim->indices, s->accessors.count) || !check_index(prim->material, s->materials.count) ||
+            prim->mode > 6 || !in_bounds(b, &prim->vertices) || !in_bounds(b, &prim->index_data))
+          return false;
+        if (prim->vertices.count ? prim->index_size != 2 && prim->index_size != 4 : prim->index_size || prim->index_count)
+          return false;
+        if (prim->vertices.count && prim->indices >= 0 && prim->index_count != s->accessors[prim->indices].count)
+          return false;
+        if (!in_bounds(b, &prim->lods) || !check_lods(prim) || !check_meshlets(b, prim))
+          return false;
+        for(uint64_t k = 0; k < prim->targets.count; ++k)
+          if (!check_attributes(b, &prim->targets[k].attributes, s->accessors.count) ||
+              !check_morphs(b, prim, &prim->targets[k]))
+            return false;
+      }
+    }
+    for(uint64_t i = 0; i < s->nodes.count; ++i) {
+      const Scene::Node *node = &s->nodes[i];
+      if (!check_indices(b, &node->children, s->nodes.count) || !in_bounds(b, &node->weights) ||
+          !check_string(b, &node->name) || !check_index(node->mesh, s->meshes.count) ||
+          !check_index(node->skin, s->skins.count) || !check_index(node->camera, s->cameras.count))
+        return false;
+    }
+    for(uint64_t i = 0; i < s->skins.count; ++i) {
+      const Scene::Skin *skin = &s->skins[i];
+      if (!check_indices(b, &skin->joints, s->nodes.count) ||
+          !check_index(skin->inverse_bind_matrices, s->accessors.count) || !check_index(skin->skeleton, s->nodes.count))
+        return false;
+    }
+    for(uint64_t i = 0; i < s->images.count; ++i) {
+      const Scene::Image *img = &s->images[i];
+      if (!check_index(img->buffer_view, s->buffer_views.count) || img->mime_type > Scene::Image::JPG)
+        return false;
+    }
+    for(uint64_t i = 0; i < s->textures.count; ++i) {
+      const Scene::Texture *tex = &s->textures[i];
+      if (!check_index(tex->sampler, s->samplers.count) || !check_index(tex->source, s->images.count))
+        return false;
+    }
+    for(uint64_t i = 0; i < s->materials.count; ++i) {
+      const Scene::Material *mat = &s->materials[i];
+      uint64_t count = s->textures.count;
+      if (!check_mat_texture(&mat->base_color_texture, count) || !check_mat_texture(&mat->metallic_roughness_texture, count) ||
+          !check_mat_texture(&mat->normal_texture, count) || !check_mat_texture(&mat->occlusion_texture, count) ||
+          !check_mat_texture(&mat->emissive_texture, count) || mat->alpha_mode > Scene::Material::BLEND ||
+          !check_string(b, &mat->name))
+        return false;
+    }
+    for(uint64_t i = 0; i < s->cameras.count; ++i)
+      if (s->cameras[i].type > Scene::Camera::ORTHO || !check_string(b, &s->cameras[i].name))
+        return false;
+    for(uint64_t i = 0; i < s->animations.count; ++i) {
+      const Scene::Animation *anim = &s->animations[i];
+      if (!in_bounds(b, &anim->channels) || !in_bounds(b, &anim->samplers) || !check_string(b, &anim->name) ||
+          !check_clip(b, anim, s->nodes.count))
+        return false;
+      for(uint64_t j = 0; j < anim->channels.count; ++j) {
+        const Scene::Animation::Channel *channel = &anim->channels[j];
+        if (channel->sampler >= anim->samplers.count || channel->node >= s->nodes.count ||
+            channel->path > Scene::Animation::WEIGHTS)
+          return false;
+      }
+      for(uint64_t j = 0; j < anim->samplers.count; ++j) {
+        const Scene::Animation::Sampler *sampler = &anim->samplers[j];
+        if (sampler->input >= s->accessors.count || sampler->output >= s->accessors.count ||
+            sampler->interpolation > Scene::Animation::CUBICSPLINE)
+          return false;
+      }
+    }
+    for(uint64_t i = 0; i < s->scenes.count; ++i)
+      if (!check_indices(b, &s->scenes[i].nodes, s->nodes.count) || !check_string(b, &s->scenes[i].name))
+        return false;
+    return check_index(s->scene, s->scenes.count);
+  }
+
+  // Writing /////////////////////
+  /*
+   * The scene is built in one block that grows as it goes, so everything is addressed by offset
+   * into it: a pointer would not survive the next alloc(). The block is on the C heap, not the
+   * HeapAllocator: a cooked scene is as big as the model, which the engine heap is not sized for.
+   */
+  struct Builder {
+    uint8_t *mem = nullptr;
+    size_t len = 0;
+    size_t cap = 0;
+
+    size_t alloc(size_t size, size_t align) {
+      size_t offset = memory_align(len, align);
+      if (offset + size > cap) {
+        size_t new_cap = cap ? cap * 2 : 64 * 1024;
+        while (new_cap < offset + size)
+          new_cap *= 2;
+        uint8_t *grown = (uint8_t*)realloc(mem, new_cap);
+        if (!grown) {
+          print_err("Scene: out of memory growing the cooked scene to {} bytes\n", new_cap);
+          abort();
+        }
+        mem = grown;
+        cap = new_cap;
+      }
+      memset(mem + len, 0, offset + size - len);
+      len = offset + size;
+      return offset;
+    }
+    template<typename T>
+    T* at(size_t offset) {
+      return (T*)(mem + offset);
+    }
+    // Allocate the 'count' Ts of the RelArray at 'field', returns their offset
+    template<typename T>
+    size_t array(size_t field, uint64_t count, size_t align = 16) {
+      if (!count)
+        return 0;
+      size_t offset = alloc(sizeof(T) * count, align);
+      RelArray<T> *arr = at<RelArray<T>>(field);
+      arr->offset = (int64_t)offset - (int64_t)field;
+      arr->count = count;
+      return offset;
+    }
+    // Always at least the null terminator, so a name is never an empty array
+    void string(size_t field, const char *str, size_t str_len) {
+      size_t offset = array<char>(field, str_len + 1, 1);
+      mem_cpy(mem + offset, str, str_len);
+    }
+    void string(size_t field, StringBuffer *str) {
+      string(field, str->c_str(), str->len);
+    }
+    template<typename T>
+    void copy(size_t field, Array<T> *src) {
+      size_t offset = array<T>(field, src->len);
+      if (src->len)
+        mem_cpy(mem + offset, src->mem, sizeof(T) * src->len);
+    }
+    void copy_indices(size_t field, Array<int32_t> *src) {
+      size_t offset = array<uint32_t>(field, src->len);
+      for(size_t i = 0; i < src->len; ++i)
+        at<uint32_t>(offset)[i] = (uint32_t)(*src)[i];
+    }
+  };
+
+  #define FIELD(base, Type, member) ((base) + offsetof(Type, member))
+
+  static void set_floats(float *dst, Array<float> *src, uint32_t count, const float *fallback) {
+    if (src->len == count)
+      mem_cpy(dst, src->mem, sizeof(float) * count);
+    else
+      mem_cpy(dst, fallback, sizeof(float) * count);
+  }
+  static int32_t index_or_none(int32_t i) {
+    return i < 0 ? -1 : i;
+  }
+  static uint32_t count_or_zero(uint32_t count) {
+    return count == glTF::INVALID_COUNT ? 0 : count;
+  }
+  static float float_or(float f, float fallback) {
+    return f == glTF::INVALID_FLOAT ? fallback : f;
+  }
+
+  static void semantic(const char *key, Scene::Attribute *attr) {
+    struct Name {
+      const char *prefix;
+      Scene::Semantic semantic;
+    };
+    static const Name NAMES[] = {
+      { "POSITION", Scene::POSITION }, { "NORMAL", Scene::NORMAL }, { "TANGENT", Scene::TANGENT },
+      { "TEXCOORD_", Scene::TEXCOORD }, { "COLOR_", Scene::COLOR }, { "JOINTS_", Scene::JOINTS },
+      { "WEIGHTS_", Scene::WEIGHTS },
+    };
+    attr->semantic = Scene::CUSTOM;
+    attr->set = 0;
+    for(const Name &name : NAMES) {
+      size_t len = strlen(name.prefix);
+      if (strncmp(key, name.prefix, len) != 0)
+        continue;
+      if (name.prefix[len - 1] == '_')
+        attr->set = (uint32_t)atoi(key + len);
+      else if (key[len] != '\0')
+        continue;
+      attr->semantic = name.semantic;
+      return;
+    }
+  }
+  static void write_attributes(Builder *b, size_t field, Array<glTF::Mesh::Primitive::Attribute> *src) {
+    size_t attrs = b->array<Scene::Attribute>(field, src->len);
+    for(size_t i = 0; i < src->len; ++i) {
+      size_t at = attrs + sizeof(Scene::Attribute) * i;
+      Scene::Attribute *attr = b->at<Scene::Attribute>(at);
+      semantic((*src)[i].key.c_str(), attr);
+      attr->accessor = (uint32_t)(*src)[i].accessor;
+      b->string(FIELD(at, Scene::Attribute, name), &(*src)[i].key);
+    }
+  }
+  // One attribute decoded to floats (uints if 'as_uint') on the heap, nullptr if it is missing or not 'count' 'type's
+  static void* decode_attribute(glTF::glTF *gltf, Array<glTF::Mesh::Primitive::Attribute> *attrs, const char *key,
+      uint32_t type, uint32_t count, bool as_uint)
+  {
+    for(size_t i = 0; i < attrs->len; ++i) {
+      if (strcmp((*attrs)[i].key.c_str(), key) != 0)
+        continue;
+      AccessorView view;
+      if (!gltf->accessor_view((*attrs)[i].accessor, &view) || view.type != type || view.count != count)
+        return nullptr;
+      size_t size = (size_t)count * Decode::components(type) * 4;
+      void *out = mem_alloca(size ? size : 4, 16);
+      if (!out) {
+        print_err("Scene: out of memory decoding {} ({} bytes)\n", key, (uint64_t)size);
+        return nullptr;
+      }
+      if (as_uint)
+        Decode::uints(&view, (uint32_t*)out);
+      else
+        Decode::floats(&view, (float*)out);
+      return out;
+    }
+    return nullptr;
+  }
+  /*
+   * LODs of a triangle list, each simplified from the last to half its triangles, until the simplifier
+   * stalls, the next would have only a few, or the errors so far add up past MAX_ERROR of the mesh's
+   * size. Returns how many there are, 'lods[0]' being 'indices'; the rest are on the heap. Running out of
+   * heap ends the chain at the LODs built so far.
+   */
+  static uint32_t simplify_lods(const uint32_t *indices, uint32_t index_count, const Quantize::Input *input,
+      uint32_t **lods, uint32_t *counts, float *errors)
+  {
+    const uint32_t MIN_TRIANGLES = 32;
+    const float MAX_ERROR = 0.05f;
+    float extent = 0.0f;
+    for(uint32_t a = 0; a < 3; ++a) {
+      float min = INFINITY, max = -INFINITY;
+      for(uint32_t i = 0; i < input->count; ++i) {
+        min = fminf(min, input->positions[i * 3 + a]);
+        max = fmaxf(max, input->positions[i * 3 + a]);
+      }
+      extent = fmaxf(extent, max - min);
+    }
+    MeshOpt::SimplifyAttribute attributes[2];
+    uint32_t attribute_count = 0;
+    if (input->normals)
+      attributes[attribute_count++] = { input->normals, 3, 0.5f };
+    if (input->uvs)
+      attributes[attribute_count++] = { input->uvs, 2, 1.0f };
+
+    lods[0] = (uint32_t*)indices;
+    counts[0] = index_count;
+    errors[0] = 0.0f;
+    uint32_t lod_count = 1;
+    while (lod_count < SCENE_MAX_LODS) {
+      uint32_t last = counts[lod_count - 1];
+      uint32_t target = last / 6 * 3;
+      if (target < MIN_TRIANGLES * 3)
+        break;
+      float budget = extent * MAX_ERROR - errors[lod_count - 1];
+      if (budget <= 0.0f)
+        break;
+      uint32_t *out = (uint32_t*)mem_alloca(sizeof(uint32_t) * last, 16);
+      if (!out) {
+        print_err("Scene: out of memory simplifying {} indices, kept {} LODs\n", last, lod_count);
+        break;
+      }
+      float error;
+      uint32_t count = MeshOpt::simplify(out, lods[lod_count - 1], last, input->positions, input->count, attributes,
+          attribute_count, target, budget, &error);
+      if (count > last - last / 10) {
+        mem_free(out);
+        break;
+      }
+      lods[lod_count] = out;
+      counts[lod_count] = count;
+      errors[lod_count] = errors[lod_count - 1] + error;
+      ++lod_count;
+    }
+    return lod_count;
+  }
+  /*
+   * Meshlets of the full detail LOD, whose indices are into the stream, so the positions are put in the
+   * stream's order first. Spheres grow by half a quantization step, as the GPU sees quantized positions.
+   */
+  static void write_meshlets(Builder *b, size_t prim, const uint32_t *indices, uint32_t index_count,
+      const float *positions, const uint32_t *remap, uint32_t count, uint32_t stream_vertices,
+      const QuantizedBounds *bounds)
+  {
+    float *stream_positions = (float*)mem_alloca(sizeof(float) * 3 * stream_vertices, 16);
+    Meshlet *meshlets = (Meshlet*)mem_alloca(sizeof(Meshlet) * Meshlets::max_count(index_count), 16);
+    uint32_t *vertices = (uint32_t*)mem_alloca(sizeof(uint32_t) * index_count, 16);
+    uint8_t *triangles = (uint8_t*)mem_alloca(index_count, 16);
+    if (!stream_positions || !meshlets || !vertices || !triangles) {
+      print_err("Scene: out of memory building the meshlets of {} indices, cooked without them\n", index_count);
+      mem_free(triangles);
+      mem_free(vertices);
+      mem_free(meshlets);
+      mem_free(stream_positions);
+      return;
+    }
+    for(uint32_t i = 0; i < count; ++i)
+      if (remap[i] != UINT32_MAX)
+        memcpy(stream_positions + remap[i] * 3, positions + i * 3, sizeof(float) * 3);
+    uint32_t vertex_count;
+    uint32_t triangle_bytes;
+    uint32_t meshlet_count = Meshlets::build(meshlets, vertices, triangles, indices, index_count, stream_positions,
+        &vertex_count, &triangle_bytes);
+
+    float step = 0.0f;
+    for(uint32_t a = 0; a < 3; ++a)
+      step += bounds->scale[a] * bounds->scale[a];
+    step = sqrtf(step) / 65535.0f * 0.5f;
+    for(uint32_t i = 0; i < meshlet_count; ++i)
+      meshlets[i].radius += step;
+
+    size_t offset = b->array<Meshlet>(FIELD(prim, Scene::Primitive, meshlets), meshlet_count);
+    mem_cpy(b->mem + offset, meshlets, sizeof(Meshlet) * meshlet_count);
+    offset = b->array<uint32_t>(FIELD(prim, Scene::Primitive, meshlet_vertices), vertex_count);
+    mem_cpy(b->mem + offset, vertices, sizeof(uint32_t) * vertex_count);
+    offset = b->array<uint8_t>(FIELD(prim, Scene::Primitive, meshlet_triangles), memory_align(triangle_bytes, 4));
+    mem_cpy(b->mem + offset, triangles, triangle_bytes);
+    mem_free(triangles);
+    mem_free(vertices);
+    mem_free(meshlets);
+    mem_free(stream_positions);
+  }
+  // A target's normal and tangent deltas only mean something if the primitive has normals and tangents
+  static void decode_target(glTF::glTF *gltf, glTF::Mesh::Primitive *src, uint32_t target, const bool *used,
+      uint32_t count, float **parts)
+  {
+    static const char *TARGET_ATTRIBUTES[3] = { "POSITION", "NORMAL", "TANGENT" };
+    for(uint32_t p = 0; p < 3; ++p)
+      parts[p] = used[p] ? (float*)decode_attribute(gltf, &src->targets[target].attributes, TARGET_ATTRIBUTES[p],
+          Scene::VEC3, count, false) : nullptr;
+  }
+  static bool morph_moves(float *const *parts, uint32_t vertex) {
+    for(uint32_t p = 0; p < 3; ++p)
+      if (parts[p] && (parts[p][vertex * 3] != 0.0f || parts[p][vertex * 3 + 1] != 0.0f || parts[p][vertex * 3 + 2] != 0.0f))
+        return true;
+    return false;
+  }
+  /*
+   * One key a vertex, 0 where no target moves it, hashing its deltas across every target: welding on it
+   * keeps apart the vertices the targets move apart (bar a 64 bit collision) without holding all the
+   * targets at once, which for a face with a hundred targets is far more than the heap. Decodes each
+   * target in turn.
+   */
+  static void morph_weld_keys(glTF::glTF *gltf, glTF::Mesh::Primitive *src, uint32_t target_count, const bool *used,
+      uint32_t count, uint64_t *keys)
+  {
+    memset(keys, 0, sizeof(uint64_t) * count);
+    for(uint32_t t = 0; t < target_count; ++t) {
+      float *parts[3];
+      decode_target(gltf, src, t, used, count, parts);
+      for(uint32_t p = 0; p < 3; ++p) {
+        if (!parts[p])
+          continue;
+        for(uint32_t v = 0; v < count; ++v)
+          if (parts[p][v * 3] != 0.0f || parts[p][v * 3 + 1] != 0.0f || parts[p][v * 3 + 2] != 0.0f)
+            keys[v] = wyhash(parts[p] + v * 3, sizeof(float) * 3, keys[v] + t * 3 + p, _wyp);
+        mem_free(parts[p]);
+      }
+    }
+  }
+  /*
+   * Each target's deltas for the vertices that made it into the stream, in stream order, leaving out the
+   * vertices it does not move. 'source' is the glTF vertex each stream vertex came from; the targets are
+   * decoded again, one at a time, and read through it.
+   */
+  static uint32_t write_morphs(Builder *b, size_t target_table, glTF::glTF *gltf, glTF::Mesh::Primitive *src,
+      uint32_t target_count, const bool *used, uint32_t count, const uint32_t *source, uint32_t stream_vertices)
+  {
+    uint32_t total = 0;
+    for(uint32_t t = 0; t < target_count; ++t) {
+      float *parts[3];
+      decode_target(gltf, src, t, used, count, parts);
+      uint32_t delta_count = 0;
+      for(uint32_t v = 0; v < stream_vertices; ++v)
+        delta_count += morph_moves(parts, source[v]);
+      size_t offset = b->array<MorphDelta>(FIELD(target_table + sizeof(Scene::Target) * t, Scene::Target, deltas), delta_count);
+      MorphDelta *d = b->at<MorphDelta>(offset);
+      for(uint32_t v = 0, n = 0; n < delta_count; ++v) {
+        uint32_t w = source[v];
+        if (!morph_moves(parts, w))
+          continue;
+        float *rows[3] = { d[n].position, d[n].normal, d[n].tangent };
+        for(uint32_t p = 0; p < 3; ++p)
+          if (parts[p])
+            memcpy(rows[p], parts[p] + w * 3, sizeof(float) * 3);
+        d[n++].vertex = v;
+      }
+      total += delta_count;
+      for(uint32_t p = 0; p < 3; ++p)
+        mem_free(parts[p]);
+    }
+    return total;
+  }
+  /*
+   * The decoded attributes are welded first, which generates indices for a primitive without them.
+   * Triangle lists are then simplified into LODs, and each goes through the MeshOpt passes: the fetch
+   * order of the full detail one decides where each quantized vertex goes, and unused vertices are
+   * dropped. Only the attributes that make it into the QuantizedVertex, and the morph targets' deltas
+   * (written to the targets at 'target_table'), count towards welding.
+   */
+  static void write_quantized(Builder *b, size_t prim, size_t target_table, glTF::glTF *gltf,
+      glTF::Mesh::Primitive *src, uint32_t mesh_index, uint32_t prim_index, float weld_epsilon)
+  {
+    Array<glTF::Mesh::Primitive::Attribute> *attrs = &src->attributes;
+    int32_t position = -1;
+    for(size_t i = 0; i < attrs->len; ++i)
+      if (strcmp((*attrs)[i].key.c_str(), "POSITION") == 0)
+        position = (*attrs)[i].accessor;
+    AccessorView view;
+    AccessorView index_view = {};
+    if (position < 0 || !gltf->accessor_view(position, &view) || view.type != Scene::VEC3 || !view.count ||
+        (src->indices >= 0 && !gltf->accessor_view(src->indices, &index_view)))
+      return;
+
+    uint32_t index_count = src->indices >= 0 ? index_view.count : view.count;
+    uint32_t *indices = (uint32_t*)mem_alloca(sizeof(uint32_t) * (index_count ? index_count : 1), 16);
+    if (!indices) {
+      print_err("Scene: mesh {} primitive {}: out of memory for its {} indices, cooked without vertices\n",
+          mesh_index, prim_index, index_count);
+      return;
+    }
+    if (src->indices >= 0) {
+      Decode::uints(&index_view, indices);
+      for(uint32_t i = 0; i < index_count; ++i) {
+        if (indices[i] >= view.count) {
+          print_err("Scene: mesh {} primitive {} has an index past its vertices\n", mesh_index, prim_index);
+          mem_free(indices);
+          return;
+        }
+      }
+    } else {
+      for(uint32_t i = 0; i < index_count; ++i)
+        indices[i] = i;
+    }
+
+    Quantize::Input input = {};
+    input.positions = (float*)decode_attribute(gltf, attrs, "POSITION", Scene::VEC3, view.count, false);
+    input.normals = (float*)decode_attribute(gltf, attrs, "NORMAL", Scene::VEC3, view.count, false);
+    input.tangents = (float*)decode_attribute(gltf, attrs, "TANGENT", Scene::VEC4, view.count, false);
+    input.uvs = (float*)decode_attribute(gltf, attrs, "TEXCOORD_0", Scene::VEC2, view.count, false);
+    input.joints = (uint32_t*)decode_attribute(gltf, attrs, "JOINTS_0", Scene::VEC4, view.count, true);
+    input.weights = (float*)decode_attribute(gltf, attrs, "WEIGHTS_0", Scene::VEC4, view.count, false);
+    glTF::Accessor *accessor = &gltf->accessors.accessors[position];
+    if (accessor->min.len == 3 && accessor->max.len == 3) {
+      input.min = accessor->min.mem;
+      input.max = accessor->max.mem;
+    }
+
+    struct { void *data; uint32_t size; } decoded[] = {
+      { (void*)input.positions, sizeof(float) * 3 }, { (void*)input.normals, sizeof(float) * 3 },
+      { (void*)input.tangents, sizeof(float) * 4 }, { (void*)input.uvs, sizeof(float) * 2 },
+      { (void*)input.joints, sizeof(uint32_t) * 4 }, { (void*)input.weights, sizeof(float) * 4 },
+    };
+    // Positions are the one attribute it cannot do without (decode_attribute has said why)
+    uint32_t *remap = input.positions ? (uint32_t*)mem_alloca(sizeof(uint32_t) * view.count, 16) : nullptr;
+    if (!remap) {
+      print_err("Scene: mesh {} primitive {}: out of memory for its {} vertices, cooked without them\n", mesh_index,
+          prim_index, view.count);
+      for(uint32_t i = 0; i < 6; ++i)
+        mem_free(decoded[i].data);
+      mem_free(indices);
+      return;
+    }
+    bool target_used[3] = { true, input.normals != nullptr, input.tangents != nullptr };
+    uint32_t target_count = (uint32_t)src->targets.len;
+    uint64_t *morph_keys = target_count ? (uint64_t*)mem_alloca(sizeof(uint64_t) * view.count, 16) : nullptr;
+    if (target_count && !morph_keys) {
+      print_err("Scene: mesh {} primitive {}: out of memory for its {} morph targets, cooked without them\n",
+          mesh_index, prim_index, target_count);
+      target_count = 0;
+    }
+    if (target_count)
+      morph_weld_keys(gltf, src, target_count, target_used, view.count, morph_keys);
+
+    MeshOpt::WeldStream streams[6];
+    uint32_t stream_count = 0;
+    for(uint32_t i = 1; i < 6; ++i)
+      if (decoded[i].data)
+        streams[stream_count++] = { decoded[i].data, decoded[i].size };
+    if (morph_keys)
+      streams[stream_count++] = { morph_keys, sizeof(uint64_t) };
+    input.count = MeshOpt::weld(input.positions, streams, stream_count, view.count, weld_epsilon, remap);
+    mem_free(morph_keys);
+    for(uint32_t i = 0; i < index_count; ++i)
+      indices[i] = remap[indices[i]];
+    for(uint32_t i = 0; i < 6; ++i)
+      if (decoded[i].data)
+        MeshOpt::compact_vertices(decoded[i].data, decoded[i].size, remap, view.count);
+    // The glTF vertex each welded one came from, to read the targets through when writing them
+    uint32_t *morph_source = target_count ? (uint32_t*)mem_alloca(sizeof(uint32_t) * input.count, 16) : nullptr;
+    if (target_count && !morph_source) {
+      print_err("Scene: mesh {} primitive {}: out of memory for its {} morph targets, cooked without them\n",
+          mesh_index, prim_index, target_count);
+      target_count = 0;
+    }
+    for(uint32_t i = view.count; target_count && i-- > 0;)
+      morph_source[remap[i]] = i;
+    if (input.count < view.count)
+      print("Scene: mesh {} primitive {}: welded {} vertices to {}\n", mesh_index, prim_index, view.count, input.count);
+
+    uint32_t *lods[SCENE_MAX_LODS] = { indices };
+    uint32_t lod_counts[SCENE_MAX_LODS] = { index_count };
+    float lod_errors[SCENE_MAX_LODS] = {};
+    uint32_t lod_count = 1;
+    // Where each welded vertex goes in the stream, if it is used
+    uint32_t stream_vertices = input.count;
+    for(uint32_t i = 0; i < input.count; ++i)
+      remap[i] = i;
+    bool triangles = (src->mode < 0 || src->mode == 4) && index_count >= 3; // TRIANGLES
+    if (triangles) {
+      lod_count = simplify_lods(indices, index_count, &input, lods, lod_counts, lod_errors);
+      VertexCacheStats before = MeshOpt::analyze_vertex_cache(indices, index_count, input.count);
+      for(uint32_t l = 0; l < lod_count; ++l) {
+        MeshOpt::optimize_vertex_cache(lods[l], lod_counts[l], input.count);
+        MeshOpt::optimize_overdraw(lods[l], lod_counts[l], input.positions, input.count);
+      }
+      // Every LOD's vertices are some of the full detail one's
+      stream_vertices = MeshOpt::optimize_vertex_fetch(indices, index_count, input.count, remap);
+      for(uint32_t l = 1; l < lod_count; ++l)
+        for(uint32_t i = 0; i < lod_counts[l]; ++i)
+          lods[l][i] = remap[lods[l][i]];
+      VertexCacheStats after = MeshOpt::analyze_vertex_cache(indices, index_count, stream_vertices);
+      print("Scene: mesh {} primitive {}: {} triangles, ACMR {:.3} -> {:.3}, ATVR {:.3} -> {:.3}\n", mesh_index,
+          prim_index, index_count / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+      for(uint32_t l = 1; l < lod_count; ++l)
+        print("Scene: mesh {} primitive {}: LOD {}, {} triangles, error {:.4}\n", mesh_index, prim_index, l,
+            lod_counts[l] / 3, lod_errors[l]);
+    }
+
+    QuantizedBounds bounds;
+    QuantizedVertex *vertices = (QuantizedVertex*)mem_alloca(sizeof(QuantizedVertex) * input.count, 16);
+    if (!vertices)
+      print_err("Scene: mesh {} primitive {}: out of memory quantizing {} vertices, cooked without them\n",
+          mesh_index, prim_index, input.count);
+    bool ok = vertices && Quantize::vertices(&input, vertices, &bounds);
+    if (ok) {
+      size_t offset = b->array<QuantizedVertex>(FIELD(prim, Scene::Primitive, vertices), stream_vertices);
+      QuantizedVertex *stream = b->at<QuantizedVertex>(offset);
+      for(uint32_t i = 0; i < input.count; ++i)
+        if (remap[i] != UINT32_MAX)
+          stream[remap[i]] = vertices[i];
+      b->at<Scene::Primitive>(prim)->bounds = bounds;
+
+      uint32_t index_size = Quantize::index_size(stream_vertices);
+      uint64_t total = 0;
+      for(uint32_t l = 0; l < lod_count; ++l)
+        total += lod_counts[l];
+      offset = b->array<uint8_t>(FIELD(prim, Scene::Primitive, index_data), total * index_size);
+      size_t lod_table = b->array<Scene::Lod>(FIELD(prim, Scene::Primitive, lods), lod_count);
+      uint32_t first = 0;
+      for(uint32_t l = 0; l < lod_count; ++l) {
+        Quantize::indices(lods[l], lod_counts[l], stream_vertices, b->mem + offset + (size_t)first * index_size);
+        Scene::Lod *lod = b->at<Scene::Lod>(lod_table) + l;
+        lod->first = first;
+        lod->count = lod_counts[l];
+        lod->error = lod_errors[l];
+        first += lod_counts[l];
+      }
+      Scene::Primitive *p = b->at<Scene::Primitive>(prim);
+      p->index_size = index_size;
+      p->index_count = index_count;
+      if (triangles)
+        write_meshlets(b, prim, indices, index_count, input.positions, remap, input.count, stream_vertices, &bounds);
+      if (target_count) {
+        uint32_t *source = (uint32_t*)mem_alloca(sizeof(uint32_t) * (stream_vertices ? stream_vertices : 1), 16);
+        uint32_t delta_count = 0;
+        if (source) {
+          for(uint32_t i = 0; i < input.count; ++i)
+            if (remap[i] != UINT32_MAX)
+              source[remap[i]] = morph_source[i];
+          delta_count = write_morphs(b, target_table, gltf, src, target_count, target_used, view.count, source,
+              stream_vertices);
+          mem_free(source);
+        } else {
+          print_err("Scene: mesh {} primitive {}: out of memory writing its morph targets\n", mesh_index, prim_index);
+        }
+        print("Scene: mesh {} primitive {}: {} morph targets, {} deltas for {} vertices\n", mesh_index, prim_index,
+            target_count, delta_count, stream_vertices);
+      }
+    }
+    for(uint32_t l = 1; l < lod_count; ++l)
+      mem_free(lods[l]);
+    mem_free(vertices);
+    mem_free(remap);
+    mem_free(morph_source);
+    for(uint32_t i = 0; i < 6; ++i)
+      if (decoded[i].data)
+        mem_free(decoded[i].data);
+    mem_free(indices);
+  }
+
+  /*
+   * An animation's TRS channels, compressed. Channels the runtime could not play (accessors of the
+   * wrong type or count, or times that go back) are left out of the clip, printing why.
+   */
+  static void write_clip(Builder *b, size_t anim, glTF::glTF *gltf, glTF::Animation *src, size_t anim_index) {
+    size_t accessor_count = gltf->accessors.accessors.len;
+    float **decoded = (float**)mem_alloca(sizeof(float*) * (accessor_count ? accessor_count : 1), 8);
+    memset(decoded, 0, sizeof(float*) * accessor_count);
+    AnimationTrack *tracks = (AnimationTrack*)mem_alloca(sizeof(AnimationTrack) * (src->channels.len ? src->channels.len : 1), 8);
+
+    uint32_t track_count = 0;
+    uint64_t source_bytes = 0;
+    for(size_t j = 0; j < src->channels.len; ++j) {
+      glTF::Animation::Channel *channel = &src->channels[j];
+      glTF::Animation::Channel::Target::Path path = channel->target.path;
+      if (path == glTF::Animation::Channel::Target::NONE || path == glTF::Animation::Channel::Target::WEIGHTS ||
+          channel->target.node < 0 || channel->sampler < 0 || (size_t)channel->sampler >= src->samplers.len)
+        continue;
+      glTF::Animation::Sampler *sampler = &src->samplers[channel->sampler];
+      uint32_t per_key = sampler->interpolation == glTF::Animation::Sampler::CUBICSPLINE ? 3 : 1;
+      uint32_t type = path == glTF::Animation::Channel::Target::ROTATION ? Scene::VEC4 : Scene::VEC3;
+      AccessorView input, output;
+      bool ok = gltf->accessor_view(sampler->input, &input) && gltf->accessor_view(sampler->output, &output) &&
+          input.type == Scene::SCALAR && output.type == type && input.count && output.count == input.count * per_key;
+      for(uint32_t a = 0; ok && a < 2; ++a) {
+        int32_t accessor = a ? sampler->output : sampler->input;
+        if (decoded[accessor])
+          continue;
+        AccessorView *view = a ? &output : &input;
+        decoded[accessor] = (float*)mem_alloca(sizeof(float) * view->count * Decode::components(view->type), 16);
+        Decode::floats(view, decoded[accessor]);
+      }
+      for(uint32_t k = 1; ok && k < input.count; ++k)
+        ok = decoded[sampler->input][k] >= decoded[sampler->input][k - 1];
+      if (!ok) {
+        print_err("Scene: animation {} channel {} cannot be played, it is left out of the clip\n", anim_index, j);
+        continue;
+      }
+      tracks[track_count++] = { (uint32_t)channel->target.node, (uint32_t)path - 1, (uint32_t)sampler->interpolation,
+          input.count, decoded[sampler->input], decoded[sampler->output] };
+      source_bytes += (uint64_t)input.count * (4 + per_key * Decode::components(type) * 4);
+    }
+
+    uint32_t max_keys = Clips::max_keys(tracks, track_count);
+    ClipTrack *clip_tracks = (ClipTrack*)mem_alloca(sizeof(ClipTrack) * (track_count ? track_count : 1), 16);
+    ClipKey *keys = (ClipKey*)mem_alloca(sizeof(ClipKey) * (max_keys ? max_keys : 1), 16);
+    Clips::Tolerance tolerance;
+    float duration = 0.0f;
+    float errors[3] = {};
+    uint32_t key_count = Clips::compress(tracks, track_count, &tolerance, clip_tracks, keys, &duration, errors);
+    if (key_count) {
+      size_t offset = b->array<ClipTrack>(FIELD(anim, Scene::Animation, clip_tracks), track_count);
+      mem_cpy(b->mem + offset, clip_tracks, sizeof(ClipTrack) * track_count);
+      offset = b->array<ClipKey>(FIELD(anim, Scene::Animation, clip_keys), key_count);
+      mem_cpy(b->mem + offset, keys, sizeof(ClipKey) * key_count);
+      b->at<Scene::Animation>(anim)->duration = duration;
+      print("Scene: animation {}: {} tracks, {} to {} bytes, error {:.5} {:.5} {:.5}\n", anim_index, track_count,
+          source_bytes, (uint64_t)(sizeof(ClipTrack) * track_count + sizeof(ClipKey) * key_count), errors[0],
+          errors[1], errors[2]);
+    }
+
+    mem_free(keys);
+    mem_free(clip_tracks);
+    for(size_t i = 0; i < accessor_count; ++i)
+      if (decoded[i])
+        mem_free(decoded[i]);
+    mem_free(tracks);
+    mem_free(decoded);
+  }
+
+  static Scene::MatTexture mat_texture(glTF::Material::MatTexture *tex) {
+    Scene::MatTexture out;
+    out.index = index_or_none(tex->index);
+    out.tex_coord = tex->tex_coord < 0 ? 0 : (uint32_t)tex->tex_coord;
+    out.scale = float_or(tex->scale, 1.0f);
+    return out;
+  }
+
+  static void write_scene(Builder *b, glTF::glTF *gltf, float weld_epsilon) {
+    static const float ZERO[4] = {};
+    static const float ONE[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    static const float IDENTITY_ROTATION[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    size_t root = b->alloc(sizeof(Scene), 64);
+    Scene *header = b->at<Scene>(root);
+    header->magic = SCENE_MAGIC;
+    header->version = SCENE_VERSION;
+    header->scene = index_or_none(gltf->scenes.scene);
+
+    // Buffers first, so their data sits apart from the tables
+    Array<glTF::Buffer> *buffers = &gltf->buffers.buffers;
+    size_t bufs = b->array<Scene::Buffer>(FIELD(root, Scene, buffers), buffers->len);
+    for(size_t i = 0; i < buffers->len; ++i) {
+      glTF::Buffer *src = &(*buffers)[i];
+      size_t len = src->data ? src->byte_length : 0;
+      size_t data = b->array<uint8_t>(FIELD(bufs + sizeof(Scene::Buffer) * i, Scene::Buffer, data), len, SCENE_DATA_ALIGN);
+      if (len)
+        mem_cpy(b->mem + data, src->data, len);
+    }
+
+    Array<glTF::BufferView> *views = &gltf->buffer_views.views;
+    size_t view_table = b->array<Scene::BufferView>(FIELD(root, Scene, buffer_views), views->len);
+    for(size_t i = 0; i < views->len; ++i) {
+      glTF::BufferView *src = &(*views)[i];
+      Scene::BufferView *view = b->at<Scene::BufferView>(view_table) + i;
+      view->buffer = (uint32_t)src->buffer;
+      view->byte_stride = count_or_zero(src->byte_stride);
+      view->byte_offset = count_or_zero(src->byte_offset);
+      view->byte_length = count_or_zero(src->byte_length);
+      view->target = (uint32_t)src->target;
+    }
+
+    Array<glTF::Accessor> *accessors = &gltf->accessors.accessors;
+    size_t accessor_table = b->array<Scene::Accessor>(FIELD(root, Scene, accessors), accessors->len);
+    for(size_t i = 0; i < accessors->len; ++i) {
+      glTF::Accessor *src = &(*accessors)[i];
+      Scene::Accessor *a = b->at<Scene::Accessor>(accessor_table) + i;
+      a->buffer_view = index_or_none(src->buffer_view);
+      a->byte_offset = count_or_zero(src->byte_offset);
+      a->component_type = (Scene::ComponentType)src->component_type;
+      a->type = (Scene::Type)src->type;
+      a->components = Decode::components(src->type);
+      a->count = count_or_zero(src->count);
+      a->normalized = src->normalized;
+      if (src->min.len == src->max.len && src->min.len <= 16) {
+        a->min_max_count = (uint32_t)src->min.len;
+        if (src->min.len) {
+          mem_cpy(a->min, src->min.mem, sizeof(float) * src->min.len);
+          mem_cpy(a->max, src->max.mem, sizeof(float) * src->max.len);
+        }
+      }
+      glTF::Accessor::Sparse *sparse = &src->sparse;
+      a->sparse.count = count_or_zero(sparse->count);
+      if (a->sparse.count) {
+        a->sparse.indices_view = (uint32_t)sparse->indices.buffer_view;
+        a->sparse.indices_offset = count_or_zero(sparse->indices.byte_offset);
+        a->sparse.indices_component_type = (Scene::ComponentType)sparse->indices.component_type;
+        a->sparse.values_view = (uint32_t)sparse->values.buffer_view;
+        a->sparse.values_offset = count_or_zero(sparse->values.byte_offset);
+      }
+    }
+
+    Array<glTF::Mesh> *meshes = &gltf->meshes.meshes;
+    size_t mesh_table = b->array<Scene::Mesh>(FIELD(root, Scene, meshes), meshes->len);
+    for(size_t i = 0; i < meshes->len; ++i) {
+      glTF::Mesh *src = &(*meshes)[i];
+      size_t mesh = mesh_table + sizeof(Scene::Mesh) * i;
+      b->copy(FIELD(mesh, Scene::Mesh, weights), &src->weights);
+
+      Array<StringBuffer> *names = &src->extras.target_names;
+      size_t name_table = b->array<RelArray<char>>(FIELD(mesh, Scene::Mesh, target_names), names->len);
+      for(size_t j = 0; j < names->len; ++j)
+        b->string(name_table + sizeof(RelArray<char>) * j, &(*names)[j]);
+
+      size_t prim_table = b->array<Scene::Primitive>(FIELD(mesh, Scene::Mesh, primitives), src->primitives.len);
+      for(size_t j = 0; j < src->primitives.len; ++j) {
+        glTF::Mesh::Primitive *src_prim = &src->primitives[j];
+        size_t prim = prim_table + sizeof(Scene::Primitive) * j;
+        Scene::Primitive *p = b->at<Scene::Primitive>(prim);
+        p->indices = index_or_none(src_prim->indices);
+        p->material = index_or_none(src_prim->material);
+        p->mode = src_prim->mode < 0 ? 4 : (uint32_t)src_prim->mode; // TRIANGLES
+
+        write_attributes(b, FIELD(prim, Scene::Primitive, attributes), &src_prim->attributes);
+        size_t target_table = b->array<Scene::Target>(FIELD(prim, Scene::Primitive, targets), src_prim->targets.len);
+        for(size_t k = 0; k < src_prim->targets.len; ++k)
+          write_attributes(b, target_table + sizeof(Scene::Target) * k, &src_prim->targets[k].attributes);
+        write_quantized(b, prim, target_table, gltf, src_prim, (uint32_t)i, (uint32_t)j, weld_epsilon);
+      }
+    }
+
+    Array<glTF::Node> *nodes = &gltf->nodes.nodes;
+    size_t node_table = b->array<Scene::Node>(FIELD(root, Scene, nodes), nodes->len);
+    for(size_t i = 0; i < nodes->len; ++i) {
+      glTF::Node *src = &(*nodes)[i];
+      size_t node = node_table + sizeof(Scene::Node) * i;
+      Scene::Node *n = b->at<Scene::Node>(node);
+      set_floats(n->translation, &src->translation, 3, ZERO);
+      set_floats(n->rotation, &src->rotation, 4, IDENTITY_ROTATION);
+      set_floats(n->scale, &src->scale, 3, ONE);
+      n->has_matrix = src->matrix.len == 16;
+      if (n->has_matrix)
+        mem_cpy(n->matrix, src->matrix.mem, sizeof(n->matrix));
+      n->mesh = index_or_none(src->mesh);
+      n->skin = index_or_none(src->skin);
+      n->camera = index_or_none(src->camera);
+
+      b->copy_indices(FIELD(node, Scene::Node, children), &src->children);
+      b->copy(FIELD(node, Scene::Node, weights), &src->weights);
+      b->string(FIELD(node, Scene::Node, name), &src->name);
+    }
+
+    Array<glTF::Scene> *scenes = &gltf->scenes.scenes;
+    size_t scene_table = b->array<Scene::Root>(FIELD(root, Scene, scenes), scenes->len);
+    for(size_t i = 0; i < scenes->len; ++i) {
+      size_t scene = scene_table + sizeof(Scene::Root) * i;
+      b->copy_indices(FIELD(scene, Scene::Root, nodes), &(*scenes)[i].nodes);
+      b->string(FIELD(scene, Scene::Root, name), &(*scenes)[i].name);
+    }
+
+    Array<glTF::Skin> *skins = &gltf->skins.skins;
+    size_t skin_table = b->array<Scene::Skin>(FIELD(root, Scene, skins), skins->len);
+    for(size_t i = 0; i < skins->len; ++i) {
+      size_t skin = skin_table + sizeof(Scene::Skin) * i;
+      Scene::Skin *s = b->at<Scene::Skin>(skin);
+      s->inverse_bind_matrices = index_or_none((*skins)[i].i_bind_matrices);
+      s->skeleton = index_or_none((*skins)[i].skeleton);
+      b->copy_indices(FIELD(skin, Scene::Skin, joints), &(*skins)[i].joints);
+    }
+
+    Array<glTF::Image> *images = &gltf->images.images;
+    size_t image_table = b->array<Scene::Image>(FIELD(root, Scene, images), images->len);
+    for(size_t i = 0; i < images->len; ++i) {
+      Scene::Image *img = b->at<Scene::Image>(image_table) + i;
+      img->buffer_view = index_or_none((*images)[i].buffer_view);
+      img->mime_type = (Scene::Image::MimeType)(*images)[i].mime_type;
+    }
+
+    Array<glTF::Texture> *textures = &gltf->textures.textures;
+    size_t texture_table = b->array<Scene::Texture>(FIELD(root, Scene, textures), textures->len);
+    for(size_t i = 0; i < textures->len; ++i) {
+      Scene::Texture *tex = b->at<Scene::Texture>(texture_table) + i;
+      tex->sampler = index_or_none((*textures)[i].sampler);
+      tex->source = index_or_none((*textures)[i].source);
+    }
+
+    Array<glTF::Sampler> *samplers = &gltf->samplers.samplers;
+    size_t sampler_table = b->array<Scene::Sampler>(FIELD(root, Scene, samplers), samplers->len);
+    for(size_t i = 0; i < samplers->len; ++i) {
+      Scene::Sampler *s = b->at<Scene::Sampler>(sampler_table) + i;
+      s->mag_filter = (uint32_t)(*samplers)[i].mag_filter;
+      s->min_filter = (uint32_t)(*samplers)[i].min_filter;
+      s->wrap_s = (uint32_t)(*samplers)[i].wrap_s;
+      s->wrap_t = (uint32_t)(*samplers)[i].wrap_t;
+    }
+
+    Array<glTF::Material> *materials = &gltf->materials.materials;
+    size_t material_table = b->array<Scene::Material>(FIELD(root, Scene, materials), materials->len);
+    for(size_t i = 0; i < materials->len; ++i) {
+      glTF::Material *src = &(*materials)[i];
+      glTF::Material::PbrMetallicRoughness *pbr = &src->pbr_metallic_roughness;
+      size_t mat = material_table + sizeof(Scene::Material) * i;
+      Scene::Material *m = b->at<Scene::Material>(mat);
+      set_floats(m->base_color_factor, &pbr->base_color_factor, 4, ONE);
+      set_floats(m->emissive_factor, &src->emissive_factor, 3, ZERO);
+      m->metallic_factor = float_or(pbr->metallic_factor, 1.0f);
+      m->roughness_factor = float_or(pbr->roughness_factor, 1.0f);
+      m->alpha_cutoff = float_or(src->alpha_cutoff, 0.5f);
+      m->alpha_mode = (Scene::Material::AlphaMode)src->alpha_mode;
+      m->double_sided = src->double_sided;
+      m->base_color_texture = mat_texture(&pbr->base_color_texture);
+      m->metallic_roughness_texture = mat_texture(&pbr->metallic_roughness_texture);
+      m->normal_texture = mat_texture(&src->normal_texture);
+      m->occlusion_texture = mat_texture(&src->occlusion_texture);
+      m->emissive_texture = mat_texture(&src->emissive_texture);
+      b->string(FIELD(mat, Scene::Material, name), &src->name);
+    }
+
+    Array<glTF::Camera> *cameras = &gltf->cameras.cameras;
+    size_t camera_table = b->array<Scene::Camera>(FIELD(root, Scene, cameras), cameras->len);
+    for(size_t i = 0; i < cameras->len; ++i) {
+      glTF::Camera *src = &(*cameras)[i];
+      size_t cam = camera_table + sizeof(Scene::Camera) * i;
+      Scene::Camera *c = b->at<Scene::Camera>(cam);
+      c->type = src->type == glTF::Camera::ORTHO ? Scene::Camera::ORTHO : Scene::Camera::PERSPECTIVE;
+      c->aspect_ratio = float_or(src->aspect_ratio, 0.0f);
+      c->yfov = float_or(src->yfov, 0.0f);
+      c->xmag = float_or(src->xmag, 0.0f);
+      c->ymag = float_or(src->ymag, 0.0f);
+      c->znear = float_or(src->znear, 0.0f);
+      c->zfar = float_or(src->zfar, 0.0f);
+      b->string(FIELD(cam, Scene::Camera, name), &src->name);
+    }
+
+    Array<glTF::Animation> *animations = &gltf->animations.animations;
+    size_t animation_table = b->array<Scene::Animation>(FIELD(root, Scene, animations), animations->len);
+    for(size_t i = 0; i < animations->len; ++i) {
+      glTF::Animation *src = &(*animations)[i];
+      size_t anim = animation_table + sizeof(Scene::Animation) * i;
+
+      // Channels that target something other than a node's TRS/weights (extensions) are dropped
+      uint32_t channel_count = 0;
+      for(size_t j = 0; j < src->channels.len; ++j)
+        channel_count += src->channels[j].target.path != glTF::Animation::Channel::Target::NONE;
+      size_t channel_table = b->array<Scene::Animation::Channel>(FIELD(anim, Scene::Animation, channels), channel_count);
+      Scene::Animation::Channel *channel = b->at<Scene::Animation::Channel>(channel_table);
+      for(size_t j = 0; j < src->channels.len; ++j) {
+        glTF::Animation::Channel *src_channel = &src->channels[j];
+        if (src_channel->target.path == glTF::Animation::Channel::Target::NONE)
+          continue;
+        channel->sampler = (uint32_t)src_channel->sampler;
+        channel->node = (uint32_t)src_channel->target.node;
+        channel->path = (Scene::Animation::Path)(src_channel->target.path - 1);
+        ++channel;
+      }
+
+      size_t sampler_table = b->array<Scene::Animation::Sampler>(FIELD(anim, Scene::Animation, samplers), src->samplers.len);
+      for(size_t j = 0; j < src->samplers.len; ++j) {
+        Scene::Animation::Sampler *s = b->at<Scene::Animation::Sampler>(sampler_table) + j;
+        s->input = (uint32_t)src->samplers[j].input;
+        s->output = (uint32_t)src->samplers[j].output;
+        s->interpolation = (Scene::Animation::Interpolation)src->samplers[j].interpolation;
+      }
+      b->string(FIELD(anim, Scene::Animation, name), &src->name);
+      write_clip(b, anim, gltf, src, i);
+    }
+
+    b->alloc(0, SCENE_DATA_ALIGN);
+    b->at<Scene>(root)->size = b->len;
+  }
+
+  #undef FIELD
+}
+
+bool Scene::validate(const uint8_t *data, size_t size) {
+  if (size < sizeof(Scene) || ((uintptr_t)data & 15) != 0)
+    return false;
+  const Scene *scene = (const Scene*)data;
+  if (scene->magic != SCENE_MAGIC || scene->version != SCENE_VERSION || scene->size != size)
+    return false;
+  Bounds bounds = { data, size };
+  return validate_scene(&bounds, scene);
+}
+
+bool Scene::write(glTF::glTF *gltf, const char *path, float weld_epsilon) {
+  Builder b;
+  write_scene(&b, gltf, weld_epsilon);
+  bool ok = File::write(path, b.mem, b.len);
+  free(b.mem);
+  return ok;
+}
+
+uint32_t Scene::select_lod(const Primitive *prim, float pixels_per_unit, float max_pixels) {
+  for(uint64_t i = prim->lods.count; i > 1; --i)
+    if (prim->lods[i - 1].error * pixels_per_unit <= max_pixels)
+      return (uint32_t)(i - 1);
+  return 0;
+}
+
+const uint8_t* Scene::view_data(uint32_t view) const {
+  const BufferView *v = &buffer_views[view];
+  return buffers[v->buffer].data.data() + v->byte_offset;
+}
+const uint8_t* Scene::accessor_data(uint32_t accessor) const {
+  const Accessor *a = &accessors[accessor];
+  if (a->buffer_view < 0)
+    return nullptr;
+  return view_data((uint32_t)a->buffer_view) + a->byte_offset;
+}
+
+AccessorView Scene::accessor_view(uint32_t accessor) const {
+  const Accessor *a = &accessors[accessor];
+  AccessorView view = {};
+  view.data = accessor_data(accessor);
+  view.stride = Decode::element_size(a->component_type, a->type);
+  if (a->buffer_view >= 0 && buffer_views[a->buffer_view].byte_stride)
+    view.stride = buffer_views[a->buffer_view].byte_stride;
+  view.component_type = a->component_type;
+  view.type = a->type;
+  view.count = a->count;
+  view.normalized = a->normalized;
+  if (a->sparse.count) {
+    view.sparse_count = a->sparse.count;
+    view.sparse_index_type = a->sparse.indices_component_type;
+    view.sparse_indices = view_data(a->sparse.indices_view) + a->sparse.indices_offset;
+    view.sparse_values = view_data(a->sparse.values_view) + a->sparse.values_offset;
+  }
+  return view;
+}
+
+// SceneFile /////////////////////
+bool SceneFile::open(const char *path) {
+  size_t size;
+  const uint8_t *data = Pack::instance()->get(path, &size, &heap);
+  if (!data) {
+    // No readahead hints: validation reads the tables, the vertex data stays on disk until it is used
+    file = File::map(path, File::ADVISE_NONE);
+    if (!file.data)
+      return false;
+    data = file.data;
+    size = file.size;
+  }
+  if (!Scene::validate(data, size)) {
+    print_err("Scene: '{}' is not a valid scene file\n", path);
+    close();
+    return false;
+  }
+  scene = (const Scene*)data;
+  return true;
+}
+void SceneFile::close() {
+  file.unmap();
+  if (heap)
+    mem_free(heap);
+  heap = nullptr;
+  scene = nullptr;
+}
+
+} // namespace Sol
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Clip.hpp"
+#include "Decode.hpp"
+#include "File.hpp"
+#include "Meshlet.hpp"
+#include "Morph.hpp"
+#include "Quantize.hpp"
+
+namespace Sol {
+
+namespace glTF { struct glTF; }
+
+/*
+ * Cooked scene: the file layout is the runtime layout. There are no pointers in the file, only
+ * self relative offsets (from the offset field itself to its target), so the mapping is used as it is,
+ * read only, with no fix up pass. Loading is mmap plus validate(), which touches the tables (nodes,
+ * accessors...) but never the vertex data, so it costs the same whatever the size of the buffers.
+ *
+ * Everything is resolved at cook time: attribute names become semantics, strings are null terminated,
+ * missing glTF values get their spec defaults and every index is checked, so the runtime indexes
+ * without checking. Tables are 16 byte aligned, buffer data 64 byte aligned.
+ */
+
+static const uint32_t SCENE_MAGIC = 0x4e435353; // "SSCN"
+static const uint32_t SCENE_VERSION = 9;
+static const size_t SCENE_DATA_ALIGN = 64;
+static const uint32_t SCENE_MAX_LODS = 8;
+
+// 'count' Ts at 'offset' bytes from this struct
+template<typename T>
+struct RelArray {
+  int64_t offset;
+  uint64_t count;
+
+  const T* data() const {
+    return (const T*)((const uint8_t*)this + offset);
+  }
+  const T& operator[](size_t i) const { return data()[i]; }
+};
+
+struct Scene {
+  enum ComponentType : uint32_t {
+    INT8 = 5120,
+    UINT8 = 5121,
+    INT16 = 5122,
+    UINT16 = 5123,
+    UINT32 = 5125,
+    FLOAT = 5126,
+  };
+  enum Type : uint32_t {
+    SCALAR,
+    VEC2,
+    VEC3,
+    VEC4,
+    MAT2,
+    MAT3,
+    MAT4,
+  };
+  enum Semantic : uint32_t {
+    POSITION,
+    NORMAL,
+    TANGENT,
+    TEXCOORD,
+    COLOR,
+    JOINTS,
+    WEIGHTS,
+    CUSTOM, // Application specific ('_NAME'), see Attribute::name
+  };
+
+  struct Buffer {
+    RelArray<uint8_t> data;
+  };
+  struct BufferView {
+    uint32_t buffer;
+    uint32_t byte_stride; // 0 is tightly packed
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint32_t target;
+    uint32_t pad;
+  };
+  struct Accessor {
+    struct Sparse {
+      uint32_t count; // 0 if not sparse
+      uint32_t indices_view;
+      uint32_t indices_offset;
+      ComponentType indices_component_type;
+      uint32_t values_view;
+      uint32_t values_offset;
+    };
+    int32_t buffer_view; // -1 is all zeros (then only 'sparse' has data)
+    uint32_t byte_offset;
+    ComponentType component_type;
+    Type type;
+    uint32_t components; // Per element, e.g. 16 for MAT4
+    uint32_t count;
+    uint32_t min_max_count; // 0 if the accessor has no bounds
+    uint32_t normalized;
+    float min[16];
+    float max[16];
+    Sparse sparse;
+  };
+
+  struct Attribute {
+    Semantic semantic;
+    uint32_t set; // The 'n' in TEXCOORD_n
+    uint32_t accessor;
+    uint32_t pad;
+    RelArray<char> name;
+  };
+  struct Target {
+    RelArray<Attribute> attributes;
+    // POSITION, NORMAL and TANGENT against the primitive's 'vertices', only where they are not all 0
+    // (see Morph.hpp); empty if the primitive has no vertices. Vertex data as far as validate() goes, so
+    // the deltas' vertex indices are not checked at load: Morph::blend() skips those past the vertices
+    RelArray<MorphDelta> deltas;
+  };
+  // A range of a primitive's index_data, in indices
+  struct Lod {
+    uint32_t first;
+    uint32_t count;
+    float error; // How far it may be from the full detail surface, in mesh units; 0 for LOD 0
+    uint32_t pad;
+  };
+  struct Primitive {
+    RelArray<Attribute> attributes;
+    RelArray<Target> targets;
+    // What the GPU draws: the attributes quantized (see Quantize.hpp), empty if the primitive has no
+    // POSITION or its joints do not fit in 8 bits, and the indices narrowed to 'index_size' bytes.
+    // Duplicate vertices are welded, so a primitive with vertices is always drawn indexed, whether
+    // or not the glTF had 'indices'. Triangle lists get simplified LODs after the full detail one,
+    // all indexing the same vertices.
+    RelArray<QuantizedVertex> vertices;
+    RelArray<uint8_t> index_data;
+    RelArray<Lod> lods; // Finest first, lods[0] is the full 'index_count'; empty if there are no vertices
+    // LOD 0 of a triangle list as meshlets (see Meshlet.hpp); meshlet_triangles is padded to 4 bytes
+    RelArray<Meshlet> meshlets;
+    RelArray<uint32_t> meshlet_vertices;
+    RelArray<uint8_t> meshlet_triangles;
+    QuantizedBounds bounds;
+    int32_t indices;
+    int32_t material;
+    uint32_t mode;
+    uint32_t index_size;  // 2 or 4, 0 if there are no vertices
+    uint32_t index_count;
+    uint32_t pad;
+  };
+  struct Mesh {
+    RelArray<Primitive> primitives;
+    RelArray<float> weights;
+    RelArray<RelArray<char>> target_names;
+  };
+
+  struct Node {
+    float translation[3];
+    float scale[3];
+    float rotation[4];
+    float matrix[16];   // Only if 'has_matrix', else the node's TRS is its transform
+    uint32_t has_matrix;
+    int32_t mesh;
+    int32_t skin;
+    int32_t camera;
+    RelArray<uint32_t> children;
+    RelArray<float> weights;
+    RelArray<char> name;
+  };
+  struct Skin {
+    RelArray<uint32_t> joints;
+    int32_t inverse_bind_matrices;
+    int32_t skeleton;
+  };
+
+  struct Image {
+    enum MimeType : uint32_t {
+      NONE,
+      PNG,
+      JPG,
+    };
+    int32_t buffer_view; // The cooker moves every image into the buffer
+    MimeType mime_type;
+  };
+  struct Sampler {
+    uint32_t mag_filter; // GL enums, 0 when unset
+    uint32_t min_filter;
+    uint32_t wrap_s;
+    uint32_t wrap_t;
+  };
+  struct Texture {
+    int32_t sampler;
+    int32_t source;
+  };
+  struct MatTexture {
+    int32_t index; // -1 is none
+    uint32_t tex_coord;
+    float scale; // normalTexture.scale or occlusionTexture.strength, else 1
+  };
+  struct Material {
+    enum AlphaMode : uint32_t {
+      OPAQUE,
+      MASK,
+      BLEND,
+    };
+    float base_color_factor[4];
+    float emissive_factor[3];
+    float metallic_factor;
+    float roughness_factor;
+    float alpha_cutoff;
+    AlphaMode alpha_mode;
+    uint32_t double_sided;
+    MatTexture base_color_texture;
+    MatTexture metallic_roughness_texture;
+    MatTexture normal_texture;
+    MatTexture occlusion_texture;
+    MatTexture emissive_texture;
+    uint32_t pad;
+    RelArray<char> name;
+  };
+  struct Camera {
+    enum Type : uint32_t {
+      PERSPECTIVE,
+      ORTHO,
+    };
+    Type type;
+    float aspect_ratio; // 0 if unset: use the viewport's
+    float yfov;
+    float xmag;
+    float ymag;
+    float znear;
+    float zfar; // 0 is infinite (perspective only)
+    uint32_t pad;
+    RelArray<char> name;
+  };
+  struct Animation {
+    enum Path : uint32_t {
+      TRANSLATION,
+      ROTATION,
+      SCALE,
+      WEIGHTS,
+    };
+    enum Interpolation : uint32_t {
+      LINEAR,
+      STEP,
+      CUBICSPLINE,
+    };
+    struct Channel {
+      uint32_t sampler;
+      uint32_t node;
+      Path path;
+      uint32_t pad;
+    };
+    struct Sampler {
+      uint32_t input;
+      uint32_t output;
+      Interpolation interpolation;
+      uint32_t pad;
+    };
+    RelArray<Channel> channels;
+    RelArray<Sampler> samplers;
+    RelArray<char> name;
+    // The TRS channels compressed (Clip.hpp), which is what Animator plays; keys are in stream order
+    RelArray<ClipTrack> clip_tracks;
+    RelArray<ClipKey> clip_keys;
+    float duration;
+    uint32_t pad;
+  };
+  struct Root {
+    RelArray<uint32_t> nodes;
+    RelArray<char> name;
+  };
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size; // Of the whole file
+  int32_t scene; // Default root, -1 if none
+  uint32_t pad;
+
+  RelArray<Root> scenes;
+  RelArray<Node> nodes;
+  RelArray<Mesh> meshes;
+  RelArray<Accessor> accessors;
+  RelArray<BufferView> buffer_views;
+  RelArray<Buffer> buffers;
+  RelArray<Material> materials;
+  RelArray<Texture> textures;
+  RelArray<Image> images;
+  RelArray<Sampler> samplers;
+  RelArray<Camera> cameras;
+  RelArray<Skin> skins;
+  RelArray<Animation> animations;
+
+  // Where an accessor's/buffer view's bytes start
+  const uint8_t* view_data(uint32_t view) const;
+  const uint8_t* accessor_data(uint32_t accessor) const;
+  // For Decode::floats/uints
+  AccessorView accessor_view(uint32_t accessor) const;
+  /*
+   * The coarsest LOD of 'prim' whose error covers at most 'max_pixels' on screen. 'pixels_per_unit' is
+   * for the primitive where it is drawn: Camera::pixels_per_unit at its bounds' centre, times its node's
+   * largest world scale.
+   */
+  static uint32_t select_lod(const Primitive *prim, float pixels_per_unit, float max_pixels = 1.0f);
+
+  // Check that the header, every offset and every index is in bounds
+  static bool validate(const uint8_t *data, size_t size);
+  // Write the scene for a loaded glTF, whose buffers must all be in memory. Positions at most
+  // 'weld_epsilon' apart per axis are welded, if the rest of the vertex is the same.
+  static bool write(glTF::glTF *gltf, const char *path, float weld_epsilon = 0.0f);
+};
+
+// A validated scene, mapped from its file or from the Pack
+struct SceneFile {
+  MappedFile file;
+  void *heap = nullptr; // If it was a compressed pack entry
+  const Scene *scene = nullptr;
+
+  bool open(const char *path);
+  void close();
+};
+
+} // namespace Sol
@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
+
+#include "SceneGraph.hpp"
+#include "Allocator.hpp"
+#include "Format.hpp"
+#include "Scene.hpp"
+
+namespace Sol {
+
+namespace {
+  /*
+   * Breadth first from the roots, in node order, which is the depth order. The arrays are allocated
+   * for every node, though only 'count' slots get used when some node is on a cycle.
+   */
+  static bool layout(SceneGraph *g, uint32_t node_count, const int32_t *parents) {
+    uint32_t alloc_count = node_count ? node_count : 1;
+    g->node_count = node_count;
+    g->node = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+    g->slot = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+    g->parent = (int32_t*)mem_alloca(sizeof(int32_t) * alloc_count, 16);
+    g->translation = (float*)mem_alloca(sizeof(float) * 4 * alloc_count, 16);
+    g->rotation = (float*)mem_alloca(sizeof(float) * 4 * alloc_count, 16);
+    g->scale = (float*)mem_alloca(sizeof(float) * 4 * alloc_count, 16);
+    g->matrix = (int32_t*)mem_alloca(sizeof(int32_t) * alloc_count, 16);
+    g->matrices = nullptr;
+    g->world = (float*)mem_alloca(sizeof(float) * 16 * alloc_count, 16);
+    g->first_child = (uint32_t*)mem_alloca(sizeof(uint32_t) * (node_count + 1), 16);
+    g->dirty = (uint8_t*)mem_alloca(alloc_count, 16);
+    g->dirty_slots = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+    g->dirty_count = 0;
+
+    uint32_t *offsets = (uint32_t*)mem_alloca(sizeof(uint32_t) * (node_count + 1), 16);
+    uint32_t *children = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+    if (!g->node || !g->slot || !g->parent || !g->translation || !g->rotation || !g->scale || !g->matrix ||
+        !g->world || !g->first_child || !g->dirty || !g->dirty_slots || !offsets || !children) {
+      print_err("SceneGraph: out of memory for {} nodes\n", node_count);
+      mem_free(children);
+      mem_free(offsets);
+      g->kill();
+      return false;
+    }
+    memset(offsets, 0, sizeof(uint32_t) * (node_count + 1));
+    for(uint32_t n = 0; n < node_count; ++n)
+      if (parents[n] >= 0)
+        ++offsets[parents[n] + 1];
+    for(uint32_t n = 0; n < node_count; ++n)
+      offsets[n + 1] += offsets[n];
+    memcpy(g->slot, offsets, sizeof(uint32_t) * node_count); // As the fill cursor, for now
+    for(uint32_t n = 0; n < node_count; ++n)
+      if (parents[n] >= 0)
+        children[g->slot[parents[n]]++] = n;
+
+    memset(g->slot, 0xff, sizeof(uint32_t) * node_count);
+    uint32_t count = 0;
+    for(uint32_t n = 0; n < node_count; ++n)
+      if (parents[n] < 0)
+        g->node[count++] = n;
+    for(uint32_t i = 0; i < count; ++i) {
+      uint32_t n = g->node[i];
+      g->slot[n] = i;
+      g->parent[i] = parents[n] < 0 ? -1 : (int32_t)g->slot[parents[n]];
+      g->first_child[i] = count;
+      for(uint32_t c = offsets[n]; c < offsets[n + 1]; ++c)
+        g->node[count++] = children[c];
+    }
+    mem_free(children);
+    mem_free(offsets);
+    if (count < node_count)
+      print_err("SceneGraph: {} nodes are on a cycle, so no root reaches them\n", node_count - count);
+
+    g->count = count;
+    g->first_child[count] = count;
+    for(uint32_t i = 0; i < count; ++i) {
+      float *t = g->translation + i * 4;
+      float *r = g->rotation + i * 4;
+      float *s = g->scale + i * 4;
+      t[0] = t[1] = t[2] = t[3] = 0.0f;
+      r[0] = r[1] = r[2] = 0.0f;
+      r[3] = 1.0f;
+      s[0] = s[1] = s[2] = 1.0f;
+      s[3] = 0.0f;
+      g->matrix[i] = -1;
+    }
+    memset(g->dirty, 0, count);
+    for(uint32_t i = 0; i < count && g->parent[i] < 0; ++i)
+      g->mark_dirty(i);
+    return true;
+  }
+
+  // Columns of T * R * S, the quaternion taken as unit length
+  static void local_matrix(const SceneGraph *g, uint32_t i, __m128 *cols) {
+    if (g->matrix[i] >= 0) {
+      const float *m = g->matrices + g->matrix[i] * 16;
+      for(uint32_t c = 0; c < 4; ++c)
+        cols[c] = _mm_loadu_ps(m + c * 4);
+      return;
+    }
+    const float *q = g->rotation + i * 4;
+    const float *s = g->scale + i * 4;
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    float xx = x * x, yy = y * y, zz = z * z;
+    float xy = x * y, xz = x * z, yz = y * z;
+    float wx = w * x, wy = w * y, wz = w * z;
+    cols[0] = _mm_mul_ps(_mm_setr_ps(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f), _mm_set1_ps(s[0]));
+    cols[1] = _mm_mul_ps(_mm_setr_ps(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f), _mm_set1_ps(s[1]));
+    cols[2] = _mm_mul_ps(_mm_setr_ps(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f), _mm_set1_ps(s[2]));
+    const float *t = g->translation + i * 4;
+    cols[3] = _mm_setr_ps(t[0], t[1], t[2], 1.0f);
+  }
+
+  /*
+   * T * R * S of slots i to i + 3 at once, for nodes without a fixed matrix: their TRS transposed to
+   * xxxx/yyyy/zzzz/wwww, each matrix entry computed for the four in one register, then transposed back
+   * to each slot's columns, cols[slot - i].
+   */
+  static void local_matrices(const SceneGraph *g, uint32_t i, __m128 (*cols)[4]) {
+    __m128 x = _mm_load_ps(g->rotation + i * 4);
+    __m128 y = _mm_load_ps(g->rotation + i * 4 + 4);
+    __m128 z = _mm_load_ps(g->rotation + i * 4 + 8);
+    __m128 w = _mm_load_ps(g->rotation + i * 4 + 12);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    __m128 sx = _mm_load_ps(g->scale + i * 4);
+    __m128 sy = _mm_load_ps(g->scale + i * 4 + 4);
+    __m128 sz = _mm_load_ps(g->scale + i * 4 + 8);
+    __m128 sw = _mm_load_ps(g->scale + i * 4 + 12);
+    _MM_TRANSPOSE4_PS(sx, sy, sz, sw);
+
+    const __m128 one = _mm_set1_ps(1.0f);
+    __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+    __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+    __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+    __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 c0[4] = {
+      _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+      _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+      _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+      zero,
+    };
+    __m128 c1[4] = {
+      _mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+      _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+      _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+      zero,
+    };
+    __m128 c2[4] = {
+      _mm_mul_ps(_mm_add_ps(xz, wy), sz),
+      _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+      _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+      zero,
+    };
+    _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+    _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+    _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+    // The translations are already columns, only w needs setting
+    const __m128 w_one = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+    const __m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    for(uint32_t k = 0; k < 4; ++k) {
+      cols[k][0] = c0[k];
+      cols[k][1] = c1[k];
+      cols[k][2] = c2[k];
+      cols[k][3] = _mm_or_ps(_mm_and_ps(_mm_load_ps(g->translation + (i + k) * 4), xyz), w_one);
+    }
+  }
+
+  // out = parent * local, a column at a time: the parent's columns scaled by the local column's entries
+  static void multiply(const float *parent, const __m128 *local, float *out) {
+    __m128 p0 = _mm_load_ps(parent);
+    __m128 p1 = _mm_load_ps(parent + 4);
+    __m128 p2 = _mm_load_ps(parent + 8);
+    __m128 p3 = _mm_load_ps(parent + 12);
+    for(uint32_t c = 0; c < 4; ++c) {
+      __m128 l = local[c];
+      __m128 col = _mm_mul_ps(p0, _mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 0, 0, 0)));
+      col = _mm_add_ps(col, _mm_mul_ps(p1, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 1, 1, 1))));
+      col = _mm_add_ps(col, _mm_mul_ps(p2, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 2, 2, 2))));
+      col = _mm_add_ps(col, _mm_mul_ps(p3, _mm_shuffle_ps(l, l, _MM_SHUFFLE(3, 3, 3, 3))));
+      _mm_store_ps(out + c * 4, col);
+    }
+  }
+}
+
+// A node listed as the child of two nodes keeps the first, as glTF nodes have one parent at most
+bool SceneGraph::init(const Scene *scene) {
+  uint32_t n_count = (uint32_t)scene->nodes.count;
+  int32_t *parents = (int32_t*)mem_alloca(sizeof(int32_t) * (n_count ? n_count : 1), 16);
+  if (!parents) {
+    print_err("SceneGraph: out of memory for {} nodes\n", n_count);
+    return false;
+  }
+  for(uint32_t n = 0; n < n_count; ++n)
+    parents[n] = -1;
+  for(uint32_t n = 0; n < n_count; ++n) {
+    const Scene::Node *src = &scene->nodes[n];
+    for(uint64_t c = 0; c < src->children.count; ++c) {
+      uint32_t child = src->children[c];
+      if (parents[child] >= 0 || child == n) {
+        print_err("SceneGraph: node {} is its own child or the child of more than one node\n", child);
+        continue;
+      }
+      parents[child] = (int32_t)n;
+    }
+  }
+  bool ok = layout(this, n_count, parents);
+  mem_free(parents);
+  if (!ok)
+    return false;
+
+  uint32_t matrix_count = 0;
+  for(uint32_t i = 0; i < count; ++i)
+    matrix_count += scene->nodes[node[i]].has_matrix != 0;
+  if (matrix_count)
+    matrices = (float*)mem_alloca(sizeof(float) * 16 * matrix_count, 16);
+  if (matrix_count && !matrices) {
+    print_err("SceneGraph: out of memory for {} node matrices\n", matrix_count);
+    kill();
+    return false;
+  }
+  matrix_count = 0;
+  for(uint32_t i = 0; i < count; ++i) {
+    const Scene::Node *src = &scene->nodes[node[i]];
+    memcpy(translation + i * 4, src->translation, sizeof(float) * 3);
+    memcpy(rotation + i * 4, src->rotation, sizeof(float) * 4);
+    memcpy(scale + i * 4, src->scale, sizeof(float) * 3);
+    if (src->has_matrix) {
+      memcpy(matrices + matrix_count * 16, src->matrix, sizeof(float) * 16);
+      matrix[i] = (int32_t)matrix_count++;
+    }
+  }
+  return true;
+}
+
+bool SceneGraph::init(uint32_t node_count_, const int32_t *parents) {
+  for(uint32_t n = 0; n < node_count_; ++n) {
+    if (parents[n] >= (int32_t)node_count_) {
+      print_err("SceneGraph: node {} has parent {}, past the {} nodes\n", n, parents[n], node_count_);
+      return false;
+    }
+  }
+  return layout(this, node_count_, parents);
+}
+
+void SceneGraph::kill() {
+  mem_free(dirty_slots);
+  mem_free(dirty);
+  mem_free(first_child);
+  mem_free(world);
+  mem_free(matrices);
+  mem_free(matrix);
+  mem_free(scale);
+  mem_free(rotation);
+  mem_free(translation);
+  mem_free(parent);
+  mem_free(slot);
+  mem_free(node);
+}
+
+void SceneGraph::set_translation(uint32_t i, const float *t) {
+  memcpy(translation + i * 4, t, sizeof(float) * 3);
+  mark_dirty(i);
+}
+void SceneGraph::set_rotation(uint32_t i, const float *q) {
+  memcpy(rotation + i * 4, q, sizeof(float) * 4);
+  mark_dirty(i);
+}
+void SceneGraph::set_scale(uint32_t i, const float *s) {
+  memcpy(scale + i * 4, s, sizeof(float) * 3);
+  mark_dirty(i);
+}
+
+namespace {
+  /*
+   * multiply() for a TRS local, whose first three columns have w 0 and whose last has w 1: the parent's
+   * last column only goes into the translation, which saves a quarter of the work.
+   */
+  static void multiply_trs(const float *parent, const __m128 *local, float *out) {
+    __m128 p0 = _mm_load_ps(parent);
+    __m128 p1 = _mm_load_ps(parent + 4);
+    __m128 p2 = _mm_load_ps(parent + 8);
+    for(uint32_t c = 0; c < 4; ++c) {
+      __m128 l = local[c];
+      __m128 col = _mm_mul_ps(p0, _mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 0, 0, 0)));
+      col = _mm_add_ps(col, _mm_mul_ps(p1, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 1, 1, 1))));
+      col = _mm_add_ps(col, _mm_mul_ps(p2, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 2, 2, 2))));
+      if (c == 3)
+        col = _mm_add_ps(col, _mm_load_ps(parent + 12));
+      _mm_store_ps(out + c * 4, col);
+    }
+  }
+
+  // The world matrix of slot i, its parent's being up to date
+  static void compose(SceneGraph *g, uint32_t i, const __m128 *local) {
+    int32_t p = g->parent[i];
+    if (p < 0)
+      for(uint32_t c = 0; c < 4; ++c)
+        _mm_store_ps(g->world + i * 16 + c * 4, local[c]);
+    else if (g->matrix[i] < 0)
+      multiply_trs(g->world + p * 16, local, g->world + i * 16);
+    else
+      multiply(g->world + p * 16, local, g->world + i * 16);
+  }
+
+  // Slots lo to hi, whose parents are all up to date or earlier in the range, four at a time
+  static void compose_range(SceneGraph *g, uint32_t lo, uint32_t hi) {
+    uint32_t i = lo;
+    for(; i + 4 <= hi; i += 4) {
+      __m128 local[4][4];
+      local_matrices(g, i, local);
+      for(uint32_t k = 0; k < 4; ++k) {
+        if (g->matrix[i + k] >= 0)
+          local_matrix(g, i + k, local[k]);
+        compose(g, i + k, local[k]);
+      }
+    }
+    for(; i < hi; ++i) {
+      __m128 local[4];
+      local_matrix(g, i, local);
+      compose(g, i, local);
+    }
+    memset(g->dirty + lo, 0, hi - lo);
+  }
+}
+
+/*
+ * The dirty slots in slot order, a run of consecutive ones at a time, each run then the children of the
+ * run, their children and so on down: a parent is always composed before its children. A range whose
+ * slots cross a depth has some children inside it already, so the next starts past it. Composing a
+ * range clears its flags, so a dirty slot inside a subtree already walked is skipped.
+ */
+void SceneGraph::update() {
+  if (!dirty_count)
+    return;
+  // With most of the graph marked, scanning the flags beats sorting the list
+  bool scan = dirty_count > count / 16;
+  if (!scan)
+    std::sort(dirty_slots, dirty_slots + dirty_count);
+  uint32_t end = scan ? count : dirty_count;
+  for(uint32_t d = 0; d < end; ++d) {
+    uint32_t lo = scan ? d : dirty_slots[d];
+    if (!dirty[lo])
+      continue;
+    uint32_t hi = lo + 1;
+    while (hi < count && dirty[hi])
+      ++hi;
+    while (lo < hi) {
+      compose_range(this, lo, hi);
+      uint32_t next_lo = first_child[lo];
+      uint32_t next_hi = first_child[hi];
+      lo = next_lo > hi ? next_lo : hi;
+      hi = next_hi;
+    }
+  }
+  dirty_count = 0;
+}
+
+} // namespace Sol
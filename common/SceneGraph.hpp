@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Sol {
+
+struct Scene;
+
+/*
+ * Runtime node hierarchy, flattened. Nodes are sorted by depth (breadth first from the roots), so a
+ * parent is always before its children and the world matrices update in one forward pass, with no
+ * recursion and no child lists. Every field is its own array (SoA) indexed by slot; 'slot' maps a scene's
+ * node index to its slot. A node's local transform is its TRS, or its fixed matrix if it has one.
+ * The children of consecutive slots are consecutive too, so a subtree is one slot range per depth and
+ * update() only walks those below the nodes marked dirty.
+ */
+struct SceneGraph {
+  uint32_t count;
+  uint32_t node_count; // Of the source, so the size of 'slot'
+  uint32_t *node;      // Slot to the source node index
+  uint32_t *slot;      // Source node index to slot, UINT32_MAX if no root reaches it
+  int32_t *parent;     // Slot, -1 for a root
+  float *translation;  // 4 floats a slot, so SSE loads line up; w unused
+  float *rotation;     // Quaternion, xyzw
+  float *scale;        // 4 floats a slot; w unused
+  int32_t *matrix;     // Into 'matrices' if the node has a fixed local matrix, else -1
+  float *matrices;     // Column major
+  float *world;        // Column major, 16 floats a slot
+  uint32_t *first_child; // Slot of each slot's first child, 'count' + 1 of them, so its children end at the next's
+  uint8_t *dirty;
+  uint32_t *dirty_slots; // Those marked since the last update(), in marking order
+  uint32_t dirty_count;
+
+  // Every node of a cooked scene
+  bool init(const Scene *scene);
+  // From parents alone (-1 for a root), each with an identity TRS, e.g. for generated hierarchies
+  bool init(uint32_t node_count_, const int32_t *parents);
+  void kill();
+
+  void set_translation(uint32_t slot, const float *t);
+  void set_rotation(uint32_t slot, const float *q);
+  void set_scale(uint32_t slot, const float *s);
+  // For a local transform written directly, as the Animator does
+  void mark_dirty(uint32_t slot) {
+    if (dirty[slot])
+      return;
+    dirty[slot] = 1;
+    dirty_slots[dirty_count++] = slot;
+  }
+  // Recompute the world matrix of every dirty node and of everything below one
+  void update();
+};
+
+} // namespace Sol
@@ -0,0 +1,241 @@
+#include <cmath>
+#include <cstring>
+#include <xmmintrin.h>
+
+#include "Skinning.hpp"
+#include "Allocator.hpp"
+#include "Decode.hpp"
+#include "Format.hpp"
+#include "Scene.hpp"
+#include "SceneGraph.hpp"
+#include "Threads.hpp"
+
+namespace Sol {
+
+namespace {
+  static const float IDENTITY[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+  // out = a * b, column major: a's columns scaled by each of b's column entries
+  static void multiply(const float *a, const float *b, float *out) {
+    __m128 a0 = _mm_loadu_ps(a);
+    __m128 a1 = _mm_loadu_ps(a + 4);
+    __m128 a2 = _mm_loadu_ps(a + 8);
+    __m128 a3 = _mm_loadu_ps(a + 12);
+    for(uint32_t c = 0; c < 4; ++c) {
+      __m128 col = _mm_mul_ps(a0, _mm_set1_ps(b[c * 4]));
+      col = _mm_add_ps(col, _mm_mul_ps(a1, _mm_set1_ps(b[c * 4 + 1])));
+      col = _mm_add_ps(col, _mm_mul_ps(a2, _mm_set1_ps(b[c * 4 + 2])));
+      col = _mm_add_ps(col, _mm_mul_ps(a3, _mm_set1_ps(b[c * 4 + 3])));
+      _mm_store_ps(out + c * 4, col);
+    }
+  }
+
+  // a x b in xyz, 0 in w
+  static __m128 cross(__m128 a, __m128 b) {
+    __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+    __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+    return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+  }
+
+  /*
+   * The upper 3x3 of a matrix applied to an octahedral direction, back to octahedral.
+   * Quantize's pair, inlined and without the lengths: the encoding divides by the L1 norm, so the
+   * decoded direction need not be unit length, and a linear transform of it only scales the result.
+   */
+  static void transform_direction(const __m128 *m, const int16_t *in, int16_t *out) {
+    float x = fmaxf((float)in[0] * (1.0f / 32767.0f), -1.0f);
+    float y = fmaxf((float)in[1] * (1.0f / 32767.0f), -1.0f);
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = fmaxf(-z, 0.0f);
+    x -= copysignf(t, x);
+    y -= copysignf(t, y);
+    __m128 v = _mm_mul_ps(m[0], _mm_set1_ps(x));
+    v = _mm_add_ps(v, _mm_mul_ps(m[1], _mm_set1_ps(y)));
+    v = _mm_add_ps(v, _mm_mul_ps(m[2], _mm_set1_ps(z)));
+
+    float d[4];
+    _mm_storeu_ps(d, v);
+    float l1 = fabsf(d[0]) + fabsf(d[1]) + fabsf(d[2]);
+    if (l1 == 0.0f) {
+      out[0] = out[1] = 0;
+      return;
+    }
+    x = d[0] / l1;
+    y = d[1] / l1;
+    if (d[2] < 0.0f) {
+      float fx = copysignf(1.0f - fabsf(y), x);
+      float fy = copysignf(1.0f - fabsf(x), y);
+      x = fx;
+      y = fy;
+    }
+    // Both in -1..1 already; cvtss rounds to nearest even like lrintf, without the call
+    __m128 xy = _mm_mul_ps(_mm_setr_ps(x, y, 0.0f, 0.0f), _mm_set1_ps(32767.0f));
+    out[0] = (int16_t)_mm_cvtss_si32(xy);
+    out[1] = (int16_t)_mm_cvtss_si32(_mm_shuffle_ps(xy, xy, _MM_SHUFFLE(1, 1, 1, 1)));
+  }
+
+  /*
+   * A vertex's matrix is the weighted sum of its joints' (the blend is linear, so summing the
+   * matrices first costs 16 multiply adds a joint, rather than transforming the position, normal and
+   * tangent once a joint). Positions are dequantized to the primitive's bounds on the way in; with
+   * 'morphed', the position, normal and tangent are its instead, and only the joints and weights cooked.
+   *
+   * Normals go through the inverse transpose, so they stay normal to the surface under non uniform
+   * scale. Its columns are the cofactors, the cross products of the matrix's columns, over the
+   * determinant; only the determinant's sign matters, as the encoding drops the length. Tangents lie in
+   * the surface and go through the matrix itself. A negative determinant mirrors the vertex, which
+   * flips the handedness of its tangent frame.
+   */
+  static void skin_vertices(const float *palette, uint32_t joint_count, const QuantizedVertex *in, const QuantizedBounds *bounds,
+      const SkinnedVertex *morphed, uint32_t count, SkinnedVertex *out)
+  {
+    float scale[3] = {};
+    for(uint32_t a = 0; bounds && a < 3; ++a)
+      scale[a] = bounds->scale[a] * (1.0f / 65535.0f);
+    const __m128 weight_scale = _mm_set1_ps(1.0f / 255.0f);
+
+    for(uint32_t i = 0; i < count; ++i) {
+      const QuantizedVertex *v = &in[i];
+      __m128 m[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+      for(uint32_t k = 0; k < 4; ++k) {
+        uint32_t joint = v->joints[k];
+        if (!v->weights[k] || joint >= joint_count)
+          continue;
+        __m128 w = _mm_mul_ps(_mm_set1_ps((float)v->weights[k]), weight_scale);
+        const float *p = palette + joint * 16;
+        for(uint32_t c = 0; c < 4; ++c)
+          m[c] = _mm_add_ps(m[c], _mm_mul_ps(_mm_load_ps(p + c * 4), w));
+      }
+
+      const SkinnedVertex *mv = morphed ? &morphed[i] : nullptr;
+      float x, y, z;
+      if (mv) {
+        x = mv->position[0];
+        y = mv->position[1];
+        z = mv->position[2];
+      } else {
+        x = bounds->offset[0] + (float)v->position[0] * scale[0];
+        y = bounds->offset[1] + (float)v->position[1] * scale[1];
+        z = bounds->offset[2] + (float)v->position[2] * scale[2];
+      }
+      __m128 p = _mm_add_ps(_mm_mul_ps(m[0], _mm_set1_ps(x)), _mm_mul_ps(m[1], _mm_set1_ps(y)));
+      p = _mm_add_ps(p, _mm_add_ps(_mm_mul_ps(m[2], _mm_set1_ps(z)), m[3]));
+
+      __m128 n[3] = { cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]) };
+      float d[4];
+      _mm_storeu_ps(d, _mm_mul_ps(m[0], n[0]));
+      bool mirrored = d[0] + d[1] + d[2] < 0.0f;
+      if (mirrored)
+        for(uint32_t c = 0; c < 3; ++c)
+          n[c] = _mm_sub_ps(_mm_setzero_ps(), n[c]);
+
+      SkinnedVertex *o = &out[i];
+      _mm_storeu_ps(o->position, p);
+      bool handedness = mv ? mv->position[3] != 0.0f : v->position[3] != 0;
+      o->position[3] = handedness != mirrored ? 1.0f : 0.0f;
+      transform_direction(n, mv ? mv->normal : v->normal, o->normal);
+      transform_direction(m, mv ? mv->tangent : v->tangent, o->tangent);
+      o->uv[0] = v->uv[0];
+      o->uv[1] = v->uv[1];
+      o->pad = 0;
+    }
+  }
+
+  struct SkinJob {
+    const float *palette;
+    uint32_t joint_count;
+    const QuantizedVertex *in;
+    const QuantizedBounds *bounds;
+    const SkinnedVertex *morphed;
+    SkinnedVertex *out;
+  };
+  static void skin_range(void *arg, size_t begin, size_t end) {
+    SkinJob *job = (SkinJob*)arg;
+    skin_vertices(job->palette, job->joint_count, job->in + begin, job->bounds, job->morphed ? job->morphed + begin : nullptr,
+        (uint32_t)(end - begin), job->out + begin);
+  }
+}
+
+bool Skinning::init(const Scene *scene, uint32_t skin, const SceneGraph *graph) {
+  *this = {};
+  if (skin >= scene->skins.count) {
+    print_err("Skinning: no skin {}, the scene has {}\n", skin, (uint64_t)scene->skins.count);
+    return false;
+  }
+  const Scene::Skin *src = &scene->skins[skin];
+  joint_count = (uint32_t)src->joints.count;
+  uint32_t alloc_count = joint_count ? joint_count : 1;
+  joint_slots = (uint32_t*)mem_alloca(sizeof(uint32_t) * alloc_count, 16);
+  inverse_binds = (float*)mem_alloca(sizeof(float) * 16 * alloc_count, 16);
+  palette = (float*)mem_alloca(sizeof(float) * 16 * alloc_count, 16);
+  if (!joint_slots || !inverse_binds || !palette) {
+    print_err("Skinning: out of memory for the {} joints of skin {}\n", joint_count, skin);
+    kill();
+    return false;
+  }
+  for(uint32_t j = 0; j < joint_count; ++j) {
+    uint32_t node = src->joints[j];
+    joint_slots[j] = node < graph->node_count ? graph->slot[node] : UINT32_MAX;
+  }
+
+  // The spec wants a MAT4 a joint; anything else is left as identities, like a skin without any
+  const Scene::Accessor *accessor = src->inverse_bind_matrices >= 0 ? &scene->accessors[src->inverse_bind_matrices] : nullptr;
+  if (accessor && accessor->type == Scene::MAT4 && accessor->count >= joint_count) {
+    float *decoded = (float*)mem_alloca(sizeof(float) * 16 * accessor->count, 16);
+    if (!decoded) {
+      print_err("Skinning: out of memory decoding the inverse bind matrices of skin {}\n", skin);
+      kill();
+      return false;
+    }
+    AccessorView view = scene->accessor_view(src->inverse_bind_matrices);
+    Decode::floats(&view, decoded);
+    memcpy(inverse_binds, decoded, sizeof(float) * 16 * joint_count);
+    mem_free(decoded);
+  } else {
+    if (accessor)
+      print_err("Skinning: skin {} has inverse bind matrices of the wrong type or count\n", skin);
+    for(uint32_t j = 0; j < joint_count; ++j)
+      memcpy(inverse_binds + j * 16, IDENTITY, sizeof(IDENTITY));
+  }
+  update_palette(graph);
+  return true;
+}
+
+void Skinning::kill() {
+  mem_free(palette);
+  mem_free(inverse_binds);
+  mem_free(joint_slots);
+  *this = {};
+}
+
+void Skinning::update_palette(const SceneGraph *graph) {
+  for(uint32_t j = 0; j < joint_count; ++j) {
+    const float *world = joint_slots[j] == UINT32_MAX ? IDENTITY : graph->world + joint_slots[j] * 16;
+    multiply(world, inverse_binds + j * 16, palette + j * 16);
+  }
+}
+
+void Skinning::skin(const float *palette, uint32_t joint_count, const QuantizedVertex *in, const QuantizedBounds *bounds,
+    uint32_t count, SkinnedVertex *out)
+{
+  skin_vertices(palette, joint_count, in, bounds, nullptr, count, out);
+}
+
+void Skinning::skin(const float *palette, uint32_t joint_count, const QuantizedVertex *in, const SkinnedVertex *morphed,
+    uint32_t count, SkinnedVertex *out)
+{
+  skin_vertices(palette, joint_count, in, nullptr, morphed, count, out);
+}
+
+void Skinning::skin_parallel(const QuantizedVertex *in, const QuantizedBounds *bounds, uint32_t count, SkinnedVertex *out) const {
+  SkinJob job = { palette, joint_count, in, bounds, nullptr, out };
+  ThreadPool::instance()->parallel_for(count, BATCH_SIZE, skin_range, &job);
+}
+
+void Skinning::skin_parallel(const QuantizedVertex *in, const SkinnedVertex *morphed, uint32_t count, SkinnedVertex *out) const {
+  SkinJob job = { palette, joint_count, in, nullptr, morphed, out };
+  ThreadPool::instance()->parallel_for(count, BATCH_SIZE, skin_range, &job);
+}
+
+} // namespace Sol
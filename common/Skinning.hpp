@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Quantize.hpp"
+
+namespace Sol {
+
+struct Scene;
+struct SceneGraph;
+
+/*
+ * A skinned vertex as the CPU path writes it: the cooked vertex with its position as floats, since a
+ * posed mesh leaves its bounds. 32 bytes, drawn through SkinnedVertexInput (Engine.hpp) with
+ * shaders/quantized.vert given an offset of 0 and a scale of 1.
+ */
+struct SkinnedVertex {
+  float position[4]; // xyz, w the tangent's handedness as QuantizedVertex has it: 0 for -1, 1 for +1
+  int16_t normal[2]; // Octahedral, SNORM16
+  int16_t tangent[2];
+  uint16_t uv[2];    // Half floats, copied through
+  uint32_t pad;
+};
+
+/*
+ * One skinned mesh primitive in the GPU skinning dispatch (shaders/skin.comp), std430. Instances of the
+ * same mesh share its bind pose vertices; each has its own palette (Skinning::palette) and output range.
+ */
+struct SkinInstance {
+  uint32_t vertex_offset;  // Bind pose vertices, in vertices
+  uint32_t vertex_count;
+  uint32_t output_offset;  // Skinned vertices, in vertices
+  uint32_t palette_offset; // In joints
+  uint32_t joint_count;
+  uint32_t pad[3];
+  float position_offset[4]; // The primitive's QuantizedBounds
+  float position_scale[4];
+};
+
+/*
+ * Linear blend skinning on the CPU, for hardware or drivers without the compute path and as the
+ * reference it is checked against. One Skinning per scene skin: update_palette() after the graph's
+ * update, then skin() each primitive of each mesh that uses it.
+ *
+ * As glTF has it, the skinned mesh's own node transform is ignored: the joint matrices take the
+ * vertices straight to world space, so the result is drawn with an identity model matrix.
+ */
+struct Skinning {
+  static const uint32_t BATCH_SIZE = 1024; // Vertices a ThreadPool task
+
+  uint32_t joint_count;
+  uint32_t *joint_slots;  // SceneGraph slot of each joint, UINT32_MAX if no root reaches it (it stays at its bind pose)
+  float *inverse_binds;   // Column major, 16 floats a joint; identities if the skin has none
+  float *palette;         // World times inverse bind, 16 floats a joint, 16 byte aligned
+
+  // On failure it holds no joints and a null 'palette', and kill() is still safe
+  bool init(const Scene *scene, uint32_t skin, const SceneGraph *graph);
+  void kill();
+
+  void update_palette(const SceneGraph *graph);
+  /*
+   * 'count' cooked vertices (with 'bounds', their primitive's) posed by 'palette', four weighted
+   * joints a vertex; a joint past 'joint_count' is skipped. Normals are transformed by the blended
+   * matrix's inverse transpose, tangents by the matrix, both renormalized, and the tangent's
+   * handedness flips where the matrix mirrors. SSE, on the calling thread.
+   */
+  static void skin(const float *palette, uint32_t joint_count, const QuantizedVertex *in, const QuantizedBounds *bounds,
+      uint32_t count, SkinnedVertex *out);
+  // A morphed primitive: 'morphed' (its Morph::vertices) posed by the joints and weights of 'in', its cooked vertices
+  static void skin(const float *palette, uint32_t joint_count, const QuantizedVertex *in, const SkinnedVertex *morphed,
+      uint32_t count, SkinnedVertex *out);
+  // skin() with this palette, in BATCH_SIZE batches across the ThreadPool; 'out' is usually a mapped vertex buffer
+  void skin_parallel(const QuantizedVertex *in, const QuantizedBounds *bounds, uint32_t count, SkinnedVertex *out) const;
+  void skin_parallel(const QuantizedVertex *in, const SkinnedVertex *morphed, uint32_t count, SkinnedVertex *out) const;
+};
+
+} // namespace Sol
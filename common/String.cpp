@@ -6,9 +6,9 @@ namespace Sol {
 
 // StringView ///////////////////
 void StringView::copy_to_buf(StringBuffer *buf, size_t start, size_t end) {
-  char *ptr = buf->str;
+  char *ptr = buf->data();
   ABORT(start < end, "StringView::copy_to_buf: start > end");
-  mem_cpy(buf->str, ptr + start, end - start);
+  mem_cpy(buf->data(), ptr + start, end - start);
 }
 
 // StringBuffer /////////////////
@@ -38,6 +38,7 @@ StringBuffer StringBuffer::get(size_t size, const char* str_, Allocator *alloc_)
     buf.init(size, alloc_);
     buf.copy_here(str_, size);
   } else {
+    buf.alloc = alloc_;
     buf.copy_here(str_, 0);
   }
   return buf;
@@ -48,46 +49,64 @@ StringBuffer StringBuffer::get(size_t size, std::string str_, Allocator *alloc_)
     buf.init(size, alloc_);
     buf.copy_here(str_.c_str(), size);
   } else {
+    buf.alloc = alloc_;
     buf.copy_here(str_.c_str(), 0);
   }
   return buf;
 }
 
+namespace {
+  // Only the system allocator can free/realloc; anything else is an arena, so spilled strings are just 
+  // bumped into it and the old memory is abandoned on grow.
+  static char* alloc_str(Allocator *alloc, size_t size) {
+    if (alloc == &MemoryService::instance()->system_allocator)
+      return (char*)mem_alloc(size);
+    else 
+      return (char*)alloc->allocate(size, 1);
+  }
+}
+
 void StringBuffer::init(size_t size) {
-  ABORT(size > 0, "StringBuffer::init: size must be greater than 0");
-  cap = size; 
+  len = 0;
+  if (size <= INLINE_CAP) {
+    cap = INLINE_CAP;
+    small[0] = '\0';
+    return;
+  }
 
-  if (alloc == &MemoryService::instance()->system_allocator)
-    str = (char*)mem_alloc(size + 1);
-  else 
-    str = (char*)lin_alloca(size + 1, 1);
-  str[0] = '\0';
+  cap = size; 
+  heap = alloc_str(alloc, size + 1);
+  heap[0] = '\0';
 }
 void StringBuffer::init(size_t size, Allocator *alloc_) {
-  cap = size;
   alloc = alloc_;
-
-  if (alloc == &MemoryService::instance()->system_allocator)
-    str = (char*)mem_alloc(size + 1);
-  else 
-    str = (char*)lin_alloca(size + 1, 1);
+  init(size);
 }
 void StringBuffer::kill() {
-  if (alloc == &MemoryService::instance()->system_allocator)
-    mem_free(str);
+  if (!is_inline() && alloc == &MemoryService::instance()->system_allocator)
+    mem_free(heap);
+  cap = INLINE_CAP;
+  len = 0;
+  small[0] = '\0';
 }
 
 void StringBuffer::grow(size_t size) {
   // +1 for null byte is not in the cap
-  if (alloc == &MemoryService::instance()->system_allocator) {
-    str = (char*)mem_realloc(size + cap + 1, str);
+  if (is_inline()) {
+    if (cap + size <= INLINE_CAP)
+      return;
+    char *new_str = alloc_str(alloc, size + cap + 1);
+    mem_cpy(new_str, small, len + 1); // len + 1 for null byte
+    heap = new_str;
+  } else if (alloc == &MemoryService::instance()->system_allocator) {
+    heap = (char*)mem_realloc(size + cap + 1, heap);
   } else {
-    char* old_str = str;
-    str = (char*)lin_alloca(size + cap + 1, 1);
-    mem_cpy(str, old_str, len + 1); // len + 1 for null byte
+    char* old_str = heap;
+    heap = alloc_str(alloc, size + cap + 1);
+    mem_cpy(heap, old_str, len + 1); // len + 1 for null byte
   }
   cap += size;
-  str[len] = '\0'; // Just for safety sake, in case for whatever reason it wasnt there for the copy...
+  heap[len] = '\0'; // Just for safety sake, in case for whatever reason it wasnt there for the copy...
 }
 void StringBuffer::copy_here(const char *str_, size_t size) {
   if (size == 0) {
@@ -95,10 +114,10 @@ void StringBuffer::copy_here(const char *str_, size_t size) {
       ++size;
   }
 
-  size_t rem = cap - len;
-  if (rem < size) 
-    grow(size - rem);
+  if (cap < size) 
+    grow(size - cap);
 
+  char *str = data();
   mem_cpy(str, str_, size);
   len = size;
   str[len] = '\0';
@@ -113,6 +132,7 @@ void StringBuffer::copy_here(std::string str_, size_t size) {
   if (cap < size) 
     grow(size - cap);
 
+  char *str = data();
   mem_cpy((void*)str, (void*)str_.c_str(), size);
   len = size;
   str[len] = '\0';
@@ -127,6 +147,7 @@ void StringBuffer::push(const char *str_) {
   if (rem < size)
     grow(size - rem);
 
+  char *str = data();
   mem_cpy(str + len, str_, size);
   len += size;
   str[len] = '\0';
@@ -138,16 +159,14 @@ void StringBuffer::push(std::string str_) {
   if (rem < size)
     grow(size - rem);
 
-  mem_cpy(str + len, str_.c_str(), size);
+  char *str = data();
+  mem_cpy(str + len, (void*)str_.c_str(), size);
   len += size;
   str[len] = '\0';
 }
 
 const char* StringBuffer::c_str() {
-  if (len == 0)
-    return "\0";
-  else 
-    return (const char*)str;
+  return (const char*)data();
 }
 StringView StringBuffer::view(size_t start, size_t end) {
   StringView view;
@@ -16,11 +16,21 @@ struct StringView {
 };
 
 struct StringBuffer {
+  // Strings up to INLINE_CAP bytes are stored in 'small', inside the struct, and never touch the 
+  // allocator; longer strings spill to 'heap'. The buffer is inline whenever cap <= INLINE_CAP.
+  static const size_t INLINE_CAP = 23;
+
   // cap is one less than the true capacity: there is always a byte for null term 
-  size_t cap = 0;
+  size_t cap = INLINE_CAP;
   size_t len = 0;
-  char *str = nullptr;
-  Allocator *alloc = &MemoryService::instance()->scratch_allocator;
+  union {
+    char small[INLINE_CAP + 1] = {};
+    char *heap;
+  };
+  Allocator *alloc = MemoryService::scratch();
+
+  inline bool is_inline() const { return cap <= INLINE_CAP; }
+  inline char* data() { return is_inline() ? small : heap; }
 
   /*
   * !! size argument should not include null byte, this is already accounted for !!
@@ -0,0 +1,151 @@
+#include "Threads.hpp"
+#include "VulkanErrors.hpp"
+
+namespace Sol {
+
+static ThreadPool GlobalThreadPool;
+ThreadPool* ThreadPool::instance() { return &GlobalThreadPool; }
+
+namespace {
+  static void run_task(Task task) {
+    task.func(task.arg);
+    if (task.group)
+      task.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+
+  struct RangeBatch {
+    ThreadPool::RangeFunc func;
+    void *arg;
+    size_t begin;
+    size_t end;
+  };
+  static void run_range(void *arg) {
+    RangeBatch *batch = (RangeBatch*)arg;
+    batch->func(batch->arg, batch->begin, batch->end);
+  }
+}
+
+void ThreadPool::init(uint32_t thread_count_) {
+  if (thread_count_ == 0) {
+    uint32_t hw = std::thread::hardware_concurrency();
+    thread_count_ = hw > 1 ? hw - 1 : 0;
+  }
+  if (thread_count_ > MAX_THREADS)
+    thread_count_ = MAX_THREADS;
+
+  queue = (Task*)mem_alloca(sizeof(Task) * QUEUE_SIZE, 8);
+  head = 0;
+  tail = 0;
+  quit = false;
+
+  thread_count = thread_count_;
+  for(uint32_t i = 0; i < thread_count; ++i)
+    threads[i] = std::thread(worker, this);
+  print("ThreadPool started {} workers...\n", thread_count);
+}
+void ThreadPool::kill() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  cond.notify_all();
+  for(uint32_t i = 0; i < thread_count; ++i)
+    threads[i].join();
+  thread_count = 0;
+
+  // Anything still queued is run here so no TaskGroup is left waiting
+  while(run_one());
+  mem_free(queue);
+  queue = nullptr;
+}
+
+void ThreadPool::submit(TaskFunc func, void *arg, TaskGroup *group) {
+  Task task = { func, arg, group };
+  if (group)
+    group->pending.fetch_add(1, std::memory_order_relaxed);
+
+  if (thread_count == 0) {
+    run_task(task);
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (tail - head == QUEUE_SIZE) {
+      lock.unlock();
+      run_task(task);
+      return;
+    }
+    queue[tail & (QUEUE_SIZE - 1)] = task;
+    ++tail;
+  }
+  cond.notify_one();
+}
+
+bool ThreadPool::run_one() {
+  Task task;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (head == tail)
+      return false;
+    task = queue[head & (QUEUE_SIZE - 1)];
+    ++head;
+  }
+  run_task(task);
+  return true;
+}
+
+void ThreadPool::wait(TaskGroup *group) {
+  while (group->pending.load(std::memory_order_acquire)) {
+    if (!run_one())
+      std::this_thread::yield();
+  }
+}
+
+void ThreadPool::parallel_for(size_t count, size_t batch_size, RangeFunc func, void *arg) {
+  if (count == 0)
+    return;
+  if (batch_size == 0)
+    batch_size = 1;
+
+  // Batches live on this stack frame (the pool may be called from a worker): if there would be too 
+  // many, make them bigger
+  const size_t MAX_BATCHES = 256;
+  size_t batch_count = (count + batch_size - 1) / batch_size;
+  if (batch_count > MAX_BATCHES) {
+    batch_size = (count + MAX_BATCHES - 1) / MAX_BATCHES;
+    batch_count = (count + batch_size - 1) / batch_size;
+  }
+  if (thread_count == 0 || batch_count == 1) {
+    func(arg, 0, count);
+    return;
+  }
+
+  RangeBatch batches[MAX_BATCHES];
+  TaskGroup group;
+  for(size_t i = 0; i < batch_count; ++i) {
+    batches[i].func = func;
+    batches[i].arg = arg;
+    batches[i].begin = i * batch_size;
+    batches[i].end = (i + 1) * batch_size < count ? (i + 1) * batch_size : count;
+    submit(run_range, &batches[i], &group);
+  }
+  wait(&group);
+}
+
+void ThreadPool::worker(ThreadPool *pool) {
+  for(;;) {
+    Task task;
+    {
+      std::unique_lock<std::mutex> lock(pool->mutex);
+      pool->cond.wait(lock, [pool]{ return pool->quit || pool->head != pool->tail; });
+      if (pool->head == pool->tail)
+        return; // quit, and nothing left to do
+      task = pool->queue[pool->head & (QUEUE_SIZE - 1)];
+      ++pool->head;
+    }
+    run_task(task);
+  }
+}
+
+} // namespace Sol
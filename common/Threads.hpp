@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "Allocator.hpp"
+
+namespace Sol {
+
+typedef void (*TaskFunc)(void *arg);
+
+// Counts outstanding tasks; ThreadPool::wait() returns once it reaches zero.
+struct TaskGroup {
+  std::atomic<uint32_t> pending{0};
+};
+
+struct Task {
+  TaskFunc func;
+  void *arg;
+  TaskGroup *group;
+};
+
+/*
+ * Fixed set of worker threads pulling from a bounded FIFO. Nothing here allocates after init(): if the
+ * queue is full, or there are no workers (single core machine), the submitting thread just runs the
+ * task itself. Waiting threads help drain the queue rather than sleeping.
+ *
+ * NOTE:: The HeapAllocator is not thread safe, tasks must only allocate from memory they own (their own
+ * LinearAllocator or TaskArena, or buffers handed to them by the submitting thread).
+ */
+struct ThreadPool {
+  static ThreadPool* instance();
+
+  static const uint32_t QUEUE_SIZE = 4096; // Must be a power of 2
+  static const uint32_t MAX_THREADS = 64;
+
+  std::thread threads[MAX_THREADS];
+  uint32_t thread_count = 0;
+
+  Task *queue = nullptr;
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool quit = false;
+
+  // thread_count == 0 uses one worker per hardware thread, minus the calling thread
+  void init(uint32_t thread_count_);
+  void kill();
+
+  void submit(TaskFunc func, void *arg, TaskGroup *group);
+  // Block until every task in 'group' is done, running queued tasks in the meantime
+  void wait(TaskGroup *group);
+
+  // Split [0, count) into batches of 'batch_size' and run 'func(arg, begin, end)' across the pool
+  typedef void (*RangeFunc)(void *arg, size_t begin, size_t end);
+  void parallel_for(size_t count, size_t batch_size, RangeFunc func, void *arg);
+
+  bool run_one();
+  static void worker(ThreadPool *pool);
+};
+
+} // namespace Sol
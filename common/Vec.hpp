@@ -8,6 +8,7 @@
 #include <utility>
 
 #include "Allocator.hpp"
+#include "Format.hpp"
 
 namespace Sol {
 
@@ -82,7 +83,7 @@ struct Vec {
   }
   T& operator[](size_t i) {
     if (i >= length) {
-      std::cerr << "OUT OF BOUNDS ACCESS ON VEC " << data << "\n";
+      print_err("OUT OF BOUNDS ACCESS ON VEC {}\n", (const void*)data);
       exit(-1);
     }
     return data[i];
@@ -1,6 +1,8 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
-#include <iostream>
+#include <cstdlib>
+
+#include "Format.hpp"
 
 namespace Sol {
 
@@ -10,7 +12,7 @@ struct VulkanError {
 
 #define ABORT(test, msg) \
   if(!(test)) { \
-    std::cerr << "ABORT in " << __FILE__ << ", line " << __LINE__ << ": " << msg << '\n'; \
+    Sol::print_err("ABORT in {}, line {}: {}\n", __FILE__, __LINE__, msg); \
     abort(); \
   }
 
@@ -19,14 +21,13 @@ struct VulkanError {
 #define DEBUG_OBJ_CREATION(creation_func, err_code)  \
   if (err_code != VK_SUCCESS) { \
     const char* err_msg = (VulkanError::match_error(err_code)); \
-    std::cerr << "OBJ CREATION ERROR: " << #creation_func << \
-    " returned " << err_msg << ", (" << __FILE__ << ", " << __LINE__ << ")\n";  \
+    Sol::print_err("OBJ CREATION ERROR: {} returned {}, ({}, {})\n", #creation_func, err_msg, __FILE__, __LINE__); \
     abort(); \
   } 
 
 #define DEBUG_ABORT(test, msg) \
   if (!(test)) { \
-    std::cerr << "DEBUG_ABORT in " << __FILE__ << ", line " << __LINE__ << ": " << msg << '\n'; \
+    Sol::print_err("DEBUG_ABORT in {}, line {}: {}\n", __FILE__, __LINE__, msg); \
     abort(); \
   }
 
@@ -0,0 +1,134 @@
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "Watcher.hpp"
+#include "Format.hpp"
+
+namespace Sol {
+
+static Watcher GlobalWatcher;
+Watcher* Watcher::instance() { return &GlobalWatcher; }
+
+namespace {
+  static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO;
+}
+
+bool Watcher::init() {
+  dirs.init(8);
+  watches.init(16);
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    print_err("Watcher: inotify unavailable ({}), hot reload disabled\n", errno);
+    return false;
+  }
+  return true;
+}
+void Watcher::kill() {
+  if (fd >= 0)
+    close(fd); // Also drops every watch descriptor
+  fd = -1;
+
+  for(size_t i = 0; i < dirs.length; ++i)
+    dirs[i].path.kill();
+  for(size_t i = 0; i < watches.length; ++i) {
+    watches[i].name.kill();
+    watches[i].path.kill();
+  }
+  dirs.kill();
+  watches.kill();
+}
+
+bool Watcher::watch(const char *path, WatchFunc func, void *arg) {
+  if (fd < 0)
+    return false;
+  for(size_t i = 0; i < watches.length; ++i)
+    if (watches[i].func == func && watches[i].arg == arg && strcmp(watches[i].path.c_str(), path) == 0)
+      return true;
+
+  Allocator *heap = &MemoryService::instance()->system_allocator;
+  const char *slash = strrchr(path, '/');
+  size_t dir_len = slash ? (slash == path ? 1 : (size_t)(slash - path)) : 0;
+  const char *name = slash ? slash + 1 : path;
+
+  StringBuffer dir_path;
+  if (dir_len) {
+    dir_path = StringBuffer::get(dir_len, path, heap);
+  } else {
+    dir_path = StringBuffer::get(0, ".", heap);
+  }
+
+  uint32_t dir = (uint32_t)dirs.length;
+  for(uint32_t i = 0; i < dirs.length; ++i)
+    if (strcmp(dirs[i].path.c_str(), dir_path.c_str()) == 0) {
+      dir = i;
+      break;
+    }
+
+  if (dir == dirs.length) {
+    int wd = inotify_add_watch(fd, dir_path.c_str(), WATCH_MASK);
+    if (wd < 0) {
+      print_err("Watcher: cannot watch '{}' ({})\n", dir_path, errno);
+      dir_path.kill();
+      return false;
+    }
+    dirs.push(Dir{ wd, dir_path });
+  } else {
+    dir_path.kill();
+  }
+
+  Watch w;
+  w.dir = dir;
+  w.name = StringBuffer::get(0, name, heap);
+  w.path = StringBuffer::get(0, path, heap);
+  w.func = func;
+  w.arg = arg;
+  w.changed = false;
+  watches.push(w);
+  return true;
+}
+
+uint32_t Watcher::dispatch() {
+  if (fd < 0)
+    return 0;
+
+  alignas(struct inotify_event) char buf[4096];
+  for(;;) {
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len <= 0)
+      break; // EAGAIN: the queue is drained
+
+    for(char *ptr = buf; ptr < buf + len;) {
+      const struct inotify_event *event = (const struct inotify_event*)ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
+      if (event->mask & IN_Q_OVERFLOW) {
+        // Events were dropped: treat everything as changed rather than miss a reload
+        for(size_t i = 0; i < watches.length; ++i)
+          watches[i].changed = true;
+        continue;
+      }
+      if (!event->len)
+        continue;
+
+      for(size_t i = 0; i < watches.length; ++i) {
+        Watch *w = &watches[i];
+        if (dirs[w->dir].wd == event->wd && strcmp(w->name.c_str(), event->name) == 0)
+          w->changed = true;
+      }
+    }
+  }
+
+  uint32_t count = 0;
+  for(size_t i = 0; i < watches.length; ++i) {
+    Watch *w = &watches[i];
+    if (!w->changed)
+      continue;
+    w->changed = false;
+    w->func(w->arg, w->path.c_str());
+    ++count;
+  }
+  return count;
+}
+
+} // namespace Sol
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Allocator.hpp"
+#include "String.hpp"
+#include "Vec.hpp"
+
+namespace Sol {
+
+typedef void (*WatchFunc)(void *arg, const char *path);
+
+/*
+ * inotify file watcher for hot reload. Directories are watched rather than files: editors and
+ * compilers often write a temporary and rename it over the original, which a watch on the file itself
+ * would lose. A file counts as changed once it is closed after writing or renamed into place.
+ *
+ * dispatch() never blocks. It reads whatever events are queued and calls each changed file's callback
+ * once (however many events it got), on the calling thread, so callers decide when reloads happen
+ * (e.g. at a frame boundary).
+ */
+struct Watcher {
+  static Watcher* instance();
+
+  struct Dir {
+    int wd;
+    StringBuffer path;
+  };
+  struct Watch {
+    uint32_t dir;
+    StringBuffer name; // File name inside 'dir'
+    StringBuffer path; // As given to watch()
+    WatchFunc func;
+    void *arg;
+    bool changed;
+  };
+
+  int fd = -1;
+  Vec<Dir> dirs;
+  Vec<Watch> watches;
+
+  // false if inotify is unavailable, in which case watch() and dispatch() do nothing
+  bool init();
+  void kill();
+  bool is_active() const { return fd >= 0; }
+
+  // Watching a path again with the same func and arg does nothing (and returns true)
+  bool watch(const char *path, WatchFunc func, void *arg);
+  // Returns how many callbacks were called
+  uint32_t dispatch();
+};
+
+} // namespace Sol
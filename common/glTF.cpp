@@ -1,12 +1,16 @@
 #include <cmath>
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <cstring>
+#include <sys/stat.h>
 
 #include "glTF.hpp"
 #include "nlohmann/json.hpp"
 #include "VulkanErrors.hpp"
+#include "File.hpp"
+#include "Pack.hpp"
+#include "AsyncIO.hpp"
+#include "Watcher.hpp"
 
 namespace Sol {
 namespace glTF {
@@ -20,14 +24,26 @@ const uint8_t JPG_BYTE_PATTERN[3] = { 0xFF, 0xD8, 0xFF };
 
 const int32_t NEAREST_FALLBACK = 9728;
 const int32_t LINEAR_FALLBACK = 9729;
+const uint32_t GLB_MAGIC = 0x46546c67;      // "glTF"
+const uint32_t GLB_CHUNK_JSON = 0x4e4f534a; // "JSON"
+const uint32_t GLB_CHUNK_BIN = 0x004e4942;  // "BIN\0"
 
 bool read_json(const char* file, Json *json) {
-  std::ifstream f(file);
-  if (!f.is_open())
+  size_t size;
+  void *heap;
+  const uint8_t *packed = Pack::instance()->get(file, &size, &heap);
+  if (packed) {
+    *json = Json::parse(packed, packed + size);
+    if (heap)
+      mem_free(heap);
+    return true;
+  }
+
+  MappedFile f = File::map(file);
+  if (!f.data)
     return false;
 
-  *json = Json::parse(f);
-  f.close();
+  *json = Json::parse(f.data, f.data + f.size);
   return true;
 }
 
@@ -48,6 +64,325 @@ void glTF::fill(Json json) {
   animations.fill(json);
 }
 
+// Async buffer loading /////////
+namespace {
+  // Lives on the scratch allocator so 'path' is stable until the read completes
+  struct PendingLoad {
+    glTF *gltf;
+    size_t length;
+    StringBuffer path;
+  };
+  static void buffer_loaded(const IoCompletion *completion) {
+    PendingLoad *load = (PendingLoad*)completion->user_data;
+    --load->gltf->loads_pending;
+    if (completion->result != (int64_t)load->length) {
+      ++load->gltf->loads_failed;
+      print_err("glTF: failed to load '{}' ({})\n", load->path, completion->result);
+    }
+  }
+  static PendingLoad* get_load(glTF *gltf, const char *dir, StringBuffer *uri) {
+    PendingLoad *load = (PendingLoad*)lin_alloca(sizeof(PendingLoad), 8);
+    load->gltf = gltf;
+    load->length = 0;
+    load->path = StringBuffer::get(0, dir);
+    load->path.push("/");
+    load->path.push(uri->c_str());
+    return load;
+  }
+  static bool external_uri(StringBuffer *uri) {
+    return uri->len && strncmp(uri->c_str(), "data:", 5) != 0;
+  }
+}
+
+void glTF::load_buffers(const char *dir) {
+  AsyncIO *io = AsyncIO::instance();
+
+  for(size_t i = 0; i < buffers.buffers.len; ++i) {
+    Buffer *buf = &buffers.buffers[i];
+    if (!external_uri(&buf->uri) || buf->data)
+      continue;
+
+    PendingLoad *load = get_load(this, dir, &buf->uri);
+    load->length = buf->byte_length;
+    buf->data = (uint8_t*)mem_alloca(buf->byte_length, 16);
+    if (!buf->data) {
+      ++loads_failed;
+      print_err("glTF: no room on the heap for '{}' ({} bytes)\n", load->path, buf->byte_length);
+      continue;
+    }
+    buf->owned = true;
+
+    IoRequest req = { load->path.c_str(), 0, buf->byte_length, buf->data, load, buffer_loaded };
+    ++loads_pending;
+    io->submit(&req, 1);
+  }
+
+  for(size_t i = 0; i < images.images.len; ++i) {
+    Image *img = &images.images[i];
+    if (!external_uri(&img->uri) || img->data)
+      continue;
+
+    PendingLoad *load = get_load(this, dir, &img->uri);
+    struct stat st;
+    if (stat(load->path.c_str(), &st) != 0) {
+      ++loads_failed;
+      print_err("glTF: failed to load '{}' (missing)\n", load->path);
+      continue;
+    }
+    load->length = (size_t)st.st_size;
+    img->byte_length = load->length;
+    img->data = (uint8_t*)mem_alloca(load->length, 16);
+    if (!img->data) {
+      ++loads_failed;
+      print_err("glTF: no room on the heap for '{}' ({} bytes)\n", load->path, load->length);
+      continue;
+    }
+
+    IoRequest req = { load->path.c_str(), 0, load->length, img->data, load, buffer_loaded };
+    ++loads_pending;
+    io->submit(&req, 1);
+  }
+}
+bool glTF::wait_buffers() {
+  AsyncIO *io = AsyncIO::instance();
+  while (loads_pending)
+    io->wait(nullptr, 0, 1);
+  return loads_failed == 0;
+}
+// Hot reload ///////////////////
+namespace {
+  // Both live on the scratch allocator for as long as the watch does (i.e. the program)
+  struct BufferWatch {
+    glTF *gltf;
+    uint32_t index;
+    bool loading;
+    bool again; // Changed again while loading
+    uint8_t *data;
+    size_t length;      // byteLength as the json has it now, which the next read asks for
+    size_t read_length; // Of the read in flight: the Buffer keeps its own until the read lands
+    StringBuffer path;
+  };
+  struct ModelWatch {
+    glTF *gltf;
+    BufferWatch **buffers; // By buffer index, nullptr if not an external file
+    StringBuffer path;
+  };
+
+  static void reload_buffer(BufferWatch *w);
+  static void buffer_reloaded(const IoCompletion *completion) {
+    BufferWatch *w = (BufferWatch*)completion->user_data;
+    Buffer *buf = &w->gltf->buffers.buffers[w->index];
+    w->loading = false;
+    if (completion->result == (int64_t)w->read_length) {
+      if (buf->owned)
+        mem_free(buf->data);
+      buf->data = w->data;
+      buf->byte_length = (uint32_t)w->read_length;
+      buf->owned = true;
+      print("Hot reload: '{}' reloaded\n", w->path);
+    } else {
+      // Most likely caught mid write, the next write will trigger another reload
+      print_err("Hot reload: failed to read '{}' ({})\n", w->path, completion->result);
+      mem_free(w->data);
+    }
+    w->data = nullptr;
+
+    if (w->again) {
+      w->again = false;
+      reload_buffer(w);
+    }
+  }
+  static void reload_buffer(BufferWatch *w) {
+    if (w->loading) {
+      w->again = true;
+      return;
+    }
+    w->read_length = w->length;
+    w->data = (uint8_t*)mem_alloca(w->read_length ? w->read_length : 1, 16);
+    if (!w->data) {
+      print_err("Hot reload: no room on the heap for '{}' ({} bytes)\n", w->path, w->read_length);
+      return;
+    }
+    w->loading = true;
+
+    IoRequest req = { w->path.c_str(), 0, w->read_length, w->data, w, buffer_reloaded };
+    AsyncIO::instance()->submit(&req, 1);
+  }
+  static void buffer_changed(void *arg, const char*) {
+    reload_buffer((BufferWatch*)arg);
+  }
+  static void model_changed(void *arg, const char *path) {
+    ModelWatch *w = (ModelWatch*)arg;
+    glTF *gltf = w->gltf;
+
+    // Straight from disk, not the pack: this is the file that was just edited
+    MappedFile f = File::map(path);
+    if (!f.data)
+      return;
+    Json json = Json::parse(f.data, f.data + f.size, nullptr, false);
+    if (json.is_discarded()) {
+      print_err("Hot reload: '{}' is not valid json yet\n", path);
+      return;
+    }
+
+    auto bufs = json.find("buffers");
+    size_t count = bufs == json.end() ? 0 : bufs->size();
+    if (count != gltf->buffers.buffers.len) {
+      print_err("Hot reload: buffers added or removed in '{}', restart to load them\n", path);
+      return;
+    }
+    for(size_t i = 0; i < count; ++i) {
+      Buffer *buf = &gltf->buffers.buffers[i];
+      uint32_t byte_length = (*bufs)[i].value("byteLength", 0u);
+      std::string uri = (*bufs)[i].value("uri", "");
+      if (strcmp(uri.c_str(), buf->uri.c_str()) != 0) {
+        print_err("Hot reload: buffer {} of '{}' changed uri, restart to load it\n", i, path);
+        continue;
+      }
+      // The new length waits in the BufferWatch: views are checked against 'byte_length', so it
+      // only changes together with 'data', when the read lands
+      BufferWatch *bw = w->buffers[i];
+      if (bw && byte_length != bw->length) {
+        bw->length = byte_length;
+        reload_buffer(bw);
+      }
+    }
+  }
+}
+
+void glTF::watch(const char *dir, const char *file) {
+  Watcher *watcher = Watcher::instance();
+  if (!watcher->is_active())
+    return;
+  // NOTE:: A .glb's buffer lives inside the file, so there is nothing to reload it separately from
+  if (glb)
+    return;
+
+  ModelWatch *model = (ModelWatch*)lin_alloca(sizeof(ModelWatch), 8);
+  model->gltf = this;
+  model->buffers = (BufferWatch**)lin_alloca(sizeof(BufferWatch*) * (buffers.buffers.len + 1), 8);
+  model->path = StringBuffer::get(0, dir);
+  model->path.push("/");
+  model->path.push(file);
+
+  for(size_t i = 0; i < buffers.buffers.len; ++i) {
+    Buffer *buf = &buffers.buffers[i];
+    model->buffers[i] = nullptr;
+    if (!external_uri(&buf->uri))
+      continue;
+
+    BufferWatch *w = (BufferWatch*)lin_alloca(sizeof(BufferWatch), 8);
+    w->gltf = this;
+    w->index = (uint32_t)i;
+    w->loading = false;
+    w->again = false;
+    w->data = nullptr;
+    w->length = buf->byte_length;
+    w->read_length = 0;
+    w->path = StringBuffer::get(0, dir);
+    w->path.push("/");
+    w->path.push(buf->uri.c_str());
+    if (watcher->watch(w->path.c_str(), buffer_changed, w))
+      model->buffers[i] = w;
+  }
+  watcher->watch(model->path.c_str(), model_changed, model);
+}
+
+void glTF::free_buffers() {
+  for(size_t i = 0; i < buffers.buffers.len; ++i) {
+    if (buffers.buffers[i].owned)
+      mem_free(buffers.buffers[i].data);
+    buffers.buffers[i].data = nullptr;
+    buffers.buffers[i].owned = false;
+  }
+  for(size_t i = 0; i < images.images.len; ++i) {
+    if (images.images[i].data)
+      mem_free(images.images[i].data);
+    images.images[i].data = nullptr;
+  }
+  container.unmap();
+  if (container_heap)
+    mem_free(container_heap);
+  container_heap = nullptr;
+}
+
+const uint8_t* glTF::view_data(int32_t view) {
+  if (view < 0 || (size_t)view >= buffer_views.views.len)
+    return nullptr;
+  BufferView *v = &buffer_views.views[view];
+  if (v->buffer < 0 || (size_t)v->buffer >= buffers.buffers.len)
+    return nullptr;
+  Buffer *buf = &buffers.buffers[v->buffer];
+  uint32_t offset = v->byte_offset == INVALID_COUNT ? 0 : v->byte_offset;
+  if (!buf->data || (uint64_t)offset + v->byte_length > buf->byte_length)
+    return nullptr;
+  return buf->data + offset;
+}
+const uint8_t* glTF::accessor_data(int32_t accessor) {
+  if (accessor < 0 || (size_t)accessor >= accessors.accessors.len)
+    return nullptr;
+  Accessor *a = &accessors.accessors[accessor];
+  const uint8_t *view = view_data(a->buffer_view);
+  if (!view)
+    return nullptr;
+  uint32_t offset = a->byte_offset == INVALID_COUNT ? 0 : a->byte_offset;
+  if (offset >= buffer_views.views[a->buffer_view].byte_length)
+    return nullptr;
+  return view + offset;
+}
+namespace {
+  // 'count' elements of 'size' bytes, 'stride' apart from 'offset', inside the buffer view
+  static bool view_range(BufferView *view, uint32_t offset, uint32_t count, uint32_t size, uint32_t stride) {
+    return !count || (uint64_t)offset + (uint64_t)(count - 1) * stride + size <= view->byte_length;
+  }
+}
+bool glTF::accessor_view(int32_t accessor, AccessorView *view) {
+  if (accessor < 0 || (size_t)accessor >= accessors.accessors.len)
+    return false;
+  Accessor *a = &accessors.accessors[accessor];
+  uint32_t count = a->count == INVALID_COUNT ? 0 : a->count;
+  uint32_t element_size = Decode::element_size(a->component_type, a->type);
+  if (!element_size)
+    return false;
+
+  *view = {};
+  view->stride = element_size;
+  view->component_type = a->component_type;
+  view->type = a->type;
+  view->count = count;
+  view->normalized = a->normalized;
+  if (a->buffer_view >= 0) {
+    view->data = accessor_data(accessor);
+    if (!view->data)
+      return false;
+    BufferView *buffer_view = &buffer_views.views[a->buffer_view];
+    if (buffer_view->byte_stride != INVALID_COUNT && buffer_view->byte_stride)
+      view->stride = buffer_view->byte_stride;
+    uint32_t offset = a->byte_offset == INVALID_COUNT ? 0 : a->byte_offset;
+    if (!view_range(buffer_view, offset, count, element_size, view->stride))
+      return false;
+  }
+
+  Accessor::Sparse *sparse = &a->sparse;
+  if (sparse->count == INVALID_COUNT || !sparse->count)
+    return true;
+  uint32_t index_size = Decode::component_size(sparse->indices.component_type);
+  const uint8_t *indices = view_data(sparse->indices.buffer_view);
+  const uint8_t *values = view_data(sparse->values.buffer_view);
+  uint32_t index_offset = sparse->indices.byte_offset == INVALID_COUNT ? 0 : sparse->indices.byte_offset;
+  uint32_t value_offset = sparse->values.byte_offset == INVALID_COUNT ? 0 : sparse->values.byte_offset;
+  if (!index_size || sparse->indices.component_type == Accessor::INT8 || sparse->indices.component_type == Accessor::INT16 ||
+      sparse->indices.component_type == Accessor::FLOAT || !indices || !values ||
+      !view_range(&buffer_views.views[sparse->indices.buffer_view], index_offset, sparse->count, index_size, index_size) ||
+      !view_range(&buffer_views.views[sparse->values.buffer_view], value_offset, sparse->count, element_size, element_size))
+    return false;
+  view->sparse_count = sparse->count;
+  view->sparse_index_type = sparse->indices.component_type;
+  view->sparse_indices = indices + index_offset;
+  view->sparse_values = values + value_offset;
+  return true;
+}
+
 namespace { 
   template<typename T>
   static bool load_T(Json json, const char* key, T *obj) {
@@ -93,27 +428,6 @@ namespace {
       array->push(buf);
     }
   }
-
-  static bool check_joints_weights_count(Array<Mesh::Primitive::Attribute> *attrs) {
-    uint32_t count_w = 0;
-    uint32_t count_j = 0;
-    const char* w = "WEIGHTS";
-    const char* j = "JOINTS";
-    for(int i = 0; i < attrs->len; ++i) {
-      StringBuffer str = (*attrs)[i].key;
-      int w_check = memcmp(w, str.c_str(), 7);
-      int j_check = memcmp(j, str.c_str(), 6);
-
-      if (w_check == 0)
-        ++count_w;
-      if (j_check == 0)
-        ++count_j;
-    }
-    if (count_j != count_w)
-      return false;
-    else 
-      return true;
-  }
 }
 
 // Asset /////////////////////////
@@ -121,8 +435,8 @@ void Asset::fill(Json json) {
   auto asset = json.find("asset");
   ABORT(asset != json.end(), "glTF has no 'asset' obj");
 
-  load_string(asset.value(), "version", &version);
-  ABORT(version.str, "glTF asset has no 'version' field");
+  bool has_version = load_string(asset.value(), "version", &version);
+  ABORT(has_version, "glTF asset has no 'version' field");
 
   load_string(asset.value(), "copyright", &copyright);
 }
@@ -229,6 +543,7 @@ void Accessor::fill(Json json) {
   load_T(json, "byteOffset", &byte_offset);
   load_T(json, "count", &count);
   load_T(json, "bufferView", &buffer_view);
+  load_T(json, "normalized", &normalized);
 
   Json json_sparse;
   if (load_T(json, "sparse", &json_sparse)) {
@@ -274,7 +589,9 @@ void Mesh::fill(Json json) {
   for(auto i : json["weights"])
     weights.push(i);
 
-  extras.fill(json);
+  Json json_extras;
+  if (load_T(json, "extras", &json_extras))
+    extras.fill(json_extras);
 }
 void Mesh::Primitive::fill(Json json) {
   load_T(json, "indices", &indices);
@@ -290,6 +607,27 @@ void Mesh::Primitive::fill(Json json) {
   ABORT(check, "Primitive JOINTS_n count != WEIGHTS_n count");
 }
 
+bool Mesh::Primitive::check_joints_weights_count(Array<Attribute> *attrs) {
+  uint32_t count_w = 0;
+  uint32_t count_j = 0;
+  const char* w = "WEIGHTS";
+  const char* j = "JOINTS";
+  for(size_t i = 0; i < attrs->len; ++i) {
+    StringBuffer str = (*attrs)[i].key;
+    int w_check = memcmp(w, str.c_str(), 7);
+    int j_check = memcmp(j, str.c_str(), 6);
+
+    if (w_check == 0)
+      ++count_w;
+    if (j_check == 0)
+      ++count_j;
+  }
+  if (count_j != count_w)
+    return false;
+  else 
+    return true;
+}
+
 void Mesh::Primitive::Target::fill(Json json) {
   attributes.init(json.size(), 8);
   if (attributes.cap)
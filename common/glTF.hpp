@@ -4,6 +4,8 @@
 #define V_LAYERS true
 #include "Array.hpp"
 #include "String.hpp"
+#include "Decode.hpp"
+#include "File.hpp"
 
 #include <cstdint>
 #include <limits>
@@ -22,6 +24,19 @@ extern const uint8_t PNG_BYTE_PATTERN[8];
 extern const uint8_t JPG_BYTE_PATTERN[3];
 extern const int32_t NEAREST_FALLBACK;
 extern const int32_t LINEAR_FALLBACK;
+extern const uint32_t GLB_MAGIC;
+extern const uint32_t GLB_CHUNK_JSON;
+extern const uint32_t GLB_CHUNK_BIN;
+
+struct GlbChunks {
+  const uint8_t *json;
+  size_t json_size;
+  const uint8_t *bin; // nullptr if the file has no BIN chunk
+  size_t bin_size;
+};
+bool is_glb(const uint8_t *data, size_t size);
+// Validate a .glb's header and chunk table, printing what is wrong if it is not one
+bool glb_chunks(const uint8_t *data, size_t size, GlbChunks *chunks);
 
 // Asset
 struct Asset {
@@ -70,6 +85,8 @@ struct Nodes {
 struct Buffer {
   uint32_t byte_length;
   StringBuffer uri;
+  uint8_t *data = nullptr; // Filled by glTF::load_buffers, or points at a .glb's BIN chunk
+  bool owned = false;      // 'data' is from the HeapAllocator, else it is inside glTF::container
   void fill(Json json);
 };
 struct Buffers {
@@ -139,6 +156,7 @@ struct Accessor {
   Array<float> min;
   Type type;
   ComponentType component_type = NONE;
+  bool normalized = false; // Integer components map to [0, 1] or [-1, 1], see Decode.hpp
 
   uint32_t byte_offset = INVALID_COUNT;
   uint32_t count = INVALID_COUNT;
@@ -170,6 +188,7 @@ struct Mesh {
     int32_t mode = INVALID_INDEX;
 
     static void fill_attrib_array(Json json, Array<Attribute> *attributes);
+    static bool check_joints_weights_count(Array<Attribute> *attributes);
     void fill(Json json);
   };
   struct Extras {
@@ -221,6 +240,8 @@ struct Image {
   StringBuffer uri;
   MimeType mime_type = NONE;
   int32_t buffer_view = INVALID_INDEX;
+  uint8_t *data = nullptr; // Encoded file contents of a 'uri' image, filled by glTF::load_buffers
+  size_t byte_length = 0;
 
   void fill(Json json);
 };
@@ -350,14 +371,14 @@ struct Animation {
       STEP,
       CUBICSPLINE,
     };
-    Interpolation interpolation;
+    Interpolation interpolation = LINEAR; // The spec default
     int32_t input = INVALID_INDEX;
     int32_t output = INVALID_INDEX;
 
     void fill(Json json);
   }; // Sampler
 
-  // NOTE: Accessor comp_type normalisation rules (see spec, right before "Specifying Extensions"...)
+  // Output accessors may be normalized integers: read them with Decode::floats
   Array<Channel> channels;
   Array<Sampler> samplers;
   StringBuffer name;
@@ -386,7 +407,65 @@ struct glTF {
   Cameras cameras;
   Animations animations;
 
+  uint32_t loads_pending = 0;
+  uint32_t loads_failed = 0;
+
+  // The loaded file when it is a .glb, as the BIN chunk buffer points straight into it (unless the
+  // file came from the pack, which is mapped for as long as it is open anyway)
+  bool glb = false;
+  MappedFile container;
+  void *container_heap = nullptr; // Set instead if the .glb was a compressed pack entry
+
   void fill(Json json);
+
+  /*
+   * Single pass loader (glTFStream.cpp): the json is tokenized once and written straight into the 
+   * structs above, with arrays and strings on the scratch arena and no Json DOM in between. Prints 
+   * the error and its byte offset and returns false on malformed input. load() reads 'file' from 
+   * the Pack if it is there, else maps it from disk.
+   *
+   * From PARALLEL_PARSE_SIZE bytes up, and if the ThreadPool has workers, the top level sections are 
+   * parsed as separate tasks (unless 'parallel' is false), each on its own TaskArena.
+   */
+  static const size_t PARALLEL_PARSE_SIZE = 256 * 1024;
+  bool parse(const uint8_t *json, size_t size, bool parallel = true);
+  bool load(const char *file);
+  /*
+   * load() for 'count' files into 'out', with the documents parsed at once on the ThreadPool (and big
+   * ones split by section again). The files are read on the calling thread first, as the Pack may
+   * decompress into the HeapAllocator. Returns how many loaded; 'loaded' (if not null) says which.
+   */
+  static uint32_t load_all(const char **files, uint32_t count, glTF *out, bool *loaded);
+  /*
+   * Binary glTF: a 12 byte header, then a JSON chunk and an optional BIN chunk. The JSON goes to 
+   * parse() and the first buffer (the one without a uri) gets the BIN chunk as its data, without a 
+   * copy, so 'data' must outlive the glTF. load() picks this over parse() by the magic, not by the 
+   * file extension.
+   */
+  bool parse_glb(const uint8_t *data, size_t size);
+
+  // Where a buffer view's/accessor's bytes start, or nullptr if its buffer is not loaded
+  const uint8_t* view_data(int32_t view);
+  const uint8_t* accessor_data(int32_t accessor);
+  // For Decode::floats/uints; false if the accessor is invalid, its data runs past its buffer view or is not loaded
+  bool accessor_view(int32_t accessor, AccessorView *view);
+
+  /*
+   * Queue reads of every external buffer and 'uri' image (relative to 'dir') on the AsyncIO service, 
+   * so the file reads overlap with whatever the caller does next. Memory is from the HeapAllocator.
+   */
+  void load_buffers(const char *dir);
+  // Block until load_buffers() is done; false if anything failed to load
+  bool wait_buffers();
+  void free_buffers();
+
+  /*
+   * Hot reload through the Watcher: a changed buffer file is re-read on the AsyncIO service and 
+   * swapped in when the read completes (so whoever polls AsyncIO decides when). A changed json file 
+   * re-reads the buffers whose byteLength changed; other edits to the json need a restart. 'file' is
+   * relative to 'dir', as the buffers' uris are.
+   */
+  void watch(const char *dir, const char *file);
 };
 
 } // namespace glTF
@@ -0,0 +1,1397 @@
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "glTF.hpp"
+#include "File.hpp"
+#include "Pack.hpp"
+#include "Format.hpp"
+#include "Threads.hpp"
+#include "VulkanErrors.hpp"
+
+namespace Sol {
+namespace glTF {
+
+/*
+ * Single pass glTF loader. The json is tokenized once, front to back, and each value is written
+ * straight into its struct field: there is no DOM, no std::string, and strings without escapes are
+ * copied once, from the input into their StringBuffer.
+ *
+ * Array lengths are only known at the closing ']', so finished elements are pushed to a stack
+ * (one heap block, reused for the whole parse) and copied to the scratch arena in one go when their
+ * array closes. Nested arrays push above their parent's elements and are popped before the parent's
+ * next element lands, so the stack is only ever as big as the deepest open path.
+ *
+ * Big documents are split by top level section (nodes, accessors, meshes...): one scan matches
+ * brackets to find where each section's value ends, then each is parsed as its own ThreadPool task
+ * into its own TaskArena. The stack and unescape buffers are on the C heap for the same reason, as
+ * the HeapAllocator is not thread safe. What a task built is rebound to the shared scratch arena
+ * before it ends (see rebind()), so nothing is left pointing at its arena.
+ */
+
+namespace {
+  static const uint32_t MAX_DEPTH = 128;
+
+  struct ElemStack {
+    uint8_t *mem = nullptr;
+    size_t len = 0;
+    size_t cap = 0;
+
+    size_t begin() {
+      len = memory_align(len, 8);
+      return len;
+    }
+    void push(const void *elem, size_t size) {
+      if (len + size > cap) {
+        size_t new_cap = cap * 2 > len + size ? cap * 2 : len + size;
+        mem = (uint8_t*)realloc(mem, new_cap);
+        cap = new_cap;
+      }
+      mem_cpy(mem + len, elem, size);
+      len += size;
+    }
+  };
+
+  // A string token: points into the input, or into the parser's unescape buffer if it had escapes
+  struct Token {
+    const char *str;
+    size_t len;
+
+    template<size_t N>
+    bool is(const char (&lit)[N]) const {
+      return len == N - 1 && memcmp(str, lit, N - 1) == 0;
+    }
+  };
+
+  // Tracks whether a ',' is due before the next key/element
+  struct Iter {
+    bool first;
+  };
+
+  // Exact powers of 10 as doubles, for the fast path below
+  static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+
+  struct Parser {
+    const char *start;
+    const char *p;
+    const char *end;
+    uint32_t depth = 0;
+    bool failed = false;
+    ElemStack stack;
+    char *unescaped = nullptr;
+    size_t unescaped_cap = 0;
+
+    void release() {
+      ::free(stack.mem);
+      ::free(unescaped);
+    }
+
+    bool fail(const char *msg) {
+      if (!failed)
+        print_err("glTF: {} at byte {}\n", msg, (uint64_t)(p - start));
+      failed = true;
+      return false;
+    }
+    void skip_ws() {
+      while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+        ++p;
+    }
+    bool expect(char c) {
+      skip_ws();
+      if (p < end && *p == c) {
+        ++p;
+        return true;
+      }
+      return fail("unexpected character");
+    }
+
+    // Objects & arrays: begin_*, then next_* until it returns false (closed, or check 'failed')
+    bool begin(Iter *it, char open) {
+      if (!expect(open))
+        return false;
+      if (++depth > MAX_DEPTH)
+        return fail("json nested too deep");
+      it->first = true;
+      return true;
+    }
+    bool next(Iter *it, char close) {
+      skip_ws();
+      if (p < end && *p == close) {
+        ++p;
+        --depth;
+        return false;
+      }
+      if (!it->first && !expect(','))
+        return false;
+      it->first = false;
+      return true;
+    }
+    bool begin_object(Iter *it) { return begin(it, '{'); }
+    bool begin_array(Iter *it) { return begin(it, '['); }
+    bool next_elem(Iter *it) { return next(it, ']'); }
+    bool next_key(Iter *it, Token *key) {
+      if (!next(it, '}'))
+        return false;
+      return string(key) && expect(':');
+    }
+
+    bool string(Token *tok) {
+      if (!expect('"'))
+        return false;
+      const char *s = p;
+      while (p < end && *p != '"' && *p != '\\')
+        ++p;
+      if (p < end && *p == '"') {
+        tok->str = s;
+        tok->len = (size_t)(p - s);
+        ++p;
+        return true;
+      }
+      return unescape(s, tok);
+    }
+    // Slow path, only for strings that actually contain escapes
+    bool unescape(const char *s, Token *tok) {
+      size_t len = 0;
+      p = s;
+      for(;;) {
+        if (p >= end)
+          return fail("unterminated string");
+        // Every escape shrinks or keeps the length, except \u as up to 4 bytes of utf8 from 6 chars
+        if (len + 4 > unescaped_cap) {
+          unescaped_cap = unescaped_cap ? unescaped_cap * 2 : 256;
+          unescaped = (char*)realloc(unescaped, unescaped_cap);
+        }
+        char c = *p++;
+        if (c == '"')
+          break;
+        if (c != '\\') {
+          unescaped[len++] = c;
+          continue;
+        }
+        if (p >= end)
+          return fail("unterminated string");
+        c = *p++;
+        switch(c) {
+          case '"': case '\\': case '/': unescaped[len++] = c; break;
+          case 'b': unescaped[len++] = '\b'; break;
+          case 'f': unescaped[len++] = '\f'; break;
+          case 'n': unescaped[len++] = '\n'; break;
+          case 'r': unescaped[len++] = '\r'; break;
+          case 't': unescaped[len++] = '\t'; break;
+          case 'u': {
+            uint32_t cp;
+            if (!hex4(&cp))
+              return false;
+            if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+              p += 2;
+              uint32_t lo;
+              if (!hex4(&lo))
+                return false;
+              cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            len += utf8(cp, unescaped + len);
+            break;
+          }
+          default:
+            return fail("bad string escape");
+        }
+      }
+      tok->str = unescaped;
+      tok->len = len;
+      return true;
+    }
+    bool hex4(uint32_t *out) {
+      if (end - p < 4)
+        return fail("bad \\u escape");
+      uint32_t v = 0;
+      for(int i = 0; i < 4; ++i) {
+        char c = *p++;
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return fail("bad \\u escape");
+      }
+      *out = v;
+      return true;
+    }
+    static size_t utf8(uint32_t cp, char *out) {
+      if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+      }
+      if (cp < 0x800) {
+        out[0] = (char)(0xc0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+      }
+      if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+      }
+      out[0] = (char)(0xf0 | (cp >> 18));
+      out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+      out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+      out[3] = (char)(0x80 | (cp & 0x3f));
+      return 4;
+    }
+
+    /*
+     * Up to 19 significant digits are gathered into an integer mantissa with a power of 10 exponent.
+     * When the mantissa fits in a double's 53 bits and the exponent is within 22, both are exact
+     * doubles and one multiply or divide is correctly rounded (Clinger's fast path), which covers
+     * nearly every number an exporter writes. Anything else goes to strtod.
+     */
+    bool number(double *out) {
+      skip_ws();
+      const char *s = p;
+      bool neg = p < end && *p == '-';
+      if (neg)
+        ++p;
+      if (p >= end || (unsigned)(*p - '0') > 9)
+        return fail("expected a number");
+
+      uint64_t mant = 0;
+      int digits = 0;
+      int exp10 = 0;
+      bool exact = true;
+      for(; p < end && (unsigned)(*p - '0') <= 9; ++p) {
+        if (digits < 19) {
+          mant = mant * 10 + (uint64_t)(*p - '0');
+          digits += mant != 0;
+        } else {
+          ++exp10;
+          exact = false;
+        }
+      }
+      if (p < end && *p == '.') {
+        ++p;
+        if (p >= end || (unsigned)(*p - '0') > 9)
+          return fail("expected a digit");
+        for(; p < end && (unsigned)(*p - '0') <= 9; ++p) {
+          if (digits < 19) {
+            mant = mant * 10 + (uint64_t)(*p - '0');
+            digits += mant != 0;
+            --exp10;
+          } else {
+            exact = false;
+          }
+        }
+      }
+      if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool exp_neg = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+'))
+          ++p;
+        if (p >= end || (unsigned)(*p - '0') > 9)
+          return fail("expected a digit");
+        int e = 0;
+        for(; p < end && (unsigned)(*p - '0') <= 9; ++p)
+          if (e < 100000)
+            e = e * 10 + (*p - '0');
+        exp10 += exp_neg ? -e : e;
+      }
+
+      if (exact && mant <= (1ull << 53) && exp10 >= -22 && exp10 <= 22) {
+        double d = (double)mant;
+        d = exp10 < 0 ? d / POW10[-exp10] : d * POW10[exp10];
+        *out = neg ? -d : d;
+        return true;
+      }
+
+      char tmp[128];
+      size_t len = (size_t)(p - s);
+      if (len >= sizeof(tmp))
+        return fail("number too long");
+      mem_cpy(tmp, s, len);
+      tmp[len] = '\0';
+      *out = strtod(tmp, nullptr);
+      return true;
+    }
+    bool literal(const char *lit, size_t len) {
+      skip_ws();
+      if ((size_t)(end - p) < len || memcmp(p, lit, len) != 0)
+        return fail("bad literal");
+      p += len;
+      return true;
+    }
+
+    // Any value, for keys that are not read (extensions, extras...)
+    bool skip() {
+      skip_ws();
+      if (p >= end)
+        return fail("unexpected end of json");
+      Iter it;
+      Token tok;
+      double d;
+      switch(*p) {
+        case '"':
+          return string(&tok);
+        case '{':
+          if (!begin_object(&it))
+            return false;
+          while (next_key(&it, &tok))
+            if (!skip())
+              return false;
+          return !failed;
+        case '[':
+          if (!begin_array(&it))
+            return false;
+          while (next_elem(&it))
+            if (!skip())
+              return false;
+          return !failed;
+        case 't': return literal("true", 4);
+        case 'f': return literal("false", 5);
+        case 'n': return literal("null", 4);
+        default: return number(&d);
+      }
+    }
+    // As skip(), but an object or array is only matched bracket for bracket: whoever parses it checks it
+    bool skip_unchecked() {
+      skip_ws();
+      if (p >= end || (*p != '{' && *p != '['))
+        return skip();
+      uint32_t open = 0;
+      for(const char *q = p; q < end; ++q) {
+        char c = *q;
+        if (c == '"') {
+          for(++q; q < end && *q != '"'; ++q)
+            if (*q == '\\')
+              ++q;
+        } else if (c == '{' || c == '[') {
+          ++open;
+        } else if ((c == '}' || c == ']') && --open == 0) {
+          p = q + 1;
+          return true;
+        }
+      }
+      p = end;
+      return fail("unexpected end of json");
+    }
+  };
+
+  // Values /////////////////////
+  // Every field type gets a parse_value overload, so Array<T> of anything is the one template below
+  static bool parse_value(Parser *ps, float *v) {
+    double d;
+    if (!ps->number(&d))
+      return false;
+    *v = (float)d;
+    return true;
+  }
+  static bool parse_value(Parser *ps, int32_t *v) {
+    double d;
+    if (!ps->number(&d))
+      return false;
+    *v = (int32_t)d;
+    return true;
+  }
+  static bool parse_value(Parser *ps, uint32_t *v) {
+    double d;
+    if (!ps->number(&d))
+      return false;
+    *v = (uint32_t)d;
+    return true;
+  }
+  static bool parse_value(Parser *ps, bool *v) {
+    ps->skip_ws();
+    *v = ps->p < ps->end && *ps->p == 't';
+    return *v ? ps->literal("true", 4) : ps->literal("false", 5);
+  }
+  static bool parse_value(Parser *ps, StringBuffer *v) {
+    Token tok;
+    if (!ps->string(&tok))
+      return false;
+    *v = tok.len ? StringBuffer::get(tok.len, tok.str) : StringBuffer();
+    return true;
+  }
+  template<typename E>
+  static bool parse_enum(Parser *ps, E *v) {
+    int32_t i;
+    if (!parse_value(ps, &i))
+      return false;
+    *v = (E)i;
+    return true;
+  }
+
+  static bool parse_value(Parser *ps, Scene *scene);
+  static bool parse_value(Parser *ps, Node *node);
+  static bool parse_value(Parser *ps, Buffer *buf);
+  static bool parse_value(Parser *ps, BufferView *view);
+  static bool parse_value(Parser *ps, Accessor *accessor);
+  static bool parse_value(Parser *ps, Mesh *mesh);
+  static bool parse_value(Parser *ps, Mesh::Primitive *prim);
+  static bool parse_value(Parser *ps, Mesh::Primitive::Target *target);
+  static bool parse_value(Parser *ps, Skin *skin);
+  static bool parse_value(Parser *ps, Texture *tex);
+  static bool parse_value(Parser *ps, Image *img);
+  static bool parse_value(Parser *ps, Sampler *sampler);
+  static bool parse_value(Parser *ps, Material *mat);
+  static bool parse_value(Parser *ps, Camera *cam);
+  static bool parse_value(Parser *ps, Animation *anim);
+  static bool parse_value(Parser *ps, Animation::Channel *channel);
+  static bool parse_value(Parser *ps, Animation::Sampler *sampler);
+
+  template<typename T>
+  static bool parse_value(Parser *ps, Array<T> *out) {
+    Iter it;
+    if (!ps->begin_array(&it))
+      return false;
+    size_t base = ps->stack.begin();
+    size_t count = 0;
+    while (ps->next_elem(&it)) {
+      T elem;
+      if (!parse_value(ps, &elem))
+        return false;
+      ps->stack.push(&elem, sizeof(T));
+      ++count;
+    }
+    if (ps->failed)
+      return false;
+
+    if (count) {
+      out->init(count, 8);
+      out->copy_here((T*)(ps->stack.mem + base), count);
+    }
+    ps->stack.len = base;
+    return true;
+  }
+
+  // Objects ////////////////////
+  static bool parse_asset(Parser *ps, Asset *asset, bool *has_version) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("version")) {
+        ok = parse_value(ps, &asset->version);
+        *has_version = true;
+      }
+      else if (key.is("copyright")) ok = parse_value(ps, &asset->copyright);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Scene *scene) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("name")) ok = parse_value(ps, &scene->name);
+      else if (key.is("nodes")) ok = parse_value(ps, &scene->nodes);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Node *node) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("name")) ok = parse_value(ps, &node->name);
+      else if (key.is("mesh")) ok = parse_value(ps, &node->mesh);
+      else if (key.is("camera")) ok = parse_value(ps, &node->camera);
+      else if (key.is("skin")) ok = parse_value(ps, &node->skin);
+      else if (key.is("rotation")) ok = parse_value(ps, &node->rotation);
+      else if (key.is("scale")) ok = parse_value(ps, &node->scale);
+      else if (key.is("translation")) ok = parse_value(ps, &node->translation);
+      else if (key.is("weights")) ok = parse_value(ps, &node->weights);
+      else if (key.is("matrix")) ok = parse_value(ps, &node->matrix);
+      else if (key.is("children")) ok = parse_value(ps, &node->children);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Buffer *buf) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("byteLength")) ok = parse_value(ps, &buf->byte_length);
+      else if (key.is("uri")) ok = parse_value(ps, &buf->uri);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, BufferView *view) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("buffer")) ok = parse_value(ps, &view->buffer);
+      else if (key.is("byteLength")) ok = parse_value(ps, &view->byte_length);
+      else if (key.is("byteOffset")) ok = parse_value(ps, &view->byte_offset);
+      else if (key.is("byteStride")) ok = parse_value(ps, &view->byte_stride);
+      else if (key.is("target")) ok = parse_enum(ps, &view->target);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+
+  static bool parse_sparse_part(Parser *ps, int32_t *buffer_view, uint32_t *byte_offset,
+      Accessor::ComponentType *component_type)
+  {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("bufferView")) ok = parse_value(ps, buffer_view);
+      else if (key.is("byteOffset")) ok = parse_value(ps, byte_offset);
+      else if (key.is("componentType") && component_type) ok = parse_enum(ps, component_type);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_sparse(Parser *ps, Accessor::Sparse *sparse) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("count"))
+        ok = parse_value(ps, &sparse->count);
+      else if (key.is("indices"))
+        ok = parse_sparse_part(ps, &sparse->indices.buffer_view, &sparse->indices.byte_offset,
+            &sparse->indices.component_type);
+      else if (key.is("values"))
+        ok = parse_sparse_part(ps, &sparse->values.buffer_view, &sparse->values.byte_offset, nullptr);
+      else
+        ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Accessor *accessor) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("bufferView")) ok = parse_value(ps, &accessor->buffer_view);
+      else if (key.is("byteOffset")) ok = parse_value(ps, &accessor->byte_offset);
+      else if (key.is("componentType")) ok = parse_enum(ps, &accessor->component_type);
+      else if (key.is("count")) ok = parse_value(ps, &accessor->count);
+      else if (key.is("normalized")) ok = parse_value(ps, &accessor->normalized);
+      else if (key.is("max")) ok = parse_value(ps, &accessor->max);
+      else if (key.is("min")) ok = parse_value(ps, &accessor->min);
+      else if (key.is("sparse")) ok = parse_sparse(ps, &accessor->sparse);
+      else if (key.is("type")) {
+        Token tok;
+        ok = ps->string(&tok);
+        if (tok.is("SCALAR")) accessor->type = Accessor::SCALAR;
+        else if (tok.is("VEC2")) accessor->type = Accessor::VEC2;
+        else if (tok.is("VEC3")) accessor->type = Accessor::VEC3;
+        else if (tok.is("VEC4")) accessor->type = Accessor::VEC4;
+        else if (tok.is("MAT2")) accessor->type = Accessor::MAT2;
+        else if (tok.is("MAT3")) accessor->type = Accessor::MAT3;
+        else if (tok.is("MAT4")) accessor->type = Accessor::MAT4;
+      }
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+
+  // { "POSITION": 0, "NORMAL": 1, ... }
+  static bool parse_attributes(Parser *ps, Array<Mesh::Primitive::Attribute> *out) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    size_t base = ps->stack.begin();
+    size_t count = 0;
+    while (ps->next_key(&it, &key)) {
+      Mesh::Primitive::Attribute attrib;
+      attrib.key = key.len ? StringBuffer::get(key.len, key.str) : StringBuffer();
+      if (!parse_value(ps, &attrib.accessor))
+        return false;
+      ps->stack.push(&attrib, sizeof(attrib));
+      ++count;
+    }
+    if (ps->failed)
+      return false;
+
+    if (count) {
+      out->init(count, 8);
+      out->copy_here((Mesh::Primitive::Attribute*)(ps->stack.mem + base), count);
+    }
+    ps->stack.len = base;
+    return true;
+  }
+  static bool parse_value(Parser *ps, Mesh::Primitive::Target *target) {
+    return parse_attributes(ps, &target->attributes);
+  }
+  static bool parse_value(Parser *ps, Mesh::Primitive *prim) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("indices")) ok = parse_value(ps, &prim->indices);
+      else if (key.is("material")) ok = parse_value(ps, &prim->material);
+      else if (key.is("mode")) ok = parse_value(ps, &prim->mode);
+      else if (key.is("attributes")) ok = parse_attributes(ps, &prim->attributes);
+      else if (key.is("targets")) ok = parse_value(ps, &prim->targets);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    if (!Mesh::Primitive::check_joints_weights_count(&prim->attributes))
+      return ps->fail("primitive JOINTS_n count != WEIGHTS_n count");
+    return !ps->failed;
+  }
+  static bool parse_extras(Parser *ps, Mesh::Extras *extras) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("targetNames")) ok = parse_value(ps, &extras->target_names);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Mesh *mesh) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("primitives")) ok = parse_value(ps, &mesh->primitives);
+      else if (key.is("weights")) ok = parse_value(ps, &mesh->weights);
+      else if (key.is("extras")) ok = parse_extras(ps, &mesh->extras);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Skin *skin) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("inverseBindMatrices")) ok = parse_value(ps, &skin->i_bind_matrices);
+      else if (key.is("skeleton")) ok = parse_value(ps, &skin->skeleton);
+      else if (key.is("joints")) ok = parse_value(ps, &skin->joints);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Texture *tex) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("sampler")) ok = parse_value(ps, &tex->sampler);
+      else if (key.is("source")) ok = parse_value(ps, &tex->source);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Image *img) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("uri")) ok = parse_value(ps, &img->uri);
+      else if (key.is("bufferView")) ok = parse_value(ps, &img->buffer_view);
+      else if (key.is("mimeType")) {
+        Token tok;
+        ok = ps->string(&tok);
+        if (tok.is("image/jpeg")) img->mime_type = Image::JPG;
+        else if (tok.is("image/png")) img->mime_type = Image::PNG;
+      }
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Sampler *sampler) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("magFilter")) ok = parse_enum(ps, &sampler->mag_filter);
+      else if (key.is("minFilter")) ok = parse_enum(ps, &sampler->min_filter);
+      else if (key.is("wrapS")) ok = parse_enum(ps, &sampler->wrap_s);
+      else if (key.is("wrapT")) ok = parse_enum(ps, &sampler->wrap_t);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_mat_texture(Parser *ps, Material::MatTexture *tex) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("index")) ok = parse_value(ps, &tex->index);
+      else if (key.is("texCoord")) ok = parse_value(ps, &tex->tex_coord);
+      else if (key.is("scale") || key.is("strength")) ok = parse_value(ps, &tex->scale);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_pbr(Parser *ps, Material::PbrMetallicRoughness *pbr) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("baseColorFactor")) ok = parse_value(ps, &pbr->base_color_factor);
+      else if (key.is("baseColorTexture")) ok = parse_mat_texture(ps, &pbr->base_color_texture);
+      else if (key.is("metallicRoughnessTexture")) ok = parse_mat_texture(ps, &pbr->metallic_roughness_texture);
+      else if (key.is("metallicFactor")) ok = parse_value(ps, &pbr->metallic_factor);
+      else if (key.is("roughnessFactor")) ok = parse_value(ps, &pbr->roughness_factor);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Material *mat) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("name")) ok = parse_value(ps, &mat->name);
+      else if (key.is("alphaCutoff")) ok = parse_value(ps, &mat->alpha_cutoff);
+      else if (key.is("doubleSided")) ok = parse_value(ps, &mat->double_sided);
+      else if (key.is("emissiveFactor")) ok = parse_value(ps, &mat->emissive_factor);
+      else if (key.is("pbrMetallicRoughness")) ok = parse_pbr(ps, &mat->pbr_metallic_roughness);
+      else if (key.is("normalTexture")) ok = parse_mat_texture(ps, &mat->normal_texture);
+      else if (key.is("occlusionTexture")) ok = parse_mat_texture(ps, &mat->occlusion_texture);
+      else if (key.is("emissiveTexture")) ok = parse_mat_texture(ps, &mat->emissive_texture);
+      else if (key.is("alphaMode")) {
+        Token tok;
+        ok = ps->string(&tok);
+        if (tok.is("OPAQUE")) mat->alpha_mode = Material::OPAQUE;
+        else if (tok.is("MASK")) mat->alpha_mode = Material::MASK;
+        else if (tok.is("BLEND")) mat->alpha_mode = Material::BLEND;
+      }
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  // The 'perspective' and 'orthographic' objects
+  static bool parse_projection(Parser *ps, Camera *cam) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("aspectRatio")) ok = parse_value(ps, &cam->aspect_ratio);
+      else if (key.is("yfov")) ok = parse_value(ps, &cam->yfov);
+      else if (key.is("xmag")) ok = parse_value(ps, &cam->xmag);
+      else if (key.is("ymag")) ok = parse_value(ps, &cam->ymag);
+      else if (key.is("zfar")) ok = parse_value(ps, &cam->zfar);
+      else if (key.is("znear")) ok = parse_value(ps, &cam->znear);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Camera *cam) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("name")) ok = parse_value(ps, &cam->name);
+      else if (key.is("perspective") || key.is("orthographic")) ok = parse_projection(ps, cam);
+      else if (key.is("type")) {
+        Token tok;
+        ok = ps->string(&tok);
+        if (tok.is("perspective")) cam->type = Camera::PERSPECTIVE;
+        else if (tok.is("orthographic")) cam->type = Camera::ORTHO;
+      }
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    if (ps->failed)
+      return false;
+
+    if (cam->type == Camera::UNKNOWN)
+      return ps->fail("camera type must be defined");
+    if (cam->type == Camera::ORTHO && (cam->xmag == INVALID_FLOAT || cam->ymag == INVALID_FLOAT ||
+          cam->zfar == INVALID_FLOAT || cam->znear == INVALID_FLOAT))
+      return ps->fail("orthographic camera must define xmag, ymag, zfar and znear");
+    if (cam->type == Camera::PERSPECTIVE && (cam->yfov == INVALID_FLOAT || cam->znear == INVALID_FLOAT))
+      return ps->fail("perspective camera must define yfov and znear");
+    return true;
+  }
+  static bool parse_channel_target(Parser *ps, Animation::Channel::Target *target) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("node")) ok = parse_value(ps, &target->node);
+      else if (key.is("path")) {
+        Token tok;
+        ok = ps->string(&tok);
+        if (tok.is("rotation")) target->path = Animation::Channel::Target::ROTATION;
+        else if (tok.is("translation")) target->path = Animation::Channel::Target::TRANSLATION;
+        else if (tok.is("scale")) target->path = Animation::Channel::Target::SCALE;
+        else if (tok.is("weights")) target->path = Animation::Channel::Target::WEIGHTS;
+      }
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Animation::Channel *channel) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("sampler")) ok = parse_value(ps, &channel->sampler);
+      else if (key.is("target")) ok = parse_channel_target(ps, &channel->target);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Animation::Sampler *sampler) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("input")) ok = parse_value(ps, &sampler->input);
+      else if (key.is("output")) ok = parse_value(ps, &sampler->output);
+      else if (key.is("interpolation")) {
+        Token tok;
+        ok = ps->string(&tok);
+        if (tok.is("LINEAR")) sampler->interpolation = Animation::Sampler::LINEAR;
+        else if (tok.is("STEP")) sampler->interpolation = Animation::Sampler::STEP;
+        else if (tok.is("CUBICSPLINE")) sampler->interpolation = Animation::Sampler::CUBICSPLINE;
+      }
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+  static bool parse_value(Parser *ps, Animation *anim) {
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      bool ok;
+      if (key.is("name")) ok = parse_value(ps, &anim->name);
+      else if (key.is("channels")) ok = parse_value(ps, &anim->channels);
+      else if (key.is("samplers")) ok = parse_value(ps, &anim->samplers);
+      else ok = ps->skip();
+      if (!ok)
+        return false;
+    }
+    return !ps->failed;
+  }
+}
+
+namespace {
+  // The top level keys that are read, each its own section when parsing in parallel
+  static const char *SECTIONS[] = {
+    "asset", "scene", "scenes", "nodes", "buffers", "bufferViews", "accessors", "meshes", "skins",
+    "textures", "images", "samplers", "materials", "cameras", "animations",
+  };
+  static const uint32_t SECTION_COUNT = sizeof(SECTIONS) / sizeof(SECTIONS[0]);
+
+  static int32_t section_index(const Token &key) {
+    for(uint32_t i = 0; i < SECTION_COUNT; ++i)
+      if (key.len == strlen(SECTIONS[i]) && memcmp(key.str, SECTIONS[i], key.len) == 0)
+        return (int32_t)i;
+    return -1;
+  }
+
+  /*
+   * What a task parses has 'alloc' set to its TaskArena, which is gone once the task returns: the
+   * memory stays, as it is in the scratch arena's blocks, but growing an Array or StringBuffer after
+   * that would call into the dead arena. So each one the task built, empty ones included, is pointed
+   * at the shared scratch arena before the task ends, as a serial parse would have left it.
+   */
+  template<typename T>
+  static void rebind(Allocator*, T*) {}
+  static void rebind(Allocator *alloc, StringBuffer *str) {
+    str->alloc = alloc;
+  }
+  static void rebind(Allocator *alloc, Scene *scene);
+  static void rebind(Allocator *alloc, Node *node);
+  static void rebind(Allocator *alloc, Buffer *buf);
+  static void rebind(Allocator *alloc, Accessor *accessor);
+  static void rebind(Allocator *alloc, Mesh *mesh);
+  static void rebind(Allocator *alloc, Mesh::Primitive *prim);
+  static void rebind(Allocator *alloc, Mesh::Primitive::Attribute *attrib);
+  static void rebind(Allocator *alloc, Mesh::Primitive::Target *target);
+  static void rebind(Allocator *alloc, Skin *skin);
+  static void rebind(Allocator *alloc, Image *img);
+  static void rebind(Allocator *alloc, Material *mat);
+  static void rebind(Allocator *alloc, Camera *cam);
+  static void rebind(Allocator *alloc, Animation *anim);
+
+  template<typename T>
+  static void rebind(Allocator *alloc, Array<T> *arr) {
+    arr->alloc = alloc;
+    for(size_t i = 0; i < arr->len; ++i)
+      rebind(alloc, &arr->mem[i]);
+  }
+
+  static void rebind(Allocator *alloc, Scene *scene) {
+    rebind(alloc, &scene->nodes);
+    rebind(alloc, &scene->name);
+  }
+  static void rebind(Allocator *alloc, Node *node) {
+    rebind(alloc, &node->rotation);
+    rebind(alloc, &node->scale);
+    rebind(alloc, &node->translation);
+    rebind(alloc, &node->matrix);
+    rebind(alloc, &node->weights);
+    rebind(alloc, &node->children);
+    rebind(alloc, &node->name);
+  }
+  static void rebind(Allocator *alloc, Buffer *buf) {
+    rebind(alloc, &buf->uri);
+  }
+  static void rebind(Allocator *alloc, Accessor *accessor) {
+    rebind(alloc, &accessor->max);
+    rebind(alloc, &accessor->min);
+  }
+  static void rebind(Allocator *alloc, Mesh *mesh) {
+    rebind(alloc, &mesh->primitives);
+    rebind(alloc, &mesh->weights);
+    rebind(alloc, &mesh->extras.target_names);
+  }
+  static void rebind(Allocator *alloc, Mesh::Primitive *prim) {
+    rebind(alloc, &prim->attributes);
+    rebind(alloc, &prim->targets);
+  }
+  static void rebind(Allocator *alloc, Mesh::Primitive::Attribute *attrib) {
+    rebind(alloc, &attrib->key);
+  }
+  static void rebind(Allocator *alloc, Mesh::Primitive::Target *target) {
+    rebind(alloc, &target->attributes);
+  }
+  static void rebind(Allocator *alloc, Skin *skin) {
+    rebind(alloc, &skin->joints);
+  }
+  static void rebind(Allocator *alloc, Image *img) {
+    rebind(alloc, &img->uri);
+  }
+  static void rebind(Allocator *alloc, Material *mat) {
+    rebind(alloc, &mat->pbr_metallic_roughness.base_color_factor);
+    rebind(alloc, &mat->emissive_factor);
+    rebind(alloc, &mat->name);
+  }
+  static void rebind(Allocator *alloc, Camera *cam) {
+    rebind(alloc, &cam->name);
+  }
+  static void rebind(Allocator *alloc, Animation *anim) {
+    rebind(alloc, &anim->channels);
+    rebind(alloc, &anim->samplers);
+    rebind(alloc, &anim->name);
+  }
+  static void rebind_section(Allocator *alloc, glTF *gltf, uint32_t section) {
+    switch(section) {
+      case 0: rebind(alloc, &gltf->asset.version); rebind(alloc, &gltf->asset.copyright); break;
+      case 1: break;
+      case 2: rebind(alloc, &gltf->scenes.scenes); break;
+      case 3: rebind(alloc, &gltf->nodes.nodes); break;
+      case 4: rebind(alloc, &gltf->buffers.buffers); break;
+      case 5: rebind(alloc, &gltf->buffer_views.views); break;
+      case 6: rebind(alloc, &gltf->accessors.accessors); break;
+      case 7: rebind(alloc, &gltf->meshes.meshes); break;
+      case 8: rebind(alloc, &gltf->skins.skins); break;
+      case 9: rebind(alloc, &gltf->textures.textures); break;
+      case 10: rebind(alloc, &gltf->images.images); break;
+      case 11: rebind(alloc, &gltf->samplers.samplers); break;
+      case 12: rebind(alloc, &gltf->materials.materials); break;
+      case 13: rebind(alloc, &gltf->cameras.cameras); break;
+      default: rebind(alloc, &gltf->animations.animations); break;
+    }
+  }
+
+  // The section's array starts over, so it takes this thread's scratch (a TaskArena in a section task)
+  template<typename T>
+  static bool parse_section_array(Parser *ps, Array<T> *out) {
+    *out = Array<T>();
+    return parse_value(ps, out);
+  }
+  static bool parse_section(Parser *ps, glTF *gltf, uint32_t section, bool *has_version) {
+    switch(section) {
+      case 0: return parse_asset(ps, &gltf->asset, has_version);
+      case 1: return parse_value(ps, &gltf->scenes.scene);
+      case 2: return parse_section_array(ps, &gltf->scenes.scenes);
+      case 3: return parse_section_array(ps, &gltf->nodes.nodes);
+      case 4: return parse_section_array(ps, &gltf->buffers.buffers);
+      case 5: return parse_section_array(ps, &gltf->buffer_views.views);
+      case 6: return parse_section_array(ps, &gltf->accessors.accessors);
+      case 7: return parse_section_array(ps, &gltf->meshes.meshes);
+      case 8: return parse_section_array(ps, &gltf->skins.skins);
+      case 9: return parse_section_array(ps, &gltf->textures.textures);
+      case 10: return parse_section_array(ps, &gltf->images.images);
+      case 11: return parse_section_array(ps, &gltf->samplers.samplers);
+      case 12: return parse_section_array(ps, &gltf->materials.materials);
+      case 13: return parse_section_array(ps, &gltf->cameras.cameras);
+      default: return parse_section_array(ps, &gltf->animations.animations);
+    }
+  }
+
+  // Where a section's value is in the document ('start', so errors keep their byte offsets)
+  struct SectionTask {
+    glTF *gltf;
+    uint32_t section;
+    const char *start;
+    const char *begin;
+    const char *end;
+    bool has_version;
+    bool ok;
+  };
+  static void parse_section_task(void *arg) {
+    SectionTask *task = (SectionTask*)arg;
+    TaskArena arena;
+    arena.bind();
+    Parser ps;
+    ps.start = task->start;
+    ps.p = task->begin;
+    ps.end = task->end;
+    ps.depth = 1; // Inside the top level object, as in a serial parse
+    task->ok = parse_section(&ps, task->gltf, task->section, &task->has_version) && !ps.failed;
+    if (task->ok) {
+      ps.skip_ws();
+      if (ps.p != ps.end)
+        task->ok = ps.fail("unexpected character");
+    }
+    ps.release();
+    rebind_section(&MemoryService::instance()->scratch_allocator, task->gltf, task->section);
+    arena.unbind();
+  }
+
+  /*
+   * The top level object, with each section's value found by skip_unchecked() and parsed as a task. A
+   * key given twice keeps its last value, as in a serial parse. The sections all write to different
+   * fields, so merging is just combining the results.
+   */
+  static bool parse_sections(Parser *ps, glTF *gltf, bool *has_version) {
+    SectionTask tasks[SECTION_COUNT];
+    bool found[SECTION_COUNT] = {};
+    Iter it;
+    Token key;
+    if (!ps->begin_object(&it))
+      return false;
+    while (ps->next_key(&it, &key)) {
+      int32_t section = section_index(key);
+      ps->skip_ws();
+      const char *begin = ps->p;
+      if (!ps->skip_unchecked())
+        return false;
+      if (section < 0)
+        continue;
+      tasks[section] = { gltf, (uint32_t)section, ps->start, begin, ps->p, false, false };
+      found[section] = true;
+    }
+    if (ps->failed)
+      return false;
+
+    ThreadPool *pool = ThreadPool::instance();
+    TaskGroup group;
+    for(uint32_t i = 0; i < SECTION_COUNT; ++i)
+      if (found[i])
+        pool->submit(parse_section_task, &tasks[i], &group);
+    pool->wait(&group);
+
+    bool ok = true;
+    for(uint32_t i = 0; i < SECTION_COUNT; ++i) {
+      if (!found[i])
+        continue;
+      ok = ok && tasks[i].ok;
+      *has_version = *has_version || tasks[i].has_version;
+    }
+    return ok;
+  }
+}
+
+bool glTF::parse(const uint8_t *json, size_t size, bool parallel) {
+  Parser ps;
+  ps.start = (const char*)json;
+  ps.p = ps.start;
+  ps.end = ps.start + size;
+
+  bool has_version = false;
+  bool ok;
+  if (parallel && size >= PARALLEL_PARSE_SIZE && ThreadPool::instance()->thread_count) {
+    ok = parse_sections(&ps, this, &has_version);
+  } else {
+    Iter it;
+    Token key;
+    ok = ps.begin_object(&it);
+    while (ok && ps.next_key(&it, &key)) {
+      int32_t section = section_index(key);
+      ok = section < 0 ? ps.skip() : parse_section(&ps, this, (uint32_t)section, &has_version);
+    }
+    ok = ok && !ps.failed;
+  }
+  if (ok) {
+    ps.skip_ws();
+    if (ps.p != ps.end)
+      ok = ps.fail("trailing data after the json");
+  }
+  if (ok && !has_version)
+    ok = ps.fail("asset has no 'version' field");
+
+  ps.release();
+  return ok;
+}
+
+namespace {
+  static uint32_t read_u32(const uint8_t *p) {
+    uint32_t v;
+    mem_cpy(&v, p, sizeof(v));
+    return v; // glb is little endian, as is everything this runs on
+  }
+}
+
+bool is_glb(const uint8_t *data, size_t size) {
+  return size >= 12 && read_u32(data) == GLB_MAGIC;
+}
+
+bool glb_chunks(const uint8_t *data, size_t size, GlbChunks *chunks) {
+  if (size < 20 || read_u32(data) != GLB_MAGIC) {
+    print_err("glTF: not a glb file\n");
+    return false;
+  }
+  uint32_t version = read_u32(data + 4);
+  uint32_t length = read_u32(data + 8);
+  if (version != 2) {
+    print_err("glTF: unsupported glb version {}\n", version);
+    return false;
+  }
+  if (length > size) {
+    print_err("glTF: glb truncated ({} of {} bytes)\n", (uint64_t)size, length);
+    return false;
+  }
+
+  // Chunks are 4 byte aligned, JSON first, then at most one BIN; anything after is skipped
+  *chunks = {};
+  for(size_t offset = 12; offset + 8 <= length;) {
+    uint32_t chunk_length = read_u32(data + offset);
+    uint32_t chunk_type = read_u32(data + offset + 4);
+    offset += 8;
+    if (chunk_length > length - offset) {
+      print_err("glTF: glb chunk at byte {} overruns the file\n", (uint64_t)offset - 8);
+      return false;
+    }
+    if (!chunks->json) {
+      if (chunk_type != GLB_CHUNK_JSON) {
+        print_err("glTF: first glb chunk is not JSON\n");
+        return false;
+      }
+      chunks->json = data + offset;
+      chunks->json_size = chunk_length;
+    } else if (!chunks->bin && chunk_type == GLB_CHUNK_BIN) {
+      chunks->bin = data + offset;
+      chunks->bin_size = chunk_length;
+    }
+    offset += memory_align(chunk_length, 4);
+  }
+  if (!chunks->json) {
+    print_err("glTF: glb has no JSON chunk\n");
+    return false;
+  }
+  return true;
+}
+
+bool glTF::parse_glb(const uint8_t *data, size_t size) {
+  GlbChunks chunks;
+  if (!glb_chunks(data, size, &chunks))
+    return false;
+  if (!parse(chunks.json, chunks.json_size))
+    return false;
+  glb = true;
+
+  // The BIN chunk is the first buffer, which must then have no uri (it may be padded past byteLength)
+  if (buffers.buffers.len && !buffers.buffers[0].uri.len) {
+    Buffer *buf = &buffers.buffers[0];
+    if (!chunks.bin || chunks.bin_size < buf->byte_length) {
+      print_err("glTF: glb BIN chunk is missing or smaller than buffer 0\n");
+      return false;
+    }
+    buf->data = (uint8_t*)chunks.bin;
+    buf->owned = false;
+  }
+  return true;
+}
+
+bool glTF::load(const char *file) {
+  size_t size;
+  void *heap;
+  const uint8_t *data = Pack::instance()->get(file, &size, &heap);
+  MappedFile f;
+  if (!data) {
+    f = File::map(file);
+    if (!f.data)
+      return false;
+    data = f.data;
+    size = f.size;
+  }
+
+  if (!is_glb(data, size)) {
+    bool ok = parse(data, size);
+    if (heap)
+      mem_free(heap);
+    return ok;
+  }
+
+  // Keep whatever holds the bytes alive: buffer 0 now points into it
+  bool ok = parse_glb(data, size);
+  if (ok) {
+    container = std::move(f);
+    container_heap = heap;
+  } else if (heap) {
+    mem_free(heap);
+  }
+  return ok;
+}
+
+namespace {
+  struct DocumentTask {
+    glTF *gltf;
+    const uint8_t *data;
+    size_t size;
+    bool ok;
+  };
+  static void parse_document_task(void *arg) {
+    DocumentTask *task = (DocumentTask*)arg;
+    TaskArena arena;
+    arena.bind();
+    if (is_glb(task->data, task->size))
+      task->ok = task->gltf->parse_glb(task->data, task->size);
+    else
+      task->ok = task->gltf->parse(task->data, task->size);
+    for(uint32_t i = 0; i < SECTION_COUNT; ++i)
+      rebind_section(&MemoryService::instance()->scratch_allocator, task->gltf, i);
+    arena.unbind();
+  }
+}
+
+uint32_t glTF::load_all(const char **files, uint32_t count, glTF *out, bool *loaded) {
+  DocumentTask *tasks = (DocumentTask*)mem_alloca(sizeof(DocumentTask) * (count ? count : 1), 8);
+  void **heaps = (void**)mem_alloca(sizeof(void*) * (count ? count : 1), 8);
+  std::vector<MappedFile> mapped(count);
+  for(uint32_t i = 0; i < count; ++i) {
+    size_t size = 0;
+    heaps[i] = nullptr;
+    const uint8_t *data = Pack::instance()->get(files[i], &size, &heaps[i]);
+    if (!data) {
+      mapped[i] = File::map(files[i]);
+      data = mapped[i].data;
+      size = mapped[i].size;
+    }
+    tasks[i] = { &out[i], data, size, false };
+  }
+
+  ThreadPool *pool = ThreadPool::instance();
+  TaskGroup group;
+  for(uint32_t i = 0; i < count; ++i)
+    if (tasks[i].data)
+      pool->submit(parse_document_task, &tasks[i], &group);
+  pool->wait(&group);
+
+  // As load(): a .glb's holder stays alive with it, as buffer 0 points into it
+  uint32_t loaded_count = 0;
+  for(uint32_t i = 0; i < count; ++i) {
+    bool keep = tasks[i].ok && out[i].glb;
+    if (keep) {
+      out[i].container = std::move(mapped[i]);
+      out[i].container_heap = heaps[i];
+    } else if (heaps[i]) {
+      mem_free(heaps[i]);
+    }
+    if (!tasks[i].data)
+      print_err("glTF: failed to read '{}'\n", files[i]);
+    loaded_count += tasks[i].ok;
+    if (loaded)
+      loaded[i] = tasks[i].ok;
+  }
+  mem_free(heaps);
+  mem_free(tasks);
+  return loaded_count;
+}
+
+} // namespace glTF
+} // namespace Sol
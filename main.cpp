@@ -1,31 +1,104 @@
+#include <unistd.h>
+#include <utility>
+
 #include "Engine.hpp"
 #include "Allocator.hpp"
 #include "Vec.hpp"
 #include "glTF.hpp"
+#include "Format.hpp"
+#include "Threads.hpp"
+#include "AsyncIO.hpp"
+#include "Pack.hpp"
+#include "Watcher.hpp"
+#include "Cooker.hpp"
+#include "Scene.hpp"
 
 using namespace Sol;
 
+namespace {
+  // The cooked model being drawn: when a source of it changes it is re-cooked and the new scene swapped in
+  struct CookedModel {
+    const char *name;
+    SceneFile *file;
+  };
+  static void cooked_model_changed(void *arg, const char *path) {
+    CookedModel *model = (CookedModel*)arg;
+    Cooker *cooker = Cooker::instance();
+    // Nothing cooked: the write did not change the hash, or the cook failed and the last good one is kept
+    if (!cooker->update())
+      return;
+    const char *cooked_path = cooker->find(model->name);
+    SceneFile file;
+    if (!cooked_path || !file.open(cooked_path)) {
+      print_err("Hot reload: '{}' changed but '{}' did not open, keeping the old scene\n", path, model->name);
+      return;
+    }
+    // The cook was renamed over the old one, which stays mapped until the engine lets go of it
+    Engine::instance()->set_scene(file.scene);
+    model->file->close();
+    *model->file = std::move(file);
+    cooker->watch(model->name, cooked_model_changed, model);
+    print("Hot reload: '{}' re-cooked\n", model->name);
+  }
+}
+
 int main() {
   MemoryConfig mem_config;
   MemoryService::instance()->init(&mem_config);
+  ThreadPool::instance()->init(0);
+  AsyncIO::instance()->init(256, false);
+  // Hot reload: changes are picked up at the top of each frame (see Engine::update_hot_reload)
+  Watcher::instance()->init();
 
-  const char* model_file_name = "test_1.json";
-  glTF::Json model_file;
-  bool ok = glTF::read_json(model_file_name, &model_file);
+  // Assets come from the pack when there is one (see tools/slugpack.cpp), else from loose files
+  const char* pack_file_name = "assets.pack";
+  if (access(pack_file_name, R_OK) == 0 && Pack::instance()->open(pack_file_name))
+    print("Using asset pack '{}'\n", pack_file_name);
+
+  // Models are cooked to one .scene each, and only re-cooked when their sources change (see Cooker)
+  Cooker *cooker = Cooker::instance();
+  cooker->init("models", "cooked");
+  cooker->update();
 
+  const char* model_file_name = "test_1.json";
+  const char* cooked_path = cooker->find(model_file_name);
+  SceneFile scene;
+  CookedModel cooked_model = { model_file_name, &scene };
   glTF::glTF gltf;
-  if (!ok)
-    std::cerr << "ALERT! '" << model_file_name << "' does not exist\n";
-  else {
-    gltf.fill(model_file);
-    std::cout << "Loaded Model '" << model_file_name << "', gltf version: " << gltf.asset.version.c_str() 
-      << ", Copyright: '" << gltf.asset.copyright.c_str() << "'\n";
+  if (cooked_path && scene.open(cooked_path)) {
+    print("Loaded Scene '{}', {} nodes, {} meshes, {} bytes\n", cooked_path, scene.scene->nodes.count,
+      scene.scene->meshes.count, scene.scene->size);
+    cooker->watch(model_file_name, cooked_model_changed, &cooked_model);
+  } else {
+    // Not cooked: the source glTF, with its buffer and image reads running while the engine initializes
+    const char* model_path = "models/test_1.json";
+    if (!gltf.load(model_path))
+      print_err("ALERT! '{}' does not exist or is not valid glTF\n", model_path);
+    else {
+      print("Loaded Model '{}', gltf version: {}, Copyright: '{}'\n", model_path, gltf.asset.version, 
+        gltf.asset.copyright);
+      gltf.load_buffers("models");
+      gltf.watch("models", model_file_name);
+    }
   }
 
   Engine::instance()->init();
+  Engine::instance()->set_scene(scene.scene);
+  if (!gltf.wait_buffers())
+    print_err("ALERT! Some buffers of '{}' failed to load\n", model_file_name);
   Engine::instance()->run();
   Engine::instance()->kill();
 
+  // Let any hot reloads still reading finish before their buffers are freed
+  while (AsyncIO::instance()->pending())
+    AsyncIO::instance()->wait(nullptr, 0, 1);
+  gltf.free_buffers();
+  scene.close();
+  cooker->kill();
+  Watcher::instance()->kill();
+  AsyncIO::instance()->kill();
+  ThreadPool::instance()->kill();
+  Pack::instance()->close();
   MemoryService::instance()->shutdown();
   return 0;
 }
@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) in vec3 in_normal;
+layout(location = 1) in vec4 in_tangent;
+layout(location = 2) in vec2 in_uv;
+
+layout(location = 0) out vec4 frag_color;
+
+void main() 
+{
+  // Normals as colour until there are materials
+  frag_color = vec4(normalize(in_normal) * 0.5 + 0.5, 1.0);
+}
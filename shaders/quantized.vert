@@ -0,0 +1,45 @@
+#version 450
+
+// Cooked vertices (common/Quantize.hpp): the vertex input has already turned the UNORM/SNORM/half
+// fields into floats, this maps the position back into its bounds and unfolds the octahedral vectors
+
+layout(location = 0) in vec4 in_pos; // xyz in [0, 1] across the bounds, w the tangent's handedness
+layout(location = 1) in vec2 in_normal;
+layout(location = 2) in vec2 in_tangent;
+layout(location = 3) in vec2 in_uv;
+// Joints and weights (locations 4 and 5) are only read by skinning, so SkinnedVertexInput can leave them out
+
+layout(location = 0) out vec3 out_normal;
+layout(location = 1) out vec4 out_tangent;
+layout(location = 2) out vec2 out_uv;
+
+layout(binding = 0) uniform UBO {
+  mat4 model;
+  mat4 view;
+  mat4 projection;
+} ubo;
+
+// QuantizedVertexInput::PushConstants (Engine.hpp): the node's world matrix and the primitive's bounds
+layout(push_constant) uniform Draw {
+  mat4 model;
+  vec4 offset;
+  vec4 scale;
+} draw;
+
+vec3 octahedral(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+  return normalize(n);
+}
+
+void main() 
+{
+  vec3 pos = draw.offset.xyz + in_pos.xyz * draw.scale.xyz;
+  gl_Position = ubo.projection * ubo.view * draw.model * vec4(pos, 1.0);
+
+  mat3 normal_matrix = mat3(draw.model);
+  out_normal = normal_matrix * octahedral(in_normal);
+  out_tangent = vec4(normal_matrix * octahedral(in_tangent), in_pos.w * 2.0 - 1.0);
+  out_uv = in_uv;
+}
@@ -0,0 +1,865 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <unistd.h>
+
+#include "Allocator.hpp"
+#include "Animator.hpp"
+#include "Clip.hpp"
+#include "Clock.hpp"
+#include "Decode.hpp"
+#include "Format.hpp"
+#include "glTF.hpp"
+#include "Morph.hpp"
+#include "Pack.hpp"
+#include "Scene.hpp"
+#include "SceneGraph.hpp"
+#include "Skinning.hpp"
+#include "Threads.hpp"
+#include "VulkanErrors.hpp"
+#include "wyhash.h"
+
+using namespace Sol;
+
+/*
+ * Counts every operator new, i.e. the allocations that do not go through the MemoryService. All of
+ * the replaceable forms are here, over std::malloc/std::free, so whichever one the library picks
+ * pairs with the matching delete.
+ */
+static uint64_t Global_New_Count = 0;
+static void* counted_new(size_t size, size_t align) {
+  ++Global_New_Count;
+  size = size ? size : 1;
+  if (align <= alignof(std::max_align_t))
+    return std::malloc(size);
+  return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+static void* counted_new_or_throw(size_t size, size_t align) {
+  void *ptr = counted_new(size, align);
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+void* operator new(size_t size) { return counted_new_or_throw(size, 0); }
+void* operator new[](size_t size) { return counted_new_or_throw(size, 0); }
+void* operator new(size_t size, std::align_val_t align) { return counted_new_or_throw(size, (size_t)align); }
+void* operator new[](size_t size, std::align_val_t align) { return counted_new_or_throw(size, (size_t)align); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_new(size, 0); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_new(size, 0); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+/*
+ * Loader benchmarks, run on generated data so they do not depend on what is in the tree:
+ *
+ *    SlugBench [scale]
+ *
+ * 'scale' multiplies the amount of generated data (default 1).
+ */
+
+namespace {
+  static float seconds_since(TimePoint start) {
+    return std::chrono::duration_cast<fsec>(Time::now() - start).count();
+  }
+
+  // Interleaved position/normal/uv grid plus its index buffer, i.e. what a glTF .bin mostly is
+  static size_t gen_mesh(const char *path, uint32_t dim) {
+    size_t vert_count = (size_t)dim * dim;
+    size_t index_count = (size_t)(dim - 1) * (dim - 1) * 6;
+    size_t size = vert_count * sizeof(float) * 8 + index_count * sizeof(uint32_t);
+    uint8_t *buf = (uint8_t*)mem_alloca(size, 16);
+
+    float *v = (float*)buf;
+    for(uint32_t y = 0; y < dim; ++y)
+      for(uint32_t x = 0; x < dim; ++x) {
+        float u = (float)x / (dim - 1);
+        float w = (float)y / (dim - 1);
+        float h = 0.1f * sinf(u * 12.0f) * cosf(w * 9.0f);
+        float vert[8] = { u, h, w, 0.0f, 1.0f, 0.0f, u, w };
+        mem_cpy(v, vert, sizeof(vert));
+        v += 8;
+      }
+    uint32_t *idx = (uint32_t*)v;
+    for(uint32_t y = 0; y < dim - 1; ++y)
+      for(uint32_t x = 0; x < dim - 1; ++x) {
+        uint32_t i = y * dim + x;
+        uint32_t quad[6] = { i, i + dim, i + 1, i + 1, i + dim, i + dim + 1 };
+        mem_cpy(idx, quad, sizeof(quad));
+        idx += 6;
+      }
+
+    FILE *f = fopen(path, "wb");
+    ABORT(f, "Failed to create benchmark file");
+    fwrite(buf, 1, size, f);
+    fclose(f);
+    mem_free(buf);
+    return size;
+  }
+
+  static void bench_pack(uint32_t scale) {
+    const char *mesh_files[] = { "bench_mesh_0.bin", "bench_mesh_1.bin", "bench_mesh_2.bin", "bench_mesh_3.bin" };
+    const uint32_t mesh_count = sizeof(mesh_files) / sizeof(mesh_files[0]);
+
+    size_t raw_total = 0;
+    for(uint32_t i = 0; i < mesh_count; ++i)
+      raw_total += gen_mesh(mesh_files[i], 128 * (i + 1) * scale);
+
+    const char *pack_files[] = { "bench_raw.pack", "bench_compressed.pack" };
+    uint32_t pack_flags[] = { PackEntry::NONE, PackEntry::COMPRESSED };
+    for(uint32_t p = 0; p < 2; ++p) {
+      PackWriter writer;
+      writer.init();
+      for(uint32_t i = 0; i < mesh_count; ++i)
+        writer.add(mesh_files[i], mesh_files[i], pack_flags[p]);
+      TimePoint start = Time::now();
+      ABORT(writer.write(pack_files[p]), "Failed to write benchmark pack");
+      float write_time = seconds_since(start);
+      writer.kill();
+
+      // Drop the pack from the page cache so the first read pays for the disk as a cold load would
+      int fd = open(pack_files[p], O_RDONLY);
+      if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+      }
+
+      uint8_t *dst = (uint8_t*)mem_alloca(raw_total, 16);
+      const uint32_t iterations = 8;
+      float cold_time = 0.0f;
+      float warm_time = 0.0f;
+      size_t stored = 0;
+      for(uint32_t it = 0; it < iterations; ++it) {
+        start = Time::now();
+        Pack *pack = Pack::instance();
+        ABORT(pack->open(pack_files[p]), "Failed to open benchmark pack");
+        size_t offset = 0;
+        stored = 0;
+        for(uint32_t i = 0; i < mesh_count; ++i) {
+          const PackEntry *entry = pack->find(mesh_files[i]);
+          ABORT(entry && pack->read(entry, dst + offset), "Failed to read benchmark entry");
+          offset += entry->raw_size;
+          stored += entry->size;
+        }
+        pack->close();
+        float t = seconds_since(start);
+        if (it == 0)
+          cold_time = t;
+        else
+          warm_time += t;
+      }
+      warm_time /= iterations - 1;
+
+      ABORT(Pack::instance()->open(pack_files[p]), "Failed to open benchmark pack");
+      size_t offset = 0;
+      for(uint32_t i = 0; i < mesh_count; ++i) {
+        const PackEntry *entry = Pack::instance()->find(mesh_files[i]);
+        ABORT(wyhash(dst + offset, entry->raw_size, 0, _wyp) == entry->content_hash, "Benchmark entry does not match its source");
+        offset += entry->raw_size;
+      }
+      Pack::instance()->close();
+      mem_free(dst);
+
+      float mb = (float)raw_total / (1024.0f * 1024.0f);
+      print("pack {}: {:.2} MB raw, {:.2} MB stored ({:.3}), write {:.3}s, cold load {:.1} MB/s, warm load {:.1} MB/s\n",
+          pack_files[p], mb, (float)stored / (1024.0f * 1024.0f), (float)stored / raw_total, write_time,
+          mb / cold_time, mb / warm_time);
+      unlink(pack_files[p]);
+    }
+    for(uint32_t i = 0; i < mesh_count; ++i)
+      unlink(mesh_files[i]);
+  }
+
+  // Growable text buffer for the generated json
+  struct Text {
+    char *mem = nullptr;
+    size_t len = 0;
+    size_t cap = 0;
+
+    template<typename... Args>
+    void add(const char *fmt, Args... args) {
+      for(;;) {
+        int n = snprintf(mem + len, cap - len, fmt, args...);
+        if (n >= 0 && (size_t)n < cap - len) {
+          len += n;
+          return;
+        }
+        cap = cap ? cap * 2 : 1024 * 1024;
+        mem = (char*)mem_realloc(cap, mem);
+      }
+    }
+  };
+
+  // A scene graph heavy glTF: transform nodes, float arrays, accessor bounds and animation samplers
+  static void gen_gltf(Text *t, uint32_t node_count) {
+    t->add("{\n  \"asset\": { \"version\": \"2.0\", \"generator\": \"SlugBench\" },\n  \"scene\": 0,\n");
+    t->add("  \"scenes\": [ { \"name\": \"bench\", \"nodes\": [ 0 ] } ],\n  \"nodes\": [\n");
+    for(uint32_t i = 0; i < node_count; ++i) {
+      float f = (float)i * 0.001f;
+      t->add("    { \"name\": \"node_%u\", ", i);
+      if (i % 4 == 0)
+        t->add("\"matrix\": [ %.7g, 0.0, 0.0, 0.0, 0.0, %.7g, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, %.7g, %.7g, %.7g, 1.0 ]",
+            1.0f + f, 1.0f - f, f * 3.0f, -f, f * 0.5f);
+      else
+        t->add("\"translation\": [ %.7g, %.7g, %.7g ], \"rotation\": [ 0.0, %.7g, 0.0, %.7g ], \"scale\": [ 1.0, 1.0, 1.0 ]",
+            f, -f * 2.0f, f * 0.25f, sinf(f), cosf(f));
+      if (i % 8 == 1)
+        t->add(", \"mesh\": %u", (i / 8) % 64);
+      uint32_t child = i * 2 + 1;
+      if (child + 1 < node_count)
+        t->add(", \"children\": [ %u, %u ]", child, child + 1);
+      t->add(i + 1 < node_count ? " },\n" : " }\n");
+    }
+    t->add("  ],\n  \"meshes\": [\n");
+    for(uint32_t i = 0; i < 64; ++i)
+      t->add("    { \"primitives\": [ { \"attributes\": { \"POSITION\": %u, \"NORMAL\": %u }, \"indices\": %u, \"mode\": 4 } ], "
+          "\"weights\": [ 0.0, 0.5 ], \"extras\": { \"targetNames\": [ \"smile\", \"frown\" ] } }%s\n",
+          i * 3, i * 3 + 1, i * 3 + 2, i + 1 < 64 ? "," : "");
+    uint32_t accessor_count = node_count;
+    t->add("  ],\n  \"accessors\": [\n");
+    for(uint32_t i = 0; i < accessor_count; ++i) {
+      float f = (float)i * 0.37f;
+      t->add("    { \"bufferView\": 0, \"byteOffset\": %u, \"componentType\": 5126, \"count\": %u, \"type\": \"VEC3\", "
+          "\"min\": [ %.7g, %.7g, %.7g ], \"max\": [ %.7g, %.7g, %.7g ] }%s\n",
+          i * 12, 1 + i % 1000, -f, -f * 0.5f, -1.0f, f, f * 0.5f, 1.0e-3f * f, i + 1 < accessor_count ? "," : "");
+    }
+    t->add("  ],\n  \"bufferViews\": [ { \"buffer\": 0, \"byteLength\": %u } ],\n", accessor_count * 12);
+    t->add("  \"buffers\": [ { \"byteLength\": %u, \"uri\": \"bench.bin\" } ],\n", accessor_count * 12);
+    t->add("  \"animations\": [ { \"name\": \"wave\", \"channels\": [\n");
+    uint32_t channel_count = node_count / 4;
+    for(uint32_t i = 0; i < channel_count; ++i)
+      t->add("    { \"sampler\": %u, \"target\": { \"node\": %u, \"path\": \"%s\" } }%s\n", i, i * 4 + 1,
+          i % 2 ? "rotation" : "translation", i + 1 < channel_count ? "," : "");
+    t->add("  ], \"samplers\": [\n");
+    for(uint32_t i = 0; i < channel_count; ++i)
+      t->add("    { \"input\": %u, \"output\": %u, \"interpolation\": \"%s\" }%s\n", i % accessor_count,
+          (i + 1) % accessor_count, i % 3 ? "LINEAR" : "STEP", i + 1 < channel_count ? "," : "");
+    t->add("  ] } ]\n}\n");
+  }
+
+  static void bench_gltf(uint32_t scale) {
+    Text json;
+    gen_gltf(&json, 20000 * scale);
+    float mb = (float)json.len / (1024.0f * 1024.0f);
+    LinearAllocator *scratch = &MemoryService::instance()->scratch_allocator;
+
+    const uint32_t iterations = 5;
+    float dom_time = 0.0f;
+    uint64_t dom_news = 0;
+    size_t dom_scratch = 0;
+    uint32_t dom_nodes = 0;
+    for(uint32_t it = 0; it < iterations; ++it) {
+      scratch->free();
+      uint64_t news = Global_New_Count;
+      TimePoint start = Time::now();
+      {
+        glTF::glTF gltf;
+        glTF::Json doc = glTF::Json::parse(json.mem, json.mem + json.len);
+        gltf.fill(doc);
+        dom_nodes = (uint32_t)gltf.nodes.nodes.len;
+      }
+      dom_time += seconds_since(start);
+      dom_news = Global_New_Count - news;
+      dom_scratch = scratch->alloced;
+    }
+
+    // Serial, then split by section across the pool (the same as serial if it has no workers)
+    float stream_time[2] = {};
+    uint64_t stream_news[2] = {};
+    size_t stream_scratch[2] = {};
+    uint32_t stream_nodes = 0;
+    for(uint32_t mode = 0; mode < 2; ++mode) {
+      for(uint32_t it = 0; it < iterations; ++it) {
+        scratch->free();
+        uint64_t news = Global_New_Count;
+        TimePoint start = Time::now();
+        glTF::glTF gltf;
+        ABORT(gltf.parse((const uint8_t*)json.mem, json.len, mode == 1), "Failed to parse benchmark glTF");
+        stream_time[mode] += seconds_since(start);
+        stream_news[mode] = Global_New_Count - news;
+        stream_scratch[mode] = scratch->alloced;
+        stream_nodes = (uint32_t)gltf.nodes.nodes.len;
+        ABORT(dom_nodes == stream_nodes, "Benchmark glTF loaders disagree");
+      }
+    }
+    scratch->free();
+    mem_free(json.mem);
+
+    print("glTF json {:.2} MB, {} nodes:\n", mb, stream_nodes);
+    print("    nlohmann + fill: {:.1} MB/s, {} operator new calls, {} scratch bytes\n",
+        mb * iterations / dom_time, dom_news, (uint64_t)dom_scratch);
+    print("    single pass:     {:.1} MB/s, {} operator new calls, {} scratch bytes\n",
+        mb * iterations / stream_time[0], stream_news[0], (uint64_t)stream_scratch[0]);
+    print("    by section, {} workers: {:.1} MB/s, {} operator new calls, {} scratch bytes\n",
+        ThreadPool::instance()->thread_count, mb * iterations / stream_time[1], stream_news[1],
+        (uint64_t)stream_scratch[1]);
+  }
+
+  // What decoding looks like without the kernels: one switch and divide per component
+  static void naive_decode(const AccessorView *view, float *out) {
+    uint32_t components = Decode::components(view->type);
+    uint32_t size = Decode::component_size(view->component_type);
+    for(uint32_t i = 0; i < view->count; ++i) {
+      for(uint32_t c = 0; c < components; ++c) {
+        const uint8_t *p = view->data + (size_t)i * view->stride + c * size;
+        float f = 0.0f;
+        switch(view->component_type) {
+          case 5120: f = view->normalized ? fmaxf(*(const int8_t*)p / 127.0f, -1.0f) : *(const int8_t*)p; break;
+          case 5121: f = view->normalized ? *p / 255.0f : *p; break;
+          case 5122: { int16_t v; memcpy(&v, p, 2); f = view->normalized ? fmaxf(v / 32767.0f, -1.0f) : v; break; }
+          case 5123: { uint16_t v; memcpy(&v, p, 2); f = view->normalized ? v / 65535.0f : v; break; }
+          case 5126: memcpy(&f, p, 4); break;
+        }
+        out[(size_t)i * components + c] = f;
+      }
+    }
+  }
+
+  // Vertex attribute layouts the decoder sees in practice, on 'scale' million vertices
+  static void bench_decode(uint32_t scale) {
+    struct Case {
+      const char *name;
+      uint32_t component_type;
+      uint32_t type;
+      uint32_t stride;
+      bool normalized;
+    };
+    const Case cases[] = {
+      { "float vec3, stride 32", 5126, 2, 32, false },
+      { "snorm16 vec4, packed ", 5122, 3, 8, true },
+      { "unorm8 vec4, packed  ", 5121, 3, 4, true },
+      { "unorm16 vec2, stride 16", 5123, 1, 16, true },
+    };
+    uint32_t count = 1000 * 1000 * scale;
+    uint8_t *data = (uint8_t*)mem_alloca((size_t)count * 32, 16);
+    float *out = (float*)mem_alloca((size_t)count * 4 * sizeof(float), 16);
+    uint64_t seed = 1;
+    for(size_t i = 0; i < (size_t)count * 32; i += 8) {
+      uint64_t r = wyrand(&seed) & 0x3f3f3f3f3f3f3f3f; // Keeps the floats finite
+      mem_cpy(data + i, &r, 8);
+    }
+
+    memset(out, 0, (size_t)count * 4 * sizeof(float)); // Fault the pages in outside the timings
+
+    print("accessor decode, {} vertices:\n", count);
+    const uint32_t iterations = 5;
+    for(const Case &c : cases) {
+      AccessorView view = {};
+      view.data = data;
+      view.stride = c.stride;
+      view.component_type = c.component_type;
+      view.type = c.type;
+      view.count = count;
+      view.normalized = c.normalized;
+
+      TimePoint start = Time::now();
+      for(uint32_t it = 0; it < iterations; ++it)
+        naive_decode(&view, out);
+      float naive_time = seconds_since(start);
+      start = Time::now();
+      for(uint32_t it = 0; it < iterations; ++it)
+        Decode::floats(&view, out);
+      float sse_time = seconds_since(start);
+
+      float verts = (float)count * iterations / 1e6f;
+      print("    {}: {:.1} M vertices/ms, naive {:.2} M vertices/ms\n", c.name, verts / (sse_time * 1000.0f),
+          verts / (naive_time * 1000.0f));
+    }
+    mem_free(out);
+    mem_free(data);
+  }
+
+  // What the SceneGraph replaces: a recursive walk of child lists, with scalar AoS matrices
+  struct NaiveNode {
+    float translation[3];
+    float rotation[4];
+    float scale[3];
+    float world[16];
+    uint32_t first_child;
+    uint32_t child_count;
+  };
+  static void naive_world(NaiveNode *nodes, const uint32_t *children, uint32_t n, const float *parent) {
+    NaiveNode *node = &nodes[n];
+    const float *q = node->rotation;
+    float x = q[0], y = q[1], z = q[2], w = q[3];
+    float local[16] = {
+      (1 - 2 * (y * y + z * z)) * node->scale[0], 2 * (x * y + w * z) * node->scale[0], 2 * (x * z - w * y) * node->scale[0], 0,
+      2 * (x * y - w * z) * node->scale[1], (1 - 2 * (x * x + z * z)) * node->scale[1], 2 * (y * z + w * x) * node->scale[1], 0,
+      2 * (x * z + w * y) * node->scale[2], 2 * (y * z - w * x) * node->scale[2], (1 - 2 * (x * x + y * y)) * node->scale[2], 0,
+      node->translation[0], node->translation[1], node->translation[2], 1,
+    };
+    for(uint32_t c = 0; c < 4; ++c)
+      for(uint32_t r = 0; r < 4; ++r) {
+        float sum = 0.0f;
+        for(uint32_t k = 0; k < 4; ++k)
+          sum += parent[k * 4 + r] * local[c * 4 + k];
+        node->world[c * 4 + r] = sum;
+      }
+    for(uint32_t c = 0; c < node->child_count; ++c)
+      naive_world(nodes, children, children[node->first_child + c], node->world);
+  }
+
+  // A random recursive tree: each node's parent is any earlier node, so depth grows like log(n)
+  static void bench_scene_graph(uint32_t scale) {
+    uint32_t count = 100000 * scale;
+    int32_t *parents = (int32_t*)mem_alloca(sizeof(int32_t) * count, 16);
+    uint64_t seed = 7;
+    parents[0] = -1;
+    for(uint32_t i = 1; i < count; ++i)
+      parents[i] = (int32_t)(wyrand(&seed) % i);
+
+    SceneGraph graph;
+    TimePoint start = Time::now();
+    graph.init(count, parents);
+    float init_time = seconds_since(start);
+    for(uint32_t i = 0; i < graph.count; ++i) {
+      float t[3] = { (float)(i % 7), 1.0f, 0.5f };
+      float q[4] = { 0.0f, 0.38268343f, 0.0f, 0.92387953f };
+      graph.set_translation(i, t);
+      graph.set_rotation(i, q);
+    }
+
+    const uint32_t iterations = 100;
+    start = Time::now();
+    for(uint32_t it = 0; it < iterations; ++it) {
+      for(uint32_t i = 0; i < graph.count; ++i)
+        graph.mark_dirty(i);
+      graph.update();
+    }
+    float full_time = seconds_since(start) / iterations;
+    start = Time::now();
+    for(uint32_t it = 0; it < iterations; ++it) {
+      for(uint32_t i = 0; i < graph.count / 100; ++i) {
+        float q[4] = { 0.0f, 0.0f, 0.38268343f, 0.92387953f };
+        graph.set_rotation((uint32_t)(wyrand(&seed) % graph.count), q);
+      }
+      graph.update();
+    }
+    float partial_time = seconds_since(start) / iterations;
+    start = Time::now();
+    for(uint32_t it = 0; it < iterations; ++it) {
+      for(uint32_t i = 0; i < 16; ++i) {
+        float q[4] = { 0.0f, 0.0f, 0.38268343f, 0.92387953f };
+        graph.set_rotation((uint32_t)(wyrand(&seed) % graph.count), q);
+      }
+      graph.update();
+    }
+    float few_time = seconds_since(start) / iterations;
+
+    NaiveNode *nodes = (NaiveNode*)mem_alloca(sizeof(NaiveNode) * count, 16);
+    uint32_t *children = (uint32_t*)mem_alloca(sizeof(uint32_t) * count, 16);
+    memset(nodes, 0, sizeof(NaiveNode) * count);
+    for(uint32_t i = 1; i < count; ++i)
+      ++nodes[parents[i]].child_count;
+    uint32_t next = 0;
+    for(uint32_t i = 0; i < count; ++i) {
+      nodes[i].first_child = next;
+      next += nodes[i].child_count;
+      nodes[i].child_count = 0;
+      float t[7] = { (float)(i % 7), 1.0f, 0.5f, 0.0f, 0.38268343f, 0.0f, 0.92387953f };
+      mem_cpy(nodes[i].translation, t, sizeof(float) * 3);
+      mem_cpy(nodes[i].rotation, t + 3, sizeof(float) * 4);
+      nodes[i].scale[0] = nodes[i].scale[1] = nodes[i].scale[2] = 1.0f;
+    }
+    for(uint32_t i = 1; i < count; ++i)
+      children[nodes[parents[i]].first_child + nodes[parents[i]].child_count++] = i;
+    const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+    start = Time::now();
+    for(uint32_t it = 0; it < iterations; ++it)
+      naive_world(nodes, children, 0, identity);
+    float naive_time = seconds_since(start) / iterations;
+    mem_free(children);
+    mem_free(nodes);
+
+    print("Scene graph, {} nodes:\n", count);
+    print("    init (depth sort) {:.3} ms\n", init_time * 1000.0f);
+    print("    update, all dirty {:.3} ms\n", full_time * 1000.0f);
+    print("    update, 1% of nodes set {:.3} ms\n", partial_time * 1000.0f);
+    print("    update, 16 nodes set {:.3} ms\n", few_time * 1000.0f);
+    print("    naive recursive update {:.3} ms\n", naive_time * 1000.0f);
+    graph.kill();
+    mem_free(parents);
+  }
+
+  // What the Animator replaces: a binary search a channel a frame, then scalar lerp and slerp
+  static void naive_sample(const AnimationTrack *tracks, uint32_t count, float time, SceneGraph *graph) {
+    for(uint32_t i = 0; i < count; ++i) {
+      const AnimationTrack *track = &tracks[i];
+      uint32_t lo = 0, hi = track->key_count;
+      while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (track->times[mid] <= time)
+          lo = mid;
+        else
+          hi = mid;
+      }
+      uint32_t k = lo + 1 < track->key_count ? lo : track->key_count - 2;
+      float u = (time - track->times[k]) / (track->times[k + 1] - track->times[k]);
+      u = u < 0.0f ? 0.0f : (u > 1.0f ? 1.0f : u);
+      if (track->path == Scene::Animation::ROTATION) {
+        const float *a = track->values + k * 4;
+        const float *b = a + 4;
+        float dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+        float sign = dot < 0.0f ? -1.0f : 1.0f;
+        float theta = acosf(fminf(fabsf(dot), 1.0f));
+        float sine = sinf(theta);
+        float w0 = sine > 1e-4f ? sinf((1.0f - u) * theta) / sine : 1.0f - u;
+        float w1 = sine > 1e-4f ? sinf(u * theta) / sine : u;
+        float *out = graph->rotation + track->slot * 4;
+        for(uint32_t c = 0; c < 4; ++c)
+          out[c] = a[c] * w0 + b[c] * w1 * sign;
+      } else {
+        const float *a = track->values + k * 3;
+        float *out = (track->path == Scene::Animation::TRANSLATION ? graph->translation : graph->scale) + track->slot * 4;
+        for(uint32_t c = 0; c < 3; ++c)
+          out[c] = a[c] + (a[c + 3] - a[c]) * u;
+      }
+      graph->mark_dirty(track->slot);
+    }
+  }
+
+  // Every node of a random tree gets a translation, rotation and scale channel of 1 second at 30 keys a
+  // second, the three sharing their times as glTF exporters write them
+  static void bench_animation(uint32_t scale) {
+    uint32_t count = 10000 * scale;
+    const uint32_t key_count = 31;
+    int32_t *parents = (int32_t*)mem_alloca(sizeof(int32_t) * count, 16);
+    uint64_t seed = 11;
+    parents[0] = -1;
+    for(uint32_t i = 1; i < count; ++i)
+      parents[i] = (int32_t)(wyrand(&seed) % i);
+    SceneGraph graph;
+    graph.init(count, parents);
+
+    float *times = (float*)mem_alloca(sizeof(float) * count * key_count, 16);
+    for(uint32_t i = 0; i < count * key_count; ++i)
+      times[i] = (float)(i % key_count) / 30.0f;
+    float *values = (float*)mem_alloca(sizeof(float) * count * key_count * 10, 16);
+    AnimationTrack *tracks = (AnimationTrack*)mem_alloca(sizeof(AnimationTrack) * count * 3, 16);
+    for(uint32_t n = 0; n < count; ++n) {
+      float *translation = values + (size_t)n * key_count * 10;
+      float *rotation = translation + key_count * 3;
+      float *scales = rotation + key_count * 4;
+      for(uint32_t k = 0; k < key_count; ++k) {
+        float angle = (float)(wyrand(&seed) % 1000) * 0.00628f;
+        float axis = (float)(n % 3);
+        translation[k * 3 + 0] = (float)(wyrand(&seed) % 100) * 0.01f;
+        translation[k * 3 + 1] = angle;
+        translation[k * 3 + 2] = -angle;
+        rotation[k * 4 + 0] = axis == 0.0f ? sinf(angle * 0.5f) : 0.0f;
+        rotation[k * 4 + 1] = axis == 1.0f ? sinf(angle * 0.5f) : 0.0f;
+        rotation[k * 4 + 2] = axis == 2.0f ? sinf(angle * 0.5f) : 0.0f;
+        rotation[k * 4 + 3] = cosf(angle * 0.5f);
+        scales[k * 3 + 0] = scales[k * 3 + 1] = scales[k * 3 + 2] = 1.0f + 0.01f * (float)(k % 5);
+      }
+      uint32_t slot = graph.slot[n];
+      const float *node_times = times + (size_t)n * key_count;
+      tracks[n * 3 + 0] = { slot, Scene::Animation::TRANSLATION, Scene::Animation::LINEAR, key_count, node_times, translation };
+      tracks[n * 3 + 1] = { slot, Scene::Animation::ROTATION, Scene::Animation::LINEAR, key_count, node_times, rotation };
+      tracks[n * 3 + 2] = { slot, Scene::Animation::SCALE, Scene::Animation::LINEAR, key_count, node_times, scales };
+    }
+
+    Animator animator;
+    TimePoint start = Time::now();
+    animator.init(tracks, count * 3);
+    float init_time = seconds_since(start);
+
+    // 10 seconds at 60 frames a second, looping
+    const uint32_t frames = 600;
+    float sample_time[2] = {};
+    float update_time = 0.0f;
+    for(uint32_t mode = 0; mode < 2; ++mode) {
+      animator.slerp = mode == 1;
+      for(uint32_t f = 0; f < frames; ++f) {
+        start = Time::now();
+        animator.sample(fmodf((float)f / 60.0f, animator.duration), &graph);
+        sample_time[mode] += seconds_since(start) / frames;
+        start = Time::now();
+        graph.update();
+        update_time += seconds_since(start) / (frames * 2);
+      }
+    }
+    start = Time::now();
+    for(uint32_t f = 0; f < frames; ++f)
+      naive_sample(tracks, count * 3, fmodf((float)f / 60.0f, animator.duration), &graph);
+    float naive_time = seconds_since(start) / frames;
+
+    // The same tracks compressed, with the slots they were given mapped back to nodes for the clip
+    uint32_t max_keys = Clips::max_keys(tracks, count * 3);
+    ClipTrack *clip_tracks = (ClipTrack*)mem_alloca(sizeof(ClipTrack) * count * 3, 16);
+    ClipKey *clip_keys = (ClipKey*)mem_alloca(sizeof(ClipKey) * max_keys, 16);
+    Clips::Tolerance tolerance;
+    float clip_duration = 0.0f;
+    float errors[3] = {};
+    start = Time::now();
+    uint32_t clip_key_count = Clips::compress(tracks, count * 3, &tolerance, clip_tracks, clip_keys, &clip_duration, errors);
+    float compress_time = seconds_since(start);
+    for(uint32_t i = 0; i < count * 3; ++i)
+      clip_tracks[i].node = graph.node[clip_tracks[i].node];
+    Animator clip;
+    clip.init(clip_tracks, count * 3, clip_keys, clip_key_count, clip_duration, &graph);
+    start = Time::now();
+    for(uint32_t f = 0; f < frames; ++f)
+      clip.sample(fmodf((float)f / 60.0f, clip.duration), &graph);
+    float clip_time = seconds_since(start) / frames;
+    uint64_t raw_bytes = (uint64_t)count * key_count * (10 + 1) * sizeof(float);
+    uint64_t clip_bytes = (uint64_t)count * 3 * sizeof(ClipTrack) + (uint64_t)clip_key_count * sizeof(ClipKey);
+
+    print("Animation, {} nodes, {} channels of {} keys:\n", count, count * 3, key_count);
+    print("    init {:.3} ms\n", init_time * 1000.0f);
+    print("    sample, nlerp {:.3} ms a frame\n", sample_time[0] * 1000.0f);
+    print("    sample, slerp {:.3} ms a frame\n", sample_time[1] * 1000.0f);
+    print("    naive search and slerp {:.3} ms a frame\n", naive_time * 1000.0f);
+    print("    scene graph update {:.3} ms a frame\n", update_time * 1000.0f);
+    print("    compress {:.3} ms, {} keys to {}, {} KB to {} KB, error {:.5} {:.5} {:.5}\n", compress_time * 1000.0f,
+        max_keys, clip_key_count, raw_bytes / 1024, clip_bytes / 1024, errors[0], errors[1], errors[2]);
+    print("    sample compressed, nlerp {:.3} ms a frame\n", clip_time * 1000.0f);
+    clip.kill();
+    mem_free(clip_keys);
+    mem_free(clip_tracks);
+    animator.kill();
+    graph.kill();
+    mem_free(tracks);
+    mem_free(values);
+    mem_free(times);
+    mem_free(parents);
+  }
+  // Per joint skinning as it is usually first written: each weighted joint transforms the vertex
+  static void naive_skin(const float *palette, uint32_t joint_count, const QuantizedVertex *in,
+      const QuantizedBounds *bounds, uint32_t count, SkinnedVertex *out)
+  {
+    for(uint32_t i = 0; i < count; ++i) {
+      const QuantizedVertex *v = &in[i];
+      float position[3], normal[3], tangent[3];
+      for(uint32_t a = 0; a < 3; ++a)
+        position[a] = bounds->offset[a] + (float)v->position[a] / 65535.0f * bounds->scale[a];
+      Quantize::from_octahedral(v->normal, normal);
+      Quantize::from_octahedral(v->tangent, tangent);
+      float p[3] = {}, n[3] = {}, t[3] = {};
+      for(uint32_t k = 0; k < 4; ++k) {
+        if (!v->weights[k] || v->joints[k] >= joint_count)
+          continue;
+        const float *m = palette + v->joints[k] * 16;
+        float w = (float)v->weights[k] / 255.0f;
+        for(uint32_t r = 0; r < 3; ++r) {
+          p[r] += w * (m[r] * position[0] + m[4 + r] * position[1] + m[8 + r] * position[2] + m[12 + r]);
+          n[r] += w * (m[r] * normal[0] + m[4 + r] * normal[1] + m[8 + r] * normal[2]);
+          t[r] += w * (m[r] * tangent[0] + m[4 + r] * tangent[1] + m[8 + r] * tangent[2]);
+        }
+      }
+      SkinnedVertex *o = &out[i];
+      o->position[0] = p[0];
+      o->position[1] = p[1];
+      o->position[2] = p[2];
+      o->position[3] = v->position[3] ? 1.0f : 0.0f;
+      Quantize::octahedral(n, o->normal);
+      Quantize::octahedral(t, o->tangent);
+      o->uv[0] = v->uv[0];
+      o->uv[1] = v->uv[1];
+      o->pad = 0;
+    }
+  }
+
+  static void bench_skinning(uint32_t scale) {
+    uint32_t count = 100000 * scale;
+    const uint32_t joint_count = 64;
+    uint64_t seed = 13;
+
+    // Rotations about z with a translation, the kind of palette a posed skeleton has
+    float *palette = (float*)mem_alloca(sizeof(float) * 16 * joint_count, 16);
+    for(uint32_t j = 0; j < joint_count; ++j) {
+      float angle = (float)(wyrand(&seed) % 1000) * 0.00628f;
+      float *m = palette + j * 16;
+      memset(m, 0, sizeof(float) * 16);
+      m[0] = m[5] = cosf(angle);
+      m[1] = sinf(angle);
+      m[4] = -m[1];
+      m[10] = m[15] = 1.0f;
+      m[12] = (float)(wyrand(&seed) % 100) * 0.01f;
+      m[13] = (float)(wyrand(&seed) % 100) * 0.01f;
+    }
+
+    QuantizedBounds bounds = { { -1.0f, -1.0f, -1.0f }, { 2.0f, 2.0f, 2.0f } };
+    QuantizedVertex *vertices = (QuantizedVertex*)mem_alloca(sizeof(QuantizedVertex) * count, 16);
+    for(uint32_t i = 0; i < count; ++i) {
+      QuantizedVertex *v = &vertices[i];
+      uint64_t r = wyrand(&seed);
+      v->position[0] = (uint16_t)r;
+      v->position[1] = (uint16_t)(r >> 16);
+      v->position[2] = (uint16_t)(r >> 32);
+      v->position[3] = (r >> 63) ? 65535 : 0;
+      float normal[3] = { (float)(r % 7) - 3.0f, 1.0f, (float)(r % 5) - 2.0f };
+      float tangent[3] = { 1.0f, (float)(r % 3) - 1.0f, 0.5f };
+      Quantize::octahedral(normal, v->normal);
+      Quantize::octahedral(tangent, v->tangent);
+      v->uv[0] = v->uv[1] = 0;
+      // Two to four joints, neighbours in the skeleton as a real mesh has them
+      uint32_t used = 2 + (uint32_t)(wyrand(&seed) % 3);
+      uint32_t first = (uint32_t)(wyrand(&seed) % joint_count);
+      uint32_t left = 255;
+      for(uint32_t k = 0; k < 4; ++k) {
+        v->joints[k] = (uint8_t)((first + k) % joint_count);
+        uint32_t weight = k + 1 == used ? left : k < used ? (uint32_t)(wyrand(&seed) % (left + 1)) : 0;
+        v->weights[k] = (uint8_t)weight;
+        left -= weight;
+      }
+    }
+    SkinnedVertex *out = (SkinnedVertex*)mem_alloca(sizeof(SkinnedVertex) * count, 16);
+
+    const uint32_t runs = 20;
+    TimePoint start = Time::now();
+    for(uint32_t r = 0; r < runs; ++r)
+      naive_skin(palette, joint_count, vertices, &bounds, count, out);
+    float naive_time = seconds_since(start) / runs;
+    start = Time::now();
+    for(uint32_t r = 0; r < runs; ++r)
+      Skinning::skin(palette, joint_count, vertices, &bounds, count, out);
+    float skin_time = seconds_since(start) / runs;
+    Skinning skinning = { joint_count, nullptr, nullptr, palette };
+    start = Time::now();
+    for(uint32_t r = 0; r < runs; ++r)
+      skinning.skin_parallel(vertices, &bounds, count, out);
+    float parallel_time = seconds_since(start) / runs;
+
+    print("Skinning, {} vertices, {} joints:\n", count, joint_count);
+    print("    naive per joint {:.3} ms\n", naive_time * 1000.0f);
+    print("    blended matrix, SSE {:.3} ms\n", skin_time * 1000.0f);
+    print("    blended matrix, thread pool {:.3} ms\n", parallel_time * 1000.0f);
+    mem_free(out);
+    mem_free(vertices);
+    mem_free(palette);
+  }
+  static void bench_morph(uint32_t scale) {
+    uint32_t count = 50000 * scale;
+    const uint32_t target_count = 32;
+    const uint32_t moved = 2000; // Vertices a target moves, as a face's expression moves part of a head
+    uint64_t seed = 17;
+
+    QuantizedBounds bounds = { { -1.0f, -1.0f, -1.0f }, { 2.0f, 2.0f, 2.0f } };
+    QuantizedVertex *vertices = (QuantizedVertex*)mem_alloca(sizeof(QuantizedVertex) * count, 16);
+    for(uint32_t i = 0; i < count; ++i) {
+      uint64_t r = wyrand(&seed);
+      QuantizedVertex *v = &vertices[i];
+      *v = {};
+      v->position[0] = (uint16_t)r;
+      v->position[1] = (uint16_t)(r >> 16);
+      v->position[2] = (uint16_t)(r >> 32);
+      float normal[3] = { (float)(r % 7) - 3.0f, 1.0f, (float)(r % 5) - 2.0f };
+      Quantize::octahedral(normal, v->normal);
+      Quantize::octahedral(normal, v->tangent);
+    }
+
+    // Each target's deltas both sparse and dense, the dense ones for blending every vertex of every target
+    MorphDelta *deltas = (MorphDelta*)mem_alloca(sizeof(MorphDelta) * target_count * moved, 16);
+    float *dense = (float*)mem_alloca(sizeof(float) * 6 * count * target_count, 16);
+    memset(dense, 0, sizeof(float) * 6 * count * target_count);
+    const MorphDelta *target_deltas[target_count];
+    uint32_t delta_counts[target_count];
+    for(uint32_t t = 0; t < target_count; ++t) {
+      uint32_t first = (uint32_t)(wyrand(&seed) % (count / moved));
+      for(uint32_t i = 0; i < moved; ++i) {
+        MorphDelta *d = &deltas[t * moved + i];
+        *d = {};
+        d->vertex = first + i * (count / moved);
+        for(uint32_t a = 0; a < 3; ++a) {
+          d->position[a] = (float)(wyrand(&seed) % 100) * 0.001f;
+          d->normal[a] = (float)(wyrand(&seed) % 100) * 0.002f - 0.1f;
+          dense[((size_t)t * count + d->vertex) * 6 + a] = d->position[a];
+          dense[((size_t)t * count + d->vertex) * 6 + 3 + a] = d->normal[a];
+        }
+      }
+      target_deltas[t] = deltas + t * moved;
+      delta_counts[t] = moved;
+    }
+
+    Morph morph;
+    morph.init(target_deltas, delta_counts, target_count, vertices, &bounds, count);
+    float weights[target_count] = {};
+    const uint32_t runs = 20;
+
+    // Every target over every vertex, the blend a dense morph target buffer gets
+    SkinnedVertex *out = (SkinnedVertex*)mem_alloca(sizeof(SkinnedVertex) * count, 16);
+    float *sums = (float*)mem_alloca(sizeof(float) * 6 * count, 16);
+    TimePoint start = Time::now();
+    for(uint32_t r = 0; r < runs; ++r) {
+      for(uint32_t t = 0; t < 4; ++t)
+        weights[(r + t * 7) % target_count] = 0.25f + 0.01f * (float)r;
+      memset(sums, 0, sizeof(float) * 6 * count);
+      for(uint32_t t = 0; t < target_count; ++t)
+        for(size_t i = 0; i < (size_t)count * 6; ++i)
+          sums[i] += weights[t] * dense[(size_t)t * count * 6 + i];
+      for(uint32_t v = 0; v < count; ++v) {
+        float normal[3];
+        Quantize::from_octahedral(vertices[v].normal, normal);
+        for(uint32_t a = 0; a < 3; ++a) {
+          out[v].position[a] = bounds.offset[a] + (float)vertices[v].position[a] / 65535.0f * bounds.scale[a] + sums[v * 6 + a];
+          normal[a] += sums[v * 6 + 3 + a];
+        }
+        Quantize::octahedral(normal, out[v].normal);
+      }
+      memset(weights, 0, sizeof(weights));
+    }
+    float dense_time = seconds_since(start) / runs;
+
+    start = Time::now();
+    for(uint32_t r = 0; r < runs; ++r) {
+      for(uint32_t t = 0; t < 4; ++t)
+        weights[(r + t * 7) % target_count] = 0.25f + 0.01f * (float)r;
+      morph.blend(weights, target_count);
+      memset(weights, 0, sizeof(weights));
+    }
+    float sparse_time = seconds_since(start) / runs;
+
+    weights[0] = 1.0f;
+    morph.blend(weights, target_count);
+    start = Time::now();
+    for(uint32_t r = 0; r < runs; ++r)
+      morph.blend(weights, target_count);
+    float cached_time = seconds_since(start) / runs;
+
+    print("Morph targets, {} vertices, {} targets of {} deltas, 4 weighted:\n", count, target_count, moved);
+    print("    dense, every target {:.3} ms\n", dense_time * 1000.0f);
+    print("    sparse, weighted targets only {:.3} ms\n", sparse_time * 1000.0f);
+    print("    same weights, cached {:.3} us\n", cached_time * 1000000.0f);
+    morph.kill();
+    mem_free(sums);
+    mem_free(out);
+    mem_free(dense);
+    mem_free(deltas);
+    mem_free(vertices);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint32_t scale = argc > 1 ? (uint32_t)atoi(argv[1]) : 1;
+  if (scale == 0)
+    scale = 1;
+
+  MemoryConfig mem_config;
+  mem_config.heap_size = (size_t)256 * 1024 * 1024 * scale * scale;
+  mem_config.linear_size = (size_t)64 * 1024 * 1024 * scale;
+  MemoryService::instance()->init(&mem_config);
+  ThreadPool::instance()->init(0);
+
+  bench_pack(scale);
+  bench_gltf(scale);
+  bench_decode(scale);
+  bench_scene_graph(scale);
+  bench_animation(scale);
+  bench_skinning(scale);
+  bench_morph(scale);
+
+  ThreadPool::instance()->kill();
+  MemoryService::instance()->shutdown();
+  return 0;
+}
@@ -0,0 +1,435 @@
+#include <cmath>
+#include <cstring>
+
+#include <vulkan/vulkan.hpp>
+
+#include "Allocator.hpp"
+#include "File.hpp"
+#include "Format.hpp"
+#include "Quantize.hpp"
+#include "Skinning.hpp"
+#include "Threads.hpp"
+#include "VulkanErrors.hpp"
+
+using namespace Sol;
+
+/*
+ * Checks shaders/skin.comp against Skinning::skin, with no window or surface, so it runs on a software
+ * device (CTest runs it on lavapipe, see LAVAPIPE_ICD in CMakeLists.txt):
+ *
+ *    SlugSkinCheck [shaders/skin.comp.spv]
+ *
+ * Random vertices and palettes (mirroring joints included) are skinned as two instances sharing their
+ * bind pose, as Engine::update_scene lays them out, and every output vertex is compared. Returns 0 if
+ * they all match.
+ */
+
+namespace {
+  static const uint32_t VERTEX_COUNT = 5000;
+  static const uint32_t JOINT_COUNT = 48;
+  static const uint32_t INSTANCE_COUNT = 2;
+  static const uint32_t BINDING_COUNT = 4;
+
+  static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+  }
+  static float unit_random(uint64_t *state) {
+    return (float)(next_random(state) % 1000001) / 1000000.0f;
+  }
+
+  static bool check(VkResult result, const char *call) {
+    if (result == VK_SUCCESS)
+      return true;
+    print_err("SkinCheck: {} returned {}\n", call, VulkanError::match_error(result));
+    return false;
+  }
+
+  struct HostBuffer {
+    VkBuffer buf;
+    VkDeviceMemory mem;
+    void *data;
+  };
+
+  // Everything the check creates, so one kill() undoes however far it got
+  struct Gpu {
+    VkInstance instance;
+    VkPhysicalDevice physical_device;
+    VkDevice device;
+    VkQueue queue;
+    uint32_t queue_family;
+    HostBuffer buffers[BINDING_COUNT]; // Bind vertices, palettes, instances, output, as skin.comp binds them
+    VkDescriptorSetLayout set_layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet set;
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+    VkCommandPool command_pool;
+    VkCommandBuffer cmd;
+    VkFence fence;
+
+    bool init();
+    void kill();
+    bool alloc_host_buffer(VkDeviceSize size, HostBuffer *out);
+    bool init_pipeline(const char *spirv_file);
+    bool run(uint32_t group_count_x);
+  };
+
+  bool Gpu::init() {
+    VkApplicationInfo app_info = { VK_STRUCTURE_TYPE_APPLICATION_INFO };
+    app_info.pApplicationName = "SkinCheck";
+    app_info.apiVersion = VK_API_VERSION_1_1;
+    VkInstanceCreateInfo instance_info = { VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO };
+    instance_info.pApplicationInfo = &app_info;
+    if (!check(vkCreateInstance(&instance_info, nullptr, &instance), "vkCreateInstance"))
+      return false;
+
+    // The first device with a compute queue
+    uint32_t device_count = 0;
+    vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
+    VkPhysicalDevice devices[16];
+    device_count = device_count < 16 ? device_count : 16;
+    vkEnumeratePhysicalDevices(instance, &device_count, devices);
+    for(uint32_t d = 0; d < device_count && !physical_device; ++d) {
+      uint32_t family_count = 0;
+      vkGetPhysicalDeviceQueueFamilyProperties(devices[d], &family_count, nullptr);
+      VkQueueFamilyProperties families[16];
+      family_count = family_count < 16 ? family_count : 16;
+      vkGetPhysicalDeviceQueueFamilyProperties(devices[d], &family_count, families);
+      for(uint32_t f = 0; f < family_count; ++f) {
+        if (families[f].queueFlags & VK_QUEUE_COMPUTE_BIT) {
+          physical_device = devices[d];
+          queue_family = f;
+          break;
+        }
+      }
+    }
+    if (!physical_device) {
+      print_err("SkinCheck: no Vulkan device with a compute queue\n");
+      return false;
+    }
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physical_device, &props);
+    print("SkinCheck: running on '{}'\n", props.deviceName);
+
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queue_info = { VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO };
+    queue_info.queueFamilyIndex = queue_family;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+    VkDeviceCreateInfo device_info = { VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO };
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    if (!check(vkCreateDevice(physical_device, &device_info, nullptr, &device), "vkCreateDevice"))
+      return false;
+    vkGetDeviceQueue(device, queue_family, 0, &queue);
+
+    VkCommandPoolCreateInfo pool_info = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO };
+    pool_info.queueFamilyIndex = queue_family;
+    if (!check(vkCreateCommandPool(device, &pool_info, nullptr, &command_pool), "vkCreateCommandPool"))
+      return false;
+    VkCommandBufferAllocateInfo cmd_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+    cmd_info.commandPool = command_pool;
+    cmd_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_info.commandBufferCount = 1;
+    if (!check(vkAllocateCommandBuffers(device, &cmd_info, &cmd), "vkAllocateCommandBuffers"))
+      return false;
+    VkFenceCreateInfo fence_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    return check(vkCreateFence(device, &fence_info, nullptr, &fence), "vkCreateFence");
+  }
+
+  void Gpu::kill() {
+    if (device) {
+      vkDeviceWaitIdle(device);
+      if (fence)
+        vkDestroyFence(device, fence, nullptr);
+      if (command_pool)
+        vkDestroyCommandPool(device, command_pool, nullptr);
+      if (pipeline)
+        vkDestroyPipeline(device, pipeline, nullptr);
+      if (layout)
+        vkDestroyPipelineLayout(device, layout, nullptr);
+      if (pool)
+        vkDestroyDescriptorPool(device, pool, nullptr);
+      if (set_layout)
+        vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+      for(uint32_t i = 0; i < BINDING_COUNT; ++i) {
+        if (buffers[i].buf)
+          vkDestroyBuffer(device, buffers[i].buf, nullptr);
+        if (buffers[i].mem)
+          vkFreeMemory(device, buffers[i].mem, nullptr);
+      }
+      vkDestroyDevice(device, nullptr);
+    }
+    if (instance)
+      vkDestroyInstance(instance, nullptr);
+    *this = {};
+  }
+
+  // Host visible and coherent, mapped for good: the check reads the output straight back
+  bool Gpu::alloc_host_buffer(VkDeviceSize size, HostBuffer *out) {
+    VkBufferCreateInfo buffer_info = { VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO };
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if (!check(vkCreateBuffer(device, &buffer_info, nullptr, &out->buf), "vkCreateBuffer"))
+      return false;
+
+    VkMemoryRequirements reqs;
+    vkGetBufferMemoryRequirements(device, out->buf, &reqs);
+    VkPhysicalDeviceMemoryProperties mem_props;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
+    const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    uint32_t type = UINT32_MAX;
+    for(uint32_t i = 0; i < mem_props.memoryTypeCount && type == UINT32_MAX; ++i)
+      if ((reqs.memoryTypeBits & (1u << i)) && (mem_props.memoryTypes[i].propertyFlags & flags) == flags)
+        type = i;
+    if (type == UINT32_MAX) {
+      print_err("SkinCheck: no host visible, coherent memory for a storage buffer\n");
+      return false;
+    }
+
+    VkMemoryAllocateInfo alloc_info = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+    alloc_info.allocationSize = reqs.size;
+    alloc_info.memoryTypeIndex = type;
+    if (!check(vkAllocateMemory(device, &alloc_info, nullptr, &out->mem), "vkAllocateMemory") ||
+        !check(vkBindBufferMemory(device, out->buf, out->mem, 0), "vkBindBufferMemory"))
+      return false;
+    return check(vkMapMemory(device, out->mem, 0, VK_WHOLE_SIZE, 0x0, &out->data), "vkMapMemory");
+  }
+
+  // As Engine::init_gpu_skinning builds it, for one frame
+  bool Gpu::init_pipeline(const char *spirv_file) {
+    MappedFile spirv = File::map(spirv_file);
+    if (!spirv.data || spirv.size < 20 || spirv.size % 4) {
+      print_err("SkinCheck: '{}' is missing or not spirv\n", spirv_file);
+      return false;
+    }
+
+    VkDescriptorSetLayoutBinding bindings[BINDING_COUNT];
+    for(uint32_t i = 0; i < BINDING_COUNT; ++i) {
+      bindings[i] = {};
+      bindings[i].binding = i;
+      bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo set_layout_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+    set_layout_info.bindingCount = BINDING_COUNT;
+    set_layout_info.pBindings = bindings;
+    if (!check(vkCreateDescriptorSetLayout(device, &set_layout_info, nullptr, &set_layout), "vkCreateDescriptorSetLayout"))
+      return false;
+
+    VkDescriptorPoolSize pool_size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, BINDING_COUNT };
+    VkDescriptorPoolCreateInfo pool_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+    pool_info.maxSets = 1;
+    if (!check(vkCreateDescriptorPool(device, &pool_info, nullptr, &pool), "vkCreateDescriptorPool"))
+      return false;
+    VkDescriptorSetAllocateInfo set_info = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+    set_info.descriptorPool = pool;
+    set_info.descriptorSetCount = 1;
+    set_info.pSetLayouts = &set_layout;
+    if (!check(vkAllocateDescriptorSets(device, &set_info, &set), "vkAllocateDescriptorSets"))
+      return false;
+
+    VkDescriptorBufferInfo buf_infos[BINDING_COUNT];
+    VkWriteDescriptorSet writes[BINDING_COUNT];
+    for(uint32_t b = 0; b < BINDING_COUNT; ++b) {
+      buf_infos[b] = { buffers[b].buf, 0, VK_WHOLE_SIZE };
+      writes[b] = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+      writes[b].dstSet = set;
+      writes[b].dstBinding = b;
+      writes[b].descriptorCount = 1;
+      writes[b].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[b].pBufferInfo = &buf_infos[b];
+    }
+    vkUpdateDescriptorSets(device, BINDING_COUNT, writes, 0, nullptr);
+
+    VkPipelineLayoutCreateInfo layout_info = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    if (!check(vkCreatePipelineLayout(device, &layout_info, nullptr, &layout), "vkCreatePipelineLayout"))
+      return false;
+
+    VkShaderModuleCreateInfo module_info = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+    module_info.codeSize = spirv.size;
+    module_info.pCode = (const uint32_t*)spirv.data;
+    VkShaderModule module;
+    if (!check(vkCreateShaderModule(device, &module_info, nullptr, &module), "vkCreateShaderModule"))
+      return false;
+    VkComputePipelineCreateInfo pipeline_info = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+    pipeline_info.stage = { VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO };
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.layout = layout;
+    VkResult result = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &pipeline);
+    vkDestroyShaderModule(device, module, nullptr);
+    return check(result, "vkCreateComputePipelines");
+  }
+
+  // One dispatch, as Engine::record_skinning records it, then the output made visible to the host
+  bool Gpu::run(uint32_t group_count_x) {
+    VkCommandBufferBeginInfo begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if (!check(vkBeginCommandBuffer(cmd, &begin_info), "vkBeginCommandBuffer"))
+      return false;
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &set, 0, nullptr);
+    vkCmdDispatch(cmd, group_count_x, INSTANCE_COUNT, 1);
+    VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0x0,
+        1, &barrier, 0, nullptr, 0, nullptr);
+    if (!check(vkEndCommandBuffer(cmd), "vkEndCommandBuffer"))
+      return false;
+
+    VkSubmitInfo submit_info = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &cmd;
+    if (!check(vkQueueSubmit(queue, 1, &submit_info, fence), "vkQueueSubmit"))
+      return false;
+    return check(vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX), "vkWaitForFences");
+  }
+
+  // Rotations about a random axis, non uniform scales (every third one mirroring) and translations
+  static void random_palette(uint64_t *seed, float *palette) {
+    for(uint32_t j = 0; j < JOINT_COUNT; ++j) {
+      float axis[3] = { unit_random(seed) - 0.5f, unit_random(seed) - 0.5f, unit_random(seed) - 0.5f };
+      float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]) + 1e-6f;
+      float angle = unit_random(seed) * 6.2831853f;
+      float c = cosf(angle);
+      float s = sinf(angle);
+      float x = axis[0] / length;
+      float y = axis[1] / length;
+      float z = axis[2] / length;
+      float rotation[9] = {
+        c + x * x * (1 - c), y * x * (1 - c) + z * s, z * x * (1 - c) - y * s,
+        x * y * (1 - c) - z * s, c + y * y * (1 - c), z * y * (1 - c) + x * s,
+        x * z * (1 - c) + y * s, y * z * (1 - c) - x * s, c + z * z * (1 - c),
+      };
+      float scale[3] = { 0.5f + unit_random(seed), 0.5f + unit_random(seed), 0.5f + unit_random(seed) };
+      if (j % 3 == 0)
+        scale[2] = -scale[2];
+      float *m = palette + j * 16;
+      for(uint32_t col = 0; col < 3; ++col) {
+        for(uint32_t row = 0; row < 3; ++row)
+          m[col * 4 + row] = rotation[col * 3 + row] * scale[col];
+        m[col * 4 + 3] = 0.0f;
+      }
+      m[12] = unit_random(seed) * 4.0f - 2.0f;
+      m[13] = unit_random(seed) * 4.0f - 2.0f;
+      m[14] = unit_random(seed) * 4.0f - 2.0f;
+      m[15] = 1.0f;
+    }
+  }
+
+  // Up to four joints, a few past the palette (which both sides skip), weights summing to 255
+  static void random_vertices(uint64_t *seed, QuantizedVertex *vertices) {
+    for(uint32_t i = 0; i < VERTEX_COUNT; ++i) {
+      QuantizedVertex *v = &vertices[i];
+      uint64_t r = next_random(seed);
+      v->position[0] = (uint16_t)r;
+      v->position[1] = (uint16_t)(r >> 16);
+      v->position[2] = (uint16_t)(r >> 32);
+      v->position[3] = (r >> 63) ? 65535 : 0;
+      float normal[3] = { unit_random(seed) - 0.5f, unit_random(seed) - 0.5f, unit_random(seed) - 0.5f };
+      float tangent[3] = { unit_random(seed) - 0.5f, unit_random(seed) - 0.5f, unit_random(seed) - 0.5f };
+      Quantize::octahedral(normal, v->normal);
+      Quantize::octahedral(tangent, v->tangent);
+      v->uv[0] = (uint16_t)next_random(seed);
+      v->uv[1] = (uint16_t)next_random(seed);
+      uint32_t left = 255;
+      for(uint32_t k = 0; k < 4; ++k) {
+        v->joints[k] = (uint8_t)(next_random(seed) % (JOINT_COUNT + 2));
+        uint32_t weight = k == 3 ? left : (uint32_t)(next_random(seed) % (left + 1));
+        v->weights[k] = (uint8_t)weight;
+        left -= weight;
+      }
+    }
+  }
+
+  // The two encodings may round a unit apart, so directions are compared decoded
+  static bool same_direction(const int16_t *a, const int16_t *b) {
+    float u[3], v[3];
+    Quantize::from_octahedral(a, u);
+    Quantize::from_octahedral(b, v);
+    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2] > 0.9995f || (!a[0] && !a[1] && !b[0] && !b[1]);
+  }
+  static uint32_t compare(const SkinnedVertex *expected, const SkinnedVertex *got, uint32_t count) {
+    uint32_t mismatches = 0;
+    for(uint32_t i = 0; i < count; ++i) {
+      const SkinnedVertex *e = &expected[i];
+      const SkinnedVertex *g = &got[i];
+      bool ok = e->position[3] == g->position[3] && same_direction(e->normal, g->normal) &&
+        same_direction(e->tangent, g->tangent) && e->uv[0] == g->uv[0] && e->uv[1] == g->uv[1];
+      for(uint32_t a = 0; a < 3; ++a)
+        ok = ok && fabsf(e->position[a] - g->position[a]) <= 1e-4f * (1.0f + fabsf(e->position[a]));
+      if (!ok && mismatches++ < 8)
+        print_err("SkinCheck: vertex {} is ({}, {}, {}) on the GPU, ({}, {}, {}) on the CPU\n", i,
+            g->position[0], g->position[1], g->position[2], e->position[0], e->position[1], e->position[2]);
+    }
+    return mismatches;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *spirv_file = argc > 1 ? argv[1] : "shaders/skin.comp.spv";
+
+  MemoryConfig mem_config;
+  MemoryService::instance()->init(&mem_config);
+  ThreadPool::instance()->init(0);
+
+  uint64_t seed = 0x9e3779b97f4a7c15;
+  Gpu gpu = {};
+  bool ok = gpu.init() &&
+    gpu.alloc_host_buffer(sizeof(QuantizedVertex) * VERTEX_COUNT, &gpu.buffers[0]) &&
+    gpu.alloc_host_buffer(sizeof(float) * 16 * JOINT_COUNT * INSTANCE_COUNT, &gpu.buffers[1]) &&
+    gpu.alloc_host_buffer(sizeof(SkinInstance) * INSTANCE_COUNT, &gpu.buffers[2]) &&
+    gpu.alloc_host_buffer(sizeof(SkinnedVertex) * VERTEX_COUNT * INSTANCE_COUNT, &gpu.buffers[3]) &&
+    gpu.init_pipeline(spirv_file);
+
+  uint32_t mismatches = 0;
+  if (ok) {
+    // Both instances skin the same bind pose, each with its own palette, to its own output range
+    QuantizedVertex *vertices = (QuantizedVertex*)gpu.buffers[0].data;
+    float *palettes = (float*)gpu.buffers[1].data;
+    SkinInstance *instances = (SkinInstance*)gpu.buffers[2].data;
+    random_vertices(&seed, vertices);
+    QuantizedBounds bounds = { { -1.0f, -2.0f, -0.5f }, { 2.0f, 3.0f, 1.0f } };
+    for(uint32_t i = 0; i < INSTANCE_COUNT; ++i) {
+      random_palette(&seed, palettes + i * 16 * JOINT_COUNT);
+      instances[i] = {};
+      instances[i].vertex_count = VERTEX_COUNT;
+      instances[i].output_offset = i * VERTEX_COUNT;
+      instances[i].palette_offset = i * JOINT_COUNT;
+      instances[i].joint_count = JOINT_COUNT;
+      memcpy(instances[i].position_offset, bounds.offset, sizeof(bounds.offset));
+      memcpy(instances[i].position_scale, bounds.scale, sizeof(bounds.scale));
+    }
+    memset(gpu.buffers[3].data, 0, sizeof(SkinnedVertex) * VERTEX_COUNT * INSTANCE_COUNT);
+
+    // 64 invocations a group, as skin.comp's local_size_x
+    ok = gpu.run((VERTEX_COUNT + 63) / 64);
+    if (ok) {
+      SkinnedVertex *expected = (SkinnedVertex*)mem_alloca(sizeof(SkinnedVertex) * VERTEX_COUNT, 16);
+      const SkinnedVertex *got = (const SkinnedVertex*)gpu.buffers[3].data;
+      for(uint32_t i = 0; i < INSTANCE_COUNT; ++i) {
+        Skinning::skin(palettes + i * 16 * JOINT_COUNT, JOINT_COUNT, vertices, &bounds, VERTEX_COUNT, expected);
+        mismatches += compare(expected, got + i * VERTEX_COUNT, VERTEX_COUNT);
+      }
+      mem_free(expected);
+      print("SkinCheck: {} vertices in {} instances, {} mismatched\n", VERTEX_COUNT, INSTANCE_COUNT, mismatches);
+    }
+  }
+  gpu.kill();
+
+  ThreadPool::instance()->kill();
+  MemoryService::instance()->shutdown();
+  return ok && !mismatches ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#include <cstring>
+
+#include "Allocator.hpp"
+#include "Format.hpp"
+#include "Pack.hpp"
+#include "Threads.hpp"
+
+using namespace Sol;
+
+/*
+ * Build an asset pack:
+ *
+ *    SlugPack <out.pack> [-c] <file>... [-c <file>...]
+ *
+ * Each file is stored under the path it was given as, which is the same path the engine asks for
+ * (e.g. 'shaders/triangle3.vert.spv'). Files after a '-c' are compressed (mesh data compresses well,
+ * already compressed images do not: they are stored raw either way).
+ */
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    print_err("usage: {} <out.pack> [-c] <file>...\n", argv[0]);
+    return 1;
+  }
+
+  MemoryConfig mem_config;
+  MemoryService::instance()->init(&mem_config);
+  ThreadPool::instance()->init(0);
+
+  PackWriter writer;
+  writer.init();
+  uint32_t flags = PackEntry::NONE;
+  int count = 0;
+  for(int i = 2; i < argc; ++i) {
+    if (strcmp(argv[i], "-c") == 0) {
+      flags = PackEntry::COMPRESSED;
+      continue;
+    }
+    writer.add(argv[i], argv[i], flags);
+    ++count;
+  }
+
+  bool ok = writer.write(argv[1]);
+  if (ok)
+    print("Wrote {} entries to '{}'\n", count, argv[1]);
+  writer.kill();
+
+  ThreadPool::instance()->kill();
+
+  MemoryService::instance()->shutdown();
+  return ok ? 0 : 1;
+}